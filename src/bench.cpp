@@ -0,0 +1,126 @@
+#include <QApplication>
+#include <QElapsedTimer>
+#include <QMainWindow>
+#include <QPushButton>
+#include <QLineEdit>
+#include <QVBoxLayout>
+#include <QDebug>
+#include <algorithm>
+#include "themes/theme.h"
+#include "views/chatview.h"
+
+// 性能基准：主题启动和切换耗时
+// 用法: bench_app [切换次数] [消息条数]
+
+namespace {
+
+double median(QList<double> values)
+{
+    if (values.isEmpty()) {
+        return 0.0;
+    }
+    std::sort(values.begin(), values.end());
+    return values.at(values.size() / 2);
+}
+
+// 构造一个与主窗口规模相近的界面，样式表的开销与控件数量有关，
+// 聊天区域中放入 messages 条消息，用来确认切换耗时与对话长度无关
+QMainWindow* createSampleWindow(int messages)
+{
+    QMainWindow* window = new QMainWindow();
+    QWidget* central = new QWidget(window);
+    QVBoxLayout* layout = new QVBoxLayout(central);
+
+    ChatView* chatDisplay = new ChatView();
+    chatDisplay->setObjectName("chatDisplay");
+    chatDisplay->document()->setDefaultStyleSheet(ThemeManager::instance().chatStyleSheet());
+    chatDisplay->setChatPalette(ThemeManager::instance().chatPalette());
+    QObject::connect(&ThemeManager::instance(), &ThemeManager::themeChanged, chatDisplay, [chatDisplay]() {
+        chatDisplay->setChatPalette(ThemeManager::instance().chatPalette());
+    });
+    for (int i = 0; i < messages; ++i) {
+        ChatView::MessageBlock message;
+        message.role = (i % 2 == 0) ? ChatView::BubbleRole::User : ChatView::BubbleRole::Assistant;
+        message.headerHtml = QString("<div class='sender-info'>消息 %1</div>").arg(i);
+        message.bodyHtml = QString("<p>第 %1 条消息的正文，包含<b>加粗</b>和<code>代码</code>。</p><p>第二段</p>").arg(i);
+        chatDisplay->appendMessage(message);
+    }
+    chatDisplay->closeMessage();
+    layout->addWidget(chatDisplay);
+
+    for (int i = 0; i < 20; ++i) {
+        QPushButton* button = new QPushButton(QString("按钮 %1").arg(i));
+        button->setObjectName(i == 0 ? "sendButton" : "compactButton");
+        layout->addWidget(button);
+    }
+
+    QLineEdit* input = new QLineEdit();
+    input->setObjectName("messageInput");
+    layout->addWidget(input);
+
+    window->setCentralWidget(central);
+    window->resize(800, 600);
+    return window;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QApplication app(argc, argv);
+    // 使用独立的设置，避免覆盖用户的主题选择
+    app.setOrganizationName("ChatDotBench");
+    app.setApplicationName("ChatDotBench");
+
+    int iterations = argc > 1 ? qMax(1, QString(argv[1]).toInt()) : 50;
+    int messages = argc > 2 ? qMax(0, QString(argv[2]).toInt()) : 2000;
+
+    // 启动：首次创建 ThemeManager 会读取资源并应用样式
+    QElapsedTimer timer;
+    timer.start();
+    ThemeManager& themes = ThemeManager::instance();
+    double startupMs = timer.nsecsElapsed() / 1e6;
+
+    QMainWindow* window = createSampleWindow(messages);
+    window->show();
+    QCoreApplication::processEvents();
+
+    // 切换：浅色和深色交替，每次都需要重新设置样式
+    QList<double> switchMs;
+    for (int i = 0; i < iterations; ++i) {
+        ThemeManager::Theme target = (i % 2 == 0) ? ThemeManager::Theme::Dark : ThemeManager::Theme::Light;
+        timer.restart();
+        themes.setTheme(target);
+        QCoreApplication::processEvents();
+        switchMs.append(timer.nsecsElapsed() / 1e6);
+    }
+
+    // 样式不变的切换：跟随系统与系统当前配色相同时应当几乎没有开销
+    QList<double> noopMs;
+    themes.setTheme(ThemeManager::Theme::System);
+    ThemeManager::Theme same = themes.isDarkMode() ? ThemeManager::Theme::Dark : ThemeManager::Theme::Light;
+    for (int i = 0; i < iterations; ++i) {
+        themes.setTheme(same);
+        timer.restart();
+        themes.setTheme(ThemeManager::Theme::System);
+        QCoreApplication::processEvents();
+        noopMs.append(timer.nsecsElapsed() / 1e6);
+    }
+
+    // 气泡颜色查询
+    timer.restart();
+    int alpha = 0;
+    const int lookups = 1000000;
+    for (int i = 0; i < lookups; ++i) {
+        alpha += themes.chatPalette().userBubble.alpha() + themes.chatPalette().aiBubble.alpha();
+    }
+    double lookupNs = double(timer.nsecsElapsed()) / lookups;
+
+    qInfo().noquote() << QString("theme startup:        %1 ms").arg(startupMs, 0, 'f', 2);
+    qInfo().noquote() << QString("theme switch median:  %1 ms (%2 runs, %3 messages)").arg(median(switchMs), 0, 'f', 2).arg(iterations).arg(messages);
+    qInfo().noquote() << QString("system switch median: %1 ms").arg(median(noopMs), 0, 'f', 3);
+    qInfo().noquote() << QString("bubble lookup:        %1 ns (%2)").arg(lookupNs, 0, 'f', 1).arg(alpha > 0 ? "ok" : "empty");
+
+    delete window;
+    return 0;
+}
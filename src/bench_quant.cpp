@@ -0,0 +1,132 @@
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QDebug>
+#include <algorithm>
+#include <cstring>
+#include <random>
+#include <vector>
+#include "utils/quantkernels.h"
+
+// 性能基准：量化矩阵乘向量，逐个指令集测量
+// 用法: bench_quant [次数]
+//
+// 每个指令集单线程运行一层 1.1B 模型（TinyLlama 的形状）的全部矩阵，报告权重读取
+// 带宽，并按 22 层加输出层估算每秒生成的 token 数。准备 4 份权重轮流使用，
+// 总量超过常见的末级缓存，结果接近真实推理时从内存读取权重的情况。
+
+namespace {
+
+const int kDim = 2048;
+const int kHidden = 5632;
+const int kKvDim = 256;
+const int kLayers = 22;
+const int kVocab = 32000;
+const int kCopies = 4;
+
+struct Shape {
+    int rows;
+    int cols;
+};
+
+// 一层中的 q、k、v、o、gate、up、down
+const Shape kLayerShapes[] = {
+    {kDim, kDim}, {kKvDim, kDim}, {kKvDim, kDim}, {kDim, kDim},
+    {kHidden, kDim}, {kHidden, kDim}, {kDim, kHidden}
+};
+
+struct Matrix {
+    Shape shape;
+    qint64 rowBytes;
+    std::vector<uchar> data;
+};
+
+// 随机量化值，缩放固定为 fp16 的 0.01
+Matrix createMatrix(quint32 type, Shape shape, std::mt19937& rng)
+{
+    Matrix matrix;
+    matrix.shape = shape;
+    const int blocks = shape.cols / QuantKernels::kBlockSize;
+    const qint64 blockBytes = QuantKernels::blockBytes(type);
+    matrix.rowBytes = blocks * blockBytes;
+    matrix.data.resize(size_t(matrix.rowBytes) * shape.rows);
+    for (uchar& byte : matrix.data) {
+        byte = uchar(rng());
+    }
+    const quint16 scale = 0x211f;
+    for (size_t offset = 0; offset < matrix.data.size(); offset += blockBytes) {
+        memcpy(matrix.data.data() + offset, &scale, sizeof(scale));
+    }
+    return matrix;
+}
+
+double median(QList<double> values)
+{
+    std::sort(values.begin(), values.end());
+    return values.at(values.size() / 2);
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    const int iterations = argc > 1 ? qMax(1, QString(argv[1]).toInt()) : 5;
+
+    std::mt19937 rng(42);
+    std::vector<float> input(kHidden);
+    std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+    for (float& value : input) {
+        value = distribution(rng);
+    }
+    std::vector<QuantKernels::ActivationBlock> activations(kHidden / QuantKernels::kBlockSize);
+    std::vector<float> output(kHidden);
+
+    for (quint32 type : {quint32(QuantKernels::Q4_0), quint32(QuantKernels::Q8_0)}) {
+        const char* typeName = type == QuantKernels::Q4_0 ? "Q4_0" : "Q8_0";
+
+        std::vector<Matrix> matrices;
+        qint64 layerBytes = 0;
+        for (int copy = 0; copy < kCopies; ++copy) {
+            for (const Shape& shape : kLayerShapes) {
+                matrices.push_back(createMatrix(type, shape, rng));
+                if (copy == 0) {
+                    layerBytes += matrices.back().data.size();
+                }
+            }
+        }
+        const qint64 outputBytes = qint64(kVocab) * (kDim / QuantKernels::kBlockSize) * QuantKernels::blockBytes(type);
+        const qint64 tokenBytes = layerBytes * kLayers + outputBytes;
+
+        qInfo().noquote() << QString("%1: 每层权重 %2 MB，每个 token %3 MB")
+            .arg(typeName)
+            .arg(layerBytes / 1048576.0, 0, 'f', 1)
+            .arg(tokenBytes / 1048576.0, 0, 'f', 1);
+
+        for (QuantKernels::Isa isa : QuantKernels::supportedIsas()) {
+            QuantKernels::setMaxIsa(isa);
+            QList<double> samples;
+            QElapsedTimer timer;
+            for (int i = 0; i < iterations; ++i) {
+                timer.restart();
+                for (const Matrix& matrix : matrices) {
+                    QuantKernels::quantize(input.data(), matrix.shape.cols, activations.data());
+                    QuantKernels::gemv(type, matrix.data.data(), matrix.rowBytes, matrix.shape.rows,
+                                       activations.data(), matrix.shape.cols, output.data());
+                }
+                samples.append(timer.nsecsElapsed() / 1e9 / kCopies);
+            }
+
+            const double layerSeconds = median(samples);
+            const double bandwidth = layerBytes / layerSeconds / 1e9;
+            const double tokensPerSecond = bandwidth * 1e9 / tokenBytes;
+            qInfo().noquote() << QString("  %1: %2 ms/层, %3 GB/s, 约 %4 token/s（单线程）")
+                .arg(QuantKernels::isaName(isa), -12)
+                .arg(layerSeconds * 1000.0, 0, 'f', 2)
+                .arg(bandwidth, 0, 'f', 2)
+                .arg(tokensPerSecond, 0, 'f', 2);
+        }
+        QuantKernels::setMaxIsa(QuantKernels::Isa::Avx512Vnni);
+    }
+
+    return 0;
+}
@@ -0,0 +1,121 @@
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QThreadPool>
+#include <QDebug>
+#include <algorithm>
+#include "services/gguffile.h"
+#include "services/llamatokenizer.h"
+
+// 性能基准：GGUF 模型自带的分词器
+// 用法: bench_tokenizer <模型.gguf> [文本文件] [次数]
+//
+// 先删除缓存目录中的词表文件测量首次生成的耗时，再测量直接映射的耗时；
+// 然后对文本单线程编码和按段落并行编码，报告 MB/s。没有给出文本文件时
+// 使用内置的中英文混合样本。
+
+namespace {
+
+const char kSample[] =
+    "The quick brown fox jumps over the lazy dog. It's 2024 and we've got 3.5 models, "
+    "they'll run locally on a laptop!\n\n"
+    "本地模型的分词器从模型文件中读取词表，第一次加载时生成紧凑的词表文件，之后直接内存映射。\n"
+    "    def tokenize(text):\n        return [vocab[piece] for piece in split(text)]\n\n"
+    "Numbers like 1234567 and symbols like <>{}[]()+-*/ are split into separate pieces.\n\n";
+
+double median(QList<double> values)
+{
+    std::sort(values.begin(), values.end());
+    return values.at(values.size() / 2);
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    if (argc < 2) {
+        qInfo().noquote() << "用法: bench_tokenizer <模型.gguf> [文本文件] [次数]";
+        return 1;
+    }
+    const QString modelPath = QString::fromLocal8Bit(argv[1]);
+    QString text;
+    int iterations = 5;
+    for (int i = 2; i < argc; ++i) {
+        bool isNumber = false;
+        const int value = QString(argv[i]).toInt(&isNumber);
+        if (isNumber) {
+            iterations = qMax(1, value);
+            continue;
+        }
+        QFile file(QString::fromLocal8Bit(argv[i]));
+        if (!file.open(QIODevice::ReadOnly)) {
+            qInfo().noquote() << QString("无法读取文本文件: %1").arg(file.errorString());
+            return 1;
+        }
+        text = QString::fromUtf8(file.readAll());
+    }
+    if (text.isEmpty()) {
+        // 重复样本到 4 MB 左右，计时不受单次调用开销影响
+        text = QString::fromUtf8(kSample).repeated(4 * 1024 * 1024 / int(sizeof(kSample)));
+    }
+    const double megabytes = text.toUtf8().size() / 1048576.0;
+
+    GgufFile file;
+    QString error;
+    if (!file.open(modelPath, &error)) {
+        qInfo().noquote() << QString("无法打开模型: %1").arg(error);
+        return 1;
+    }
+
+    // 首次加载：生成词表文件
+    QDir(LlamaTokenizer::vocabCacheDirectory()).removeRecursively();
+    QElapsedTimer timer;
+    timer.start();
+    {
+        LlamaTokenizer tokenizer;
+        if (!tokenizer.load(file, &error)) {
+            qInfo().noquote() << QString("无法加载分词器: %1").arg(error);
+            return 1;
+        }
+    }
+    const double buildMs = timer.nsecsElapsed() / 1e6;
+
+    // 之后的加载：直接映射
+    LlamaTokenizer tokenizer;
+    timer.restart();
+    tokenizer.load(file, &error);
+    const double openMs = timer.nsecsElapsed() / 1e6;
+    qInfo().noquote() << QString("词表 %1 个 token: 首次生成 %2 ms，映射 %3 ms")
+        .arg(tokenizer.vocabSize())
+        .arg(buildMs, 0, 'f', 1)
+        .arg(openMs, 0, 'f', 2);
+
+    QList<double> samples;
+    int tokenCount = 0;
+    for (int i = 0; i < iterations; ++i) {
+        timer.restart();
+        tokenCount = int(tokenizer.encode(text).size());
+        samples.append(timer.nsecsElapsed() / 1e9);
+    }
+    qInfo().noquote() << QString("单线程: %1 MB，%2 token，%3 MB/s")
+        .arg(megabytes, 0, 'f', 2)
+        .arg(tokenCount)
+        .arg(megabytes / median(samples), 0, 'f', 2);
+
+    // 按空行分成多段，相当于一次统计整段对话历史
+    const QStringList messages = text.split("\n\n", Qt::SkipEmptyParts);
+    samples.clear();
+    for (int i = 0; i < iterations; ++i) {
+        timer.restart();
+        tokenizer.encodeBatch(messages);
+        samples.append(timer.nsecsElapsed() / 1e9);
+    }
+    qInfo().noquote() << QString("并行（%1 段，%2 线程）: %3 MB/s")
+        .arg(messages.size())
+        .arg(QThreadPool::globalInstance()->maxThreadCount())
+        .arg(megabytes / median(samples), 0, 'f', 2);
+
+    return 0;
+}
@@ -1,5 +1,6 @@
 #include "views/mainwindow.h"
 #include "services/logger.h"
+#include "services/tracer.h"
 #include "models/settingsmodel.h"
 #include <QApplication>
 #include <QCommandLineParser>
@@ -8,33 +9,26 @@
 #include <QLibraryInfo>
 #include <QDebug>
 #include <QMessageBox>
-#include <QFile>
-#include <QTextStream>
-#include <QDateTime>
 #include <QCoreApplication>
 #include <QDir>
 #include <iostream>
 #include <windows.h>
 
+namespace {
+// 默认的窗口可见时间预算（毫秒），--startup-benchmark 据此判断是否通过
+const int kDefaultStartupBudgetMs = 800;
+}
+
 int main(int argc, char *argv[])
 {
-    // 设置控制台输出
-    QFile logFile("debug.log");
-    if (logFile.open(QIODevice::WriteOnly | QIODevice::Text)) {
-        QTextStream out(&logFile);
-        out << "程序开始执行: " << QDateTime::currentDateTime().toString() << "\n";
-    }
+    // 计时从这里开始
+    Tracer& tracer = Tracer::instance();
 
     try {
-        std::cout << "程序开始执行" << std::endl;
-        if (logFile.isOpen()) {
-            QTextStream(&logFile) << "准备创建 QApplication\n";
-        }
-
+        // 命令行解析之后才知道是否启用跟踪，这一段的区间事后补上
+        qint64 appStartUs = tracer.nowUs();
         QApplication app(argc, argv);
-        if (logFile.isOpen()) {
-            QTextStream(&logFile) << "QApplication 创建成功\n";
-        }
+        qint64 appEndUs = tracer.nowUs();
 
         // 设置应用程序信息
         app.setApplicationName("ChatDot");
@@ -42,72 +36,88 @@ int main(int argc, char *argv[])
         app.setOrganizationName("ChatDot");
         app.setOrganizationDomain("chatdot.org");
 
-        // 初始化日志系统
-        if (logFile.isOpen()) {
-            QTextStream(&logFile) << "准备初始化日志系统\n";
-        }
-        Logger::instance().init();
-        if (logFile.isOpen()) {
-            QTextStream(&logFile) << "日志系统初始化完成\n";
-        }
+        QCommandLineParser parser;
+        parser.addHelpOption();
+        parser.addVersionOption();
+        QCommandLineOption traceOption("trace", "把启动过程写入 Chrome trace 文件", "file");
+        QCommandLineOption benchmarkOption("startup-benchmark", "首帧显示后退出，超出时间预算时返回非零值");
+        QCommandLineOption budgetOption("startup-budget", "窗口可见时间预算（毫秒）", "ms",
+                                        QString::number(kDefaultStartupBudgetMs));
+        parser.addOption(traceOption);
+        parser.addOption(benchmarkOption);
+        parser.addOption(budgetOption);
+        parser.process(app);
 
-        // 加载设置
-        if (logFile.isOpen()) {
-            QTextStream(&logFile) << "准备加载设置\n";
+        const bool benchmark = parser.isSet(benchmarkOption);
+        QString tracePath = parser.value(traceOption);
+        if (benchmark && tracePath.isEmpty()) {
+            tracePath = QDir::current().absoluteFilePath("startup-trace.json");
         }
-        SettingsModel::instance().loadSettings();
-        if (logFile.isOpen()) {
-            QTextStream(&logFile) << "设置加载完成\n";
+        if (!tracePath.isEmpty()) {
+            tracer.start();
         }
+        tracer.addSpan("QApplication", "app", appStartUs, appEndUs - appStartUs);
 
-        // 刷新模型列表
-        if (logFile.isOpen()) {
-            QTextStream(&logFile) << "准备刷新模型列表\n";
-        }
-        SettingsModel::instance().refreshOllamaModels();
-        if (logFile.isOpen()) {
-            QTextStream(&logFile) << "模型列表刷新完成\n";
+        // 初始化日志系统
+        {
+            TRACE_SCOPE("Logger::init");
+            Logger::instance().init();
         }
 
-        // 创建并显示主窗口
-        if (logFile.isOpen()) {
-            QTextStream(&logFile) << "准备创建主窗口\n";
-            QTextStream(&logFile) << "Qt版本: " << QT_VERSION_STR << "\n";
-            QTextStream(&logFile) << "应用程序路径: " << QCoreApplication::applicationDirPath() << "\n";
-            QTextStream(&logFile) << "当前工作目录: " << QDir::currentPath() << "\n";
+        // 加载设置，构造时只加载一次
+        {
+            TRACE_SCOPE("SettingsModel");
+            SettingsModel::instance();
         }
 
+        // 首帧只需要界面和上次的对话，Ollama 发现、模型列表和服务创建
+        // 由主窗口在首帧显示后启动
         try {
-            MainWindow w;
-            if (logFile.isOpen()) {
-                QTextStream(&logFile) << "主窗口创建成功\n";
+            QScopedPointer<MainWindow> w;
+            {
+                TRACE_SCOPE("MainWindow");
+                w.reset(new MainWindow);
             }
-            w.show();
-            if (logFile.isOpen()) {
-                QTextStream(&logFile) << "主窗口显示成功\n";
+            {
+                TRACE_SCOPE("MainWindow::show");
+                w->show();
             }
-            return app.exec();
+
+            QObject::connect(w.data(), &MainWindow::firstFrameShown, &app, [&]() {
+                qint64 visibleMs = tracer.nowUs() / 1000;
+                TRACE_INSTANT("首帧");
+                LOG_INFO(QString("窗口可见耗时: %1 ms").arg(visibleMs));
+
+                if (benchmark) {
+                    int budgetMs = parser.value(budgetOption).toInt();
+                    bool passed = visibleMs <= budgetMs;
+                    std::cout << "startup: " << visibleMs << " ms, budget: " << budgetMs << " ms, "
+                              << (passed ? "PASS" : "FAIL") << std::endl;
+                    tracer.writeTo(tracePath);
+                    app.exit(passed ? 0 : 2);
+                }
+            });
+
+            int result = app.exec();
+            if (!benchmark && !tracePath.isEmpty()) {
+                tracer.writeTo(tracePath);
+            }
+            return result;
         } catch (const std::exception& e) {
             QString errorMsg = QString("创建主窗口时发生异常: %1").arg(e.what());
-            if (logFile.isOpen()) {
-                QTextStream(&logFile) << errorMsg << "\n";
-            }
+            LOG_ERROR(errorMsg);
             QMessageBox::critical(nullptr, "错误", errorMsg);
             return 1;
         }
     } catch (const std::exception& e) {
         QString errorMsg = QString("程序发生异常: %1").arg(e.what());
-        if (logFile.isOpen()) {
-            QTextStream(&logFile) << errorMsg << "\n";
-        }
-        QMessageBox::critical(nullptr, "错误", errorMsg);
+        LOG_ERROR(errorMsg);
+        std::cerr << errorMsg.toStdString() << std::endl;
         return 1;
     } catch (...) {
         QString errorMsg = "程序发生未知异常";
-        if (logFile.isOpen()) {
-            QTextStream(&logFile) << errorMsg << "\n";
-        }
-        QMessageBox::critical(nullptr, "错误", errorMsg);
+        LOG_ERROR(errorMsg);
+        std::cerr << errorMsg.toStdString() << std::endl;
         return 1;
     }
 }
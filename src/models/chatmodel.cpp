@@ -1,23 +1,104 @@
 #include "chatmodel.h"
+#include "models/messagepagecache.h"
 
 ChatModel::ChatModel(QObject *parent)
     : QObject(parent)
+    , m_history(new MessagePageCache(this))
 {
+    connect(m_history, &MessagePageCache::pageReady, this, &ChatModel::historyPageReady);
 }
 
-void ChatModel::addMessage(const QString& role, const QString& content)
+ChatModel::Message ChatModel::messageAt(int index) const
+{
+    if (isLoaded(index)) {
+        return m_messages.at(index - m_firstIndex);
+    }
+    return m_history->message(index);
+}
+
+int ChatModel::historyPageOf(int index)
+{
+    return MessagePageCache::pageOf(index);
+}
+
+int ChatModel::historyPageFirst(int page) const
+{
+    return page * MessagePageCache::kPageSize;
+}
+
+void ChatModel::fetchHistoryPage(int page)
+{
+    m_history->requestPage(page);
+}
+
+void ChatModel::addMessage(const QString& role, const QString& content, const QStringList& attachments)
 {
     Message msg;
     msg.role = role;
     msg.content = content;
+    msg.attachments = attachments;
     msg.timestamp = QDateTime::currentDateTime();
-    
+
     m_messages.append(msg);
+    emit messageAdded(messageCount() - 1);
+    emit messagesChanged();
+}
+
+int ChatModel::beginMessage(const QString& role, const QString& model)
+{
+    Message msg;
+    msg.role = role;
+    msg.model = model;
+    msg.timestamp = QDateTime::currentDateTime();
+    msg.complete = false;
+
+    m_messages.append(msg);
+    int index = messageCount() - 1;
+    emit messageAdded(index);
+    emit messagesChanged();
+    return index;
+}
+
+void ChatModel::appendToMessage(int index, const QString& delta)
+{
+    if (!isLoaded(index) || delta.isEmpty()) {
+        return;
+    }
+
+    m_messages[index - m_firstIndex].content += delta;
+    emit messageAppended(index, delta);
+}
+
+void ChatModel::finishMessage(int index, const QJsonObject& metrics)
+{
+    if (!isLoaded(index)) {
+        return;
+    }
+
+    Message& msg = m_messages[index - m_firstIndex];
+    if (!msg.complete) {
+        msg.complete = true;
+        msg.metrics = metrics;
+        emit messageFinished(index);
+        emit messagesChanged();
+    }
+}
+
+void ChatModel::loadHistory(const QList<Message>& messages, int firstIndex,
+                            const HistoryLoader& loader)
+{
+    m_messages = messages;
+    m_firstIndex = qMax(0, firstIndex);
+    m_history->reset(loader, m_firstIndex);
+    emit messagesReset();
     emit messagesChanged();
 }
 
 void ChatModel::clearMessages()
 {
     m_messages.clear();
+    m_firstIndex = 0;
+    m_history->reset(HistoryLoader(), 0);
+    emit messagesReset();
     emit messagesChanged();
-} 
\ No newline at end of file
+}
@@ -3,7 +3,12 @@
 
 #include <QObject>
 #include <QList>
+#include <QStringList>
 #include <QDateTime>
+#include <QJsonObject>
+#include <functional>
+
+class MessagePageCache;
 
 class ChatModel : public QObject
 {
@@ -17,19 +22,57 @@ public:
         QString role;
         QString content;
         QDateTime timestamp;
+        QString model;          // 生成该消息的模型，用户消息为空
+        bool complete = true;   // 流式输出未结束时为 false
+        QJsonObject metrics;    // 生成耗时等统计信息
+        QStringList attachments;  // 随消息发送的图片在附件存储中的哈希
     };
 
+    // 按序号读取一段历史消息，会在后台线程中调用
+    using HistoryLoader = std::function<QList<Message>(int first, int count)>;
+
+    // 只包含常驻内存的最近消息，较早的消息由分页缓存按需提供
     QList<Message> messages() const { return m_messages; }
 
+    // 消息序号在整个对话中全局有效
+    int messageCount() const { return m_firstIndex + m_messages.size(); }
+    int firstLoadedIndex() const { return m_firstIndex; }
+    bool isLoaded(int index) const { return index >= m_firstIndex && index < messageCount(); }
+    Message messageAt(int index) const;
+
+    // 较早的历史按页加载，historyPageReady 发出后该页可以无阻塞地读取
+    static int historyPageOf(int index);
+    int historyPageFirst(int page) const;
+    void fetchHistoryPage(int page);
+    MessagePageCache* historyCache() const { return m_history; }
+
+    // 流式消息：先创建空消息，再逐段追加内容
+    int beginMessage(const QString& role, const QString& model = QString());
+    void appendToMessage(int index, const QString& delta);
+    void finishMessage(int index, const QJsonObject& metrics = QJsonObject());
+
+    // 载入历史对话的最近一段，firstIndex 为第一条消息在对话中的序号，
+    // 更早的消息通过 loader 分页读取
+    void loadHistory(const QList<Message>& messages, int firstIndex,
+                     const HistoryLoader& loader = HistoryLoader());
+
 public slots:
-    void addMessage(const QString& role, const QString& content);
+    void addMessage(const QString& role, const QString& content,
+                    const QStringList& attachments = QStringList());
     void clearMessages();
 
 signals:
     void messagesChanged();
+    void messageAdded(int index);
+    void messageAppended(int index, const QString& delta);
+    void messageFinished(int index);
+    void messagesReset();
+    void historyPageReady(int page);
 
 private:
     QList<Message> m_messages;
+    int m_firstIndex = 0;
+    MessagePageCache* m_history;
 };
 
-#endif // CHATMODEL_H 
\ No newline at end of file
+#endif // CHATMODEL_H
@@ -1,6 +1,6 @@
 #include "imagemodel.h"
 #include <QDebug>
-#include <QFile>
+#include "services/logger.h"
 
 ImageModel::ImageModel(QObject *parent)
     : QObject(parent)
@@ -25,24 +25,21 @@ void ImageModel::processImage(const QImage& image)
     });
 }
 
-void ImageModel::uploadImage(const QString& filePath)
+void ImageModel::uploadImage(const ImagePipeline::ImageHandle& image)
 {
-    QFile file(filePath);
-    if (file.open(QIODevice::ReadOnly)) {
-        QByteArray imageData = file.readAll();
-        qDebug() << "Image file uploaded:" << filePath << ", size:" << imageData.size();
-        // TODO: Handle the uploaded image data
-        // This might involve loading it into a QImage and then processing
-
-        QImage image;
-        if (image.loadFromData(imageData)) {
-            processImage(image);
-        } else {
-            emit errorOccurred("无法加载图片文件");
-        }
-
-        file.close();
-    } else {
-        emit errorOccurred(QString("无法打开图片文件：%1").arg(filePath));
+    if (!image) {
+        emit errorOccurred("无法加载图片文件");
+        return;
     }
-} 
\ No newline at end of file
+
+    LOG_DEBUG(QString("已添加待发送图片: %1，%2 字节").arg(image->sourcePath).arg(image->data.size()));
+    m_pendingImages.append(image);
+}
+
+QList<ImagePipeline::ImageHandle> ImageModel::takePendingImages()
+{
+    QList<ImagePipeline::ImageHandle> images;
+    images.swap(m_pendingImages);
+    return images;
+}
+
@@ -5,6 +5,7 @@
 #include <QImage>
 #include <QString>
 #include <QTimer>
+#include "services/imagepipeline.h"
 
 class ImageModel : public QObject
 {
@@ -15,14 +16,17 @@ public:
     ~ImageModel();
 
     Q_INVOKABLE void processImage(const QImage& image);
-    Q_INVOKABLE void uploadImage(const QString& filePath);
+    // 使用流水线已经解码的图片，不再重新读取文件。图片随下一条消息发送给模型
+    void uploadImage(const ImagePipeline::ImageHandle& image);
+    QList<ImagePipeline::ImageHandle> takePendingImages();
+    int pendingImageCount() const { return m_pendingImages.size(); }
 
 signals:
     void imageProcessed(const QString& result);
     void errorOccurred(const QString& error);
 
 private:
-    // TODO: Add image processing related members (e.g., image data, processing engine)
+    QList<ImagePipeline::ImageHandle> m_pendingImages;
 };
 
 #endif // IMAGEMODEL_H 
\ No newline at end of file
@@ -0,0 +1,133 @@
+#include "messagepagecache.h"
+#include <QFutureWatcher>
+#include <QtConcurrent/QtConcurrent>
+
+namespace {
+// 估算一条消息占用的内存
+qint64 messageBytes(const ChatModel::Message& message)
+{
+    return sizeof(ChatModel::Message)
+        + (message.role.size() + message.content.size() + message.model.size()) * sizeof(QChar);
+}
+}
+
+MessagePageCache::MessagePageCache(QObject *parent)
+    : QObject(parent)
+{
+}
+
+void MessagePageCache::reset(const ChatModel::HistoryLoader& loader, int limit)
+{
+    // 旧数据源上仍在进行的加载结果会被丢弃
+    ++m_generation;
+    m_loader = loader;
+    m_limit = qMax(0, limit);
+    m_pages.clear();
+    m_loading.clear();
+    m_bytes = 0;
+    m_hits = 0;
+    m_misses = 0;
+}
+
+void MessagePageCache::setBudget(qint64 bytes)
+{
+    m_budget = qMax<qint64>(0, bytes);
+    evict(-1);
+}
+
+int MessagePageCache::pageLength(int page) const
+{
+    return qBound(0, m_limit - pageFirst(page), kPageSize);
+}
+
+ChatModel::Message MessagePageCache::message(int index)
+{
+    if (index < 0 || index >= m_limit) {
+        return ChatModel::Message();
+    }
+
+    int page = pageOf(index);
+    auto it = m_pages.find(page);
+    if (it == m_pages.end()) {
+        ++m_misses;
+        if (!m_loader) {
+            return ChatModel::Message();
+        }
+        insertPage(page, m_loader(pageFirst(page), pageLength(page)));
+        it = m_pages.find(page);
+        if (it == m_pages.end()) {
+            return ChatModel::Message();
+        }
+    } else {
+        ++m_hits;
+    }
+
+    it->lastUse = ++m_clock;
+    int offset = index - pageFirst(page);
+    return offset < it->messages.size() ? it->messages.at(offset) : ChatModel::Message();
+}
+
+void MessagePageCache::requestPage(int page)
+{
+    if (page < 0 || pageLength(page) == 0) {
+        return;
+    }
+    if (m_pages.contains(page)) {
+        m_pages[page].lastUse = ++m_clock;
+        emit pageReady(page);
+        return;
+    }
+    if (m_loading.contains(page) || !m_loader) {
+        return;
+    }
+
+    m_loading.insert(page);
+    int generation = m_generation;
+    auto* watcher = new QFutureWatcher<QList<ChatModel::Message>>(this);
+    connect(watcher, &QFutureWatcher<QList<ChatModel::Message>>::finished, this,
+            [this, watcher, page, generation]() {
+                watcher->deleteLater();
+                if (generation != m_generation) {
+                    return;
+                }
+                m_loading.remove(page);
+                insertPage(page, watcher->result());
+                emit pageReady(page);
+            });
+    watcher->setFuture(QtConcurrent::run(m_loader, pageFirst(page), pageLength(page)));
+}
+
+void MessagePageCache::insertPage(int page, const QList<ChatModel::Message>& messages)
+{
+    Page entry;
+    entry.messages = messages;
+    entry.lastUse = ++m_clock;
+    for (const ChatModel::Message& message : messages) {
+        entry.bytes += messageBytes(message);
+    }
+
+    auto it = m_pages.find(page);
+    if (it != m_pages.end()) {
+        m_bytes -= it->bytes;
+    }
+    m_bytes += entry.bytes;
+    m_pages.insert(page, entry);
+    evict(page);
+}
+
+void MessagePageCache::evict(int keepPage)
+{
+    while (m_bytes > m_budget && m_pages.size() > (m_pages.contains(keepPage) ? 1 : 0)) {
+        auto oldest = m_pages.end();
+        for (auto it = m_pages.begin(); it != m_pages.end(); ++it) {
+            if (it.key() != keepPage && (oldest == m_pages.end() || it->lastUse < oldest->lastUse)) {
+                oldest = it;
+            }
+        }
+        if (oldest == m_pages.end()) {
+            break;
+        }
+        m_bytes -= oldest->bytes;
+        m_pages.erase(oldest);
+    }
+}
@@ -0,0 +1,73 @@
+#ifndef MESSAGEPAGECACHE_H
+#define MESSAGEPAGECACHE_H
+
+#include <QObject>
+#include <QHash>
+#include <QSet>
+#include "models/chatmodel.h"
+
+/**
+ * @brief 历史消息分页缓存
+ *
+ * 按固定大小的页缓存较早的消息。页在后台线程中通过加载函数读取，
+ * 总大小超过内存预算时按最近最少使用的顺序释放。
+ */
+class MessagePageCache : public QObject
+{
+    Q_OBJECT
+
+public:
+    static constexpr int kPageSize = 64;
+    static constexpr qint64 kDefaultBudget = 8 * 1024 * 1024;
+
+    explicit MessagePageCache(QObject *parent = nullptr);
+
+    static int pageOf(int index) { return index / kPageSize; }
+
+    // 切换数据源，limit 之前的消息由缓存提供
+    void reset(const ChatModel::HistoryLoader& loader, int limit);
+    int limit() const { return m_limit; }
+
+    void setBudget(qint64 bytes);
+    qint64 budget() const { return m_budget; }
+    qint64 memoryUsage() const { return m_bytes; }
+    int pageCount() const { return m_pages.size(); }
+    int hits() const { return m_hits; }
+    int misses() const { return m_misses; }
+
+    bool containsPage(int page) const { return m_pages.contains(page); }
+
+    // 缓存未命中时同步读取所在的页
+    ChatModel::Message message(int index);
+
+    // 在后台加载指定页，完成后发出 pageReady
+    void requestPage(int page);
+
+signals:
+    void pageReady(int page);
+
+private:
+    struct Page {
+        QList<ChatModel::Message> messages;
+        qint64 bytes = 0;
+        quint64 lastUse = 0;
+    };
+
+    void insertPage(int page, const QList<ChatModel::Message>& messages);
+    void evict(int keepPage);
+    int pageFirst(int page) const { return page * kPageSize; }
+    int pageLength(int page) const;
+
+    ChatModel::HistoryLoader m_loader;
+    int m_limit = 0;
+    int m_generation = 0;
+    QHash<int, Page> m_pages;
+    QSet<int> m_loading;
+    quint64 m_clock = 0;
+    qint64 m_bytes = 0;
+    qint64 m_budget = kDefaultBudget;
+    int m_hits = 0;
+    int m_misses = 0;
+};
+
+#endif // MESSAGEPAGECACHE_H
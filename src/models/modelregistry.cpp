@@ -0,0 +1,219 @@
+#include "modelregistry.h"
+#include <QFile>
+#include <algorithm>
+
+void ModelRegistry::rebuild(const QJsonObject& modelsConfig)
+{
+    m_providers.clear();
+    m_apiModels.clear();
+    m_providersByModel.clear();
+    m_models.clear();
+    m_modelOrder.clear();
+
+    const QJsonObject apiConfig = modelsConfig["api"].toObject();
+    for (auto it = apiConfig.begin(); it != apiConfig.end(); ++it) {
+        if (it.key() != "has_API" && it.key() != "default_url" && it.value().isObject()) {
+            setProvider(it.key(), it.value().toObject());
+        }
+    }
+
+    setModels("ollama", modelsConfig["ollama"].toObject()["models"].toObject());
+    setModels("local", modelsConfig["local"].toObject()["models"].toObject());
+}
+
+void ModelRegistry::setProvider(const QString& name, const QJsonObject& config)
+{
+    QStringList affected;
+    if (const Provider* old = provider(name)) {
+        affected = old->models;
+    }
+    removeProvider(name);
+    if (config.isEmpty()) {
+        refreshApiModels(affected);
+        return;
+    }
+
+    Provider& entry = m_providers[name];
+    entry.name = name;
+    entry.config = config;
+    entry.missingItems = missingProviderItems(config);
+
+    const QJsonObject models = config["models"].toObject();
+    const QString defaultUrl = config["default_url"].toString();
+    for (auto it = models.begin(); it != models.end(); ++it) {
+        Model model;
+        model.type = "api";
+        model.name = it.key();
+        model.provider = name;
+        model.config = it.value().toObject();
+        model.config["provider"] = name;
+        if (model.config["url"].toString().isEmpty()) {
+            model.config["url"] = defaultUrl;
+        }
+
+        entry.models.append(model.name);
+        QStringList& owners = m_providersByModel[model.name];
+        owners.insert(std::lower_bound(owners.begin(), owners.end(), name), name);
+        m_apiModels.insert(apiKey(name, model.name), model);
+    }
+
+    affected.append(entry.models);
+    refreshApiModels(affected);
+}
+
+void ModelRegistry::refreshApiModels(const QStringList& names)
+{
+    // 模型的完整性取决于同名模型的第一个提供商，其他提供商中的同名模型也要重新计算
+    for (const QString& modelName : names) {
+        const QStringList owners = m_providersByModel.value(modelName);
+        if (owners.isEmpty()) {
+            continue;
+        }
+        const Provider* first = provider(owners.first());
+        for (const QString& owner : owners) {
+            Model& model = m_apiModels[apiKey(owner, modelName)];
+            model.missingItems = missingModelItems("api", model.config, first);
+        }
+    }
+}
+
+void ModelRegistry::removeProvider(const QString& name)
+{
+    auto it = m_providers.find(name);
+    if (it == m_providers.end()) {
+        return;
+    }
+
+    for (const QString& modelName : std::as_const(it->models)) {
+        m_apiModels.remove(apiKey(name, modelName));
+        auto owners = m_providersByModel.find(modelName);
+        if (owners != m_providersByModel.end()) {
+            owners->removeOne(name);
+            if (owners->isEmpty()) {
+                m_providersByModel.erase(owners);
+            }
+        }
+    }
+    m_providers.erase(it);
+}
+
+void ModelRegistry::setModels(const QString& type, const QJsonObject& models)
+{
+    QHash<QString, Model>& entries = m_models[type];
+    QStringList& order = m_modelOrder[type];
+    entries.clear();
+    order.clear();
+    entries.reserve(models.size());
+
+    for (auto it = models.begin(); it != models.end(); ++it) {
+        Model model;
+        model.type = type;
+        model.name = it.key();
+        model.config = it.value().toObject();
+        model.missingItems = missingModelItems(type, model.config, nullptr);
+        order.append(model.name);
+        entries.insert(model.name, model);
+    }
+}
+
+const ModelRegistry::Model* ModelRegistry::model(const QString& type, const QString& name) const
+{
+    if (type == "api") {
+        QString provider = providerForModel(name);
+        return provider.isEmpty() ? nullptr : apiModel(provider, name);
+    }
+
+    auto entries = m_models.constFind(type);
+    if (entries == m_models.constEnd()) {
+        return nullptr;
+    }
+    auto it = entries->constFind(name);
+    return it == entries->constEnd() ? nullptr : &it.value();
+}
+
+const ModelRegistry::Model* ModelRegistry::apiModel(const QString& provider, const QString& name) const
+{
+    auto it = m_apiModels.constFind(apiKey(provider, name));
+    return it == m_apiModels.constEnd() ? nullptr : &it.value();
+}
+
+const ModelRegistry::Provider* ModelRegistry::provider(const QString& name) const
+{
+    auto it = m_providers.constFind(name);
+    return it == m_providers.constEnd() ? nullptr : &it.value();
+}
+
+QString ModelRegistry::providerForModel(const QString& name) const
+{
+    auto it = m_providersByModel.constFind(name);
+    return it == m_providersByModel.constEnd() || it->isEmpty() ? QString() : it->first();
+}
+
+QStringList ModelRegistry::models(const QString& type) const
+{
+    if (type != "api") {
+        return m_modelOrder.value(type);
+    }
+
+    QStringList result;
+    for (const Provider& provider : m_providers) {
+        result.append(provider.models);
+    }
+    return result;
+}
+
+QStringList ModelRegistry::missingProviderItems(const QJsonObject& config)
+{
+    QStringList missingItems;
+    if (config["api_key"].toString().isEmpty()) {
+        missingItems << "api_key";
+    }
+    if (config["default_url"].toString().isEmpty()) {
+        missingItems << "default_url";
+    }
+    if (!config["models"].isObject()) {
+        missingItems << "models";
+    }
+    return missingItems;
+}
+
+QStringList ModelRegistry::missingModelItems(const QString& type, const QJsonObject& config, const Provider* provider)
+{
+    QStringList missingItems;
+    if (!config["enabled"].toBool(true)) {
+        missingItems << "enabled";
+    }
+
+    if (type == "api") {
+        if (config["name"].toString().isEmpty()) {
+            missingItems << "name";
+        }
+        if (config["url"].toString().isEmpty()) {
+            missingItems << "url";
+        }
+        if (!provider) {
+            missingItems << "provider";
+        } else {
+            missingItems << provider->missingItems;
+        }
+    } else if (type == "local") {
+        if (config["name"].toString().isEmpty()) {
+            missingItems << "name";
+        }
+        QString path = config["path"].toString();
+        if (path.isEmpty()) {
+            missingItems << "path";
+        }
+    }
+    // Ollama 模型只需要名称即可
+    return missingItems;
+}
+
+QStringList ModelRegistry::Model::currentMissingItems() const
+{
+    QStringList items = missingItems;
+    if (type == "local" && !QFile::exists(config["path"].toString())) {
+        items << "path (文件不存在)";
+    }
+    return items;
+}
@@ -0,0 +1,73 @@
+#ifndef MODELREGISTRY_H
+#define MODELREGISTRY_H
+
+#include <QString>
+#include <QStringList>
+#include <QHash>
+#include <QMap>
+#include <QJsonObject>
+
+/**
+ * @brief 模型配置索引
+ *
+ * 由 SettingsModel 的 models_config 生成，按模型名称和提供商建立哈希索引，
+ * 并预先算好每个模型的配置是否完整。配置变化时只重建受影响的提供商或类型，
+ * JSON 只用于保存。类型字符串与 SettingsModel 一致："api"、"ollama"、"local"。
+ */
+class ModelRegistry
+{
+public:
+    struct Provider {
+        QString name;
+        QJsonObject config;
+        QStringList models;        // 与配置中的顺序一致
+        QStringList missingItems;
+        bool isComplete() const { return missingItems.isEmpty(); }
+    };
+
+    struct Model {
+        QString type;
+        QString name;
+        QString provider;          // 只有 API 模型有提供商
+        QJsonObject config;        // API 模型已补上 provider，url 为空时使用提供商的 default_url
+        QStringList missingItems;  // 配置中缺少的项，重建时算好
+        bool enabled() const { return config["enabled"].toBool(true); }
+        // missingItems 加上本地模型文件当前是否存在，文件随时可能被删除或下载完成，每次查询时检查
+        QStringList currentMissingItems() const;
+        bool isComplete() const { return currentMissingItems().isEmpty(); }
+    };
+
+    // 从完整的 models_config 重建
+    void rebuild(const QJsonObject& modelsConfig);
+    // 只重建一个 API 提供商及其模型，config 为空时移除该提供商
+    void setProvider(const QString& provider, const QJsonObject& config);
+    // 只重建 Ollama 或本地模型中的一类
+    void setModels(const QString& type, const QJsonObject& models);
+
+    const Model* model(const QString& type, const QString& name) const;
+    // 指定提供商下的 API 模型
+    const Model* apiModel(const QString& provider, const QString& name) const;
+    const Provider* provider(const QString& name) const;
+    // 同名模型出现在多个提供商中时，返回按名称排序的第一个
+    QString providerForModel(const QString& name) const;
+    QStringList providers() const { return m_providers.keys(); }
+    // API 模型按提供商排列，可能有重名
+    QStringList models(const QString& type) const;
+
+    static QStringList missingProviderItems(const QJsonObject& config);
+
+private:
+    static QString apiKey(const QString& provider, const QString& name) { return provider + QChar(0) + name; }
+    static QStringList missingModelItems(const QString& type, const QJsonObject& config, const Provider* provider);
+
+    void removeProvider(const QString& name);
+    void refreshApiModels(const QStringList& names);
+
+    QMap<QString, Provider> m_providers;            // 按名称排序，与 JSON 的遍历顺序一致
+    QHash<QString, Model> m_apiModels;              // 提供商 + 模型名
+    QHash<QString, QStringList> m_providersByModel; // 模型名 -> 提供商，已排序
+    QHash<QString, QHash<QString, Model>> m_models; // Ollama 和本地模型
+    QHash<QString, QStringList> m_modelOrder;
+};
+
+#endif // MODELREGISTRY_H
@@ -7,7 +7,52 @@
 #include <QProcess>
 #include <QSettings>
 #include <QTimer>
+#include <QDateTime>
 #include "services/logger.h"
+#include "services/settingswriter.h"
+#include "services/tracer.h"
+
+namespace {
+// 快照是未加密的缓存文件，API Key 只保存在 settings.json 中。
+// 返回去掉各提供商 api_key 的模型配置，hadKeys 表示原来是否带有 API Key
+QJsonObject withoutApiKeys(QJsonObject modelsConfig, bool* hadKeys = nullptr)
+{
+    QJsonObject api = modelsConfig["api"].toObject();
+    for (auto it = api.begin(); it != api.end(); ++it) {
+        QJsonObject provider = it.value().toObject();
+        if (provider.contains("api_key")) {
+            if (hadKeys) {
+                *hadKeys = true;
+            }
+            provider.remove("api_key");
+            it.value() = provider;
+        }
+    }
+    if (modelsConfig.contains("api")) {
+        modelsConfig["api"] = api;
+    }
+    return modelsConfig;
+}
+
+// 把 source 中各提供商的 api_key 补回 modelsConfig
+QJsonObject withApiKeys(QJsonObject modelsConfig, const QJsonObject& source)
+{
+    const QJsonObject sourceApi = source["api"].toObject();
+    QJsonObject api = modelsConfig["api"].toObject();
+    for (auto it = api.begin(); it != api.end(); ++it) {
+        const QJsonObject sourceProvider = sourceApi[it.key()].toObject();
+        if (sourceProvider.contains("api_key")) {
+            QJsonObject provider = it.value().toObject();
+            provider["api_key"] = sourceProvider["api_key"];
+            it.value() = provider;
+        }
+    }
+    if (modelsConfig.contains("api")) {
+        modelsConfig["api"] = api;
+    }
+    return modelsConfig;
+}
+}
 
 // 单例实现
 SettingsModel& SettingsModel::instance()
@@ -35,17 +80,19 @@ SettingsModel::SettingsModel(QObject *parent)
     m_saveTimer->setSingleShot(true);
     m_saveTimer->setInterval(1000); // 1秒延迟
     connect(m_saveTimer, &QTimer::timeout, this, &SettingsModel::saveSettings);
+
+    // 序列化和写文件都在后台进行
+    m_writer = new SettingsWriter(getSettingsPath(), this);
+    connect(m_writer, &SettingsWriter::written, this, &SettingsModel::settingsSaved);
     
     loadSettings();
 }
 
 SettingsModel::~SettingsModel()
 {
-    // 确保在析构时保存设置
-    if (m_saveTimer->isActive()) {
-        m_saveTimer->stop();
-        saveSettings();
-    }
+    // 确保在析构时保存设置并等待写入完成
+    saveSettings();
+    m_writer->waitForDone();
 }
 
 QString SettingsModel::getSettingsPath() const
@@ -126,6 +173,7 @@ void SettingsModel::initializeDefaultModels()
     models["local"] = localConfig;
 
     m_models_config = models;
+    m_registry.rebuild(m_models_config);
     
     // 初始化已配置的模型列表
     updateConfiguredModels();
@@ -161,6 +209,7 @@ void SettingsModel::migrateConfig()
             }
             
             m_models_config["api"] = newApiConfig;
+            m_registry.rebuild(m_models_config);
             LOG_INFO("API 配置迁移完成");
         }
     }
@@ -169,6 +218,7 @@ void SettingsModel::migrateConfig()
     updateConfiguredModels();
     
     // 保存迁移后的配置
+    m_dirtySections |= ModelsSection;
     saveSettings();
     LOG_INFO("配置迁移完成");
 }
@@ -211,36 +261,22 @@ void SettingsModel::updateConfiguredModels()
 
 void SettingsModel::updateApiConfiguredModels(QJsonArray& apiModels)
 {
-    if (!m_models_config.contains("api")) {
-        return;
-    }
+    for (const QString& provider : m_registry.providers()) {
+        const ModelRegistry::Provider* providerEntry = m_registry.provider(provider);
+        if (!providerEntry->isComplete()) {
+            LOG_WARNING(QString("API提供商 %1 配置不完整，缺少: %2")
+                .arg(provider, providerEntry->missingItems.join(", ")));
+            continue;
+        }
 
-    QJsonObject apiConfig = m_models_config["api"].toObject();
-    for (auto providerIt = apiConfig.begin(); providerIt != apiConfig.end(); ++providerIt) {
-        if (providerIt.key() != "has_API" && providerIt.key() != "default_url" && 
-            providerIt.value().isObject()) {
-            QString provider = providerIt.key();
-            QJsonObject providerConfig = providerIt.value().toObject();
-            
-            if (isProviderConfigComplete(provider, providerConfig)) {
-                if (providerConfig.contains("models")) {
-                    QJsonObject models = providerConfig["models"].toObject();
-                    for (auto modelIt = models.begin(); modelIt != models.end(); ++modelIt) {
-                        QString modelName = modelIt.key();
-                        if (isModelConfigComplete("api", modelName)) {
-                            addModelToConfiguredList("api", modelName, provider);
-                            apiModels.append(modelName);
-                        } else {
-                            QStringList missingItems = getMissingConfigItems("api", modelName);
-                            LOG_WARNING(QString("API模型 %1 配置不完整，缺少: %2")
-                                .arg(modelName, missingItems.join(", ")));
-                        }
-                    }
-                }
+        for (const QString& modelName : providerEntry->models) {
+            const ModelRegistry::Model* model = m_registry.model("api", modelName);
+            if (model && model->isComplete()) {
+                addModelToConfiguredList("api", modelName, provider);
+                apiModels.append(modelName);
             } else {
-                QStringList missingItems = getMissingProviderConfigItems(provider, providerConfig);
-                LOG_WARNING(QString("API提供商 %1 配置不完整，缺少: %2")
-                    .arg(provider, missingItems.join(", ")));
+                LOG_WARNING(QString("API模型 %1 配置不完整，缺少: %2")
+                    .arg(modelName, getMissingConfigItems("api", modelName).join(", ")));
             }
         }
     }
@@ -248,41 +284,23 @@ void SettingsModel::updateApiConfiguredModels(QJsonArray& apiModels)
 
 void SettingsModel::updateOllamaConfiguredModels(QJsonArray& ollamaModels)
 {
-    if (!m_models_config.contains("ollama")) {
-        return;
-    }
-
-    QJsonObject ollamaConfig = m_models_config["ollama"].toObject();
-    if (ollamaConfig.contains("models")) {
-        QJsonObject models = ollamaConfig["models"].toObject();
-        for (auto it = models.begin(); it != models.end(); ++it) {
-            QString modelName = it.key();
-            // Ollama模型只需要名称即可
-            addModelToConfiguredList("ollama", modelName);
-            ollamaModels.append(modelName);
-        }
+    // Ollama模型只需要名称即可
+    for (const QString& modelName : m_registry.models("ollama")) {
+        addModelToConfiguredList("ollama", modelName);
+        ollamaModels.append(modelName);
     }
 }
 
 void SettingsModel::updateLocalConfiguredModels(QJsonArray& localModels)
 {
-    if (!m_models_config.contains("local")) {
-        return;
-    }
-
-    QJsonObject localConfig = m_models_config["local"].toObject();
-    if (localConfig.contains("models")) {
-        QJsonObject models = localConfig["models"].toObject();
-        for (auto it = models.begin(); it != models.end(); ++it) {
-            QString modelName = it.key();
-            if (isModelConfigComplete("local", modelName)) {
-                addModelToConfiguredList("local", modelName);
-                localModels.append(modelName);
-            } else {
-                QStringList missingItems = getMissingConfigItems("local", modelName);
-                LOG_WARNING(QString("本地模型 %1 配置不完整，缺少: %2")
-                    .arg(modelName, missingItems.join(", ")));
-            }
+    for (const QString& modelName : m_registry.models("local")) {
+        if (isModelConfigComplete("local", modelName)) {
+            addModelToConfiguredList("local", modelName);
+            localModels.append(modelName);
+        } else {
+            QStringList missingItems = getMissingConfigItems("local", modelName);
+            LOG_WARNING(QString("本地模型 %1 配置不完整，缺少: %2")
+                .arg(modelName, missingItems.join(", ")));
         }
     }
 }
@@ -310,165 +328,53 @@ void SettingsModel::logConfiguredModelsSummary()
 
 bool SettingsModel::isProviderConfigComplete(const QString& provider, const QJsonObject& config) const
 {
-    // 检查必需的提供商配置项
-    if (!config.contains("api_key") || config["api_key"].toString().isEmpty()) {
-        return false;
-    }
-    if (!config.contains("default_url") || config["default_url"].toString().isEmpty()) {
-        return false;
-    }
-    if (!config.contains("models") || !config["models"].isObject()) {
-        return false;
-    }
-    return true;
+    Q_UNUSED(provider);
+    return ModelRegistry::missingProviderItems(config).isEmpty();
 }
 
 QStringList SettingsModel::getMissingProviderConfigItems(const QString& provider, const QJsonObject& config) const
 {
-    QStringList missingItems;
-    
-    if (!config.contains("api_key") || config["api_key"].toString().isEmpty()) {
-        missingItems << "api_key";
-    }
-    if (!config.contains("default_url") || config["default_url"].toString().isEmpty()) {
-        missingItems << "default_url";
-    }
-    if (!config.contains("models") || !config["models"].isObject()) {
-        missingItems << "models";
-    }
-    
-    return missingItems;
+    Q_UNUSED(provider);
+    return ModelRegistry::missingProviderItems(config);
 }
 
 bool SettingsModel::isModelConfigComplete(const QString& type, const QString& modelName) const
 {
-    QJsonObject config = getModelConfig(type, modelName);
-    
-    // 检查模型是否启用
-    if (!config["enabled"].toBool(true)) {
-        return false;
-    }
-
-    // 根据不同类型检查必需的配置项
-    if (type == "api") {
-        // 检查模型名称
-        if (!config.contains("name") || config["name"].toString().isEmpty()) {
-            return false;
-        }
-        // 检查API URL
-        if (!config.contains("url") || config["url"].toString().isEmpty()) {
-            return false;
-        }
-        // 检查提供商配置
-        QString provider = getProviderForModel(modelName);
-        if (provider.isEmpty()) {
-            return false;
-        }
-        QJsonObject providerConfig = getProviderConfig("api", provider);
-        if (!isProviderConfigComplete(provider, providerConfig)) {
-            return false;
-        }
-    }
-    else if (type == "ollama") {
-        // Ollama模型只需要名称即可
-        return true;
-    }
-    else if (type == "local") {
-        // 检查模型名称
-        if (!config.contains("name") || config["name"].toString().isEmpty()) {
-            return false;
-        }
-        // 检查模型路径
-        if (!config.contains("path") || config["path"].toString().isEmpty()) {
-            return false;
-        }
-        // 检查模型文件是否存在
-        QString path = config["path"].toString();
-        if (!QFile::exists(path)) {
-            return false;
-        }
-    }
-
-    return true;
+    return getMissingConfigItems(type, modelName).isEmpty();
 }
 
 QStringList SettingsModel::getMissingConfigItems(const QString& type, const QString& modelName) const
 {
-    QStringList missingItems;
-    QJsonObject config = getModelConfig(type, modelName);
-    
-    // 检查模型是否启用
-    if (!config["enabled"].toBool(true)) {
-        missingItems << "enabled";
+    checkModelsLoaded();
+    // 配置项的完整性在配置变化时已经算好，本地模型文件是否存在在这里检查
+    if (const ModelRegistry::Model* model = m_registry.model(type, modelName)) {
+        return model->currentMissingItems();
     }
 
-    // 根据不同类型检查必需的配置项
+    // 配置中没有的模型按空配置处理
+    QStringList missingItems;
     if (type == "api") {
-        // 检查模型名称
-        if (!config.contains("name") || config["name"].toString().isEmpty()) {
-            missingItems << "name";
-        }
-        // 检查API URL
-        if (!config.contains("url") || config["url"].toString().isEmpty()) {
-            missingItems << "url";
-        }
-        // 检查提供商配置
-        QString provider = getProviderForModel(modelName);
-        if (provider.isEmpty()) {
-            missingItems << "provider";
-        } else {
-            QJsonObject providerConfig = getProviderConfig("api", provider);
-            missingItems << getMissingProviderConfigItems(provider, providerConfig);
-        }
-    }
-    else if (type == "ollama") {
-        // Ollama模型不需要额外检查
-        return missingItems;
-    }
-    else if (type == "local") {
-        // 检查模型名称
-        if (!config.contains("name") || config["name"].toString().isEmpty()) {
-            missingItems << "name";
-        }
-        // 检查模型路径
-        if (!config.contains("path") || config["path"].toString().isEmpty()) {
-            missingItems << "path";
-        }
-        // 检查模型文件是否存在
-        QString path = config["path"].toString();
-        if (!QFile::exists(path)) {
-            missingItems << "path (文件不存在)";
-        }
+        missingItems << "name" << "url" << "provider";
+    } else if (type == "local") {
+        missingItems << "name" << "path" << "path (文件不存在)";
     }
-
     return missingItems;
 }
 
 QString SettingsModel::getProviderForModel(const QString& modelName) const
 {
-    if (!m_models_config.contains("api")) {
-        return QString();
-    }
-
-    QJsonObject apiConfig = m_models_config["api"].toObject();
-    for (auto it = apiConfig.begin(); it != apiConfig.end(); ++it) {
-        if (it.key() != "has_API" && it.key() != "default_url" && 
-            it.value().isObject()) {
-            QString provider = it.key();
-            QJsonObject providerConfig = it.value().toObject();
-            if (providerConfig.contains("models")) {
-                QJsonObject models = providerConfig["models"].toObject();
-                if (models.contains(modelName)) {
-                    return provider;
-                }
-            }
-        }
-    }
-    return QString();
+    checkModelsLoaded();
+    return m_registry.providerForModel(modelName);
 }
 
 QJsonObject SettingsModel::getProviderConfig(const QString& type, const QString& provider) const
 {
+    checkModelsLoaded();
+    if (type == "api") {
+        const ModelRegistry::Provider* entry = m_registry.provider(provider);
+        return entry ? entry->config : QJsonObject();
+    }
+
     if (m_models_config.contains(type) && m_models_config[type].isObject()) {
         QJsonObject typeConfig = m_models_config[type].toObject();
         if (typeConfig.contains(provider)) {
@@ -478,8 +384,16 @@ QJsonObject SettingsModel::getProviderConfig(const QString& type, const QString&
     return QJsonObject();
 }
 
+QStringList SettingsModel::getProviderModels(const QString& provider) const
+{
+    checkModelsLoaded();
+    const ModelRegistry::Provider* entry = m_registry.provider(provider);
+    return entry ? entry->models : QStringList();
+}
+
 void SettingsModel::setProviderConfig(const QString& type, const QString& provider, const QJsonObject& config)
 {
+    ensureModelsLoaded();
     if (!m_models_config.contains(type)) {
         m_models_config[type] = QJsonObject();
     }
@@ -487,11 +401,16 @@ void SettingsModel::setProviderConfig(const QString& type, const QString& provid
     QJsonObject typeConfig = m_models_config[type].toObject();
     typeConfig[provider] = config;
     m_models_config[type] = typeConfig;
+    if (type == "api") {
+        m_registry.setProvider(provider, config);
+    } else {
+        m_registry.rebuild(m_models_config);
+    }
     
     // 更新已配置的模型列表
     updateConfiguredModels();
     
-    scheduleSave();
+    scheduleSave(ModelsSection);
     emit modelConfigChanged();
 }
 
@@ -503,6 +422,7 @@ QString SettingsModel::getProviderApiKey(const QString& type, const QString& pro
 
 void SettingsModel::setProviderApiKey(const QString& type, const QString& provider, const QString& apiKey)
 {
+    ensureModelsLoaded();
     if (m_models_config.contains(type) && m_models_config[type].isObject()) {
         QJsonObject typeConfig = m_models_config[type].toObject();
         if (typeConfig.contains(provider)) {
@@ -510,6 +430,9 @@ void SettingsModel::setProviderApiKey(const QString& type, const QString& provid
             providerConfig["api_key"] = apiKey;
             typeConfig[provider] = providerConfig;
             m_models_config[type] = typeConfig;
+            if (type == "api") {
+                m_registry.setProvider(provider, providerConfig);
+            }
             
             // 如果当前正在使用这个提供商，更新 API Key
             if (m_modelType == ModelType::API && m_currentProvider == provider) {
@@ -519,7 +442,7 @@ void SettingsModel::setProviderApiKey(const QString& type, const QString& provid
             // 更新已配置的模型列表
             updateConfiguredModels();
             
-            scheduleSave();
+            scheduleSave(ModelsSection);
             emit apiKeyChanged();
             LOG_INFO(QString("已更新提供商 %1 的 API Key").arg(provider));
         }
@@ -528,6 +451,7 @@ void SettingsModel::setProviderApiKey(const QString& type, const QString& provid
 
 QStringList SettingsModel::getConfiguredModels(const QString& type) const
 {
+    checkModelsLoaded();
     QStringList models;
     if (m_configuredModels.contains(type)) {
         QJsonArray modelArray = m_configuredModels[type].toArray();
@@ -540,6 +464,7 @@ QStringList SettingsModel::getConfiguredModels(const QString& type) const
 
 void SettingsModel::addConfiguredModel(const QString& type, const QString& modelName)
 {
+    ensureModelsLoaded();
     if (!m_configuredModels.contains(type)) {
         m_configuredModels[type] = QJsonArray();
     }
@@ -548,12 +473,13 @@ void SettingsModel::addConfiguredModel(const QString& type, const QString& model
     if (!modelArray.contains(modelName)) {
         modelArray.append(modelName);
         m_configuredModels[type] = modelArray;
-        scheduleSave();
+        scheduleSave(ModelsSection);
     }
 }
 
 void SettingsModel::removeConfiguredModel(const QString& type, const QString& modelName)
 {
+    ensureModelsLoaded();
     if (m_configuredModels.contains(type)) {
         QJsonArray modelArray = m_configuredModels[type].toArray();
         QJsonArray newArray;
@@ -565,7 +491,7 @@ void SettingsModel::removeConfiguredModel(const QString& type, const QString& mo
         }
         
         m_configuredModels[type] = newArray;
-        scheduleSave();
+        scheduleSave(ModelsSection);
     }
 }
 
@@ -576,24 +502,14 @@ QString SettingsModel::getCurrentProvider() const
 
 QStringList SettingsModel::getConfiguredProviders() const
 {
+    checkModelsLoaded();
     QStringList providers;
-    
-    // 获取API类型的配置
-    QJsonObject apiConfig = getModelConfig("api", "");
-    
-    // 遍历API配置中的所有键，找出所有提供商
-    for (auto it = apiConfig.begin(); it != apiConfig.end(); ++it) {
-        QString key = it.key();
-        // 排除非提供商的键
-        if (key != "has_API" && key != "default_url" && it.value().isObject()) {
-            QJsonObject providerConfig = it.value().toObject();
-            // 检查提供商是否配置了API Key
-            if (providerConfig.contains("api_key") && !providerConfig["api_key"].toString().isEmpty()) {
-                providers.append(key);
-            }
+    for (const QString& provider : m_registry.providers()) {
+        // 只返回配置了API Key的提供商
+        if (!m_registry.provider(provider)->config["api_key"].toString().isEmpty()) {
+            providers.append(provider);
         }
     }
-    
     return providers;
 }
 
@@ -645,7 +561,7 @@ void SettingsModel::setDeepThinkingMode(bool enabled)
     }
 }
 
-bool SettingsModel::loadConfigFile(QJsonObject& root)
+bool SettingsModel::readConfigFile(QByteArray& data)
 {
     QString settingsPath = getSettingsPath();
     if (settingsPath.isEmpty()) {
@@ -664,16 +580,8 @@ bool SettingsModel::loadConfigFile(QJsonObject& root)
         return false;
     }
 
-    QByteArray data = file.readAll();
+    data = file.readAll();
     file.close();
-
-    QJsonDocument doc = QJsonDocument::fromJson(data);
-    if (doc.isNull()) {
-        LOG_ERROR("配置文件格式错误");
-        return false;
-    }
-
-    root = doc.object();
     return true;
 }
 
@@ -681,6 +589,7 @@ void SettingsModel::loadModelConfig(const QJsonObject& root)
 {
     if (root.contains("models_config")) {
         m_models_config = root["models_config"].toObject();
+        m_registry.rebuild(m_models_config);
         LOG_INFO("已加载模型配置");
         
         // 检查 API 配置
@@ -733,6 +642,7 @@ void SettingsModel::loadBasicSettings(const QJsonObject& root)
 {
     if (root.contains("appState")) {
         QJsonObject appState = root["appState"].toObject();
+        m_appState = appState;
         if (appState.contains("lastModelType")) {
             m_modelType = static_cast<ModelType>(appState["lastModelType"].toInt());
             LOG_INFO(QString("已加载上次使用的模型类型: %1").arg(static_cast<int>(m_modelType)));
@@ -753,6 +663,15 @@ void SettingsModel::loadBasicSettings(const QJsonObject& root)
     if (root.contains("contextWindow")) {
         m_contextWindow = root["contextWindow"].toInt();
     }
+    if (root.contains("inferenceThreads")) {
+        m_inferenceThreads = qMax(0, root["inferenceThreads"].toInt());
+    }
+    if (root.contains("kvCacheMB")) {
+        m_kvCacheMB = qMax(64, root["kvCacheMB"].toInt());
+    }
+    if (root.contains("kvCache8Bit")) {
+        m_kvCache8Bit = root["kvCache8Bit"].toBool();
+    }
     if (root.contains("theme")) {
         m_theme = root["theme"].toString();
     }
@@ -842,37 +761,18 @@ void SettingsModel::loadAPIModelSettings()
     
     // 从模型配置中获取提供商和 API URL
     if (!m_currentModelName.isEmpty()) {
-        QJsonObject apiConfig = m_models_config["api"].toObject();
-        bool found = false;
-        
-        for (auto providerIt = apiConfig.begin(); providerIt != apiConfig.end(); ++providerIt) {
-            if (providerIt.value().isObject()) {
-                QJsonObject providerConfig = providerIt.value().toObject();
-                if (providerConfig.contains("models")) {
-                    QJsonObject models = providerConfig["models"].toObject();
-                    if (models.contains(m_currentModelName)) {
-                        m_currentProvider = providerIt.key();
-                        m_apiKey = providerConfig["api_key"].toString();
-                        m_apiUrl = providerConfig["default_url"].toString();
-                        
-                        // 如果模型配置中有特定的 URL，使用模型的 URL
-                        QJsonObject modelConfig = models[m_currentModelName].toObject();
-                        if (modelConfig.contains("url") && !modelConfig["url"].toString().isEmpty()) {
-                            m_apiUrl = modelConfig["url"].toString();
-                        }
-                        
-                        LOG_INFO(QString("已加载模型配置 - 提供商: %1, API Key: %2, API URL: %3")
-                            .arg(m_currentProvider)
-                            .arg(m_apiKey.isEmpty() ? "未设置" : "已设置")
-                            .arg(m_apiUrl));
-                        found = true;
-                        break;
-                    }
-                }
-            }
-        }
-        
-        if (!found) {
+        const ModelRegistry::Model* model = m_registry.model("api", m_currentModelName);
+        if (model) {
+            // 模型配置中的 url 为空时已经补上提供商的 default_url
+            m_currentProvider = model->provider;
+            m_apiKey = m_registry.provider(model->provider)->config["api_key"].toString();
+            m_apiUrl = model->config["url"].toString();
+
+            LOG_INFO(QString("已加载模型配置 - 提供商: %1, API Key: %2, API URL: %3")
+                .arg(m_currentProvider)
+                .arg(m_apiKey.isEmpty() ? "未设置" : "已设置")
+                .arg(m_apiUrl));
+        } else {
             LOG_ERROR(QString("未找到模型 %1 的配置").arg(m_currentModelName));
         }
     }
@@ -914,18 +814,132 @@ void SettingsModel::loadLocalModelSettings()
     }
 }
 
-void SettingsModel::loadSettings()
+const ModelRegistry& SettingsModel::modelRegistry() const
 {
-    QJsonObject root;
-    if (!loadConfigFile(root)) {
-        setDefaultSettings();
-        return;
+    checkModelsLoaded();
+    return m_registry;
+}
+
+void SettingsModel::ensureModelsLoaded()
+{
+    if (m_modelsPending) {
+        loadModels();
+    }
+}
+
+void SettingsModel::checkModelsLoaded() const
+{
+    // 查询接口不触发加载，加载时机由 ensureModelsLoaded 的调用方决定
+    if (m_modelsPending) {
+        LOG_WARNING("模型配置尚未加载，查询结果为空");
     }
+}
+
+void SettingsModel::loadModels()
+{
+    TRACE_SCOPE("SettingsModel::loadModels");
+    m_modelsPending = false;
 
+    QJsonObject root = m_snapshot.section("models");
+    // 旧版本写入的快照带有 API Key，否则从 settings.json 中取回
+    bool legacyKeys = false;
+    withoutApiKeys(root["models_config"].toObject(), &legacyKeys);
+    if (!legacyKeys && !m_settingsJson.isEmpty()) {
+        const QJsonObject json = QJsonDocument::fromJson(m_settingsJson).object();
+        root["models_config"] = withApiKeys(root["models_config"].toObject(), json["models_config"].toObject());
+    }
+    m_settingsJson.clear();
     loadModelConfig(root);
     loadConfiguredModels(root);
+    snapshotSections(ModelsSection);
+
+    if (m_modelType == ModelType::API && !m_currentProvider.isEmpty()) {
+        if (const ModelRegistry::Provider* provider = m_registry.provider(m_currentProvider)) {
+            m_apiKey = provider->config["api_key"].toString();
+            emit apiKeyChanged();
+        }
+    }
+
+    // 旧版本写入的快照带有 API Key，所有分区都齐了之后重写一次
+    if (legacyKeys || m_snapshot.section("current").contains("apiKey")) {
+        m_writer->commitSnapshot();
+    }
+
+    // 所有分区都已取出，快照不再需要
+    m_snapshot.clear();
+}
+
+void SettingsModel::loadFromSnapshot()
+{
+    QJsonObject root = m_snapshot.section("general");
+    const QJsonObject appState = m_snapshot.section("appState");
+    for (auto it = appState.begin(); it != appState.end(); ++it) {
+        root.insert(it.key(), it.value());
+    }
     loadBasicSettings(root);
-    loadModelSpecificSettings();
+    m_writer->setSection("appState", appState);
+    m_writer->setSection("general", m_snapshot.section("general"));
+
+    // 模型配置是最大的分区，推迟到第一次使用时再加载
+    m_modelsPending = true;
+
+    // 当前模型的提供商、地址等由模型配置推出，快照中保存了结果
+    QJsonObject current = m_snapshot.section("current");
+    if (!m_currentModelName.isEmpty()
+        && current["type"].toInt(-1) == static_cast<int>(m_modelType)
+        && current["model"].toString() == m_currentModelName) {
+        if (current.contains("provider")) {
+            // API Key 不写入快照，加载模型配置时再从提供商配置中取出
+            m_currentProvider = current["provider"].toString();
+            m_apiUrl = current["apiUrl"].toString();
+        }
+        if (current.contains("ollamaUrl")) {
+            m_ollamaUrl = current["ollamaUrl"].toString();
+        }
+        if (current.contains("modelPath")) {
+            m_modelPath = current["modelPath"].toString();
+        }
+        current.remove("apiKey");
+        m_writer->setCacheSection("current", current);
+    } else {
+        ensureModelsLoaded();
+        loadModelSpecificSettings();
+    }
+}
+
+void SettingsModel::loadSettings()
+{
+    TRACE_SCOPE("SettingsModel::loadSettings");
+    m_modelsPending = false;
+
+    QByteArray data;
+    if (!readConfigFile(data)) {
+        setDefaultSettings();
+        return;
+    }
+
+    QString settingsPath = getSettingsPath();
+    if (m_snapshot.load(SettingsSnapshot::pathFor(settingsPath), data, QFileInfo(settingsPath).lastModified())) {
+        m_settingsJson = data;
+        loadFromSnapshot();
+    } else {
+        QJsonDocument doc = QJsonDocument::fromJson(data);
+        if (doc.isNull()) {
+            LOG_ERROR("配置文件格式错误");
+            setDefaultSettings();
+            return;
+        }
+
+        QJsonObject root = doc.object();
+        loadModelConfig(root);
+        loadConfiguredModels(root);
+        loadBasicSettings(root);
+        loadModelSpecificSettings();
+
+        // JSON 没有变化，只补写快照
+        snapshotSections(AllSections);
+        m_writer->commitSnapshot();
+    }
 
     LOG_INFO(QString("设置加载完成 - 当前配置:")
              .arg(static_cast<int>(m_modelType))
@@ -934,6 +948,9 @@ void SettingsModel::loadSettings()
              .arg(m_apiUrl)
              .arg(m_modelPath));
 
+    // 刚读出的内容不需要写回，之后只重新生成有变化的分区
+    m_dirtySections = 0;
+
     // 发送所有必要的信号
     emit apiKeyChanged();
     emit modelTypeChanged();
@@ -944,25 +961,51 @@ void SettingsModel::loadSettings()
 
 void SettingsModel::saveSettings()
 {
-    QString settingsPath = getSettingsPath();
-    if (settingsPath.isEmpty()) {
-        LOG_ERROR("无法获取设置文件路径");
+    m_saveTimer->stop();
+    if (m_dirtySections == 0) {
         return;
     }
+    TRACE_SCOPE_CAT("SettingsModel::saveSettings", "settings");
 
-    QJsonObject obj;
+    // 快照记录的当前模型信息需要模型配置才能更新
+    ensureModelsLoaded();
+    snapshotSections(m_dirtySections);
+    m_dirtySections = 0;
+    m_writer->commit();
+}
 
-    // 保存应用状态
-    QJsonObject appState;
-    appState["lastModelType"] = static_cast<int>(m_modelType);
-    appState["lastSelectedModel"] = m_currentModelName;
-    obj["appState"] = appState;
+void SettingsModel::snapshotSections(int sections)
+{
+    if (sections & AppStateSection) {
+        // 保存应用状态
+        QJsonObject appState = m_appState;
+        appState["lastModelType"] = static_cast<int>(m_modelType);
+        appState["lastSelectedModel"] = m_currentModelName;
+        QJsonObject obj;
+        obj["appState"] = appState;
+        m_writer->setSection("appState", obj);
+    }
+
+    if (sections & ModelsSection) {
+        QJsonObject obj;
+        // 保存模型配置
+        obj["models_config"] = m_models_config;
+        // 保存已配置的模型列表
+        obj["configured_models"] = m_configuredModels;
+        m_writer->setSection("models", obj);
+        // 快照中的同名分区不含 API Key
+        obj["models_config"] = withoutApiKeys(m_models_config);
+        m_writer->setCacheSection("models", obj);
+    }
+
+    // 只写入快照，启动时不必为了这几项加载模型配置
+    m_writer->setCacheSection("current", currentModelSection());
 
-    // 保存模型配置
-    obj["models_config"] = m_models_config;
+    if (!(sections & GeneralSection)) {
+        return;
+    }
 
-    // 保存已配置的模型列表
-    obj["configured_models"] = m_configuredModels;
+    QJsonObject obj;
 
     // 保存其他设置
     if (m_temperature != 0.7) {
@@ -974,6 +1017,15 @@ void SettingsModel::saveSettings()
     if (m_contextWindow != 2048) {
         obj["contextWindow"] = m_contextWindow;
     }
+    if (m_inferenceThreads != 0) {
+        obj["inferenceThreads"] = m_inferenceThreads;
+    }
+    if (m_kvCacheMB != 1024) {
+        obj["kvCacheMB"] = m_kvCacheMB;
+    }
+    if (m_kvCache8Bit) {
+        obj["kvCache8Bit"] = true;
+    }
     if (!m_theme.isEmpty()) {
         obj["theme"] = m_theme;
     }
@@ -1022,19 +1074,32 @@ void SettingsModel::saveSettings()
     }
     obj["rolePresets"] = presetsArray;
 
-    QJsonDocument doc(obj);
+    m_writer->setSection("general", obj);
+}
 
-    // 保存到文件
-    QFile file(settingsPath);
-    if (!file.open(QIODevice::WriteOnly)) {
-        LOG_ERROR("无法保存配置文件");
-        return;
+QJsonObject SettingsModel::currentModelSection() const
+{
+    // 与 loadModelSpecificSettings 推出的结果一致
+    QJsonObject current;
+    current["type"] = static_cast<int>(m_modelType);
+    current["model"] = m_currentModelName;
+    switch (m_modelType) {
+        case ModelType::API:
+            if (const ModelRegistry::Model* model = m_registry.model("api", m_currentModelName)) {
+                current["provider"] = model->provider;
+                current["apiUrl"] = model->config["url"].toString();
+            }
+            break;
+        case ModelType::Ollama:
+            current["ollamaUrl"] = m_models_config["ollama"].toObject()["default_url"].toString();
+            break;
+        case ModelType::Local:
+            if (const ModelRegistry::Model* model = m_registry.model("local", m_currentModelName)) {
+                current["modelPath"] = model->config["path"].toString();
+            }
+            break;
     }
-
-    file.write(doc.toJson());
-    file.close();
-
-    LOG_INFO("设置保存完成");
+    return current;
 }
 
 void SettingsModel::setDefaultSettings()
@@ -1056,7 +1121,7 @@ void SettingsModel::setDefaultSettings()
 void SettingsModel::setAppStateValue(const QString& key, const QJsonValue& value)
 {
     m_appState[key] = value;
-    scheduleSave();
+    scheduleSave(AppStateSection);
     emit appStateChanged();
 }
 
@@ -1067,49 +1132,19 @@ QJsonValue SettingsModel::appStateValue(const QString& key) const
 
 QJsonObject SettingsModel::getModelConfig(const QString& type, const QString& name) const
 {
-    if (m_models_config.contains(type) && m_models_config[type].isObject()) {
-        QJsonObject typeConfig = m_models_config[type].toObject();
-        
-        // 如果 name 为空，返回整个类型的配置
-        if (name.isEmpty()) {
-            return typeConfig;
-        }
-        
-        // 对于 API 类型
-        if (type == "api") {
-            // 遍历所有提供商
-            for (auto providerIt = typeConfig.begin(); providerIt != typeConfig.end(); ++providerIt) {
-                if (providerIt.key() != "has_API" && providerIt.key() != "default_url" && 
-                    providerIt.value().isObject()) {
-                    QJsonObject providerConfig = providerIt.value().toObject();
-                    if (providerConfig.contains("models")) {
-                        QJsonObject models = providerConfig["models"].toObject();
-                        if (models.contains(name)) {
-                            QJsonObject modelConfig = models[name].toObject();
-                            modelConfig["provider"] = providerIt.key();
-                            // 如果模型没有指定 url，使用提供商的 default_url
-                            if (!modelConfig.contains("url") || modelConfig["url"].toString().isEmpty()) {
-                                modelConfig["url"] = providerConfig["default_url"].toString();
-                            }
-                            return modelConfig;
-                        }
-                    }
-                }
-            }
-        }
-        // 对于其他类型（如 Ollama 和本地模型）
-        else if (typeConfig.contains("models")) {
-            QJsonObject modelsObj = typeConfig["models"].toObject();
-            if (modelsObj.contains(name)) {
-                return modelsObj[name].toObject();
-            }
-        }
+    checkModelsLoaded();
+    // 如果 name 为空，返回整个类型的配置
+    if (name.isEmpty()) {
+        return m_models_config[type].toObject();
     }
-    return QJsonObject();
+
+    const ModelRegistry::Model* model = m_registry.model(type, name);
+    return model ? model->config : QJsonObject();
 }
 
 void SettingsModel::setModelConfig(const QString& type, const QString& name, const QJsonObject& config)
 {
+    ensureModelsLoaded();
     if (!m_models_config.contains(type)) {
         m_models_config[type] = QJsonObject();
     }
@@ -1118,26 +1153,22 @@ void SettingsModel::setModelConfig(const QString& type, const QString& name, con
     
     if (type == "api") {
         // 对于 API 类型，需要找到模型所属的提供商
-        for (auto providerIt = typeConfig.begin(); providerIt != typeConfig.end(); ++providerIt) {
-            if (providerIt.value().isObject()) {
-                QJsonObject providerConfig = providerIt.value().toObject();
-                if (providerConfig.contains("models")) {
-                    QJsonObject models = providerConfig["models"].toObject();
-                    if (models.contains(name)) {
-                        models[name] = config;
-                        providerConfig["models"] = models;
-                        typeConfig[providerIt.key()] = providerConfig;
-                        m_models_config[type] = typeConfig;
-                        
-                        // 更新已配置的模型列表
-                        updateConfiguredModels();
-                        
-                        scheduleSave();
-                        emit modelConfigChanged();
-                        return;
-                    }
-                }
-            }
+        QString provider = m_registry.providerForModel(name);
+        if (!provider.isEmpty()) {
+            QJsonObject providerConfig = typeConfig[provider].toObject();
+            QJsonObject models = providerConfig["models"].toObject();
+            models[name] = config;
+            providerConfig["models"] = models;
+            typeConfig[provider] = providerConfig;
+            m_models_config[type] = typeConfig;
+            m_registry.setProvider(provider, providerConfig);
+
+            // 更新已配置的模型列表
+            updateConfiguredModels();
+
+            scheduleSave(ModelsSection);
+            emit modelConfigChanged();
+            return;
         }
     }
     // 对于其他类型，直接更新配置
@@ -1148,45 +1179,27 @@ void SettingsModel::setModelConfig(const QString& type, const QString& name, con
     models[name] = config;
     typeConfig["models"] = models;
     m_models_config[type] = typeConfig;
+    if (type == "api") {
+        m_registry.rebuild(m_models_config);
+    } else {
+        m_registry.setModels(type, models);
+    }
     
     // 更新已配置的模型列表
     updateConfiguredModels();
     
-    scheduleSave();
+    scheduleSave(ModelsSection);
     emit modelConfigChanged();
 }
 
 QStringList SettingsModel::getAvailableModels(const QString& type) const
 {
+    checkModelsLoaded();
     QStringList models;
-    if (m_models_config.contains(type) && m_models_config[type].isObject()) {
-        QJsonObject typeConfig = m_models_config[type].toObject();
-        if (typeConfig.contains("models")) {
-            QJsonObject modelsObj = typeConfig["models"].toObject();
-            for (auto it = modelsObj.begin(); it != modelsObj.end(); ++it) {
-                if (it.value().isObject()) {
-                    QJsonObject modelObj = it.value().toObject();
-                    if (modelObj["enabled"].toBool(true)) {
-                        models.append(it.key());
-                    }
-                }
-            }
-        } else {
-            // 对于按提供商组织的模型（如 API 类型）
-            for (auto providerIt = typeConfig.begin(); providerIt != typeConfig.end(); ++providerIt) {
-                if (providerIt.key() != "has_API" && providerIt.key() != "default_url" && 
-                    providerIt.value().isObject()) {
-                    QJsonObject providerModels = providerIt.value().toObject();
-                    for (auto modelIt = providerModels.begin(); modelIt != providerModels.end(); ++modelIt) {
-                        if (modelIt.value().isObject()) {
-                            QJsonObject modelObj = modelIt.value().toObject();
-                            if (modelObj["enabled"].toBool(true)) {
-                                models.append(modelIt.key());
-                            }
-                        }
-                    }
-                }
-            }
+    for (const QString& name : m_registry.models(type)) {
+        const ModelRegistry::Model* model = m_registry.model(type, name);
+        if (model && model->enabled()) {
+            models.append(name);
         }
     }
     return models;
@@ -1205,8 +1218,10 @@ void SettingsModel::setModelEnabled(const QString& type, const QString& name, bo
     setModelConfig(type, name, config);
 }
 
-void SettingsModel::scheduleSave()
+void SettingsModel::scheduleSave(int sections)
 {
+    // 一秒内的连续修改合并为一次写入
+    m_dirtySections |= sections;
     m_saveTimer->start();
 }
 
@@ -1268,7 +1283,7 @@ void SettingsModel::setModelType(ModelType type)
                 break;
         }
         LOG_INFO(QString("模型类型已更新: %1").arg(typeStr));
-        scheduleSave();
+        scheduleSave(AppStateSection);
         emit modelTypeChanged();
     }
 }
@@ -1278,7 +1293,7 @@ void SettingsModel::setCurrentModelName(const QString &name)
     if (m_currentModelName != name) {
         m_currentModelName = name;
         LOG_INFO(QString("当前模型已更新: %1").arg(name));
-        scheduleSave();
+        scheduleSave(AppStateSection);
         emit currentModelNameChanged(name);
     }
 }
@@ -1314,6 +1329,7 @@ void SettingsModel::refreshOllamaModels()
             setOllamaModels(models);
             
             // 更新模型配置
+            ensureModelsLoaded();
             QJsonObject ollamaConfig = m_models_config["ollama"].toObject();
             QJsonObject modelsObj;
             
@@ -1326,6 +1342,8 @@ void SettingsModel::refreshOllamaModels()
             
             ollamaConfig["models"] = modelsObj;
             m_models_config["ollama"] = ollamaConfig;
+            m_registry.setModels("ollama", modelsObj);
+            scheduleSave(ModelsSection);
             
             // 更新已配置的模型列表
             updateConfiguredModels();
@@ -1383,6 +1401,35 @@ void SettingsModel::setAutoSave(bool autoSave)
     }
 }
 
+void SettingsModel::setInferenceThreads(int threads)
+{
+    threads = qMax(0, threads);
+    if (m_inferenceThreads != threads) {
+        m_inferenceThreads = threads;
+        emit inferenceThreadsChanged();
+        scheduleSave();
+    }
+}
+
+void SettingsModel::setKvCacheMB(int megabytes)
+{
+    megabytes = qMax(64, megabytes);
+    if (m_kvCacheMB != megabytes) {
+        m_kvCacheMB = megabytes;
+        emit kvCacheChanged();
+        scheduleSave();
+    }
+}
+
+void SettingsModel::setKvCache8Bit(bool enabled)
+{
+    if (m_kvCache8Bit != enabled) {
+        m_kvCache8Bit = enabled;
+        emit kvCacheChanged();
+        scheduleSave();
+    }
+}
+
 void SettingsModel::setSaveInterval(int interval)
 {
     if (m_saveInterval != interval) {
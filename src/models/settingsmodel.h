@@ -12,8 +12,12 @@
 #include <QFile>
 #include <QFileInfo>
 #include <QTimer>
+#include "models/modelregistry.h"
+#include "services/settingssnapshot.h"
 // #include "utils/encryption.h"
 
+class SettingsWriter;
+
 class SettingsModel : public QObject
 {
     Q_OBJECT
@@ -56,17 +60,32 @@ public:
     void setOllamaModels(const QStringList &models);
     void refreshOllamaModels();
 
+    // 分区对应设置文件中的若干顶层键，保存时只重新生成有变化的分区
+    enum SaveSection {
+        AppStateSection = 0x1,
+        ModelsSection = 0x2,
+        GeneralSection = 0x4,
+        AllSections = AppStateSection | ModelsSection | GeneralSection
+    };
+
     void loadSettings();
+    // 把有变化的分区交给后台写入，不等待写完
     void saveSettings();
     QString getSettingsPath() const;
 
     void setDefaultSettings();
-    void scheduleSave();
+    void scheduleSave(int sections = GeneralSection);
 
     void setAppStateValue(const QString& key, const QJsonValue& value);
     QJsonValue appStateValue(const QString& key) const;
     QJsonObject appState() const { return m_appState; }
 
+    // 模型配置的哈希索引，配置变化时增量更新
+    const ModelRegistry& modelRegistry() const;
+    // 从快照中取出模型配置。启动时推迟到首帧之后调用，修改模型配置的接口会自动调用；
+    // 查询接口不会触发加载
+    void ensureModelsLoaded();
+
     QJsonObject getModelConfig(const QString& type, const QString& name) const;
     void setModelConfig(const QString& type, const QString& name, const QJsonObject& config);
     QStringList getAvailableModels(const QString& type) const;
@@ -85,6 +104,16 @@ public:
     int contextWindow() const { return m_contextWindow; }
     void setContextWindow(int value);
 
+    // 本地模型推理使用的线程数，0 表示使用全部逻辑核心
+    int inferenceThreads() const { return m_inferenceThreads; }
+    void setInferenceThreads(int threads);
+
+    // 本地模型键值缓存的内存上限（MB），以及是否以 8 位存储
+    int kvCacheMB() const { return m_kvCacheMB; }
+    void setKvCacheMB(int megabytes);
+    bool kvCache8Bit() const { return m_kvCache8Bit; }
+    void setKvCache8Bit(bool enabled);
+
     QString theme() const { return m_theme; }
     void setTheme(const QString &theme);
 
@@ -146,6 +175,9 @@ public:
     // 设置提供商的 API Key
     void setProviderApiKey(const QString& type, const QString& provider, const QString& apiKey);
     
+    // 获取提供商下的所有 API 模型
+    QStringList getProviderModels(const QString& provider) const;
+
     // 获取已配置的模型列表
     QStringList getConfiguredModels(const QString& type) const;
     
@@ -203,6 +235,8 @@ signals:
     void temperatureChanged();
     void maxTokensChanged();
     void contextWindowChanged();
+    void inferenceThreadsChanged();
+    void kvCacheChanged();
     void themeChanged();
     void fontSizeChanged();
     void fontFamilyChanged();
@@ -214,6 +248,8 @@ signals:
     void rolePromptChanged();
     void rolePresetChanged();
     void rolePresetsChanged();
+    // 每次写入设置文件后报告累计次数和耗时
+    void settingsSaved(int count, qint64 elapsedMs);
 
 private:
     SettingsModel(const SettingsModel&) = delete;
@@ -227,8 +263,14 @@ private:
     QStringList m_ollamaModels;
     QString m_ollamaUrl;
     QTimer* m_saveTimer;
+    SettingsWriter* m_writer = nullptr;
+    int m_dirtySections = AllSections;
+    SettingsSnapshot m_snapshot;
+    bool m_modelsPending = false;  // 模型配置还留在快照中，等首帧之后再加载
+    QByteArray m_settingsJson;     // 快照中的模型配置不含 API Key，加载模型配置时从原始 JSON 中取回
     QJsonObject m_appState;
-    QJsonObject m_models_config;
+    QJsonObject m_models_config;  // 只用于保存，查询都通过 m_registry
+    ModelRegistry m_registry;
     QJsonObject m_configuredModels;
     QString m_currentProvider;
     bool m_isDeepThinking = false;  // 添加深度思考模式标志
@@ -236,6 +278,9 @@ private:
     double m_temperature;
     int m_maxTokens;
     int m_contextWindow;
+    int m_inferenceThreads = 0;
+    int m_kvCacheMB = 1024;
+    bool m_kvCache8Bit = false;
     QString m_theme;
     int m_fontSize;
     QString m_fontFamily;
@@ -256,6 +301,11 @@ private:
     QString m_proxyUsername;
     QString m_proxyPassword;
 
+    void snapshotSections(int sections);
+    QJsonObject currentModelSection() const;
+    void checkModelsLoaded() const;
+    void loadModels();
+    void loadFromSnapshot();
     void initializeDefaultModels();
     void migrateConfig();
     void updateConfiguredModels();
@@ -275,7 +325,7 @@ private:
     void logConfiguredModelsSummary();
 
     // 设置加载相关函数
-    bool loadConfigFile(QJsonObject& root);
+    bool readConfigFile(QByteArray& data);
     void loadModelConfig(const QJsonObject& root);
     void loadConfiguredModels(const QJsonObject& root);
     void loadBasicSettings(const QJsonObject& root);
@@ -4,8 +4,14 @@
 #include <QJsonArray>
 #include <QUrlQuery>
 #include "services/logger.h"
+#include "services/tracer.h"
 #include <QTimer>
 
+namespace {
+// 发送前把图片长边缩小到该值，与 OpenAI 高精度模式的上限一致
+const int kMaxImageEdge = 2048;
+}
+
 APIService::APIService(const QString& apiKey, const QString& apiUrl, const QString& modelName, QObject *parent)
     : LLMService(parent)
     , m_apiKey(apiKey)
@@ -94,6 +100,8 @@ QFuture<QString> APIService::generateResponse(const QString& prompt)
     QFutureInterface<QString> future;
     m_currentFuture = future;
     m_currentResponse.clear();  // 清空当前响应
+    m_isCancelled = false;
+    QList<ImagePipeline::ImageHandle> images = takeImages();
 
     QUrl url(m_apiUrl);
     QNetworkRequest request(url);
@@ -112,7 +120,27 @@ QFuture<QString> APIService::generateResponse(const QString& prompt)
     QJsonArray messages;
     QJsonObject message;
     message["role"] = "user";
-    message["content"] = prompt;
+    if (images.isEmpty()) {
+        message["content"] = prompt;
+    } else {
+        // 图片以 image_url 内容块发送，base64 数据在发送时写入占位字符串的位置
+        QJsonArray content;
+        QJsonObject text;
+        text["type"] = "text";
+        text["text"] = prompt;
+        content.append(text);
+        for (int i = 0; i < images.size(); ++i) {
+            QJsonObject imageUrl;
+            imageUrl["url"] = QString("data:%1;base64,%2")
+                .arg(QString::fromLatin1(ImageEncoder::mimeTypeFor(*images.at(i))),
+                     ImageRequestBody::placeholder(i));
+            QJsonObject part;
+            part["type"] = "image_url";
+            part["image_url"] = imageUrl;
+            content.append(part);
+        }
+        message["content"] = content;
+    }
     messages.append(message);
     json["messages"] = messages;
 
@@ -136,8 +164,37 @@ QFuture<QString> APIService::generateResponse(const QString& prompt)
     QByteArray jsonData = QJsonDocument(json).toJson();
     LOG_INFO(QString("API 请求数据: %1").arg(QString(jsonData)));
 
+    if (images.isEmpty()) {
+        startRequest(request, jsonData, {});
+    } else {
+        // 图片在后台缩小并编码，完成后再发送请求
+        encodeImages(images, kMaxImageEdge, [this, request, jsonData](const QList<ImageEncoder::Encoded>& encoded) {
+            if (m_isCancelled) {
+                m_currentFuture.reportResult(QString());
+                m_currentFuture.reportFinished();
+                return;
+            }
+            startRequest(request, jsonData, encoded);
+        }, [this](const QString& error) {
+            if (m_isCancelled) {
+                m_currentFuture.reportResult(QString());
+                m_currentFuture.reportFinished();
+            } else if (m_currentFuture.isRunning()) {
+                m_currentFuture.reportException(std::make_exception_ptr(std::runtime_error(error.toStdString())));
+                m_currentFuture.reportFinished();
+            }
+        });
+    }
+
+    future.reportStarted();
+    return future.future();
+}
+
+void APIService::startRequest(const QNetworkRequest& request, const QByteArray& jsonData,
+                              const QList<ImageEncoder::Encoded>& images)
+{
     // 发送请求
-    QNetworkReply* reply = m_networkManager->post(request, jsonData);
+    QNetworkReply* reply = ImageRequestBody::post(m_networkManager, request, jsonData, images);
 
     // 设置单个请求的超时
     QTimer::singleShot(120000, reply, [reply]() {  // 120秒
@@ -161,7 +218,9 @@ QFuture<QString> APIService::generateResponse(const QString& prompt)
     // 连接数据接收信号
     connect(reply, &QNetworkReply::readyRead,
             this, [this, reply]() {
+        TRACE_SCOPE_CAT("APIService::readyRead", "network");
         QByteArray data = reply->readAll();
+        TRACE_COUNTER("api bytes read", data.size());
         QStringList lines = QString::fromUtf8(data).split('\n', Qt::SkipEmptyParts);
         
         for (const QString& line : lines) {
@@ -185,6 +244,7 @@ QFuture<QString> APIService::generateResponse(const QString& prompt)
                 continue;
             }
             
+            TRACE_SCOPE_CAT("APIService::parseEvent", "parse");
             QJsonParseError parseError;
             QJsonDocument doc = QJsonDocument::fromJson(jsonStr.toUtf8(), &parseError);
             
@@ -202,7 +262,7 @@ QFuture<QString> APIService::generateResponse(const QString& prompt)
                                 LOG_INFO(QString("收到响应片段: %1").arg(chunk));
                                 
                                 // 发送流式响应信号
-                                emit streamResponseReceived(m_currentResponse);
+                                emitStreamChunk(m_currentResponse);
                                 
                                 // 报告当前累积的响应
                                 if (m_currentFuture.isRunning()) {
@@ -224,9 +284,6 @@ QFuture<QString> APIService::generateResponse(const QString& prompt)
             this, [this, reply]() {
         reply->deleteLater();
     });
-
-    future.reportStarted();
-    return future.future();
 }
 
 void APIService::handleResponse(QNetworkReply* reply)
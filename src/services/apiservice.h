@@ -18,6 +18,7 @@ public:
     QFuture<QString> generateResponse(const QString& prompt) override;
     bool isAvailable() const override;
     QString getModelName() const override;
+    bool supportsImages() const override { return true; }
 
 private slots:
     void handleResponse(QNetworkReply* reply);
@@ -25,6 +26,8 @@ private slots:
 private:
     QString getProviderFromUrl(const QString& url) const;
     QByteArray prepareRequestData(const QString& prompt) const;
+    void startRequest(const QNetworkRequest& request, const QByteArray& jsonData,
+                      const QList<ImageEncoder::Encoded>& images);
 
     QString m_apiKey;
     QString m_apiUrl;
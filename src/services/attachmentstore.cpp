@@ -0,0 +1,292 @@
+#include "attachmentstore.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QCryptographicHash>
+#include <QStandardPaths>
+#include <QMutexLocker>
+#include "services/logger.h"
+
+AttachmentStore::AttachmentStore(const QString& rootPath, QObject *parent)
+    : QObject(parent)
+    , m_rootPath(rootPath.isEmpty() ? defaultRootPath() : rootPath)
+{
+    m_writer.setMaxThreadCount(1);
+    QDir().mkpath(m_rootPath + "/objects");
+    QDir().mkpath(m_rootPath + "/derived");
+
+    QMutexLocker locker(&m_mutex);
+    loadIndex();
+    // 上次运行中添加但没有发送的附件不再需要。回收要遍历整个目录，
+    // 放到后台线程中进行，不推迟第一帧
+    m_writer.start([this]() {
+        QMutexLocker locker(&m_mutex);
+        int removed = collectGarbageLocked();
+        if (removed > 0) {
+            saveIndex();
+            LOG_INFO(QString("已回收 %1 个未使用的附件").arg(removed));
+        }
+    });
+}
+
+AttachmentStore::~AttachmentStore()
+{
+    // 等待尚未完成的索引写入
+    m_writer.waitForDone();
+}
+
+QString AttachmentStore::defaultRootPath()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/attachments";
+}
+
+QString AttachmentStore::hashOf(const QByteArray& data)
+{
+    return QString::fromLatin1(QCryptographicHash::hash(data, QCryptographicHash::Sha256).toHex());
+}
+
+QString AttachmentStore::blobPath(const QString& hash) const
+{
+    // 按前两位分目录，避免单个目录下文件过多
+    return m_rootPath + "/objects/" + hash.left(2) + "/" + hash;
+}
+
+QString AttachmentStore::derivedPath(const QString& hash, const QString& variant) const
+{
+    return m_rootPath + "/derived/" + hash + "/" + variant;
+}
+
+bool AttachmentStore::writeFile(const QString& path, const QByteArray& data)
+{
+    QDir().mkpath(QFileInfo(path).absolutePath());
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        LOG_ERROR(QString("无法写入附件 %1: %2").arg(path, file.errorString()));
+        return false;
+    }
+    file.write(data);
+    if (!file.commit()) {
+        LOG_ERROR(QString("无法写入附件 %1: %2").arg(path, file.errorString()));
+        return false;
+    }
+    return true;
+}
+
+QString AttachmentStore::put(const QByteArray& data)
+{
+    QString hash = hashOf(data);
+
+    // 先保留，写入期间回收不会删除这个文件
+    {
+        QMutexLocker locker(&m_mutex);
+        ++m_pins[hash];
+        if (m_entries.contains(hash) && QFile::exists(blobPath(hash))) {
+            return hash;
+        }
+    }
+
+    // 在锁外写入。内容相同的文件写入结果也相同，并发写入同一个哈希不会出错
+    if (!writeFile(blobPath(hash), data)) {
+        return hash;
+    }
+
+    QMutexLocker locker(&m_mutex);
+    Entry& entry = m_entries[hash];
+    entry.size = data.size();
+    saveIndex();
+    return hash;
+}
+
+void AttachmentStore::unpin(const QString& hash)
+{
+    QMutexLocker locker(&m_mutex);
+    auto it = m_pins.find(hash);
+    if (it != m_pins.end() && --it.value() <= 0) {
+        m_pins.erase(it);
+    }
+}
+
+bool AttachmentStore::contains(const QString& hash) const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_entries.contains(hash);
+}
+
+QByteArray AttachmentStore::blob(const QString& hash) const
+{
+    QFile file(blobPath(hash));
+    return file.open(QIODevice::ReadOnly) ? file.readAll() : QByteArray();
+}
+
+QJsonObject AttachmentStore::properties(const QString& hash) const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_entries.value(hash).properties;
+}
+
+void AttachmentStore::setProperties(const QString& hash, const QJsonObject& properties)
+{
+    QMutexLocker locker(&m_mutex);
+    auto it = m_entries.find(hash);
+    if (it == m_entries.end() || it->properties == properties) {
+        return;
+    }
+    it->properties = properties;
+    saveIndex();
+}
+
+QByteArray AttachmentStore::derived(const QString& hash, const QString& variant) const
+{
+    QFile file(derivedPath(hash, variant));
+    return file.open(QIODevice::ReadOnly) ? file.readAll() : QByteArray();
+}
+
+void AttachmentStore::putDerived(const QString& hash, const QString& variant, const QByteArray& data)
+{
+    if (data.isEmpty() || !contains(hash)) {
+        return;
+    }
+    writeFile(derivedPath(hash, variant), data);
+}
+
+void AttachmentStore::addReference(const QString& hash, const QString& conversationId)
+{
+    if (hash.isEmpty() || conversationId.isEmpty()) {
+        return;
+    }
+
+    QMutexLocker locker(&m_mutex);
+    auto it = m_entries.find(hash);
+    if (it == m_entries.end() || it->references.contains(conversationId)) {
+        return;
+    }
+    it->references.insert(conversationId);
+    saveIndex();
+}
+
+void AttachmentStore::releaseConversation(const QString& conversationId)
+{
+    QMutexLocker locker(&m_mutex);
+    bool changed = false;
+    for (Entry& entry : m_entries) {
+        changed |= entry.references.remove(conversationId);
+    }
+    if (!changed) {
+        return;
+    }
+
+    int removed = collectGarbageLocked();
+    saveIndex();
+    LOG_INFO(QString("对话 %1 已删除，回收 %2 个附件").arg(conversationId).arg(removed));
+}
+
+int AttachmentStore::collectGarbage()
+{
+    QMutexLocker locker(&m_mutex);
+    int removed = collectGarbageLocked();
+    if (removed > 0) {
+        saveIndex();
+    }
+    return removed;
+}
+
+int AttachmentStore::collectGarbageLocked()
+{
+    int removed = 0;
+    for (auto it = m_entries.begin(); it != m_entries.end();) {
+        if (!it->references.isEmpty() || m_pins.contains(it.key())) {
+            ++it;
+            continue;
+        }
+        QFile::remove(blobPath(it.key()));
+        QDir(m_rootPath + "/derived/" + it.key()).removeRecursively();
+        it = m_entries.erase(it);
+        ++removed;
+    }
+
+    // 写入文件后、保存索引前退出时会留下索引中没有的文件
+    const QStringList buckets = QDir(m_rootPath + "/objects").entryList(QDir::Dirs | QDir::NoDotAndDotDot);
+    for (const QString& bucket : buckets) {
+        QDir dir(m_rootPath + "/objects/" + bucket);
+        for (const QString& name : dir.entryList(QDir::Files)) {
+            if (!m_entries.contains(name) && !m_pins.contains(name)) {
+                dir.remove(name);
+            }
+        }
+    }
+    const QStringList derivedDirs = QDir(m_rootPath + "/derived").entryList(QDir::Dirs | QDir::NoDotAndDotDot);
+    for (const QString& hash : derivedDirs) {
+        if (!m_entries.contains(hash) && !m_pins.contains(hash)) {
+            QDir(m_rootPath + "/derived/" + hash).removeRecursively();
+        }
+    }
+    return removed;
+}
+
+void AttachmentStore::loadIndex()
+{
+    QFile file(m_rootPath + "/index.json");
+    if (!file.open(QIODevice::ReadOnly)) {
+        return;
+    }
+
+    const QJsonObject index = QJsonDocument::fromJson(file.readAll()).object();
+    for (auto it = index.begin(); it != index.end(); ++it) {
+        const QJsonObject value = it.value().toObject();
+        Entry entry;
+        entry.size = qint64(value["size"].toDouble());
+        for (const QJsonValue& reference : value["references"].toArray()) {
+            entry.references.insert(reference.toString());
+        }
+        entry.properties = value["properties"].toObject();
+        m_entries.insert(it.key(), entry);
+    }
+}
+
+void AttachmentStore::saveIndex()
+{
+    if (m_saveQueued) {
+        return;
+    }
+    m_saveQueued = true;
+    m_writer.start([this]() {
+        writeIndex();
+    });
+}
+
+void AttachmentStore::writeIndex()
+{
+    // 取出当前索引后立即释放锁，序列化和写文件不阻塞其他线程的修改
+    QHash<QString, Entry> entries;
+    {
+        QMutexLocker locker(&m_mutex);
+        m_saveQueued = false;
+        entries = m_entries;
+    }
+
+    QJsonObject index;
+    for (auto it = entries.cbegin(); it != entries.cend(); ++it) {
+        QJsonObject value;
+        value["size"] = double(it->size);
+        QJsonArray references;
+        for (const QString& reference : it->references) {
+            references.append(reference);
+        }
+        value["references"] = references;
+        if (!it->properties.isEmpty()) {
+            value["properties"] = it->properties;
+        }
+        index[it.key()] = value;
+    }
+
+    QSaveFile file(m_rootPath + "/index.json");
+    if (file.open(QIODevice::WriteOnly)) {
+        file.write(QJsonDocument(index).toJson(QJsonDocument::Compact));
+        if (!file.commit()) {
+            LOG_ERROR(QString("无法保存附件索引: %1").arg(file.errorString()));
+        }
+    }
+}
@@ -0,0 +1,83 @@
+#ifndef ATTACHMENTSTORE_H
+#define ATTACHMENTSTORE_H
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QHash>
+#include <QSet>
+#include <QJsonObject>
+#include <QMutex>
+#include <QThreadPool>
+
+/**
+ * @brief 按内容寻址的附件存储
+ *
+ * 附件原文件以 SHA-256 命名保存一份，同一内容在多个对话中重复添加时
+ * 不再重复保存。缩略图、按服务商缩放后的编码等派生数据和原文件放在一起，
+ * 再次添加同一附件时只需计算一次哈希即可复用。
+ *
+ * 每个附件记录引用它的对话，对话删除后没有任何引用的附件会被回收。
+ * 尚未发送的附件由调用方临时保留，回收时跳过。所有方法都可以在任意线程调用。
+ *
+ * 索引文件在后台线程中重写，写入开始前的多次修改合并为一次，修改时不必
+ * 持有锁等待整个索引序列化和落盘。
+ */
+class AttachmentStore : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit AttachmentStore(const QString& rootPath = QString(), QObject *parent = nullptr);
+    ~AttachmentStore();
+
+    static QString defaultRootPath();
+    static QString hashOf(const QByteArray& data);
+
+    // 保存 data 并返回其哈希。内容已存在时不再写入。
+    // 返回的附件会被临时保留，直到调用 unpin
+    QString put(const QByteArray& data);
+    void unpin(const QString& hash);
+    bool contains(const QString& hash) const;
+    QByteArray blob(const QString& hash) const;
+
+    // 附件的附加信息，如图片尺寸和格式
+    QJsonObject properties(const QString& hash) const;
+    void setProperties(const QString& hash, const QJsonObject& properties);
+
+    // 派生数据，variant 区分用途，如 "thumb-600"、"jpeg-2048-q85"
+    QByteArray derived(const QString& hash, const QString& variant) const;
+    void putDerived(const QString& hash, const QString& variant, const QByteArray& data);
+
+    void addReference(const QString& hash, const QString& conversationId);
+    // 对话删除后移除它的引用并回收不再使用的附件
+    void releaseConversation(const QString& conversationId);
+    // 删除没有引用也没有被临时保留的附件，返回删除的数量
+    int collectGarbage();
+
+private:
+    struct Entry {
+        qint64 size = 0;
+        QSet<QString> references;
+        QJsonObject properties;
+    };
+
+    QString blobPath(const QString& hash) const;
+    QString derivedPath(const QString& hash, const QString& variant) const;
+    static bool writeFile(const QString& path, const QByteArray& data);
+    void loadIndex();
+    // 安排一次后台写入，调用时必须持有 m_mutex
+    void saveIndex();
+    // 在后台线程中执行，写入当前的索引
+    void writeIndex();
+    int collectGarbageLocked();
+
+    QString m_rootPath;
+    mutable QMutex m_mutex;
+    QHash<QString, Entry> m_entries;
+    QHash<QString, int> m_pins;
+    bool m_saveQueued = false;  // 已有尚未开始的写入，新的修改由它一并写入
+    QThreadPool m_writer;       // 单线程，写入按提交顺序进行
+};
+
+#endif // ATTACHMENTSTORE_H
@@ -0,0 +1,204 @@
+#include "autosaveengine.h"
+#include <QElapsedTimer>
+#include "services/logger.h"
+
+namespace {
+// 流式回答输出期间，检查点间隔不超过该值
+const int kStreamCheckpointMs = 5000;
+// 从第一条用户消息截取的标题长度
+const int kTitleLength = 30;
+}
+
+AutoSaveEngine::AutoSaveEngine(ChatModel* model, SettingsModel* settings, QObject *parent)
+    : QObject(parent)
+    , m_model(model)
+    , m_settings(settings)
+{
+    // 单线程保证日志记录按提交顺序写入
+    m_writer.setMaxThreadCount(1);
+
+    m_timer.setSingleShot(true);
+    connect(&m_timer, &QTimer::timeout, this, &AutoSaveEngine::flush);
+
+    connect(m_model, &ChatModel::messageAdded, this, &AutoSaveEngine::onMessageAdded);
+    connect(m_model, &ChatModel::messageAppended, this, &AutoSaveEngine::onMessageAppended);
+    connect(m_model, &ChatModel::messageFinished, this, &AutoSaveEngine::onMessageFinished);
+    connect(m_model, &ChatModel::messagesReset, this, &AutoSaveEngine::onMessagesReset);
+
+    connect(m_settings, &SettingsModel::autoSaveChanged, this, &AutoSaveEngine::updateInterval);
+    connect(m_settings, &SettingsModel::saveIntervalChanged, this, &AutoSaveEngine::updateInterval);
+}
+
+AutoSaveEngine::~AutoSaveEngine()
+{
+    m_timer.stop();
+    m_writer.waitForDone();
+}
+
+void AutoSaveEngine::setConversation(const QSharedPointer<ConversationFile>& file)
+{
+    m_timer.stop();
+    m_pending.clear();
+    m_file = file;
+}
+
+void AutoSaveEngine::onMessageAdded(int index)
+{
+    m_pending[index].added = true;
+    scheduleFlush();
+}
+
+void AutoSaveEngine::onMessageAppended(int index, const QString& delta)
+{
+    PendingChange& change = m_pending[index];
+    // 新消息在提交时整体快照，不需要单独记录片段
+    if (!change.added) {
+        change.delta += delta;
+    }
+    scheduleFlush();
+}
+
+void AutoSaveEngine::onMessageFinished(int index)
+{
+    m_pending[index].finished = true;
+    // 回答结束是天然的检查点，开启自动保存时立即保存，
+    // 否则与其他变化一样等到切换对话或退出时再写入
+    if (m_settings->autoSave()) {
+        flush();
+    }
+}
+
+void AutoSaveEngine::onMessagesReset()
+{
+    // 载入历史或清空后，尚未提交的序号已经失效
+    m_timer.stop();
+    m_pending.clear();
+}
+
+void AutoSaveEngine::updateInterval()
+{
+    if (!m_settings->autoSave()) {
+        m_timer.stop();
+        return;
+    }
+    if (!m_pending.isEmpty()) {
+        m_timer.stop();
+        scheduleFlush();
+    }
+}
+
+bool AutoSaveEngine::hasStreamingChanges() const
+{
+    for (auto it = m_pending.cbegin(); it != m_pending.cend(); ++it) {
+        if (!it.value().finished && m_model->isLoaded(it.key())
+            && !m_model->messageAt(it.key()).complete) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void AutoSaveEngine::scheduleFlush()
+{
+    // 关闭自动保存时只在切换对话和退出时保存
+    if (!m_settings->autoSave() || m_timer.isActive()) {
+        return;
+    }
+
+    int interval = qMax(1, m_settings->saveInterval()) * 1000;
+    if (hasStreamingChanges()) {
+        interval = qMin(interval, kStreamCheckpointMs);
+    }
+    m_timer.start(interval);
+}
+
+void AutoSaveEngine::flush()
+{
+    m_timer.stop();
+    if (m_pending.isEmpty() || !m_file) {
+        return;
+    }
+
+    // 在界面线程生成快照，后台线程只负责写入
+    QList<WriteOp> ops;
+    ops.reserve(m_pending.size());
+    for (auto it = m_pending.cbegin(); it != m_pending.cend(); ++it) {
+        if (!m_model->isLoaded(it.key())) {
+            continue;
+        }
+        WriteOp op;
+        op.index = it.key();
+        op.added = it.value().added;
+        if (op.added) {
+            op.message = m_model->messageAt(op.index);
+        } else {
+            op.delta = it.value().delta;
+            op.finished = it.value().finished;
+            if (op.finished) {
+                op.metrics = m_model->messageAt(op.index).metrics;
+            }
+        }
+        ops.append(op);
+    }
+    m_pending.clear();
+
+    if (ops.isEmpty()) {
+        return;
+    }
+
+    QSharedPointer<ConversationFile> file = m_file;
+    m_writer.start([this, file, ops]() {
+        writeBatch(file, ops);
+    });
+}
+
+void AutoSaveEngine::flushAndWait()
+{
+    flush();
+    m_writer.waitForDone();
+}
+
+void AutoSaveEngine::writeBatch(const QSharedPointer<ConversationFile>& file, const QList<WriteOp>& ops)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    int records = 0;
+    bool ok = true;
+    for (const WriteOp& op : ops) {
+        if (op.added) {
+            ok = file->appendMessage(op.index, op.message);
+            ++records;
+            if (ok && op.message.role == "user" && file->title().isEmpty()) {
+                file->setTitle(op.message.content.simplified().left(kTitleLength));
+            }
+        } else {
+            if (ok && !op.delta.isEmpty()) {
+                ok = file->appendDelta(op.index, op.delta);
+                ++records;
+            }
+            if (ok && op.finished) {
+                ok = file->finishMessage(op.index, op.metrics);
+                ++records;
+            }
+        }
+        if (!ok) {
+            break;
+        }
+    }
+
+    if (!ok) {
+        QString error = tr("自动保存失败: %1").arg(file->lastError());
+        LOG_ERROR(error);
+        emit errorOccurred(error);
+        return;
+    }
+
+    if (file->needsCompaction()) {
+        file->compact();
+    }
+
+    qint64 elapsed = timer.elapsed();
+    LOG_DEBUG(QString("自动保存 %1 条记录，耗时 %2 ms").arg(records).arg(elapsed));
+    emit saved(records, elapsed);
+}
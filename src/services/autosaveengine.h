@@ -0,0 +1,78 @@
+#ifndef AUTOSAVEENGINE_H
+#define AUTOSAVEENGINE_H
+
+#include <QObject>
+#include <QMap>
+#include <QTimer>
+#include <QThreadPool>
+#include <QSharedPointer>
+#include "models/chatmodel.h"
+#include "models/settingsmodel.h"
+#include "services/conversationfile.h"
+
+/**
+ * @brief 自动保存引擎
+ *
+ * 跟踪 ChatModel 的增量变化（新消息、流式片段、完成标记），按设置中的
+ * autoSave / saveInterval 定时把变化写入当前对话的日志。写入在单线程的
+ * 后台线程池中按顺序执行，不阻塞界面。流式回答在输出过程中也会定期
+ * 保存检查点，回答结束时立即保存。
+ */
+class AutoSaveEngine : public QObject
+{
+    Q_OBJECT
+
+public:
+    AutoSaveEngine(ChatModel* model, SettingsModel* settings, QObject *parent = nullptr);
+    ~AutoSaveEngine();
+
+    // 切换目标对话，调用前应先 flushAndWait() 写完上一个对话
+    void setConversation(const QSharedPointer<ConversationFile>& file);
+    bool hasPendingChanges() const { return !m_pending.isEmpty(); }
+
+public slots:
+    // 把当前的变化提交给后台线程
+    void flush();
+    // 提交并等待所有写入完成，用于切换对话和退出
+    void flushAndWait();
+
+signals:
+    void saved(int records, qint64 elapsedMs);
+    void errorOccurred(const QString& error);
+
+private slots:
+    void onMessageAdded(int index);
+    void onMessageAppended(int index, const QString& delta);
+    void onMessageFinished(int index);
+    void onMessagesReset();
+    void updateInterval();
+
+private:
+    struct PendingChange {
+        bool added = false;
+        QString delta;
+        bool finished = false;
+    };
+
+    struct WriteOp {
+        int index = 0;
+        bool added = false;
+        ChatModel::Message message;
+        QString delta;
+        bool finished = false;
+        QJsonObject metrics;
+    };
+
+    void scheduleFlush();
+    bool hasStreamingChanges() const;
+    void writeBatch(const QSharedPointer<ConversationFile>& file, const QList<WriteOp>& ops);
+
+    ChatModel* m_model;
+    SettingsModel* m_settings;
+    QSharedPointer<ConversationFile> m_file;
+    QMap<int, PendingChange> m_pending;
+    QTimer m_timer;
+    QThreadPool m_writer;
+};
+
+#endif // AUTOSAVEENGINE_H
@@ -0,0 +1,678 @@
+#include "conversationfile.h"
+#include <QDir>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QDataStream>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutexLocker>
+#include <QtEndian>
+#include "services/logger.h"
+
+namespace {
+
+const quint32 kJournalMagic = 0x4A474443;  // "CDGJ"
+const quint32 kIndexMagic = 0x58494443;    // "CDIX"
+const quint32 kFormatVersion = 1;
+const quint8 kMessageVersion = 3;  // 2: 增加 metrics，3: 增加 attachments
+
+const qint64 kJournalHeaderSize = 8;
+const qint64 kFrameHeaderSize = 6;         // 长度(4) + 校验(2)
+const qint64 kIndexHeaderSize = 16;
+const qint64 kIndexEntrySize = 16;         // 偏移(8) + 长度(4) + 保留(4)
+
+// 日志超过这些阈值时进行压缩
+const int kCompactRecordThreshold = 256;
+const qint64 kCompactSizeThreshold = 1024 * 1024;
+
+QByteArray serializeMessage(const ChatModel::Message& message)
+{
+    QByteArray data;
+    QDataStream out(&data, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_6_0);
+    out << kMessageVersion
+        << message.role
+        << message.content
+        << message.timestamp
+        << message.model
+        << message.complete
+        << QJsonDocument(message.metrics).toJson(QJsonDocument::Compact)
+        << message.attachments;
+    return data;
+}
+
+bool deserializeMessage(const QByteArray& data, ChatModel::Message& message)
+{
+    QDataStream in(data);
+    in.setVersion(QDataStream::Qt_6_0);
+    quint8 version = 0;
+    in >> version;
+    if (version == 0 || version > kMessageVersion) {
+        return false;
+    }
+    in >> message.role >> message.content >> message.timestamp >> message.model >> message.complete;
+    if (version >= 2) {
+        QByteArray metrics;
+        in >> metrics;
+        message.metrics = QJsonDocument::fromJson(metrics).object();
+    }
+    if (version >= 3) {
+        in >> message.attachments;
+    }
+    return in.status() == QDataStream::Ok;
+}
+
+QByteArray headerBytes(quint32 magic, quint32 version)
+{
+    QByteArray header(kJournalHeaderSize, Qt::Uninitialized);
+    qToLittleEndian<quint32>(magic, header.data());
+    qToLittleEndian<quint32>(version, header.data() + 4);
+    return header;
+}
+
+QByteArray frameRecord(quint8 type, int index, const QByteArray& body)
+{
+    QByteArray payload;
+    payload.reserve(5 + body.size());
+    payload.append(char(type));
+    char indexBytes[4];
+    qToLittleEndian<qint32>(index, indexBytes);
+    payload.append(indexBytes, 4);
+    payload.append(body);
+
+    QByteArray frame(kFrameHeaderSize, Qt::Uninitialized);
+    qToLittleEndian<quint32>(quint32(payload.size()), frame.data());
+    qToLittleEndian<quint16>(qChecksum(payload), frame.data() + 4);
+    frame.append(payload);
+    return frame;
+}
+
+} // namespace
+
+ConversationFile::ConversationFile(const QString& dirPath)
+    : m_dirPath(dirPath)
+{
+}
+
+ConversationFile::~ConversationFile()
+{
+    close();
+}
+
+QString ConversationFile::id() const
+{
+    return QFileInfo(m_dirPath).fileName();
+}
+
+QString ConversationFile::lastError() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_lastError;
+}
+
+bool ConversationFile::isOpen() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_journal.isOpen();
+}
+
+bool ConversationFile::open()
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_journal.isOpen()) {
+        return true;
+    }
+
+    if (!m_readOnly && !QDir().mkpath(m_dirPath)) {
+        m_lastError = QString("无法创建对话目录: %1").arg(m_dirPath);
+        LOG_ERROR(m_lastError);
+        return false;
+    }
+
+    loadMeta();
+
+    if (!mapIndex()) {
+        return false;
+    }
+
+    m_dataFile.setFileName(m_dirPath + "/messages.dat");
+    if (m_dataFile.exists() && !m_dataFile.open(QIODevice::ReadOnly)) {
+        m_lastError = QString("无法打开消息数据文件: %1").arg(m_dataFile.errorString());
+        LOG_ERROR(m_lastError);
+        return false;
+    }
+
+    if (!openJournal() || !replayJournal()) {
+        return false;
+    }
+
+    LOG_INFO(QString("已打开对话 %1，已压缩 %2 条，日志中 %3 条")
+        .arg(id())
+        .arg(m_compactedCount)
+        .arg(m_tail.size()));
+    return true;
+}
+
+bool ConversationFile::openReadOnly()
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        if (m_journal.isOpen()) {
+            return m_readOnly;
+        }
+        m_readOnly = true;
+    }
+    return open();
+}
+
+void ConversationFile::close()
+{
+    QMutexLocker locker(&m_mutex);
+    if (!m_journal.isOpen()) {
+        return;
+    }
+
+    m_journal.close();
+    if (!m_readOnly) {
+        saveMeta();
+    }
+    unmapIndex();
+    m_dataFile.close();
+    m_tail.clear();
+    m_compactedCount = 0;
+    m_journalRecords = 0;
+}
+
+QString ConversationFile::title() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_title;
+}
+
+void ConversationFile::setTitle(const QString& title)
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_title != title) {
+        m_title = title;
+        if (!m_readOnly) {
+            saveMeta();
+        }
+    }
+}
+
+QDateTime ConversationFile::createdTime() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_created;
+}
+
+QDateTime ConversationFile::updatedTime() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_updated;
+}
+
+int ConversationFile::messageCount() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_compactedCount + m_tail.size();
+}
+
+ChatModel::Message ConversationFile::readMessage(int index) const
+{
+    QMutexLocker locker(&m_mutex);
+    if (index < 0 || index >= m_compactedCount + m_tail.size()) {
+        return ChatModel::Message();
+    }
+    if (index < m_compactedCount) {
+        return readCompacted(index);
+    }
+    return m_tail.at(index - m_compactedCount);
+}
+
+QList<ChatModel::Message> ConversationFile::readMessages(int first, int count) const
+{
+    QMutexLocker locker(&m_mutex);
+    QList<ChatModel::Message> result;
+    int total = m_compactedCount + m_tail.size();
+    first = qBound(0, first, total);
+    int last = qMin(total, first + qMax(0, count));
+    result.reserve(last - first);
+
+    for (int i = first; i < last; ++i) {
+        if (i < m_compactedCount) {
+            result.append(readCompacted(i));
+        } else {
+            result.append(m_tail.at(i - m_compactedCount));
+        }
+    }
+    return result;
+}
+
+bool ConversationFile::appendMessage(int index, const ChatModel::Message& message)
+{
+    QMutexLocker locker(&m_mutex);
+    QByteArray body = serializeMessage(message);
+    if (!writeRecord(MessageRecord, index, body)) {
+        return false;
+    }
+    applyRecord(MessageRecord, index, body);
+    return true;
+}
+
+bool ConversationFile::appendDelta(int index, const QString& delta)
+{
+    QMutexLocker locker(&m_mutex);
+    QByteArray body = delta.toUtf8();
+    if (!writeRecord(DeltaRecord, index, body)) {
+        return false;
+    }
+    applyRecord(DeltaRecord, index, body);
+    return true;
+}
+
+bool ConversationFile::finishMessage(int index, const QJsonObject& metrics)
+{
+    QMutexLocker locker(&m_mutex);
+    QByteArray body = metrics.isEmpty() ? QByteArray() : QJsonDocument(metrics).toJson(QJsonDocument::Compact);
+    if (!writeRecord(FinishRecord, index, body)) {
+        return false;
+    }
+    applyRecord(FinishRecord, index, body);
+    return true;
+}
+
+QList<int> ConversationFile::recoverInterrupted()
+{
+    QMutexLocker locker(&m_mutex);
+    QList<int> interrupted;
+    for (int i = 0; i < m_tail.size(); ++i) {
+        if (!m_tail.at(i).complete) {
+            int index = m_compactedCount + i;
+            if (writeRecord(FinishRecord, index, QByteArray())) {
+                applyRecord(FinishRecord, index, QByteArray());
+                interrupted.append(index);
+            }
+        }
+    }
+
+    if (!interrupted.isEmpty()) {
+        LOG_WARNING(QString("对话 %1 恢复了 %2 条未完成的回答").arg(id()).arg(interrupted.size()));
+    }
+    return interrupted;
+}
+
+bool ConversationFile::needsCompaction() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_journalRecords >= kCompactRecordThreshold
+        || m_journal.size() >= kCompactSizeThreshold;
+}
+
+bool ConversationFile::compact()
+{
+    QMutexLocker locker(&m_mutex);
+    if (!m_journal.isOpen() || m_readOnly) {
+        return false;
+    }
+    return compactLocked();
+}
+
+bool ConversationFile::openJournal()
+{
+    m_journal.setFileName(m_dirPath + "/journal.bin");
+    if (!m_journal.open(m_readOnly ? QIODevice::ReadOnly : QIODevice::ReadWrite)) {
+        m_lastError = QString("无法打开对话日志: %1").arg(m_journal.errorString());
+        LOG_ERROR(m_lastError);
+        return false;
+    }
+
+    if (m_journal.size() < kJournalHeaderSize) {
+        if (m_readOnly) {
+            m_lastError = QString("对话日志为空: %1").arg(m_journal.fileName());
+            m_journal.close();
+            return false;
+        }
+        m_journal.resize(0);
+        m_journal.write(headerBytes(kJournalMagic, kFormatVersion));
+        m_journal.flush();
+    }
+    return true;
+}
+
+bool ConversationFile::replayJournal()
+{
+    m_journal.seek(0);
+    QByteArray data = m_journal.readAll();
+
+    if (qFromLittleEndian<quint32>(data.constData()) != kJournalMagic) {
+        m_lastError = QString("对话日志格式错误: %1").arg(m_journal.fileName());
+        LOG_ERROR(m_lastError);
+        m_journal.close();
+        return false;
+    }
+
+    qint64 pos = kJournalHeaderSize;
+    qint64 validEnd = pos;
+    m_journalRecords = 0;
+
+    while (pos + kFrameHeaderSize <= data.size()) {
+        quint32 length = qFromLittleEndian<quint32>(data.constData() + pos);
+        quint16 checksum = qFromLittleEndian<quint16>(data.constData() + pos + 4);
+        if (length < 5 || pos + kFrameHeaderSize + length > data.size()) {
+            break;
+        }
+
+        QByteArray payload = data.mid(pos + kFrameHeaderSize, length);
+        if (qChecksum(payload) != checksum) {
+            break;
+        }
+
+        RecordType type = static_cast<RecordType>(quint8(payload.at(0)));
+        int index = qFromLittleEndian<qint32>(payload.constData() + 1);
+        applyRecord(type, index, payload.mid(5));
+
+        ++m_journalRecords;
+        pos += kFrameHeaderSize + length;
+        validEnd = pos;
+    }
+
+    // 丢弃崩溃时写了一半的记录，只读时写入方可能正在追加，不做处理
+    if (validEnd < data.size() && !m_readOnly) {
+        LOG_WARNING(QString("对话日志 %1 末尾有 %2 字节不完整，已截断")
+            .arg(id())
+            .arg(data.size() - validEnd));
+        m_journal.resize(validEnd);
+    }
+
+    m_journal.seek(m_journal.size());
+    return true;
+}
+
+bool ConversationFile::writeRecord(RecordType type, int index, const QByteArray& body)
+{
+    if (!m_journal.isOpen() || m_readOnly) {
+        m_lastError = "对话日志未以写入方式打开";
+        return false;
+    }
+
+    QByteArray frame = frameRecord(type, index, body);
+    if (m_journal.write(frame) != frame.size() || !m_journal.flush()) {
+        m_lastError = QString("写入对话日志失败: %1").arg(m_journal.errorString());
+        LOG_ERROR(m_lastError);
+        return false;
+    }
+
+    ++m_journalRecords;
+    m_updated = QDateTime::currentDateTime();
+    return true;
+}
+
+void ConversationFile::applyRecord(RecordType type, int index, const QByteArray& body)
+{
+    // 已压缩的消息不再接受日志记录（压缩中途崩溃时日志可能还保留着它们）
+    if (index < m_compactedCount) {
+        return;
+    }
+
+    int local = index - m_compactedCount;
+    switch (type) {
+        case MessageRecord: {
+            ChatModel::Message message;
+            if (!deserializeMessage(body, message)) {
+                LOG_WARNING(QString("对话 %1 中的消息 %2 无法解析").arg(id()).arg(index));
+                return;
+            }
+            if (local == m_tail.size()) {
+                m_tail.append(message);
+            } else if (local < m_tail.size()) {
+                m_tail[local] = message;
+            } else {
+                LOG_WARNING(QString("对话 %1 的日志缺少消息 %2 之前的记录").arg(id()).arg(index));
+            }
+            break;
+        }
+        case DeltaRecord:
+            if (local < m_tail.size()) {
+                m_tail[local].content += QString::fromUtf8(body);
+            }
+            break;
+        case FinishRecord:
+            // 版本 1 的完成记录没有内容
+            if (local < m_tail.size()) {
+                m_tail[local].complete = true;
+                if (!body.isEmpty()) {
+                    m_tail[local].metrics = QJsonDocument::fromJson(body).object();
+                }
+            }
+            break;
+    }
+}
+
+bool ConversationFile::mapIndex()
+{
+    m_compactedCount = 0;
+    m_indexFile.setFileName(m_dirPath + "/messages.idx");
+    if (!m_indexFile.exists()) {
+        return true;
+    }
+
+    if (!m_indexFile.open(QIODevice::ReadOnly)) {
+        m_lastError = QString("无法打开消息索引: %1").arg(m_indexFile.errorString());
+        LOG_ERROR(m_lastError);
+        return false;
+    }
+
+    qint64 size = m_indexFile.size();
+    if (size < kIndexHeaderSize) {
+        m_indexFile.close();
+        return true;
+    }
+
+    m_indexMap = m_indexFile.map(0, size);
+    if (!m_indexMap) {
+        m_lastError = QString("无法映射消息索引: %1").arg(m_indexFile.errorString());
+        LOG_ERROR(m_lastError);
+        m_indexFile.close();
+        return false;
+    }
+
+    if (qFromLittleEndian<quint32>(m_indexMap) != kIndexMagic) {
+        m_lastError = QString("消息索引格式错误: %1").arg(m_indexFile.fileName());
+        LOG_ERROR(m_lastError);
+        unmapIndex();
+        return false;
+    }
+
+    // 头部中的数量是提交点，之后的条目属于未完成的压缩
+    quint32 count = qFromLittleEndian<quint32>(m_indexMap + 8);
+    qint64 available = (size - kIndexHeaderSize) / kIndexEntrySize;
+    m_compactedCount = int(qMin<qint64>(count, available));
+    return true;
+}
+
+void ConversationFile::unmapIndex()
+{
+    if (m_indexMap) {
+        m_indexFile.unmap(m_indexMap);
+        m_indexMap = nullptr;
+    }
+    m_indexFile.close();
+}
+
+ChatModel::Message ConversationFile::readCompacted(int index) const
+{
+    ChatModel::Message message;
+    if (!m_indexMap || !m_dataFile.isOpen()) {
+        return message;
+    }
+
+    const uchar* entry = m_indexMap + kIndexHeaderSize + qint64(index) * kIndexEntrySize;
+    quint64 offset = qFromLittleEndian<quint64>(entry);
+    quint32 size = qFromLittleEndian<quint32>(entry + 8);
+
+    if (!m_dataFile.seek(qint64(offset))) {
+        LOG_WARNING(QString("对话 %1 无法定位消息 %2").arg(id()).arg(index));
+        return message;
+    }
+
+    QByteArray data = m_dataFile.read(size);
+    if (data.size() != qint64(size) || !deserializeMessage(data, message)) {
+        LOG_WARNING(QString("对话 %1 的消息 %2 已损坏").arg(id()).arg(index));
+    }
+    return message;
+}
+
+bool ConversationFile::compactLocked()
+{
+    int finished = 0;
+    while (finished < m_tail.size() && m_tail.at(finished).complete) {
+        ++finished;
+    }
+
+    // 没有可合并的消息且日志也不冗余时无需重写
+    if (finished == 0 && m_journalRecords <= m_tail.size()) {
+        return true;
+    }
+
+    qint64 committedEnd = 0;
+    if (m_compactedCount > 0 && m_indexMap) {
+        const uchar* last = m_indexMap + kIndexHeaderSize + qint64(m_compactedCount - 1) * kIndexEntrySize;
+        committedEnd = qint64(qFromLittleEndian<quint64>(last)) + qFromLittleEndian<quint32>(last + 8);
+    }
+
+    unmapIndex();
+    m_dataFile.close();
+
+    // 任何一步写入失败都在更新头部数量之前放弃，已写的部分在下次压缩时被覆盖
+    auto fail = [this](const QString& error) {
+        m_lastError = error;
+        LOG_ERROR(m_lastError);
+        mapIndex();
+        m_dataFile.open(QIODevice::ReadOnly);
+        return false;
+    };
+
+    // 1. 追加消息数据，先丢弃上次未提交的部分
+    QByteArray entries;
+    if (finished > 0) {
+        QFile data(m_dirPath + "/messages.dat");
+        if (!data.open(QIODevice::ReadWrite)) {
+            return fail(QString("无法写入消息数据: %1").arg(data.errorString()));
+        }
+        if (!data.resize(committedEnd) || !data.seek(committedEnd)) {
+            return fail(QString("无法写入消息数据: %1").arg(data.errorString()));
+        }
+
+        qint64 offset = committedEnd;
+        entries.resize(finished * kIndexEntrySize);
+        entries.fill(0);
+        for (int i = 0; i < finished; ++i) {
+            QByteArray bytes = serializeMessage(m_tail.at(i));
+            if (data.write(bytes) != bytes.size()) {
+                return fail(QString("无法写入消息数据: %1").arg(data.errorString()));
+            }
+            char* entry = entries.data() + i * kIndexEntrySize;
+            qToLittleEndian<quint64>(quint64(offset), entry);
+            qToLittleEndian<quint32>(quint32(bytes.size()), entry + 8);
+            offset += bytes.size();
+        }
+        if (!data.flush()) {
+            return fail(QString("无法写入消息数据: %1").arg(data.errorString()));
+        }
+        data.close();
+
+        // 2. 追加索引条目，最后更新头部数量作为提交点
+        QFile index(m_dirPath + "/messages.idx");
+        if (!index.open(QIODevice::ReadWrite)) {
+            return fail(QString("无法写入消息索引: %1").arg(index.errorString()));
+        }
+        if (index.size() < kIndexHeaderSize) {
+            QByteArray header(kIndexHeaderSize, 0);
+            qToLittleEndian<quint32>(kIndexMagic, header.data());
+            qToLittleEndian<quint32>(kFormatVersion, header.data() + 4);
+            if (!index.resize(0) || index.write(header) != header.size()) {
+                return fail(QString("无法写入消息索引: %1").arg(index.errorString()));
+            }
+        }
+        qint64 entriesStart = kIndexHeaderSize + qint64(m_compactedCount) * kIndexEntrySize;
+        if (!index.resize(entriesStart) || !index.seek(entriesStart)
+            || index.write(entries) != entries.size() || !index.flush()) {
+            return fail(QString("无法写入消息索引: %1").arg(index.errorString()));
+        }
+
+        char countBytes[4];
+        qToLittleEndian<quint32>(quint32(m_compactedCount + finished), countBytes);
+        if (!index.seek(8) || index.write(countBytes, 4) != 4 || !index.flush()) {
+            return fail(QString("无法提交消息索引: %1").arg(index.errorString()));
+        }
+        index.close();
+
+        m_compactedCount += finished;
+        m_tail.remove(0, finished);
+    }
+
+    // 3. 用剩余的消息重写日志。失败时原日志保持不变，其中已压缩的记录在载入时会被跳过
+    m_journal.close();
+    QSaveFile journal(m_dirPath + "/journal.bin");
+    bool rewritten = journal.open(QIODevice::WriteOnly)
+        && journal.write(headerBytes(kJournalMagic, kFormatVersion)) == kJournalHeaderSize;
+    for (int i = 0; rewritten && i < m_tail.size(); ++i) {
+        QByteArray frame = frameRecord(MessageRecord, m_compactedCount + i, serializeMessage(m_tail.at(i)));
+        rewritten = journal.write(frame) == frame.size();
+    }
+    rewritten = rewritten && journal.commit();
+    if (!rewritten) {
+        m_lastError = QString("重写对话日志失败: %1").arg(journal.errorString());
+        LOG_ERROR(m_lastError);
+        journal.cancelWriting();
+    }
+
+    if (!m_journal.open(QIODevice::ReadWrite) || !m_journal.seek(m_journal.size())) {
+        return fail(QString("无法打开对话日志: %1").arg(m_journal.errorString()));
+    }
+    if (rewritten) {
+        m_journalRecords = m_tail.size();
+    }
+
+    bool ok = mapIndex() && rewritten;
+    m_dataFile.open(QIODevice::ReadOnly);
+    saveMeta();
+
+    LOG_INFO(QString("对话 %1 压缩完成，已压缩 %2 条，剩余 %3 条")
+        .arg(id())
+        .arg(m_compactedCount)
+        .arg(m_tail.size()));
+    return ok;
+}
+
+void ConversationFile::loadMeta()
+{
+    QFile file(m_dirPath + "/meta.json");
+    if (file.open(QIODevice::ReadOnly)) {
+        QJsonObject meta = QJsonDocument::fromJson(file.readAll()).object();
+        m_title = meta["title"].toString();
+        m_created = QDateTime::fromString(meta["created"].toString(), Qt::ISODate);
+        m_updated = QDateTime::fromString(meta["updated"].toString(), Qt::ISODate);
+    }
+    if (!m_created.isValid()) {
+        m_created = QDateTime::currentDateTime();
+    }
+    if (!m_updated.isValid()) {
+        m_updated = m_created;
+    }
+}
+
+void ConversationFile::saveMeta()
+{
+    QJsonObject meta;
+    meta["title"] = m_title;
+    meta["created"] = m_created.toString(Qt::ISODate);
+    meta["updated"] = m_updated.toString(Qt::ISODate);
+
+    QSaveFile file(m_dirPath + "/meta.json");
+    if (file.open(QIODevice::WriteOnly)) {
+        file.write(QJsonDocument(meta).toJson(QJsonDocument::Compact));
+        file.commit();
+    }
+}
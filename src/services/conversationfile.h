@@ -0,0 +1,97 @@
+#ifndef CONVERSATIONFILE_H
+#define CONVERSATIONFILE_H
+
+#include <QString>
+#include <QList>
+#include <QFile>
+#include <QMutex>
+#include <QDateTime>
+#include "models/chatmodel.h"
+
+/**
+ * @brief 单个对话的持久化文件
+ *
+ * 目录结构:
+ *   journal.bin   追加写日志，每条记录带长度和校验，崩溃后截断到最后一条完整记录
+ *   messages.dat  压缩后的消息数据
+ *   messages.idx  定长索引（偏移 + 长度），可以按序号直接定位任意消息
+ *   meta.json     标题、创建和更新时间
+ *
+ * 已压缩的消息只在需要时从 messages.dat 读取，日志中的消息常驻内存。
+ * 所有公开方法都是线程安全的。
+ */
+class ConversationFile
+{
+public:
+    explicit ConversationFile(const QString& dirPath);
+    ~ConversationFile();
+
+    bool open();
+    // 只读打开，不修改任何文件，可以与写入方同时打开同一个对话
+    bool openReadOnly();
+    void close();
+    bool isOpen() const;
+
+    QString id() const;
+    QString path() const { return m_dirPath; }
+    QString lastError() const;
+
+    QString title() const;
+    void setTitle(const QString& title);
+    QDateTime createdTime() const;
+    QDateTime updatedTime() const;
+
+    int messageCount() const;
+    ChatModel::Message readMessage(int index) const;
+    QList<ChatModel::Message> readMessages(int first, int count) const;
+
+    // 日志写入，index 为消息在对话中的序号
+    bool appendMessage(int index, const ChatModel::Message& message);
+    bool appendDelta(int index, const QString& delta);
+    bool finishMessage(int index, const QJsonObject& metrics = QJsonObject());
+
+    // 将上次异常退出时未完成的流式消息标记为完成，返回这些消息的序号
+    QList<int> recoverInterrupted();
+
+    // 将日志中已完成的消息合并到索引文件
+    bool needsCompaction() const;
+    bool compact();
+
+private:
+    enum RecordType : quint8 {
+        MessageRecord = 1,
+        DeltaRecord = 2,
+        FinishRecord = 3
+    };
+
+    bool openJournal();
+    bool replayJournal();
+    bool writeRecord(RecordType type, int index, const QByteArray& body);
+    bool mapIndex();
+    void unmapIndex();
+    ChatModel::Message readCompacted(int index) const;
+    void applyRecord(RecordType type, int index, const QByteArray& body);
+    void loadMeta();
+    void saveMeta();
+    bool compactLocked();
+
+    QString m_dirPath;
+    QString m_lastError;
+    mutable QMutex m_mutex;
+    bool m_readOnly = false;
+
+    QFile m_journal;
+    mutable QFile m_dataFile;
+    QFile m_indexFile;
+    uchar* m_indexMap = nullptr;
+
+    int m_compactedCount = 0;
+    QList<ChatModel::Message> m_tail;  // 序号 >= m_compactedCount 的消息
+    int m_journalRecords = 0;
+
+    QString m_title;
+    QDateTime m_created;
+    QDateTime m_updated;
+};
+
+#endif // CONVERSATIONFILE_H
@@ -0,0 +1,133 @@
+#include "conversationstore.h"
+#include <QDir>
+#include <QUuid>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QStandardPaths>
+#include <algorithm>
+#include "services/logger.h"
+
+ConversationStore::ConversationStore(const QString& rootPath, QObject *parent)
+    : QObject(parent)
+    , m_rootPath(rootPath.isEmpty() ? defaultRootPath() : rootPath)
+{
+    QDir().mkpath(m_rootPath);
+}
+
+ConversationStore::~ConversationStore()
+{
+    closeConversation();
+}
+
+QString ConversationStore::defaultRootPath()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/conversations";
+}
+
+QString ConversationStore::conversationPath(const QString& id) const
+{
+    return m_rootPath + "/" + id;
+}
+
+QString ConversationStore::currentConversationId() const
+{
+    return m_current ? m_current->id() : QString();
+}
+
+QString ConversationStore::createConversation()
+{
+    QString id = QDateTime::currentDateTime().toString("yyyyMMdd-hhmmss-")
+        + QUuid::createUuid().toString(QUuid::Id128).left(8);
+    if (!QDir().mkpath(conversationPath(id))) {
+        emit errorOccurred(tr("无法创建对话目录"));
+        return QString();
+    }
+    LOG_INFO(QString("创建新对话: %1").arg(id));
+    return id;
+}
+
+bool ConversationStore::hasConversation(const QString& id) const
+{
+    return !id.isEmpty() && QDir(conversationPath(id)).exists();
+}
+
+bool ConversationStore::openConversation(const QString& id)
+{
+    if (m_current && m_current->id() == id) {
+        return true;
+    }
+
+    closeConversation();
+
+    QSharedPointer<ConversationFile> file(new ConversationFile(conversationPath(id)));
+    if (!file->open()) {
+        emit errorOccurred(file->lastError());
+        return false;
+    }
+
+    m_current = file;
+    emit conversationOpened(id);
+    return true;
+}
+
+void ConversationStore::closeConversation()
+{
+    if (!m_current) {
+        return;
+    }
+
+    compactIfNeeded();
+    m_current->close();
+    m_current.reset();
+}
+
+bool ConversationStore::removeConversation(const QString& id)
+{
+    if (m_current && m_current->id() == id) {
+        m_current->close();
+        m_current.reset();
+    }
+
+    bool ok = QDir(conversationPath(id)).removeRecursively();
+    if (ok) {
+        LOG_INFO(QString("已删除对话: %1").arg(id));
+        emit conversationRemoved(id);
+    } else {
+        LOG_WARNING(QString("删除对话失败: %1").arg(id));
+    }
+    return ok;
+}
+
+QList<ConversationStore::ConversationInfo> ConversationStore::listConversations() const
+{
+    QList<ConversationInfo> result;
+    const QStringList ids = QDir(m_rootPath).entryList(QDir::Dirs | QDir::NoDotAndDotDot);
+    for (const QString& id : ids) {
+        // 只读取 meta.json，不打开日志和索引
+        QFile metaFile(conversationPath(id) + "/meta.json");
+        if (!metaFile.exists()) {
+            continue;
+        }
+
+        QJsonObject meta = QJsonDocument::fromJson(
+            metaFile.open(QIODevice::ReadOnly) ? metaFile.readAll() : QByteArray()).object();
+        ConversationInfo info;
+        info.id = id;
+        info.title = meta["title"].toString();
+        info.created = QDateTime::fromString(meta["created"].toString(), Qt::ISODate);
+        info.updated = QDateTime::fromString(meta["updated"].toString(), Qt::ISODate);
+        result.append(info);
+    }
+
+    std::sort(result.begin(), result.end(), [](const ConversationInfo& a, const ConversationInfo& b) {
+        return a.updated > b.updated;
+    });
+    return result;
+}
+
+void ConversationStore::compactIfNeeded()
+{
+    if (m_current && m_current->needsCompaction()) {
+        m_current->compact();
+    }
+}
@@ -0,0 +1,58 @@
+#ifndef CONVERSATIONSTORE_H
+#define CONVERSATIONSTORE_H
+
+#include <QObject>
+#include <QString>
+#include <QList>
+#include <QDateTime>
+#include <QSharedPointer>
+#include "models/chatmodel.h"
+#include "services/conversationfile.h"
+
+/**
+ * @brief 对话存储管理
+ *
+ * 管理应用数据目录下的所有对话。消息的写入由 AutoSaveEngine 负责。
+ */
+class ConversationStore : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct ConversationInfo {
+        QString id;
+        QString title;
+        QDateTime created;
+        QDateTime updated;
+    };
+
+    explicit ConversationStore(const QString& rootPath = QString(), QObject *parent = nullptr);
+    ~ConversationStore();
+
+    QString rootPath() const { return m_rootPath; }
+    static QString defaultRootPath();
+
+    QString createConversation();
+    bool openConversation(const QString& id);
+    void closeConversation();
+    bool removeConversation(const QString& id);
+    bool hasConversation(const QString& id) const;
+    QList<ConversationInfo> listConversations() const;
+
+    QSharedPointer<ConversationFile> current() const { return m_current; }
+    QString currentConversationId() const;
+    QString conversationPath(const QString& id) const;
+
+signals:
+    void conversationOpened(const QString& id);
+    void conversationRemoved(const QString& id);
+    void errorOccurred(const QString& error);
+
+private:
+    void compactIfNeeded();
+
+    QString m_rootPath;
+    QSharedPointer<ConversationFile> m_current;
+};
+
+#endif // CONVERSATIONSTORE_H
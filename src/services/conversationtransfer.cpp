@@ -0,0 +1,295 @@
+#include "conversationtransfer.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QtConcurrent/QtConcurrent>
+#include "utils/markdownparser.h"
+#include "services/logger.h"
+
+namespace {
+
+// 每次从对话中读取的消息数
+const int kExportBatch = 128;
+// 导入时每处理这么多条消息报告一次进度
+const int kProgressStep = 64;
+const int kTitleLength = 30;
+
+QJsonObject messageToJson(const ChatModel::Message& message)
+{
+    QJsonObject obj;
+    obj["role"] = message.role;
+    obj["content"] = message.content;
+    obj["timestamp"] = message.timestamp.toString(Qt::ISODateWithMs);
+    if (!message.model.isEmpty()) {
+        obj["model"] = message.model;
+    }
+    if (!message.complete) {
+        obj["complete"] = false;
+    }
+    if (!message.metrics.isEmpty()) {
+        obj["metrics"] = message.metrics;
+    }
+    return obj;
+}
+
+ChatModel::Message messageFromJson(const QJsonObject& obj)
+{
+    ChatModel::Message message;
+    message.role = obj["role"].toString();
+    message.content = obj["content"].toString();
+    message.timestamp = QDateTime::fromString(obj["timestamp"].toString(), Qt::ISODateWithMs);
+    message.model = obj["model"].toString();
+    message.complete = true;  // 导入的消息不会再继续生成
+    message.metrics = obj["metrics"].toObject();
+    return message;
+}
+
+QString speakerName(const ChatModel::Message& message, const QString& aiName)
+{
+    if (message.role == "user") {
+        return QObject::tr("用户");
+    }
+    if (message.role == "system") {
+        return QObject::tr("系统");
+    }
+    return message.model.isEmpty() ? aiName : QString("%1 (%2)").arg(aiName, message.model);
+}
+
+QByteArray headerBytes(ConversationTransfer::Format format, ConversationFile* file)
+{
+    QString title = file->title().isEmpty() ? QObject::tr("未命名对话") : file->title();
+    switch (format) {
+        case ConversationTransfer::Format::JsonLines: {
+            QJsonObject header;
+            header["type"] = "conversation";
+            header["version"] = 1;
+            header["title"] = file->title();
+            header["created"] = file->createdTime().toString(Qt::ISODate);
+            header["updated"] = file->updatedTime().toString(Qt::ISODate);
+            return QJsonDocument(header).toJson(QJsonDocument::Compact) + '\n';
+        }
+        case ConversationTransfer::Format::Markdown:
+            return QString("# %1\n\n").arg(title).toUtf8();
+        case ConversationTransfer::Format::Html:
+            return QString(
+                "<!DOCTYPE html>\n<html>\n<head>\n<meta charset='utf-8'>\n<title>%1</title>\n"
+                "<style>\n"
+                "body { font-family: sans-serif; max-width: 860px; margin: 24px auto; color: #222; }\n"
+                ".message { margin: 12px 0; padding: 10px 14px; border-radius: 10px; }\n"
+                ".user { background: #dcf1ff; }\n"
+                ".assistant { background: #f3f3f3; }\n"
+                ".sender { font-weight: bold; margin-bottom: 6px; }\n"
+                ".timestamp { color: #888; font-weight: normal; font-size: 0.9em; }\n"
+                "pre { background: #272822; color: #f8f8f2; padding: 8px; overflow-x: auto; }\n"
+                "</style>\n</head>\n<body>\n<h1>%1</h1>\n")
+                .arg(title.toHtmlEscaped()).toUtf8();
+    }
+    return QByteArray();
+}
+
+QByteArray messageBytes(ConversationTransfer::Format format, const ChatModel::Message& message,
+                        const QString& aiName)
+{
+    QString time = message.timestamp.toString("yyyy-MM-dd hh:mm:ss");
+    switch (format) {
+        case ConversationTransfer::Format::JsonLines:
+            return QJsonDocument(messageToJson(message)).toJson(QJsonDocument::Compact) + '\n';
+        case ConversationTransfer::Format::Markdown:
+            return QString("### %1 · %2\n\n%3\n\n")
+                .arg(speakerName(message, aiName), time, message.content).toUtf8();
+        case ConversationTransfer::Format::Html:
+            return QString(
+                "<div class='message %1'>\n"
+                "<div class='sender'>%2 <span class='timestamp'>[%3]</span></div>\n"
+                "%4\n</div>\n")
+                .arg(message.role == "user" ? "user" : "assistant",
+                     speakerName(message, aiName).toHtmlEscaped(),
+                     time,
+                     MarkdownParser::toHtml(message.content)).toUtf8();
+    }
+    return QByteArray();
+}
+
+} // namespace
+
+ConversationTransfer::ConversationTransfer(QObject *parent)
+    : QObject(parent)
+{
+}
+
+ConversationTransfer::~ConversationTransfer()
+{
+    cancel();
+    m_future.waitForFinished();
+}
+
+ConversationTransfer::Format ConversationTransfer::formatForPath(const QString& path)
+{
+    QString suffix = QFileInfo(path).suffix().toLower();
+    if (suffix == "md" || suffix == "markdown") {
+        return Format::Markdown;
+    }
+    if (suffix == "html" || suffix == "htm") {
+        return Format::Html;
+    }
+    return Format::JsonLines;
+}
+
+bool ConversationTransfer::exportConversation(const QSharedPointer<ConversationFile>& file, const QString& path,
+                                              Format format, const QString& aiName)
+{
+    if (isRunning() || !file) {
+        return false;
+    }
+    m_cancelled = false;
+    m_future = QtConcurrent::run([this, file, path, format, aiName]() {
+        runExport(file, path, format, aiName);
+    });
+    return true;
+}
+
+bool ConversationTransfer::importConversation(const QString& path, const QString& conversationPath)
+{
+    if (isRunning()) {
+        return false;
+    }
+    m_cancelled = false;
+    m_future = QtConcurrent::run([this, path, conversationPath]() {
+        runImport(path, conversationPath);
+    });
+    return true;
+}
+
+void ConversationTransfer::cancel()
+{
+    m_cancelled = true;
+}
+
+void ConversationTransfer::runExport(QSharedPointer<ConversationFile> file, QString path,
+                                     Format format, QString aiName)
+{
+    QSaveFile out(path);
+    if (!out.open(QIODevice::WriteOnly)) {
+        emit finished(false, tr("无法写入文件: %1").arg(out.errorString()));
+        return;
+    }
+
+    int total = file->messageCount();
+    emit progress(0, total);
+    out.write(headerBytes(format, file.data()));
+
+    // 按批读取，已压缩的消息直接从磁盘读出，不会整体载入内存
+    for (int first = 0; first < total; first += kExportBatch) {
+        if (m_cancelled) {
+            out.cancelWriting();
+            emit finished(false, tr("导出已取消"));
+            return;
+        }
+
+        const QList<ChatModel::Message> messages = file->readMessages(first, kExportBatch);
+        for (const ChatModel::Message& message : messages) {
+            out.write(messageBytes(format, message, aiName));
+        }
+
+        emit progress(qMin(total, first + kExportBatch), total);
+    }
+
+    if (format == Format::Html) {
+        out.write("</body>\n</html>\n");
+    }
+
+    if (!out.commit()) {
+        emit finished(false, tr("无法写入文件: %1").arg(out.errorString()));
+        return;
+    }
+
+    LOG_INFO(QString("已导出对话 %1 到 %2，共 %3 条消息").arg(file->id(), path).arg(total));
+    emit finished(true, tr("已导出 %1 条消息").arg(total));
+}
+
+void ConversationTransfer::runImport(QString path, QString conversationPath)
+{
+    QFile in(path);
+    if (!in.open(QIODevice::ReadOnly)) {
+        emit finished(false, tr("无法读取文件: %1").arg(in.errorString()));
+        return;
+    }
+
+    ConversationFile target(conversationPath);
+    if (!target.open()) {
+        emit finished(false, target.lastError());
+        return;
+    }
+
+    qint64 total = in.size();
+    emit progress(0, total);
+
+    int index = target.messageCount();
+    int lineNumber = 0;
+    int skipped = 0;
+    QString title;
+    QString firstUserMessage;
+
+    // 逐行解析，只有当前这一行在内存中
+    while (!in.atEnd()) {
+        if (m_cancelled) {
+            target.close();
+            emit finished(false, tr("导入已取消，已导入 %1 条消息").arg(index));
+            return;
+        }
+
+        QByteArray line = in.readLine().trimmed();
+        ++lineNumber;
+        if (line.isEmpty()) {
+            continue;
+        }
+
+        QJsonParseError error;
+        QJsonObject obj = QJsonDocument::fromJson(line, &error).object();
+        if (error.error != QJsonParseError::NoError) {
+            ++skipped;
+            LOG_WARNING(QString("导入 %1 第 %2 行无法解析: %3").arg(path).arg(lineNumber).arg(error.errorString()));
+            continue;
+        }
+
+        if (obj["type"].toString() == "conversation") {
+            title = obj["title"].toString();
+            continue;
+        }
+
+        ChatModel::Message message = messageFromJson(obj);
+        if (message.role.isEmpty()) {
+            ++skipped;
+            continue;
+        }
+        if (firstUserMessage.isEmpty() && message.role == "user") {
+            firstUserMessage = message.content;
+        }
+
+        if (!target.appendMessage(index, message)) {
+            target.close();
+            emit finished(false, target.lastError());
+            return;
+        }
+        ++index;
+
+        if (target.needsCompaction()) {
+            target.compact();
+        }
+        if (index % kProgressStep == 0) {
+            emit progress(in.pos(), total);
+        }
+    }
+
+    target.setTitle(!title.isEmpty() ? title : firstUserMessage.simplified().left(kTitleLength));
+    target.compact();
+    target.close();
+
+    emit progress(total, total);
+    LOG_INFO(QString("已从 %1 导入 %2 条消息，跳过 %3 行").arg(path).arg(index).arg(skipped));
+    emit finished(true, skipped > 0
+        ? tr("已导入 %1 条消息，%2 行无法识别").arg(index).arg(skipped)
+        : tr("已导入 %1 条消息").arg(index));
+}
@@ -0,0 +1,54 @@
+#ifndef CONVERSATIONTRANSFER_H
+#define CONVERSATIONTRANSFER_H
+
+#include <QObject>
+#include <QString>
+#include <QFuture>
+#include <QSharedPointer>
+#include <atomic>
+#include "services/conversationfile.h"
+
+/**
+ * @brief 对话导出和导入
+ *
+ * 在后台线程中逐条读取和写入消息，内存占用与对话长度无关。
+ * 导出支持 JSONL（保留角色、时间、模型和统计信息）、Markdown 和 HTML，
+ * 导入只支持 JSONL。同一时间只运行一个任务。
+ */
+class ConversationTransfer : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum class Format {
+        JsonLines,
+        Markdown,
+        Html
+    };
+
+    explicit ConversationTransfer(QObject *parent = nullptr);
+    ~ConversationTransfer();
+
+    static Format formatForPath(const QString& path);
+    bool isRunning() const { return m_future.isRunning(); }
+
+    // file 为已经写入完毕的对话，aiName 用于 Markdown 和 HTML 中的发言人
+    bool exportConversation(const QSharedPointer<ConversationFile>& file, const QString& path,
+                            Format format, const QString& aiName);
+    // 把 JSONL 文件导入到 conversationPath 指向的新对话目录
+    bool importConversation(const QString& path, const QString& conversationPath);
+    void cancel();
+
+signals:
+    void progress(qint64 done, qint64 total);
+    void finished(bool ok, const QString& message);
+
+private:
+    void runExport(QSharedPointer<ConversationFile> file, QString path, Format format, QString aiName);
+    void runImport(QString path, QString conversationPath);
+
+    QFuture<void> m_future;
+    std::atomic_bool m_cancelled{false};
+};
+
+#endif // CONVERSATIONTRANSFER_H
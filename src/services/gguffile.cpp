@@ -0,0 +1,396 @@
+#include "gguffile.h"
+#include <cstring>
+#include <stdexcept>
+#include "services/logger.h"
+#include "services/tracer.h"
+
+namespace {
+const quint32 kMagic = 0x46554747;   // "GGUF"，小端
+const quint32 kDefaultAlignment = 32;
+// 防止损坏的文件让解析分配过多内存
+const quint64 kMaxTensors = 1 << 20;
+const quint64 kMaxKeyValues = 1 << 20;
+const quint32 kMaxDims = 4;
+// 每个元素至少占 1 比特，张量的元素数不可能超过文件字节数的 8 倍
+const quint64 kMaxElementsPerByte = 8;
+// 计算指纹时读取的文件头字节数和每个张量的字节数
+const qint64 kFingerprintHeader = 1 << 20;
+const qint64 kFingerprintTensor = 4096;
+
+quint64 fnv1a(quint64 hash, const uchar* data, qint64 size)
+{
+    for (qint64 i = 0; i < size; ++i) {
+        hash = (hash ^ data[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+}
+
+/**
+ * @brief 带边界检查的顺序读取，越界时抛出异常
+ */
+class GgufFile::Reader
+{
+public:
+    Reader(const uchar* begin, const uchar* end)
+        : m_pos(begin)
+        , m_begin(begin)
+        , m_end(end)
+    {
+    }
+
+    template <typename T>
+    T read()
+    {
+        need(sizeof(T));
+        T value;
+        memcpy(&value, m_pos, sizeof(T));
+        m_pos += sizeof(T);
+        return value;
+    }
+
+    QByteArray readString()
+    {
+        quint64 length = read<quint64>();
+        need(length);
+        QByteArray text(reinterpret_cast<const char*>(m_pos), qsizetype(length));
+        m_pos += length;
+        return text;
+    }
+
+    void skipString()
+    {
+        quint64 length = read<quint64>();
+        skip(length);
+    }
+
+    void skip(quint64 bytes)
+    {
+        need(bytes);
+        m_pos += bytes;
+    }
+
+    // 跳过一个指定类型的值，数组类型由调用方处理
+    void skipValue(quint32 type)
+    {
+        switch (type) {
+            case UInt8: case Int8: case Bool: skip(1); break;
+            case UInt16: case Int16: skip(2); break;
+            case UInt32: case Int32: case Float32: skip(4); break;
+            case UInt64: case Int64: case Float64: skip(8); break;
+            case String: skipString(); break;
+            default: throw std::runtime_error("无效的元数据类型");
+        }
+    }
+
+    QVariant readValue(quint32 type)
+    {
+        switch (type) {
+            case UInt8: return QVariant::fromValue(uint(read<quint8>()));
+            case Int8: return QVariant::fromValue(int(read<qint8>()));
+            case UInt16: return QVariant::fromValue(uint(read<quint16>()));
+            case Int16: return QVariant::fromValue(int(read<qint16>()));
+            case UInt32: return QVariant::fromValue(read<quint32>());
+            case Int32: return QVariant::fromValue(read<qint32>());
+            case Float32: return QVariant::fromValue(read<float>());
+            case Bool: return QVariant::fromValue(read<quint8>() != 0);
+            case UInt64: return QVariant::fromValue(read<quint64>());
+            case Int64: return QVariant::fromValue(read<qint64>());
+            case Float64: return QVariant::fromValue(read<double>());
+            case String: return QVariant::fromValue(readString());
+            default: throw std::runtime_error("无效的元数据类型");
+        }
+    }
+
+    const uchar* pos() const { return m_pos; }
+    quint64 offset() const { return quint64(m_pos - m_begin); }
+
+private:
+    void need(quint64 bytes) const
+    {
+        if (bytes > quint64(m_end - m_pos)) {
+            throw std::runtime_error("文件不完整");
+        }
+    }
+
+    const uchar* m_pos;
+    const uchar* m_begin;
+    const uchar* m_end;
+};
+
+qint64 GgufFile::Tensor::elements() const
+{
+    // 维度在 open 时已经检查过为正数且乘积不会溢出
+    qint64 count = 1;
+    for (qint64 dim : dims) {
+        count *= dim;
+    }
+    return count;
+}
+
+GgufFile::GgufFile()
+{
+}
+
+GgufFile::~GgufFile()
+{
+    close();
+}
+
+bool GgufFile::probe(const QString& path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    quint32 magic = 0;
+    return file.read(reinterpret_cast<char*>(&magic), sizeof(magic)) == sizeof(magic)
+        && magic == kMagic;
+}
+
+bool GgufFile::open(const QString& path, QString* error)
+{
+    TRACE_SCOPE("GgufFile::open");
+    close();
+
+    auto fail = [&](const QString& message) {
+        if (error) {
+            *error = message;
+        }
+        LOG_ERROR(QString("加载模型文件失败 %1: %2").arg(path, message));
+        close();
+        return false;
+    };
+
+    m_file.setFileName(path);
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        return fail(m_file.errorString());
+    }
+    m_size = m_file.size();
+    m_data = m_file.map(0, m_size);
+    if (!m_data) {
+        return fail(QString("无法映射文件: %1").arg(m_file.errorString()));
+    }
+
+    try {
+        Reader reader(m_data, m_data + m_size);
+        if (reader.read<quint32>() != kMagic) {
+            return fail("不是 GGUF 文件");
+        }
+        quint32 version = reader.read<quint32>();
+        if (version < 2 || version > 3) {
+            return fail(QString("不支持的 GGUF 版本 %1").arg(version));
+        }
+        quint64 tensorCount = reader.read<quint64>();
+        quint64 keyValueCount = reader.read<quint64>();
+        if (tensorCount > kMaxTensors || keyValueCount > kMaxKeyValues) {
+            return fail("文件头无效");
+        }
+
+        for (quint64 i = 0; i < keyValueCount; ++i) {
+            QByteArray key = reader.readString();
+            quint32 type = reader.read<quint32>();
+            if (type != Array) {
+                m_values.insert(key, reader.readValue(type));
+                continue;
+            }
+
+            ArrayRef ref;
+            ref.type = reader.read<quint32>();
+            ref.count = reader.read<quint64>();
+            ref.data = reader.pos();
+            if (ref.type == Array) {
+                return fail("不支持嵌套数组");
+            }
+            for (quint64 k = 0; k < ref.count; ++k) {
+                reader.skipValue(ref.type);
+            }
+            ref.end = reader.pos();
+            m_arrays.insert(key, ref);
+        }
+
+        QList<quint64> offsets;
+        m_tensors.reserve(qsizetype(tensorCount));
+        for (quint64 i = 0; i < tensorCount; ++i) {
+            Tensor tensor;
+            tensor.name = reader.readString();
+            quint32 dimCount = reader.read<quint32>();
+            if (dimCount == 0 || dimCount > kMaxDims) {
+                return fail(QString("张量 %1 的维数无效").arg(QString::fromUtf8(tensor.name)));
+            }
+            // 逐维检查乘积，构造的文件头不能让元素数溢出
+            const quint64 maxElements = quint64(m_size) * kMaxElementsPerByte;
+            quint64 elements = 1;
+            for (quint32 d = 0; d < dimCount; ++d) {
+                quint64 dim = reader.read<quint64>();
+                if (dim == 0 || dim > maxElements / elements) {
+                    return fail(QString("张量 %1 的维度无效").arg(QString::fromUtf8(tensor.name)));
+                }
+                elements *= dim;
+                tensor.dims.append(qint64(dim));
+            }
+            tensor.type = reader.read<quint32>();
+            offsets.append(reader.read<quint64>());
+            m_tensors.append(tensor);
+        }
+
+        quint32 alignment = value("general.alignment", kDefaultAlignment).toUInt();
+        if (alignment == 0 || (alignment & (alignment - 1)) != 0) {
+            return fail("general.alignment 无效");
+        }
+        quint64 dataStart = (reader.offset() + alignment - 1) / alignment * alignment;
+
+        for (int i = 0; i < m_tensors.size(); ++i) {
+            Tensor& tensor = m_tensors[i];
+            if (offsets.at(i) % alignment != 0) {
+                return fail(QString("张量 %1 的偏移没有按 %2 字节对齐")
+                    .arg(QString::fromUtf8(tensor.name)).arg(alignment));
+            }
+            int perBlock = blockElements(tensor.type);
+            if (perBlock == 0) {
+                // 不支持的类型也登记下来，用到时再报错
+                tensor.bytes = 0;
+            } else {
+                if (tensor.dims.first() % perBlock != 0) {
+                    return fail(QString("张量 %1 的行长度不是块大小的整数倍").arg(QString::fromUtf8(tensor.name)));
+                }
+                tensor.bytes = tensor.elements() / perBlock * blockBytes(tensor.type);
+            }
+            if (offsets.at(i) > quint64(m_size) || dataStart > quint64(m_size) - offsets.at(i)) {
+                return fail(QString("张量 %1 超出文件范围").arg(QString::fromUtf8(tensor.name)));
+            }
+            quint64 begin = dataStart + offsets.at(i);
+            if (quint64(tensor.bytes) > quint64(m_size) - begin) {
+                return fail(QString("张量 %1 超出文件范围").arg(QString::fromUtf8(tensor.name)));
+            }
+            tensor.data = m_data + begin;
+            m_tensorIndex.insert(tensor.name, i);
+        }
+    } catch (const std::exception& e) {
+        return fail(QString::fromUtf8(e.what()));
+    }
+
+    LOG_INFO(QString("已映射模型文件 %1: %2 个张量, %3 MB")
+        .arg(path).arg(m_tensors.size()).arg(m_size / (1024 * 1024)));
+    return true;
+}
+
+void GgufFile::close()
+{
+    if (m_data) {
+        m_file.unmap(m_data);
+        m_data = nullptr;
+    }
+    m_file.close();
+    m_size = 0;
+    m_values.clear();
+    m_arrays.clear();
+    m_tensors.clear();
+    m_tensorIndex.clear();
+}
+
+QVariant GgufFile::value(const QByteArray& key, const QVariant& defaultValue) const
+{
+    return m_values.value(key, defaultValue);
+}
+
+QList<QByteArray> GgufFile::stringArray(const QByteArray& key) const
+{
+    QList<QByteArray> result;
+    ArrayRef ref = array(key);
+    if (ref.type != String || !ref.data) {
+        return result;
+    }
+    result.reserve(qsizetype(ref.count));
+    Reader reader(ref.data, ref.end);
+    for (quint64 i = 0; i < ref.count; ++i) {
+        result.append(reader.readString());
+    }
+    return result;
+}
+
+QList<float> GgufFile::floatArray(const QByteArray& key) const
+{
+    QList<float> result;
+    ArrayRef ref = array(key);
+    if (!ref.data || ref.type == String) {
+        return result;
+    }
+    result.reserve(qsizetype(ref.count));
+    Reader reader(ref.data, ref.end);
+    for (quint64 i = 0; i < ref.count; ++i) {
+        result.append(reader.readValue(ref.type).toFloat());
+    }
+    return result;
+}
+
+QList<qint32> GgufFile::intArray(const QByteArray& key) const
+{
+    QList<qint32> result;
+    ArrayRef ref = array(key);
+    if (!ref.data || ref.type == String) {
+        return result;
+    }
+    result.reserve(qsizetype(ref.count));
+    Reader reader(ref.data, ref.end);
+    for (quint64 i = 0; i < ref.count; ++i) {
+        result.append(reader.readValue(ref.type).toInt());
+    }
+    return result;
+}
+
+quint64 GgufFile::fingerprint() const
+{
+    if (!m_data) {
+        return 0;
+    }
+    quint64 hash = 14695981039346656037ULL;
+    hash = fnv1a(hash, reinterpret_cast<const uchar*>(&m_size), sizeof(m_size));
+    hash = fnv1a(hash, m_data, qMin(m_size, kFingerprintHeader));
+    for (const Tensor& tensor : m_tensors) {
+        hash = fnv1a(hash, tensor.data, qMin(tensor.bytes, kFingerprintTensor));
+    }
+    return hash;
+}
+
+const GgufFile::Tensor* GgufFile::tensor(const QByteArray& name) const
+{
+    auto it = m_tensorIndex.constFind(name);
+    return it == m_tensorIndex.constEnd() ? nullptr : &m_tensors.at(it.value());
+}
+
+qint64 GgufFile::blockBytes(quint32 type)
+{
+    switch (type) {
+        case F32: return 4;
+        case F16: return 2;
+        case Q4_0: return 2 + 16;    // fp16 缩放 + 32 个 4 位值
+        case Q8_0: return 2 + 32;    // fp16 缩放 + 32 个 8 位值
+        default: return 0;
+    }
+}
+
+int GgufFile::blockElements(quint32 type)
+{
+    switch (type) {
+        case F32:
+        case F16:
+            return 1;
+        case Q4_0:
+        case Q8_0:
+            return 32;
+        default:
+            return 0;
+    }
+}
+
+QString GgufFile::typeName(quint32 type)
+{
+    switch (type) {
+        case F32: return "F32";
+        case F16: return "F16";
+        case Q4_0: return "Q4_0";
+        case Q8_0: return "Q8_0";
+        default: return QString("type %1").arg(type);
+    }
+}
@@ -0,0 +1,101 @@
+#ifndef GGUFFILE_H
+#define GGUFFILE_H
+
+#include <QFile>
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <QByteArray>
+#include <QVariant>
+
+/**
+ * @brief GGUF 模型文件
+ *
+ * 用内存映射打开 GGUF 文件，只解析文件头、元数据和张量目录，张量数据直接指向
+ * 映射区域，不复制也不预先读入。多个进程或多次加载同一个模型时共享页缓存，
+ * 首次访问某个张量时才由系统按页读入。
+ *
+ * 数组类型的元数据（词表等）只记录位置，需要时再从映射区域中读取。
+ */
+class GgufFile
+{
+public:
+    // ggml 张量类型，只列出推理引擎支持的几种
+    enum TensorType : quint32 {
+        F32 = 0,
+        F16 = 1,
+        Q4_0 = 2,
+        Q8_0 = 8
+    };
+
+    // 元数据值类型
+    enum ValueType : quint32 {
+        UInt8 = 0, Int8 = 1, UInt16 = 2, Int16 = 3, UInt32 = 4, Int32 = 5,
+        Float32 = 6, Bool = 7, String = 8, Array = 9, UInt64 = 10, Int64 = 11, Float64 = 12
+    };
+
+    struct Tensor {
+        QByteArray name;
+        QList<qint64> dims;     // dims[0] 是最内层（行内）的元素数
+        quint32 type = F32;
+        const uchar* data = nullptr;
+        qint64 bytes = 0;
+
+        qint64 elements() const;
+        qint64 rows() const { return dims.isEmpty() ? 0 : elements() / dims.first(); }
+    };
+
+    struct ArrayRef {
+        quint32 type = UInt8;
+        quint64 count = 0;
+        const uchar* data = nullptr;   // 第一个元素的位置
+        const uchar* end = nullptr;    // 数组之后的位置
+    };
+
+    GgufFile();
+    ~GgufFile();
+    GgufFile(const GgufFile&) = delete;
+    GgufFile& operator=(const GgufFile&) = delete;
+
+    // 打开并解析文件，失败时返回 false 并写入 error
+    bool open(const QString& path, QString* error = nullptr);
+    void close();
+    bool isOpen() const { return m_data != nullptr; }
+    QString path() const { return m_file.fileName(); }
+    qint64 size() const { return m_size; }
+
+    // 文件开头是否是 GGUF 魔数，不做完整解析
+    static bool probe(const QString& path);
+    // 模型内容的指纹：文件大小、文件头和每个张量开头的数据，不读取整个文件
+    quint64 fingerprint() const;
+
+    bool contains(const QByteArray& key) const { return m_values.contains(key) || m_arrays.contains(key); }
+    QVariant value(const QByteArray& key, const QVariant& defaultValue = QVariant()) const;
+    ArrayRef array(const QByteArray& key) const { return m_arrays.value(key); }
+    // 读出字符串数组的全部元素
+    QList<QByteArray> stringArray(const QByteArray& key) const;
+    // 读出数值数组，元素转换为 float
+    QList<float> floatArray(const QByteArray& key) const;
+    QList<qint32> intArray(const QByteArray& key) const;
+
+    const Tensor* tensor(const QByteArray& name) const;
+    const QList<Tensor>& tensors() const { return m_tensors; }
+
+    // 每个量化块的字节数和元素数，不支持的类型返回 0
+    static qint64 blockBytes(quint32 type);
+    static int blockElements(quint32 type);
+    static QString typeName(quint32 type);
+
+private:
+    class Reader;
+
+    QFile m_file;
+    uchar* m_data = nullptr;
+    qint64 m_size = 0;
+    QHash<QByteArray, QVariant> m_values;
+    QHash<QByteArray, ArrayRef> m_arrays;
+    QList<Tensor> m_tensors;
+    QHash<QByteArray, int> m_tensorIndex;
+};
+
+#endif // GGUFFILE_H
@@ -0,0 +1,208 @@
+#include "imageencoder.h"
+#include <QBuffer>
+#include <QImageReader>
+#include <QImageWriter>
+#include <QElapsedTimer>
+#include <cstring>
+#include "services/attachmentstore.h"
+#include "services/logger.h"
+#include "utils/imageresize.h"
+
+namespace {
+
+const char kBase64Table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// 第 group 组（3 字节输入，4 字符输出）的编码结果
+void encodeGroup(const QByteArray& source, qint64 group, char* quad)
+{
+    qint64 index = group * 3;
+    qint64 remaining = source.size() - index;
+    uchar b0 = uchar(source.at(index));
+    uchar b1 = remaining > 1 ? uchar(source.at(index + 1)) : 0;
+    uchar b2 = remaining > 2 ? uchar(source.at(index + 2)) : 0;
+
+    quad[0] = kBase64Table[b0 >> 2];
+    quad[1] = kBase64Table[((b0 & 0x03) << 4) | (b1 >> 4)];
+    quad[2] = remaining > 1 ? kBase64Table[((b1 & 0x0f) << 2) | (b2 >> 6)] : '=';
+    quad[3] = remaining > 2 ? kBase64Table[b2 & 0x3f] : '=';
+}
+
+// 从 base64 输出的 offset 处开始写 count 个字符
+void encodeBase64Range(const QByteArray& source, qint64 offset, char* out, qint64 count)
+{
+    qint64 group = offset / 4;
+    int skip = int(offset % 4);
+    char quad[4];
+    while (count > 0) {
+        encodeGroup(source, group++, quad);
+        int n = int(qMin<qint64>(4 - skip, count));
+        std::memcpy(out, quad + skip, n);
+        out += n;
+        count -= n;
+        skip = 0;
+    }
+}
+
+} // namespace
+
+ImageEncoder::Encoded ImageEncoder::encode(const ImagePipeline::Image& image, int maxEdge, int quality,
+                                           AttachmentStore* store)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    Encoded result;
+    result.id = image.id;
+
+    result.mimeType = mimeTypeFor(image);
+    bool keepAlpha = result.mimeType == "image/png";
+    QByteArray format = keepAlpha ? "png" : "jpeg";
+
+    QString variant = keepAlpha
+        ? QString("png-%1").arg(maxEdge)
+        : QString("jpeg-%1-q%2").arg(maxEdge).arg(quality);
+    bool cacheable = store && !image.hash.isEmpty();
+    if (cacheable) {
+        result.data = store->derived(image.hash, variant);
+        if (!result.data.isEmpty()) {
+            // 只读取文件头获得尺寸
+            QBuffer cached(&result.data);
+            cached.open(QIODevice::ReadOnly);
+            result.size = QImageReader(&cached, format).size();
+            result.encodeMs = timer.elapsed();
+            return result;
+        }
+    }
+
+    // 不需要透明通道时直接输出 RGB888，编码器不必再转换一次
+    QImage scaled = ImageResize::fitWithin(ImagePipeline::fullImage(image), maxEdge,
+                                           ImageResize::Filter::Area, keepAlpha);
+
+    QBuffer buffer(&result.data);
+    buffer.open(QIODevice::WriteOnly);
+    QImageWriter writer(&buffer, format);
+    if (!keepAlpha) {
+        writer.setQuality(quality);
+    }
+    if (!writer.write(scaled)) {
+        LOG_ERROR(QString("图片 %1 编码失败: %2").arg(image.id, writer.errorString()));
+        result.data.clear();
+    } else if (cacheable) {
+        store->putDerived(image.hash, variant, result.data);
+    }
+
+    result.size = scaled.size();
+    result.encodeMs = timer.elapsed();
+    return result;
+}
+
+QByteArray ImageEncoder::mimeTypeFor(const ImagePipeline::Image& image)
+{
+    // 带透明通道的图片保留为 PNG，其余统一用 JPEG 以减小上传体积
+    return image.hasAlpha ? "image/png" : "image/jpeg";
+}
+
+QList<ImageEncoder::Encoded> ImageEncoder::encodeAll(const QList<ImagePipeline::ImageHandle>& images,
+                                                     int maxEdge, int quality, AttachmentStore* store)
+{
+    QList<Encoded> results;
+    results.reserve(images.size());
+    // 结果与占位字符串按下标对应，无效的图片保留一个没有数据的结果，由调用方报告失败
+    for (const ImagePipeline::ImageHandle& image : images) {
+        results.append(image ? encode(*image, maxEdge, quality, store) : Encoded());
+    }
+    return results;
+}
+
+ImageRequestBody::ImageRequestBody(const QByteArray& json, const QList<ImageEncoder::Encoded>& images,
+                                   QObject *parent)
+    : QIODevice(parent)
+{
+    // 按占位字符串把 JSON 切开，图片数据在读取时才编码
+    qint64 from = 0;
+    for (int i = 0; i < images.size(); ++i) {
+        QByteArray marker = placeholder(i).toUtf8();
+        qint64 at = json.indexOf(marker, from);
+        if (at < 0) {
+            continue;
+        }
+        appendSegment(json.mid(from, at - from), false);
+        appendSegment(images.at(i).data, true);
+        from = at + marker.size();
+    }
+    appendSegment(json.mid(from), false);
+
+    // 不使用 QIODevice 的内部缓冲，读取位置由 m_readPos 维护
+    open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+}
+
+QString ImageRequestBody::placeholder(int index)
+{
+    return QString("@@chatdot-image-%1@@").arg(index);
+}
+
+QNetworkReply* ImageRequestBody::post(QNetworkAccessManager* manager, QNetworkRequest request,
+                                      const QByteArray& json, const QList<ImageEncoder::Encoded>& images)
+{
+    if (images.isEmpty()) {
+        return manager->post(request, json);
+    }
+
+    auto* body = new ImageRequestBody(json, images);
+    request.setHeader(QNetworkRequest::ContentLengthHeader, body->size());
+    QNetworkReply* reply = manager->post(request, body);
+    body->setParent(reply);
+    return reply;
+}
+
+void ImageRequestBody::appendSegment(const QByteArray& bytes, bool base64)
+{
+    Segment segment;
+    segment.start = m_size;
+    segment.length = base64 ? ImageEncoder::base64Size(bytes.size()) : bytes.size();
+    segment.bytes = bytes;
+    segment.base64 = base64;
+    if (segment.length > 0) {
+        m_size += segment.length;
+        m_segments.append(segment);
+    }
+}
+
+bool ImageRequestBody::seek(qint64 pos)
+{
+    if (pos < 0 || pos > m_size || !QIODevice::seek(pos)) {
+        return false;
+    }
+    m_readPos = pos;
+    return true;
+}
+
+qint64 ImageRequestBody::readData(char *data, qint64 maxSize)
+{
+    qint64 total = 0;
+    int index = 0;
+    while (total < maxSize && m_readPos < m_size) {
+        while (index < m_segments.size()
+               && m_segments.at(index).start + m_segments.at(index).length <= m_readPos) {
+            ++index;
+        }
+        const Segment& segment = m_segments.at(index);
+        qint64 offset = m_readPos - segment.start;
+        qint64 count = qMin(maxSize - total, segment.length - offset);
+        if (segment.base64) {
+            encodeBase64Range(segment.bytes, offset, data + total, count);
+        } else {
+            std::memcpy(data + total, segment.bytes.constData() + offset, count);
+        }
+        total += count;
+        m_readPos += count;
+    }
+    return total;
+}
+
+qint64 ImageRequestBody::writeData(const char *data, qint64 maxSize)
+{
+    Q_UNUSED(data);
+    Q_UNUSED(maxSize);
+    return -1;
+}
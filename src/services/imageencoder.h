@@ -0,0 +1,85 @@
+#ifndef IMAGEENCODER_H
+#define IMAGEENCODER_H
+
+#include <QIODevice>
+#include <QList>
+#include <QSize>
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include "services/imagepipeline.h"
+
+/**
+ * @brief 发送给模型前的图片编码
+ *
+ * 把解码后的图片缩小到服务商允许的最大边长并重新编码，去掉原文件中的元数据。
+ * 应在后台线程中调用。设置了附件存储时，编码结果按服务商的参数缓存，
+ * 同一图片再次发送时直接复用。
+ */
+class ImageEncoder
+{
+public:
+    struct Encoded {
+        QString id;
+        QByteArray data;       // 编码后的文件内容
+        QByteArray mimeType;
+        QSize size;
+        qint64 encodeMs = 0;
+    };
+
+    static constexpr int kDefaultQuality = 85;
+
+    // maxEdge 为长边的最大像素数，quality 用于有损格式
+    static Encoded encode(const ImagePipeline::Image& image, int maxEdge, int quality = kDefaultQuality,
+                          AttachmentStore* store = nullptr);
+    static QList<Encoded> encodeAll(const QList<ImagePipeline::ImageHandle>& images, int maxEdge, int quality = kDefaultQuality,
+                                    AttachmentStore* store = nullptr);
+    // 编码后的类型只取决于是否有透明通道，构造请求时即可确定
+    static QByteArray mimeTypeFor(const ImagePipeline::Image& image);
+
+    // base64 编码后的长度
+    static qint64 base64Size(qint64 bytes) { return (bytes + 2) / 3 * 4; }
+};
+
+/**
+ * @brief 带图片的请求体
+ *
+ * 请求 JSON 中的占位字符串在读取时才替换为图片的 base64 编码，
+ * 内存中只保留编码后的图片，不会生成 base64 文本和 JSON 的完整副本。
+ */
+class ImageRequestBody : public QIODevice
+{
+    Q_OBJECT
+
+public:
+    ImageRequestBody(const QByteArray& json, const QList<ImageEncoder::Encoded>& images, QObject *parent = nullptr);
+
+    // 第 index 张图片在 JSON 中的占位字符串
+    static QString placeholder(int index);
+    // 没有图片时直接发送 JSON
+    static QNetworkReply* post(QNetworkAccessManager* manager, QNetworkRequest request,
+                               const QByteArray& json, const QList<ImageEncoder::Encoded>& images);
+
+    bool isSequential() const override { return false; }
+    qint64 size() const override { return m_size; }
+    bool seek(qint64 pos) override;
+
+protected:
+    qint64 readData(char *data, qint64 maxSize) override;
+    qint64 writeData(const char *data, qint64 maxSize) override;
+
+private:
+    struct Segment {
+        qint64 start = 0;
+        qint64 length = 0;
+        QByteArray bytes;      // 文本原样输出，图片按 base64 输出
+        bool base64 = false;
+    };
+
+    void appendSegment(const QByteArray& bytes, bool base64);
+
+    QList<Segment> m_segments;
+    qint64 m_size = 0;
+    qint64 m_readPos = 0;
+};
+
+#endif // IMAGEENCODER_H
@@ -0,0 +1,205 @@
+#include "imagepipeline.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QBuffer>
+#include <QImageReader>
+#include <QElapsedTimer>
+#include <QFutureWatcher>
+#include <QJsonObject>
+#include <QtConcurrent/QtConcurrent>
+#include "services/attachmentstore.h"
+#include "services/logger.h"
+#include "utils/imageresize.h"
+
+ImagePipeline::ImagePipeline(QObject *parent)
+    : QObject(parent)
+{
+}
+
+ImagePipeline::~ImagePipeline()
+{
+}
+
+QString ImagePipeline::load(const QString& path, int displayWidth, qreal devicePixelRatio)
+{
+    QSize thumbnailSize(qRound(displayWidth * devicePixelRatio), 0);
+    QString key = cacheKey(path, QFileInfo(path), thumbnailSize);
+
+    QString cachedId = m_idByKey.value(key);
+    if (!cachedId.isEmpty() && m_images.contains(cachedId)) {
+        // 异步发出，调用方总是在 load 返回之后收到结果
+        QImage thumbnail = m_thumbnails.value(cachedId);
+        QMetaObject::invokeMethod(this, [this, cachedId, thumbnail]() {
+            emit imageReady(cachedId, thumbnail);
+        }, Qt::QueuedConnection);
+        return cachedId;
+    }
+
+    QString id = QString("img-%1").arg(++m_nextId);
+    m_idByKey.insert(key, id);
+
+    auto* watcher = new QFutureWatcher<LoadResult>(this);
+    connect(watcher, &QFutureWatcher<LoadResult>::finished, this, [this, watcher, id, key]() {
+        watcher->deleteLater();
+        LoadResult result = watcher->result();
+        if (!result.image) {
+            m_idByKey.remove(key);
+            emit imageFailed(id, result.error);
+            return;
+        }
+        m_images.insert(id, result.image);
+        m_thumbnails.insert(id, result.thumbnail);
+        emit imageReady(id, result.thumbnail);
+    });
+    watcher->setFuture(QtConcurrent::run(&ImagePipeline::decode, id, path, thumbnailSize, devicePixelRatio,
+                                         m_attachmentStore));
+    return id;
+}
+
+void ImagePipeline::release(const QString& id)
+{
+    ImageHandle image = m_images.take(id);
+    if (image && m_attachmentStore && !image->hash.isEmpty()) {
+        m_attachmentStore->unpin(image->hash);
+    }
+    m_thumbnails.remove(id);
+    for (auto it = m_idByKey.begin(); it != m_idByKey.end();) {
+        if (it.value() == id) {
+            it = m_idByKey.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+QString ImagePipeline::cacheKey(const QString& path, const QFileInfo& info, const QSize& thumbnailSize)
+{
+    // 修改时间的精度有限，再加上文件大小，同一秒内被覆盖的文件也能区分
+    return QString("%1|%2|%3|%4").arg(path).arg(info.lastModified().toMSecsSinceEpoch())
+        .arg(info.size()).arg(thumbnailSize.width());
+}
+
+QImage ImagePipeline::fullImage(const Image& image)
+{
+    if (!image.decoded.isNull()) {
+        return image.decoded;
+    }
+
+    QBuffer buffer;
+    buffer.setData(image.data);
+    buffer.open(QIODevice::ReadOnly);
+    QImageReader reader(&buffer);
+    reader.setAutoTransform(true);
+    return reader.read();
+}
+
+bool ImagePipeline::loadCached(AttachmentStore* store, Image& image, QImage& thumbnail, const QString& variant)
+{
+    QJsonObject properties = store->properties(image.hash);
+    if (properties["type"].toString() != "image") {
+        return false;
+    }
+    QByteArray cached = store->derived(image.hash, variant);
+    if (cached.isEmpty() || !thumbnail.loadFromData(cached, "PNG")) {
+        return false;
+    }
+
+    image.format = properties["format"].toString().toLatin1();
+    image.size = QSize(properties["width"].toInt(), properties["height"].toInt());
+    image.hasAlpha = properties["alpha"].toBool();
+    return true;
+}
+
+ImagePipeline::LoadResult ImagePipeline::decode(const QString& id, const QString& path,
+                                                const QSize& thumbnailSize, qreal devicePixelRatio,
+                                                AttachmentStore* store)
+{
+    QElapsedTimer timer;
+    timer.start();
+    LoadResult result;
+
+    // 文件只读一次，解码和上传都使用这份数据
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        result.error = QObject::tr("无法打开图片文件：%1").arg(file.errorString());
+        return result;
+    }
+    QByteArray data = file.readAll();
+    file.close();
+
+    auto image = QSharedPointer<Image>::create();
+    image->id = id;
+    image->sourcePath = path;
+    image->data = data;
+
+    // 同一内容之前添加过时直接使用缓存的缩略图，完整图片等到编码时才解码
+    QString variant = thumbnailVariant(thumbnailSize.width());
+    if (store) {
+        image->hash = store->put(data);
+        QImage cached;
+        if (loadCached(store, *image, cached, variant)) {
+            cached.setDevicePixelRatio(devicePixelRatio);
+            result.image = image;
+            result.thumbnail = cached;
+            LOG_DEBUG(QString("图片 %1 命中附件缓存，耗时 %2 ms").arg(path).arg(timer.elapsed()));
+            return result;
+        }
+    }
+
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::ReadOnly);
+    QImageReader reader(&buffer);
+    reader.setAutoTransform(true);
+    QByteArray format = reader.format();
+    QImage decoded = reader.read();
+    if (decoded.isNull()) {
+        result.error = QObject::tr("无法加载图片：%1").arg(reader.errorString());
+        if (store) {
+            store->unpin(image->hash);
+        }
+        return result;
+    }
+
+    image->format = format;
+    image->size = decoded.size();
+    image->hasAlpha = decoded.hasAlphaChannel();
+
+    // 缩略图按设备像素比生成，高分屏上显示清晰，比原图小时不放大
+    int width = qMin(thumbnailSize.width(), decoded.width());
+    QImage thumbnail;
+    if (width < decoded.width()) {
+        int height = qMax(1, qRound(double(decoded.height()) * width / decoded.width()));
+        thumbnail = ImageResize::resize(decoded, QSize(width, height), ImageResize::Filter::Area,
+                                        decoded.hasAlphaChannel());
+    } else {
+        thumbnail = decoded.copy();
+    }
+
+    if (store) {
+        QByteArray png;
+        QBuffer pngBuffer(&png);
+        pngBuffer.open(QIODevice::WriteOnly);
+        thumbnail.save(&pngBuffer, "PNG");
+        store->putDerived(image->hash, variant, png);
+
+        QJsonObject properties;
+        properties["type"] = "image";
+        properties["format"] = QString::fromLatin1(format);
+        properties["width"] = decoded.width();
+        properties["height"] = decoded.height();
+        properties["alpha"] = image->hasAlpha;
+        store->setProperties(image->hash, properties);
+    }
+    thumbnail.setDevicePixelRatio(devicePixelRatio);
+
+    image->decoded = decoded;
+    result.image = image;
+    result.thumbnail = thumbnail;
+
+    LOG_DEBUG(QString("图片 %1 解码完成：%2x%3，缩略图 %4x%5，耗时 %6 ms")
+        .arg(path)
+        .arg(decoded.width()).arg(decoded.height())
+        .arg(thumbnail.width()).arg(thumbnail.height())
+        .arg(timer.elapsed()));
+    return result;
+}
@@ -0,0 +1,83 @@
+#ifndef IMAGEPIPELINE_H
+#define IMAGEPIPELINE_H
+
+#include <QObject>
+#include <QImage>
+#include <QHash>
+#include <QSharedPointer>
+#include <QDateTime>
+#include <QFileInfo>
+
+class AttachmentStore;
+
+/**
+ * @brief 图片导入流水线
+ *
+ * 在后台线程中读取并解码图片，同时生成显示用的缩略图。原始文件内容和
+ * 解码结果只保存一份，显示和上传共用；界面线程只接触缩略图。
+ *
+ * 设置了附件存储时，原文件按内容保存，缩略图也缓存在存储中。
+ * 同一内容再次载入时只计算哈希，不再解码和缩放。
+ */
+class ImagePipeline : public QObject
+{
+    Q_OBJECT
+
+public:
+    // 解码完成的图片，创建后不再修改，可以在线程之间共享
+    struct Image {
+        QString id;
+        QString sourcePath;
+        QByteArray data;       // 原始文件内容
+        QByteArray format;     // 图片格式，如 "png"、"jpeg"
+        QImage decoded;        // 完整分辨率，只在后台线程中使用；缩略图来自缓存时为空
+        QSize size;
+        bool hasAlpha = false;
+        QString hash;          // 在附件存储中的哈希，没有存储时为空
+    };
+    using ImageHandle = QSharedPointer<const Image>;
+
+    explicit ImagePipeline(QObject *parent = nullptr);
+    ~ImagePipeline();
+
+    void setAttachmentStore(AttachmentStore* store) { m_attachmentStore = store; }
+
+    // 在后台载入 path，displayWidth 为显示宽度（逻辑像素），返回图片编号
+    QString load(const QString& path, int displayWidth, qreal devicePixelRatio);
+
+    ImageHandle image(const QString& id) const { return m_images.value(id); }
+    QImage thumbnail(const QString& id) const { return m_thumbnails.value(id); }
+    // 图片不再需要时释放解码结果
+    void release(const QString& id);
+
+    // 完整分辨率的图片，decoded 为空时从原文件内容解码，应在后台线程中调用
+    static QImage fullImage(const Image& image);
+    // 附件存储中缩略图的派生数据名，width 为设备像素宽度。缩略图保存为 PNG
+    static QString thumbnailVariant(int width) { return QString("thumb-%1").arg(width); }
+
+signals:
+    void imageReady(const QString& id, const QImage& thumbnail);
+    void imageFailed(const QString& id, const QString& error);
+
+private:
+    struct LoadResult {
+        QSharedPointer<Image> image;
+        QImage thumbnail;
+        QString error;
+    };
+
+    static LoadResult decode(const QString& id, const QString& path, const QSize& thumbnailSize,
+                             qreal devicePixelRatio, AttachmentStore* store);
+    // 从附件存储中取缓存的缩略图，没有时返回 false
+    static bool loadCached(AttachmentStore* store, Image& image, QImage& thumbnail, const QString& variant);
+    static QString cacheKey(const QString& path, const QFileInfo& info, const QSize& thumbnailSize);
+
+    QHash<QString, ImageHandle> m_images;
+    QHash<QString, QImage> m_thumbnails;
+    // 同一文件同一尺寸再次载入时直接复用
+    QHash<QString, QString> m_idByKey;
+    AttachmentStore* m_attachmentStore = nullptr;
+    int m_nextId = 0;
+};
+
+#endif // IMAGEPIPELINE_H
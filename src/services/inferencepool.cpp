@@ -0,0 +1,215 @@
+#include "inferencepool.h"
+#include <QMutexLocker>
+#include <thread>
+#include "services/logger.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#include <immintrin.h>
+#define CHATDOT_CPU_RELAX() _mm_pause()
+#else
+#define CHATDOT_CPU_RELAX() std::this_thread::yield()
+#endif
+
+#if defined(Q_OS_LINUX)
+#include <pthread.h>
+#include <sched.h>
+#elif defined(Q_OS_WIN)
+#include <windows.h>
+#endif
+
+namespace {
+// 休眠前自旋的次数，约为几十到几百微秒
+const int kSpinIterations = 4000;
+
+quint64 packRange(quint32 begin, quint32 end)
+{
+    return (quint64(end) << 32) | begin;
+}
+
+quint32 rangeBegin(quint64 range)
+{
+    return quint32(range);
+}
+
+quint32 rangeEnd(quint64 range)
+{
+    return quint32(range >> 32);
+}
+
+// 把当前线程绑定到指定的逻辑核心，失败时只记录日志
+void pinCurrentThread(int cpu)
+{
+#if defined(Q_OS_LINUX)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu % CPU_SETSIZE, &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+        LOG_WARNING(QString("推理线程无法绑定到核心 %1").arg(cpu));
+    }
+#elif defined(Q_OS_WIN)
+    if (cpu < int(sizeof(DWORD_PTR) * 8)
+        && SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << cpu) == 0) {
+        LOG_WARNING(QString("推理线程无法绑定到核心 %1").arg(cpu));
+    }
+#else
+    Q_UNUSED(cpu);
+#endif
+}
+}
+
+InferencePool::InferencePool(int threads)
+{
+    const int cores = qMax(1, QThread::idealThreadCount());
+    m_threadCount = threads > 0 ? threads : cores;
+    m_slots.reset(new Slot[m_threadCount]);
+
+    // 0 号是调用线程，其余为常驻工作线程
+    for (int i = 1; i < m_threadCount; ++i) {
+        QThread* thread = QThread::create([this, i]() { workerLoop(i); });
+        thread->setObjectName(QString("Inference %1").arg(i));
+        thread->start(QThread::HighPriority);
+        m_workers.append(thread);
+    }
+    LOG_INFO(QString("推理线程池: %1 个线程").arg(m_threadCount));
+}
+
+InferencePool::~InferencePool()
+{
+    {
+        QMutexLocker locker(&m_parkMutex);
+        m_stopping.store(true);
+        m_parkCondition.wakeAll();
+    }
+    for (QThread* thread : m_workers) {
+        thread->wait();
+        delete thread;
+    }
+}
+
+void InferencePool::parallelFor(int count, const std::function<void(int)>& task)
+{
+    if (count <= 0) {
+        return;
+    }
+    if (m_threadCount == 1 || count == 1) {
+        for (int i = 0; i < count; ++i) {
+            task(i);
+        }
+        return;
+    }
+
+    QMutexLocker locker(&m_callMutex);
+
+    Job job;
+    job.task = &task;
+    job.remaining.store(count, std::memory_order_relaxed);
+    for (int s = 0; s < m_threadCount; ++s) {
+        quint32 begin = quint32(qint64(s) * count / m_threadCount);
+        quint32 end = quint32(qint64(s + 1) * count / m_threadCount);
+        m_slots[s].range.store(packRange(begin, end), std::memory_order_relaxed);
+    }
+
+    m_job.store(&job);
+    m_generation.fetch_add(1);
+    if (m_sleepers.load() > 0) {
+        QMutexLocker parkLocker(&m_parkMutex);
+        m_parkCondition.wakeAll();
+    }
+
+    runTasks(job, 0);
+    while (job.remaining.load(std::memory_order_acquire) > 0) {
+        CHATDOT_CPU_RELAX();
+    }
+
+    // job 在栈上，返回前确保没有工作线程还持有它
+    m_job.store(nullptr);
+    while (m_active.load() > 0) {
+        CHATDOT_CPU_RELAX();
+    }
+}
+
+void InferencePool::workerLoop(int self)
+{
+    pinCurrentThread(self);
+
+    quint64 seen = m_generation.load();
+    for (;;) {
+        int spins = 0;
+        while (m_generation.load(std::memory_order_acquire) == seen && !m_stopping.load(std::memory_order_relaxed)) {
+            if (++spins < kSpinIterations) {
+                CHATDOT_CPU_RELAX();
+                continue;
+            }
+            // 先登记为休眠再检查，parallelFor 先递增代数再检查休眠数，不会漏掉唤醒
+            QMutexLocker locker(&m_parkMutex);
+            m_sleepers.fetch_add(1);
+            while (m_generation.load() == seen && !m_stopping.load()) {
+                m_parkCondition.wait(&m_parkMutex);
+            }
+            m_sleepers.fetch_sub(1);
+            break;
+        }
+        if (m_stopping.load()) {
+            return;
+        }
+        seen = m_generation.load(std::memory_order_acquire);
+
+        // 先登记再读取 m_job：parallelFor 清空 m_job 之后会等这里退出
+        m_active.fetch_add(1);
+        if (Job* job = m_job.load()) {
+            runTasks(*job, self);
+        }
+        m_active.fetch_sub(1);
+    }
+}
+
+void InferencePool::runTasks(Job& job, int self)
+{
+    for (;;) {
+        int index = popLocal(self);
+        if (index < 0) {
+            index = steal(self);
+        }
+        if (index < 0) {
+            return;
+        }
+        (*job.task)(index);
+        job.remaining.fetch_sub(1, std::memory_order_release);
+    }
+}
+
+int InferencePool::popLocal(int self)
+{
+    std::atomic<quint64>& slot = m_slots[self].range;
+    quint64 range = slot.load(std::memory_order_acquire);
+    while (rangeBegin(range) < rangeEnd(range)) {
+        if (slot.compare_exchange_weak(range, packRange(rangeBegin(range) + 1, rangeEnd(range)),
+                                       std::memory_order_acq_rel)) {
+            return int(rangeBegin(range));
+        }
+    }
+    return -1;
+}
+
+int InferencePool::steal(int self)
+{
+    for (int i = 1; i < m_threadCount; ++i) {
+        std::atomic<quint64>& victim = m_slots[(self + i) % m_threadCount].range;
+        quint64 range = victim.load(std::memory_order_acquire);
+        while (rangeBegin(range) < rangeEnd(range)) {
+            // 取走后一半，只剩一个任务时整个取走
+            quint32 begin = rangeBegin(range);
+            quint32 end = rangeEnd(range);
+            quint32 middle = begin + (end - begin) / 2;
+            if (!victim.compare_exchange_weak(range, packRange(begin, middle), std::memory_order_acq_rel)) {
+                continue;
+            }
+            // 自己的区间此时为空，其余部分放进去，别的线程也可以再窃取
+            if (middle + 1 < end) {
+                m_slots[self].range.store(packRange(middle + 1, end), std::memory_order_release);
+            }
+            return int(middle);
+        }
+    }
+    return -1;
+}
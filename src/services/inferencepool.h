@@ -0,0 +1,68 @@
+#ifndef INFERENCEPOOL_H
+#define INFERENCEPOOL_H
+
+#include <QList>
+#include <QMutex>
+#include <QThread>
+#include <QWaitCondition>
+#include <atomic>
+#include <functional>
+#include <memory>
+
+/**
+ * @brief 本地推理专用的工作窃取线程池
+ *
+ * 与 QThreadPool::globalInstance() 相互独立，界面一侧的并发任务不会占用推理线程。
+ * 工作线程常驻并绑定到各自的 CPU 核心。parallelFor 把任务按编号均分给各线程
+ * （调用线程也参与），每个线程先处理自己的区间，做完后从其他线程区间的末尾
+ * 窃取一半。区间的起止打包在一个 64 位原子变量里，领取和窃取都只需一次 CAS。
+ *
+ * 每个 token 要连续执行几百次 parallelFor，间隔只有几微秒，因此空闲线程先自旋
+ * 等待一段时间，仍没有新任务时才休眠。
+ */
+class InferencePool
+{
+public:
+    // threads 包括调用线程，0 表示使用全部逻辑核心
+    explicit InferencePool(int threads = 0);
+    ~InferencePool();
+    InferencePool(const InferencePool&) = delete;
+    InferencePool& operator=(const InferencePool&) = delete;
+
+    int threadCount() const { return m_threadCount; }
+
+    // 在各线程上执行 task(0) ... task(count - 1)，全部完成后返回。
+    // 多个线程同时调用时依次执行
+    void parallelFor(int count, const std::function<void(int)>& task);
+
+private:
+    struct Job {
+        const std::function<void(int)>* task;
+        std::atomic<int> remaining;
+    };
+
+    struct alignas(64) Slot {
+        std::atomic<quint64> range{0};   // 低 32 位是起点，高 32 位是终点
+    };
+
+    void workerLoop(int self);
+    void runTasks(Job& job, int self);
+    int popLocal(int self);
+    int steal(int self);
+
+    int m_threadCount;
+    QList<QThread*> m_workers;
+    std::unique_ptr<Slot[]> m_slots;
+
+    std::atomic<Job*> m_job{nullptr};
+    std::atomic<quint64> m_generation{0};
+    std::atomic<int> m_active{0};       // 正在读取 m_job 的工作线程数
+    std::atomic<int> m_sleepers{0};
+    std::atomic<bool> m_stopping{false};
+
+    QMutex m_parkMutex;
+    QWaitCondition m_parkCondition;
+    QMutex m_callMutex;
+};
+
+#endif // INFERENCEPOOL_H
@@ -0,0 +1,385 @@
+#include "kvcache.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include "services/logger.h"
+
+namespace {
+const quint64 kFnvOffset = 14695981039346656037ULL;
+const quint64 kFnvPrime = 1099511628211ULL;
+
+// 把 size 个 float 量化为 8 位，返回缩放
+float quantizeHead(const float* x, int size, qint8* out)
+{
+    float maxAbs = 0.0f;
+    for (int i = 0; i < size; ++i) {
+        maxAbs = std::max(maxAbs, std::fabs(x[i]));
+    }
+    const float scale = maxAbs / 127.0f;
+    const float inverse = scale > 0.0f ? 1.0f / scale : 0.0f;
+    for (int i = 0; i < size; ++i) {
+        out[i] = qint8(std::lround(x[i] * inverse));
+    }
+    return scale;
+}
+
+void softmax(float* x, int size)
+{
+    float maxValue = *std::max_element(x, x + size);
+    float sum = 0.0f;
+    for (int i = 0; i < size; ++i) {
+        x[i] = std::exp(x[i] - maxValue);
+        sum += x[i];
+    }
+    for (int i = 0; i < size; ++i) {
+        x[i] /= sum;
+    }
+}
+}
+
+KvCache::KvCache()
+{
+}
+
+KvCache::~KvCache()
+{
+}
+
+void KvCache::configure(int layers, int kvHeads, int headDim, int contextLength,
+                        qint64 budgetBytes, bool quantized)
+{
+    clear();
+    m_layers = layers;
+    m_kvHeads = kvHeads;
+    m_headDim = headDim;
+    m_kvDim = kvHeads * headDim;
+    m_quantized = quantized;
+    m_stats = Stats();
+
+    // 当前序列必须放得下，页表最后一页可能只写了一部分
+    const int minimumPages = (contextLength + kPageTokens - 1) / kPageTokens + 1;
+    m_maxPages = int(qBound<qint64>(minimumPages, budgetBytes / qMax<qint64>(1, pageBytes()), INT_MAX));
+
+    LOG_INFO(QString("键值缓存: 每页 %1 KB，最多 %2 页（%3 MB），%4")
+        .arg(pageBytes() / 1024)
+        .arg(m_maxPages)
+        .arg(m_maxPages * pageBytes() / 1048576)
+        .arg(quantized ? "8 位" : "float"));
+}
+
+void KvCache::clear()
+{
+    m_pages.clear();
+    m_freePages.clear();
+    m_lru.clear();
+    m_index.clear();
+    m_table.clear();
+    m_tokens.clear();
+}
+
+qint64 KvCache::pageBytes() const
+{
+    const qint64 positions = qint64(m_layers) * kPageTokens;
+    if (m_quantized) {
+        return 2 * positions * (m_kvDim * qint64(sizeof(qint8)) + m_kvHeads * qint64(sizeof(float)));
+    }
+    return 2 * positions * m_kvDim * qint64(sizeof(float));
+}
+
+quint64 KvCache::chainHash(quint64 parent, const int* tokens)
+{
+    quint64 hash = kFnvOffset ^ parent;
+    for (int i = 0; i < kPageTokens; ++i) {
+        quint32 token = quint32(tokens[i]);
+        for (int b = 0; b < 4; ++b) {
+            hash = (hash ^ ((token >> (8 * b)) & 0xff)) * kFnvPrime;
+        }
+    }
+    // 0 表示未登记
+    return hash ? hash : 1;
+}
+
+int KvCache::beginSequence(const QList<int>& tokens)
+{
+    releaseSequence();
+
+    // 沿前缀逐页查找，命中的页移出 LRU 放进页表
+    quint64 parent = 0;
+    for (int first = 0; first + kPageTokens <= tokens.size(); first += kPageTokens) {
+        quint64 hash = 0;
+        const int id = findPage(parent, tokens.constData() + first, &hash);
+        if (id < 0) {
+            break;
+        }
+        Page& page = *m_pages[id];
+        m_lru.erase(page.lruPosition);
+        page.active = true;
+        m_table.append(id);
+        m_tokens.append(tokens.mid(first, kPageTokens));
+        parent = hash;
+    }
+
+    // 完全命中时最后一个 token 仍要重新计算以得到 logits，它写回原来的位置，内容不变
+    if (!m_tokens.isEmpty() && m_tokens.size() == tokens.size()) {
+        m_tokens.removeLast();
+    }
+
+    const int reused = m_tokens.size();
+    m_stats.promptTokens += tokens.size();
+    m_stats.reusedTokens += reused;
+    return reused;
+}
+
+int KvCache::matchLength(const QList<int>& tokens) const
+{
+    quint64 parent = 0;
+    int matched = 0;
+    while (matched + kPageTokens <= tokens.size()
+           && findPage(parent, tokens.constData() + matched, &parent) >= 0) {
+        matched += kPageTokens;
+    }
+    return matched;
+}
+
+int KvCache::findPage(quint64 parent, const int* tokens, quint64* hash) const
+{
+    *hash = chainHash(parent, tokens);
+    auto it = m_index.constFind(*hash);
+    if (it == m_index.constEnd()) {
+        return -1;
+    }
+    // 哈希相同时还要核对 token，防止碰撞
+    const Page& page = *m_pages[it.value()];
+    if (page.parentHash != parent || memcmp(page.tokens, tokens, sizeof(page.tokens)) != 0) {
+        return -1;
+    }
+    return it.value();
+}
+
+void KvCache::releaseSequence()
+{
+    // 倒序放回，淘汰时先丢掉链条靠后的页，前面的页仍然可以命中
+    for (int i = m_table.size() - 1; i >= 0; --i) {
+        makeInactive(m_table.at(i));
+    }
+    m_table.clear();
+    m_tokens.clear();
+}
+
+void KvCache::makeInactive(int id)
+{
+    Page& page = *m_pages[id];
+    page.active = false;
+    if (page.hash != 0) {
+        m_lru.push_back(id);
+        page.lruPosition = std::prev(m_lru.end());
+    } else {
+        m_freePages.append(id);
+    }
+}
+
+int KvCache::allocatePage()
+{
+    if (!m_freePages.isEmpty()) {
+        return m_freePages.takeLast();
+    }
+
+    if (int(m_pages.size()) < m_maxPages) {
+        try {
+            auto page = std::make_unique<Page>();
+            const size_t values = size_t(m_layers) * kPageTokens * m_kvDim;
+            if (m_quantized) {
+                const size_t scales = size_t(m_layers) * kPageTokens * m_kvHeads;
+                page->quantizedKeys.resize(values);
+                page->quantizedValues.resize(values);
+                page->keyScales.resize(scales);
+                page->valueScales.resize(scales);
+            } else {
+                page->keys.resize(values);
+                page->values.resize(values);
+            }
+            m_pages.push_back(std::move(page));
+            return int(m_pages.size()) - 1;
+        } catch (const std::bad_alloc&) {
+            LOG_WARNING("键值缓存分配失败，改为淘汰旧页");
+        }
+    }
+
+    if (m_lru.empty()) {
+        return -1;
+    }
+    const int id = m_lru.front();
+    m_lru.pop_front();
+    Page& page = *m_pages[id];
+    m_index.remove(page.hash);
+    page.hash = 0;
+    page.parentHash = 0;
+    ++m_stats.evictedPages;
+    return id;
+}
+
+bool KvCache::append(int token)
+{
+    const int position = m_tokens.size();
+    const int slot = position % kPageTokens;
+    if (position / kPageTokens == m_table.size()) {
+        const int id = allocatePage();
+        if (id < 0) {
+            return false;
+        }
+        m_pages[id]->active = true;
+        m_table.append(id);
+    }
+
+    Page& page = *m_pages[m_table.at(position / kPageTokens)];
+    if (page.hash != 0 && page.tokens[slot] != token) {
+        // 改写已登记的页，原来的内容不再有效
+        m_index.remove(page.hash);
+        page.hash = 0;
+        page.parentHash = 0;
+    }
+    page.tokens[slot] = token;
+    m_tokens.append(token);
+
+    if (slot == kPageTokens - 1 && page.hash == 0) {
+        const int index = position / kPageTokens;
+        const quint64 parent = index > 0 ? m_pages[m_table.at(index - 1)]->hash : 0;
+        const quint64 hash = chainHash(parent, page.tokens);
+        // 前一页没有登记或已有相同内容的页时不登记，序列结束后这一页直接回收
+        if ((index == 0 || parent != 0) && !m_index.contains(hash)) {
+            page.hash = hash;
+            page.parentHash = parent;
+            m_index.insert(hash, m_table.at(index));
+        }
+    }
+    return true;
+}
+
+void KvCache::store(int layer, int position, const float* key, const float* value)
+{
+    Page& page = *m_pages[m_table.at(position / kPageTokens)];
+    const size_t row = size_t(layer) * kPageTokens + position % kPageTokens;
+    if (!m_quantized) {
+        memcpy(page.keys.data() + row * m_kvDim, key, m_kvDim * sizeof(float));
+        memcpy(page.values.data() + row * m_kvDim, value, m_kvDim * sizeof(float));
+        return;
+    }
+    for (int h = 0; h < m_kvHeads; ++h) {
+        const size_t offset = row * m_kvDim + h * m_headDim;
+        page.keyScales[row * m_kvHeads + h] = quantizeHead(key + h * m_headDim, m_headDim, page.quantizedKeys.data() + offset);
+        page.valueScales[row * m_kvHeads + h] = quantizeHead(value + h * m_headDim, m_headDim, page.quantizedValues.data() + offset);
+    }
+}
+
+void KvCache::attend(int layer, int kvHead, const float* query, int length, float scale,
+                     float* scores, float* out) const
+{
+    const int headOffset = kvHead * m_headDim;
+
+    for (int t = 0; t < length; ++t) {
+        const Page& page = *m_pages[m_table.at(t / kPageTokens)];
+        const size_t row = size_t(layer) * kPageTokens + t % kPageTokens;
+        float dot = 0.0f;
+        if (m_quantized) {
+            const qint8* k = page.quantizedKeys.data() + row * m_kvDim + headOffset;
+            for (int i = 0; i < m_headDim; ++i) {
+                dot += query[i] * k[i];
+            }
+            dot *= page.keyScales[row * m_kvHeads + kvHead];
+        } else {
+            const float* k = page.keys.data() + row * m_kvDim + headOffset;
+            for (int i = 0; i < m_headDim; ++i) {
+                dot += query[i] * k[i];
+            }
+        }
+        scores[t] = dot * scale;
+    }
+    softmax(scores, length);
+
+    std::fill(out, out + m_headDim, 0.0f);
+    for (int t = 0; t < length; ++t) {
+        const Page& page = *m_pages[m_table.at(t / kPageTokens)];
+        const size_t row = size_t(layer) * kPageTokens + t % kPageTokens;
+        if (m_quantized) {
+            const qint8* v = page.quantizedValues.data() + row * m_kvDim + headOffset;
+            const float weight = scores[t] * page.valueScales[row * m_kvHeads + kvHead];
+            for (int i = 0; i < m_headDim; ++i) {
+                out[i] += weight * v[i];
+            }
+        } else {
+            const float* v = page.values.data() + row * m_kvDim + headOffset;
+            const float weight = scores[t];
+            for (int i = 0; i < m_headDim; ++i) {
+                out[i] += weight * v[i];
+            }
+        }
+    }
+}
+
+KvCache::Stats KvCache::stats() const
+{
+    Stats stats = m_stats;
+    stats.activePages = m_table.size();
+    stats.cachedPages = int(m_lru.size());
+    stats.bytes = qint64(m_pages.size()) * pageBytes();
+    return stats;
+}
+
+void KvCache::exportPage(int index, uchar* out) const
+{
+    const Page& page = *m_pages[m_table.at(index)];
+    auto write = [&out](const auto& values) {
+        const size_t bytes = values.size() * sizeof(values[0]);
+        memcpy(out, values.data(), bytes);
+        out += bytes;
+    };
+    if (m_quantized) {
+        write(page.quantizedKeys);
+        write(page.quantizedValues);
+        write(page.keyScales);
+        write(page.valueScales);
+    } else {
+        write(page.keys);
+        write(page.values);
+    }
+}
+
+quint64 KvCache::importPage(quint64 parent, const int* tokens, const uchar* data)
+{
+    quint64 hash = 0;
+    if (findPage(parent, tokens, &hash) >= 0) {
+        return hash;
+    }
+    if (m_index.contains(hash)) {
+        return 0;
+    }
+    const int id = allocatePage();
+    if (id < 0) {
+        return 0;
+    }
+
+    Page& page = *m_pages[id];
+    auto read = [&data](auto& values) {
+        const size_t bytes = values.size() * sizeof(values[0]);
+        memcpy(values.data(), data, bytes);
+        data += bytes;
+    };
+    if (m_quantized) {
+        read(page.quantizedKeys);
+        read(page.quantizedValues);
+        read(page.keyScales);
+        read(page.valueScales);
+    } else {
+        read(page.keys);
+        read(page.values);
+    }
+    memcpy(page.tokens, tokens, sizeof(page.tokens));
+    page.hash = hash;
+    page.parentHash = parent;
+    page.active = false;
+    m_index.insert(hash, id);
+    m_lru.push_back(id);
+    page.lruPosition = std::prev(m_lru.end());
+    return hash;
+}
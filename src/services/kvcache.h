@@ -0,0 +1,123 @@
+#ifndef KVCACHE_H
+#define KVCACHE_H
+
+#include <QHash>
+#include <QList>
+#include <list>
+#include <memory>
+#include <vector>
+
+/**
+ * @brief 本地推理的分页键值缓存
+ *
+ * 键值按 64 个 token 一页存放，当前序列由页表映射到各页。写满的页以
+ * “前一页的哈希 + 本页 token”的链式哈希登记，开始新序列时沿着 token 前缀
+ * 逐页查找，命中的页直接放进新序列的页表，只需为剩下的 token 计算键值。
+ * 多轮对话中每一轮的提示都以上一轮为前缀，因此只有新增的部分需要预填充。
+ *
+ * 不属于当前序列的满页按最近使用顺序保留，超出内存预算时从最久未用的开始淘汰。
+ * 可以选择以 8 位存储（每个头一个缩放），内存约为 float 的四分之一多一点。
+ */
+class KvCache
+{
+public:
+    static constexpr int kPageTokens = 64;
+
+    struct Stats {
+        qint64 promptTokens = 0;    // 累计提交的提示 token 数
+        qint64 reusedTokens = 0;    // 其中直接复用缓存的数量
+        qint64 evictedPages = 0;
+        int activePages = 0;
+        int cachedPages = 0;
+        qint64 bytes = 0;           // 已分配页的总字节数
+
+        double hitRate() const { return promptTokens > 0 ? double(reusedTokens) / promptTokens : 0.0; }
+    };
+
+    KvCache();
+    ~KvCache();
+    KvCache(const KvCache&) = delete;
+    KvCache& operator=(const KvCache&) = delete;
+
+    // 设置形状和预算并清空缓存。预算至少能容纳一个完整上下文
+    void configure(int layers, int kvHeads, int headDim, int contextLength,
+                   qint64 budgetBytes, bool quantized);
+    void clear();
+
+    bool isQuantized() const { return m_quantized; }
+    int layers() const { return m_layers; }
+    int kvHeads() const { return m_kvHeads; }
+    int headDim() const { return m_headDim; }
+    // 一页键值序列化后的字节数
+    qint64 pageBytes() const;
+
+    // 开始新序列，之前的序列留在缓存中。返回 tokens 开头已经有键值的 token 数，
+    // 至少留下一个 token 需要计算，调用方由此得到 logits
+    int beginSequence(const QList<int>& tokens);
+    // 当前序列的长度
+    int length() const { return m_tokens.size(); }
+    const QList<int>& tokens() const { return m_tokens; }
+    // 结束当前序列，页面留在缓存中
+    void endSequence() { releaseSequence(); }
+    // 不改变缓存，返回 tokens 开头能按整页命中的 token 数
+    int matchLength(const QList<int>& tokens) const;
+
+    // 在序列末尾追加一个 token，需要时分配新页。超出预算时返回 false
+    bool append(int token);
+    // 写入序列中 position 处第 layer 层的键值，长度均为 kvHeads * headDim
+    void store(int layer, int position, const float* key, const float* value);
+
+    // 第 layer 层、第 kvHead 个头对序列前 length 个位置的注意力：
+    // scores 为长度 length 的临时空间，结果写入 out（headDim 个值）
+    void attend(int layer, int kvHead, const float* query, int length, float scale,
+                float* scores, float* out) const;
+
+    Stats stats() const;
+
+    // 把当前序列的第 index 页（必须已写满）序列化到 out，长度为 pageBytes()
+    void exportPage(int index, uchar* out) const;
+    // 登记一个从外部读入的整页，parent 为前一页的哈希（第一页为 0），
+    // 返回本页的哈希，没有空间时返回 0。调用前应先结束当前序列
+    quint64 importPage(quint64 parent, const int* tokens, const uchar* data);
+
+private:
+    struct Page {
+        quint64 hash = 0;           // 写满并登记后的链式哈希，0 表示未登记
+        quint64 parentHash = 0;
+        bool active = false;        // 在当前序列的页表中
+        int tokens[kPageTokens];
+        std::vector<float> keys;    // float 模式：[层][位置][kvDim]
+        std::vector<float> values;
+        std::vector<qint8> quantizedKeys;     // 8 位模式：[层][位置][kvDim]
+        std::vector<qint8> quantizedValues;
+        std::vector<float> keyScales;         // [层][位置][kvHeads]
+        std::vector<float> valueScales;
+        std::list<int>::iterator lruPosition;
+    };
+
+    static quint64 chainHash(quint64 parent, const int* tokens);
+    // 按链式哈希查找与 tokens 相同的已登记页，找不到时返回 -1
+    int findPage(quint64 parent, const int* tokens, quint64* hash) const;
+    int allocatePage();
+    void releaseSequence();
+    void makeInactive(int id);
+
+    int m_layers = 0;
+    int m_kvHeads = 0;
+    int m_headDim = 0;
+    int m_kvDim = 0;
+    int m_maxPages = 0;
+    bool m_quantized = false;
+
+    std::vector<std::unique_ptr<Page>> m_pages;
+    QList<int> m_freePages;
+    std::list<int> m_lru;                  // 不在当前序列中的已登记页，最久未用的在前
+    QHash<quint64, int> m_index;           // 链式哈希 -> 页
+
+    QList<int> m_table;                    // 当前序列的页表
+    QList<int> m_tokens;                   // 当前序列的 token
+
+    Stats m_stats;
+};
+
+#endif // KVCACHE_H
@@ -0,0 +1,230 @@
+#include "kvcachefile.h"
+#include <QByteArray>
+#include <QFile>
+#include <QtEndian>
+#include "services/kvcache.h"
+#include "services/logger.h"
+#include "services/tracer.h"
+
+namespace {
+const quint32 kMagic = 0x43564b43;     // "CKVC"，小端
+const quint32 kVersion = 1;
+const qint64 kHeaderSize = 48;
+// 页数据从整页边界开始，映射后可以直接按页读取
+const qint64 kDataOffset = 4096;
+const quint32 kQuantizedFlag = 1;
+
+struct Header {
+    quint64 modelHash = 0;
+    quint32 layers = 0;
+    quint32 kvHeads = 0;
+    quint32 headDim = 0;
+    quint32 flags = 0;
+    quint64 pageBytes = 0;
+    quint32 pageTokens = 0;
+    quint32 pageCount = 0;
+
+    // 除页数以外都相同时，文件中的页可以与缓存互相替换
+    bool sameLayout(const Header& other) const
+    {
+        return modelHash == other.modelHash && layers == other.layers && kvHeads == other.kvHeads
+            && headDim == other.headDim && flags == other.flags && pageBytes == other.pageBytes
+            && pageTokens == other.pageTokens;
+    }
+
+    qint64 tokensOffset() const { return kDataOffset + qint64(pageCount) * qint64(pageBytes); }
+    qint64 fileSize() const { return tokensOffset() + qint64(pageCount) * pageTokens * 4; }
+};
+
+Header headerFor(const KvCache& cache, quint64 modelHash)
+{
+    Header header;
+    header.modelHash = modelHash;
+    header.layers = quint32(cache.layers());
+    header.kvHeads = quint32(cache.kvHeads());
+    header.headDim = quint32(cache.headDim());
+    header.flags = cache.isQuantized() ? kQuantizedFlag : 0;
+    header.pageBytes = quint64(cache.pageBytes());
+    header.pageTokens = KvCache::kPageTokens;
+    return header;
+}
+
+QByteArray encodeHeader(const Header& header)
+{
+    QByteArray bytes(kHeaderSize, '\0');
+    uchar* p = reinterpret_cast<uchar*>(bytes.data());
+    qToLittleEndian<quint32>(kMagic, p);
+    qToLittleEndian<quint32>(kVersion, p + 4);
+    qToLittleEndian<quint64>(header.modelHash, p + 8);
+    qToLittleEndian<quint32>(header.layers, p + 16);
+    qToLittleEndian<quint32>(header.kvHeads, p + 20);
+    qToLittleEndian<quint32>(header.headDim, p + 24);
+    qToLittleEndian<quint32>(header.flags, p + 28);
+    qToLittleEndian<quint64>(header.pageBytes, p + 32);
+    qToLittleEndian<quint32>(header.pageTokens, p + 40);
+    qToLittleEndian<quint32>(header.pageCount, p + 44);
+    return bytes;
+}
+
+bool decodeHeader(const uchar* p, qint64 size, Header* header)
+{
+    if (size < kDataOffset || qFromLittleEndian<quint32>(p) != kMagic
+        || qFromLittleEndian<quint32>(p + 4) != kVersion) {
+        return false;
+    }
+    header->modelHash = qFromLittleEndian<quint64>(p + 8);
+    header->layers = qFromLittleEndian<quint32>(p + 16);
+    header->kvHeads = qFromLittleEndian<quint32>(p + 20);
+    header->headDim = qFromLittleEndian<quint32>(p + 24);
+    header->flags = qFromLittleEndian<quint32>(p + 28);
+    header->pageBytes = qFromLittleEndian<quint64>(p + 32);
+    header->pageTokens = qFromLittleEndian<quint32>(p + 40);
+    header->pageCount = qFromLittleEndian<quint32>(p + 44);
+    // 页数超出文件长度时视为损坏
+    return header->pageTokens == quint32(KvCache::kPageTokens) && header->fileSize() <= size;
+}
+
+// 文件中第 page 页的 token 是否与 tokens 中对应的部分相同
+bool samePage(const uchar* stored, int page, const QList<int>& tokens)
+{
+    const int first = page * KvCache::kPageTokens;
+    if (first + KvCache::kPageTokens > tokens.size()) {
+        return false;
+    }
+    const uchar* p = stored + qint64(first) * 4;
+    for (int i = 0; i < KvCache::kPageTokens; ++i) {
+        if (qFromLittleEndian<qint32>(p + i * 4) != tokens.at(first + i)) {
+            return false;
+        }
+    }
+    return true;
+}
+}
+
+bool KvCacheFile::save(const QString& path, const KvCache& cache, quint64 modelHash, QString* error,
+                       const std::atomic<bool>* cancelled)
+{
+    TRACE_SCOPE_CAT("KvCacheFile::save", "inference");
+    const int pages = cache.length() / KvCache::kPageTokens;
+    if (pages == 0) {
+        return true;
+    }
+
+    auto fail = [&](const QString& message) {
+        if (error) {
+            *error = message;
+        }
+        LOG_WARNING(QString("保存键值缓存失败: %1").arg(message));
+        return false;
+    };
+
+    QFile file(path);
+    if (!file.open(QIODevice::ReadWrite)) {
+        return fail(file.errorString());
+    }
+
+    Header header = headerFor(cache, modelHash);
+    const QList<int>& tokens = cache.tokens();
+
+    // 与文件中已有的页逐页比较，相同的部分不再写入
+    int common = 0;
+    Header existing;
+    const QByteArray head = file.read(kDataOffset);
+    if (head.size() == kDataOffset
+        && decodeHeader(reinterpret_cast<const uchar*>(head.constData()), file.size(), &existing)
+        && existing.sameLayout(header) && file.seek(existing.tokensOffset())) {
+        const QByteArray stored = file.read(qint64(existing.pageCount) * KvCache::kPageTokens * 4);
+        const int storedPages = int(stored.size() / (KvCache::kPageTokens * 4));
+        while (common < qMin(storedPages, pages)
+               && samePage(reinterpret_cast<const uchar*>(stored.constData()), common, tokens)) {
+            ++common;
+        }
+        if (common == pages && existing.pageCount == quint32(pages)) {
+            return true;
+        }
+    }
+
+    // 开始写入前已经取消时保留原文件
+    if (cancelled && *cancelled) {
+        return fail("已取消");
+    }
+
+    // 先撤销提交点，写到一半时文件不会被当作有效
+    header.pageCount = 0;
+    if (!file.seek(0) || file.write(encodeHeader(header)) != kHeaderSize || !file.flush()) {
+        return fail(file.errorString());
+    }
+    if (file.size() < kDataOffset && !file.resize(kDataOffset)) {
+        return fail(file.errorString());
+    }
+
+    QByteArray buffer(cache.pageBytes(), Qt::Uninitialized);
+    for (int i = common; i < pages; ++i) {
+        if (cancelled && *cancelled) {
+            return fail("已取消");
+        }
+        cache.exportPage(i, reinterpret_cast<uchar*>(buffer.data()));
+        if (!file.seek(kDataOffset + qint64(i) * cache.pageBytes()) || file.write(buffer) != buffer.size()) {
+            return fail(file.errorString());
+        }
+    }
+
+    header.pageCount = quint32(pages);
+    QByteArray tokenBytes(qint64(pages) * KvCache::kPageTokens * 4, Qt::Uninitialized);
+    for (int i = 0; i < pages * KvCache::kPageTokens; ++i) {
+        qToLittleEndian<qint32>(tokens.at(i), reinterpret_cast<uchar*>(tokenBytes.data()) + qint64(i) * 4);
+    }
+    if (!file.seek(header.tokensOffset()) || file.write(tokenBytes) != tokenBytes.size()
+        || !file.resize(header.fileSize()) || !file.flush()) {
+        return fail(file.errorString());
+    }
+    if (!file.seek(0) || file.write(encodeHeader(header)) != kHeaderSize || !file.flush()) {
+        return fail(file.errorString());
+    }
+
+    LOG_INFO(QString("已保存键值缓存: %1 页，其中新写入 %2 页（%3 MB）")
+        .arg(pages).arg(pages - common)
+        .arg((pages - common) * cache.pageBytes() / 1048576));
+    return true;
+}
+
+int KvCacheFile::restore(const QString& path, KvCache& cache, quint64 modelHash, const QList<int>& tokens)
+{
+    TRACE_SCOPE_CAT("KvCacheFile::restore", "inference");
+    QFile file(path);
+    if (!file.exists() || !file.open(QIODevice::ReadOnly) || file.size() < kDataOffset) {
+        return 0;
+    }
+    uchar* data = file.map(0, file.size());
+    if (!data) {
+        LOG_WARNING(QString("无法映射键值缓存文件: %1").arg(file.errorString()));
+        return 0;
+    }
+
+    Header header;
+    if (!decodeHeader(data, file.size(), &header) || !header.sameLayout(headerFor(cache, modelHash))) {
+        LOG_INFO("键值缓存文件与当前模型或缓存设置不符，已忽略");
+        file.unmap(data);
+        return 0;
+    }
+
+    const uchar* stored = data + header.tokensOffset();
+    cache.endSequence();
+    quint64 parent = 0;
+    int restored = 0;
+    while (restored < int(header.pageCount) && samePage(stored, restored, tokens)) {
+        parent = cache.importPage(parent, tokens.constData() + restored * KvCache::kPageTokens,
+                                  data + kDataOffset + qint64(restored) * qint64(header.pageBytes));
+        if (parent == 0) {
+            break;
+        }
+        ++restored;
+    }
+    file.unmap(data);
+
+    if (restored > 0) {
+        LOG_INFO(QString("已从文件恢复键值缓存: %1 页，%2 个 token").arg(restored)
+            .arg(restored * KvCache::kPageTokens));
+    }
+    return restored * KvCache::kPageTokens;
+}
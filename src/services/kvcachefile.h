@@ -0,0 +1,38 @@
+#ifndef KVCACHEFILE_H
+#define KVCACHEFILE_H
+
+#include <QList>
+#include <QString>
+#include <atomic>
+
+class KvCache;
+
+/**
+ * @brief 键值缓存在对话目录中的持久化文件（kvcache.bin）
+ *
+ * 文件格式:
+ *   [0, 4096)     头部：魔数、版本、模型指纹、层数、kv 头数、头维度、是否 8 位、
+ *                 每页字节数、每页 token 数、页数
+ *   页数据        第 i 页位于 4096 + i * 每页字节数，与 KvCache 的页面布局相同
+ *   token         页数据之后，每页 64 个 int32
+ *
+ * 头部中的页数是提交点：保存时先清零，写完页数据和 token 后再写入，中途崩溃的文件
+ * 只会被当作空文件。读取时整个文件内存映射，模型指纹和形状不同的文件直接忽略，
+ * 只导入与新提示词前缀逐页相同的部分，页数据直接复制，不再计算。
+ *
+ * 同一对话的前缀通常不变，保存时只写入与文件中不同的页。
+ */
+class KvCacheFile
+{
+public:
+    // 保存 cache 当前序列中已写满的页，失败时返回 false 并写入 error。
+    // cancelled 置位后在下一页之前放弃，文件不提交，之后当作空文件
+    static bool save(const QString& path, const KvCache& cache, quint64 modelHash,
+                     QString* error = nullptr, const std::atomic<bool>* cancelled = nullptr);
+    // 把文件中与 tokens 前缀相同的页导入 cache，返回导入覆盖的 token 数。
+    // 会结束 cache 的当前序列
+    static int restore(const QString& path, KvCache& cache, quint64 modelHash,
+                       const QList<int>& tokens);
+};
+
+#endif // KVCACHEFILE_H
@@ -0,0 +1,589 @@
+#include "llamaengine.h"
+#include <QFloat16>
+#include <QThread>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "services/kvcachefile.h"
+#include "services/logger.h"
+#include "services/tracer.h"
+#include "utils/quantkernels.h"
+
+namespace {
+// 行数少于该值的矩阵不拆分，线程调度的开销超过计算量
+const int kMinTileRows = 32;
+// 每个线程平均分到的块数，块越多负载越均衡，窃取的机会也越多
+const int kTilesPerThread = 8;
+
+float halfToFloat(const uchar* p)
+{
+    qfloat16 value;
+    memcpy(&value, p, sizeof(value));
+    return float(value);
+}
+
+// 一行未量化的权重与 x 的点积，量化权重由 QuantKernels 计算
+float dotRow(const uchar* row, quint32 type, const float* x, int cols)
+{
+    float sum = 0.0f;
+    switch (type) {
+        case GgufFile::F32: {
+            const float* w = reinterpret_cast<const float*>(row);
+            for (int i = 0; i < cols; ++i) {
+                sum += w[i] * x[i];
+            }
+            break;
+        }
+        case GgufFile::F16:
+            for (int i = 0; i < cols; ++i) {
+                sum += halfToFloat(row + i * 2) * x[i];
+            }
+            break;
+        default:
+            break;
+    }
+    return sum;
+}
+
+void dequantizeRow(const uchar* row, quint32 type, float* out, int cols)
+{
+    switch (type) {
+        case GgufFile::F32:
+            memcpy(out, row, cols * sizeof(float));
+            break;
+        case GgufFile::F16:
+            for (int i = 0; i < cols; ++i) {
+                out[i] = halfToFloat(row + i * 2);
+            }
+            break;
+        case GgufFile::Q8_0:
+            for (int b = 0; b < cols / 32; ++b) {
+                const uchar* block = row + b * 34;
+                const qint8* qs = reinterpret_cast<const qint8*>(block + 2);
+                float d = halfToFloat(block);
+                for (int j = 0; j < 32; ++j) {
+                    out[b * 32 + j] = qs[j] * d;
+                }
+            }
+            break;
+        case GgufFile::Q4_0:
+            for (int b = 0; b < cols / 32; ++b) {
+                const uchar* block = row + b * 18;
+                const uchar* qs = block + 2;
+                float d = halfToFloat(block);
+                for (int j = 0; j < 16; ++j) {
+                    out[b * 32 + j] = ((qs[j] & 0x0f) - 8) * d;
+                    out[b * 32 + j + 16] = ((qs[j] >> 4) - 8) * d;
+                }
+            }
+            break;
+        default:
+            std::fill(out, out + cols, 0.0f);
+            break;
+    }
+}
+
+void rmsNorm(float* out, const float* x, const float* weight, int size, float eps)
+{
+    double squares = 0.0;
+    for (int i = 0; i < size; ++i) {
+        squares += double(x[i]) * x[i];
+    }
+    float scale = 1.0f / std::sqrt(float(squares / size) + eps);
+    for (int i = 0; i < size; ++i) {
+        out[i] = x[i] * scale * weight[i];
+    }
+}
+
+void addBias(float* x, const float* bias, int size)
+{
+    if (bias) {
+        for (int i = 0; i < size; ++i) {
+            x[i] += bias[i];
+        }
+    }
+}
+
+void softmax(float* x, int size)
+{
+    float maxValue = *std::max_element(x, x + size);
+    float sum = 0.0f;
+    for (int i = 0; i < size; ++i) {
+        x[i] = std::exp(x[i] - maxValue);
+        sum += x[i];
+    }
+    for (int i = 0; i < size; ++i) {
+        x[i] /= sum;
+    }
+}
+
+// 对每个头的前 2 * frequencies.size() 维做旋转位置编码。
+// llama 的权重在转换时已经重排，相邻两维为一对；neox 风格（Qwen2 等）前后两半为一对
+void rope(float* x, int heads, int headDim, int position,
+          const std::vector<float>& frequencies, bool neox)
+{
+    const int pairs = int(frequencies.size());
+    for (int h = 0; h < heads; ++h) {
+        float* head = x + h * headDim;
+        for (int i = 0; i < pairs; ++i) {
+            float angle = position * frequencies[i];
+            float c = std::cos(angle);
+            float s = std::sin(angle);
+            int a = neox ? i : 2 * i;
+            int b = neox ? i + pairs : 2 * i + 1;
+            float x0 = head[a];
+            float x1 = head[b];
+            head[a] = x0 * c - x1 * s;
+            head[b] = x0 * s + x1 * c;
+        }
+    }
+}
+}
+
+LlamaEngine::LlamaEngine()
+    : m_pool(new InferencePool)
+{
+}
+
+LlamaEngine::~LlamaEngine()
+{
+}
+
+bool LlamaEngine::load(const QString& path, int maxContext, QString* error, const std::atomic<bool>* cancelled)
+{
+    TRACE_SCOPE("LlamaEngine::load");
+    unload();
+
+    auto fail = [&](const QString& message) {
+        if (error) {
+            *error = message;
+        }
+        LOG_ERROR(QString("加载本地模型失败: %1").arg(message));
+        unload();
+        return false;
+    };
+    auto isCancelled = [&]() {
+        if (!cancelled || !*cancelled) {
+            return false;
+        }
+        if (error) {
+            *error = "已取消加载";
+        }
+        LOG_INFO("已取消加载本地模型");
+        unload();
+        return true;
+    };
+
+    QString message;
+    if (!m_file.open(path, &message)) {
+        return fail(message);
+    }
+    if (isCancelled()) {
+        return false;
+    }
+
+    const QByteArray arch = m_file.value("general.architecture").toByteArray();
+    if (arch != "llama" && arch != "qwen2") {
+        return fail(QString("不支持的模型结构: %1").arg(QString::fromUtf8(arch)));
+    }
+    const bool neoxRope = arch == "qwen2";
+    auto meta = [&](const char* key, const QVariant& defaultValue = QVariant()) {
+        return m_file.value(arch + '.' + key, defaultValue);
+    };
+
+    if (!m_tokenizer.load(m_file, &message)) {
+        return fail(message);
+    }
+    if (isCancelled()) {
+        return false;
+    }
+
+    Config& c = m_config;
+    c.dim = meta("embedding_length").toInt();
+    c.hiddenDim = meta("feed_forward_length").toInt();
+    c.layers = meta("block_count").toInt();
+    c.heads = meta("attention.head_count").toInt();
+    c.kvHeads = meta("attention.head_count_kv", c.heads).toInt();
+    c.normEps = meta("attention.layer_norm_rms_epsilon", 1e-5f).toFloat();
+    c.ropeBase = meta("rope.freq_base", 10000.0f).toFloat();
+    // 有些模型的词嵌入按对齐补齐了行数，以张量的形状为准
+    const GgufFile::Tensor* embedding = m_file.tensor("token_embd.weight");
+    c.vocabSize = embedding && embedding->dims.size() == 2 ? int(embedding->dims.at(1)) : m_tokenizer.vocabSize();
+    if (c.dim <= 0 || c.hiddenDim <= 0 || c.layers <= 0 || c.heads <= 0
+        || c.kvHeads <= 0 || c.heads % c.kvHeads != 0 || c.dim % c.heads != 0) {
+        return fail("模型超参数无效");
+    }
+    c.headDim = c.dim / c.heads;
+    int trainedContext = meta("context_length", 2048).toInt();
+    c.contextLength = qMax(16, maxContext > 0 ? qMin(maxContext, trainedContext) : trainedContext);
+    int ropeDim = meta("rope.dimension_count", c.headDim).toInt();
+
+    const int qDim = c.heads * c.headDim;
+    const int kvDim = c.kvHeads * c.headDim;
+    if (!loadMatrix("token_embd.weight", c.vocabSize, c.dim, &m_embedding, &message)
+        || !loadVector("output_norm.weight", c.dim, &m_outputNorm, &message)) {
+        return fail(message);
+    }
+    // 没有单独的输出层时与词嵌入共享权重
+    if (m_file.tensor("output.weight")) {
+        if (!loadMatrix("output.weight", c.vocabSize, c.dim, &m_output, &message)) {
+            return fail(message);
+        }
+    } else {
+        m_output = m_embedding;
+    }
+
+    m_layers.resize(c.layers);
+    for (int i = 0; i < c.layers; ++i) {
+        if (isCancelled()) {
+            return false;
+        }
+        const QByteArray prefix = "blk." + QByteArray::number(i) + '.';
+        Layer& layer = m_layers[i];
+        bool ok = loadVector(prefix + "attn_norm.weight", c.dim, &layer.attentionNorm, &message)
+            && loadMatrix(prefix + "attn_q.weight", qDim, c.dim, &layer.query, &message)
+            && loadMatrix(prefix + "attn_k.weight", kvDim, c.dim, &layer.key, &message)
+            && loadMatrix(prefix + "attn_v.weight", kvDim, c.dim, &layer.value, &message)
+            && loadMatrix(prefix + "attn_output.weight", c.dim, qDim, &layer.attentionOutput, &message)
+            && loadVector(prefix + "ffn_norm.weight", c.dim, &layer.ffnNorm, &message)
+            && loadMatrix(prefix + "ffn_gate.weight", c.hiddenDim, c.dim, &layer.gate, &message)
+            && loadMatrix(prefix + "ffn_up.weight", c.hiddenDim, c.dim, &layer.up, &message)
+            && loadMatrix(prefix + "ffn_down.weight", c.dim, c.hiddenDim, &layer.down, &message);
+        if (!ok) {
+            return fail(message);
+        }
+        // Qwen2 的 q/k/v 带偏置
+        if (m_file.tensor(prefix + "attn_q.bias")) {
+            ok = loadVector(prefix + "attn_q.bias", qDim, &layer.queryBias, &message)
+                && loadVector(prefix + "attn_k.bias", kvDim, &layer.keyBias, &message)
+                && loadVector(prefix + "attn_v.bias", kvDim, &layer.valueBias, &message);
+            if (!ok) {
+                return fail(message);
+            }
+        }
+    }
+
+    m_neoxRope = neoxRope;
+    m_modelHash = m_file.fingerprint();
+    m_ropeFrequencies.resize(qMin(ropeDim, c.headDim) / 2);
+    for (int i = 0; i < int(m_ropeFrequencies.size()); ++i) {
+        m_ropeFrequencies[i] = std::pow(c.ropeBase, -2.0f * i / ropeDim);
+    }
+
+    m_cache.configure(c.layers, c.kvHeads, c.headDim, c.contextLength, m_cacheBudget, m_cacheQuantized);
+    m_x.resize(size_t(kBatchSize) * c.dim);
+    m_xb.resize(size_t(kBatchSize) * c.dim);
+    m_xb2.resize(size_t(kBatchSize) * qDim);
+    m_q.resize(size_t(kBatchSize) * qDim);
+    m_k.resize(size_t(kBatchSize) * kvDim);
+    m_v.resize(size_t(kBatchSize) * kvDim);
+    m_hb.resize(size_t(kBatchSize) * c.hiddenDim);
+    m_hb2.resize(size_t(kBatchSize) * c.hiddenDim);
+    m_scores.resize(size_t(c.heads) * c.contextLength);
+    m_logits.resize(c.vocabSize);
+
+    LOG_INFO(QString("本地模型已加载: %1 层, 维度 %2, 词表 %3, 上下文 %4, 权重 %5, 内核 %6")
+        .arg(c.layers).arg(c.dim).arg(c.vocabSize).arg(c.contextLength)
+        .arg(GgufFile::typeName(m_layers.first().query.type))
+        .arg(QuantKernels::isaName(QuantKernels::isa())));
+    return true;
+}
+
+void LlamaEngine::setThreadCount(int threads)
+{
+    int wanted = threads > 0 ? threads : qMax(1, QThread::idealThreadCount());
+    if (wanted != m_pool->threadCount()) {
+        m_pool.reset(new InferencePool(wanted));
+    }
+}
+
+bool LlamaEngine::configureCache(qint64 budgetBytes, bool quantized)
+{
+    if (budgetBytes == m_cacheBudget && quantized == m_cacheQuantized) {
+        return false;
+    }
+    m_cacheBudget = budgetBytes;
+    m_cacheQuantized = quantized;
+    if (isLoaded()) {
+        const Config& c = m_config;
+        m_cache.configure(c.layers, c.kvHeads, c.headDim, c.contextLength, m_cacheBudget, m_cacheQuantized);
+    }
+    return true;
+}
+
+int LlamaEngine::beginSequence(const QList<int>& tokens)
+{
+    return m_cache.beginSequence(tokens);
+}
+
+bool LlamaEngine::saveCache(const QString& path, const std::atomic<bool>* cancelled) const
+{
+    return isLoaded() && KvCacheFile::save(path, m_cache, m_modelHash, nullptr, cancelled);
+}
+
+int LlamaEngine::restoreCache(const QString& path, const QList<int>& tokens)
+{
+    return isLoaded() ? KvCacheFile::restore(path, m_cache, m_modelHash, tokens) : 0;
+}
+
+void LlamaEngine::unload()
+{
+    m_file.close();
+    m_layers.clear();
+    m_embedding = Matrix();
+    m_output = Matrix();
+    m_outputNorm = nullptr;
+    m_config = Config();
+    m_modelHash = 0;
+    m_cache.clear();
+}
+
+bool LlamaEngine::loadMatrix(const QByteArray& name, int rows, int cols, Matrix* matrix, QString* error) const
+{
+    const GgufFile::Tensor* tensor = m_file.tensor(name);
+    if (!tensor) {
+        if (error) {
+            *error = QString("缺少张量 %1").arg(QString::fromUtf8(name));
+        }
+        return false;
+    }
+    if (tensor->dims.size() != 2 || tensor->dims.at(0) != cols || tensor->dims.at(1) != rows) {
+        if (error) {
+            *error = QString("张量 %1 的形状不符").arg(QString::fromUtf8(name));
+        }
+        return false;
+    }
+    if (tensor->bytes == 0) {
+        if (error) {
+            *error = QString("张量 %1 使用了不支持的类型 %2")
+                .arg(QString::fromUtf8(name), GgufFile::typeName(tensor->type));
+        }
+        return false;
+    }
+    matrix->data = tensor->data;
+    matrix->type = tensor->type;
+    matrix->rows = rows;
+    matrix->cols = cols;
+    matrix->rowBytes = tensor->bytes / rows;
+    return true;
+}
+
+bool LlamaEngine::loadVector(const QByteArray& name, int size, const float** vector, QString* error) const
+{
+    const GgufFile::Tensor* tensor = m_file.tensor(name);
+    if (!tensor || tensor->type != GgufFile::F32 || tensor->elements() != size) {
+        if (error) {
+            *error = QString("缺少张量或格式不符: %1").arg(QString::fromUtf8(name));
+        }
+        return false;
+    }
+    *vector = reinterpret_cast<const float*>(tensor->data);
+    return true;
+}
+
+void LlamaEngine::matmul(float* out, qint64 outStride, const Matrix& w, const float* x, qint64 xStride,
+                         int count) const
+{
+    // 量化权重先把 x 量化为 8 位块，整行点积都用整数完成
+    const bool quantized = QuantKernels::supports(w.type);
+    const int blocks = w.cols / QuantKernels::kBlockSize;
+    if (quantized) {
+        m_activations.resize(size_t(count) * blocks);
+        for (int i = 0; i < count; ++i) {
+            QuantKernels::quantize(x + i * xStride, w.cols, m_activations.data() + size_t(i) * blocks);
+        }
+    }
+
+    auto computeRows = [&](int first, int last) {
+        if (quantized && count == 1) {
+            QuantKernels::gemv(w.type, w.data + first * w.rowBytes, w.rowBytes, last - first,
+                               m_activations.data(), w.cols, out + first);
+            return;
+        }
+        if (quantized) {
+            QuantKernels::gemm(w.type, w.data + first * w.rowBytes, w.rowBytes, last - first,
+                               m_activations.data(), count, w.cols, out + first, outStride);
+            return;
+        }
+        for (int r = first; r < last; ++r) {
+            for (int i = 0; i < count; ++i) {
+                out[i * outStride + r] = dotRow(w.data + r * w.rowBytes, w.type, x + i * xStride, w.cols);
+            }
+        }
+    };
+
+    // 按行分块，边界对齐到 16 行，不同线程写的输出不落在同一缓存行
+    int tileCount = qBound(1, w.rows / kMinTileRows, m_pool->threadCount() * kTilesPerThread);
+    m_pool->parallelFor(tileCount, [&](int tile) {
+        int first = int(qint64(tile) * w.rows / tileCount) & ~15;
+        int last = tile + 1 == tileCount ? w.rows : int(qint64(tile + 1) * w.rows / tileCount) & ~15;
+        computeRows(first, last);
+    });
+}
+
+void LlamaEngine::attention(int layer, int start, int count)
+{
+    const Config& c = m_config;
+    const int group = c.heads / c.kvHeads;
+    const int qDim = c.heads * c.headDim;
+    const float scale = 1.0f / std::sqrt(float(c.headDim));
+
+    // 按头并行，同一个头的分数缓冲区在整批 token 之间复用
+    m_pool->parallelFor(c.heads, [&](int h) {
+        float* scores = m_scores.data() + size_t(h) * c.contextLength;
+        for (int i = 0; i < count; ++i) {
+            const size_t offset = size_t(i) * qDim + h * c.headDim;
+            m_cache.attend(layer, h / group, m_q.data() + offset, start + i + 1, scale, scores,
+                           m_xb2.data() + offset);
+        }
+    });
+}
+
+const float* LlamaEngine::forward(int token)
+{
+    TRACE_SCOPE_CAT("LlamaEngine::forward", "inference");
+    return evaluate(&token, 1);
+}
+
+const float* LlamaEngine::prefill(const int* tokens, int count)
+{
+    TRACE_SCOPE_CAT("LlamaEngine::prefill", "inference");
+    return evaluate(tokens, qMin(count, kBatchSize));
+}
+
+const float* LlamaEngine::evaluate(const int* tokens, int count)
+{
+    const Config& c = m_config;
+    // 先把整批 token 加入缓存，缓存满时只计算已经加入的部分
+    const int start = m_cache.length();
+    int n = 0;
+    while (n < count && m_cache.length() < c.contextLength
+           && m_cache.append(qBound(0, tokens[n], c.vocabSize - 1))) {
+        ++n;
+    }
+    if (n == 0) {
+        return nullptr;
+    }
+    const int qDim = c.heads * c.headDim;
+    const int kvDim = c.kvHeads * c.headDim;
+
+    for (int i = 0; i < n; ++i) {
+        const int token = qBound(0, tokens[i], c.vocabSize - 1);
+        dequantizeRow(m_embedding.data + token * m_embedding.rowBytes, m_embedding.type,
+                      m_x.data() + size_t(i) * c.dim, c.dim);
+    }
+
+    for (int l = 0; l < c.layers; ++l) {
+        const Layer& layer = m_layers.at(l);
+
+        for (int i = 0; i < n; ++i) {
+            rmsNorm(m_xb.data() + size_t(i) * c.dim, m_x.data() + size_t(i) * c.dim,
+                    layer.attentionNorm, c.dim, c.normEps);
+        }
+        matmul(m_q.data(), qDim, layer.query, m_xb.data(), c.dim, n);
+        matmul(m_k.data(), kvDim, layer.key, m_xb.data(), c.dim, n);
+        matmul(m_v.data(), kvDim, layer.value, m_xb.data(), c.dim, n);
+        for (int i = 0; i < n; ++i) {
+            float* q = m_q.data() + size_t(i) * qDim;
+            float* k = m_k.data() + size_t(i) * kvDim;
+            float* v = m_v.data() + size_t(i) * kvDim;
+            addBias(q, layer.queryBias, qDim);
+            addBias(k, layer.keyBias, kvDim);
+            addBias(v, layer.valueBias, kvDim);
+            rope(q, c.heads, c.headDim, start + i, m_ropeFrequencies, m_neoxRope);
+            rope(k, c.kvHeads, c.headDim, start + i, m_ropeFrequencies, m_neoxRope);
+            m_cache.store(l, start + i, k, v);
+        }
+
+        attention(l, start, n);
+        matmul(m_xb.data(), c.dim, layer.attentionOutput, m_xb2.data(), qDim, n);
+        for (size_t i = 0; i < size_t(n) * c.dim; ++i) {
+            m_x[i] += m_xb[i];
+        }
+
+        // SwiGLU: down(silu(gate(x)) * up(x))
+        for (int i = 0; i < n; ++i) {
+            rmsNorm(m_xb.data() + size_t(i) * c.dim, m_x.data() + size_t(i) * c.dim,
+                    layer.ffnNorm, c.dim, c.normEps);
+        }
+        matmul(m_hb.data(), c.hiddenDim, layer.gate, m_xb.data(), c.dim, n);
+        matmul(m_hb2.data(), c.hiddenDim, layer.up, m_xb.data(), c.dim, n);
+        for (size_t i = 0; i < size_t(n) * c.hiddenDim; ++i) {
+            float g = m_hb[i];
+            m_hb[i] = g / (1.0f + std::exp(-g)) * m_hb2[i];
+        }
+        matmul(m_xb.data(), c.dim, layer.down, m_hb.data(), c.hiddenDim, n);
+        for (size_t i = 0; i < size_t(n) * c.dim; ++i) {
+            m_x[i] += m_xb[i];
+        }
+    }
+
+    // 只有最后一个 token 需要 logits
+    const float* last = m_x.data() + size_t(n - 1) * c.dim;
+    rmsNorm(m_xb.data(), last, m_outputNorm, c.dim, c.normEps);
+    matmul(m_logits.data(), c.vocabSize, m_output, m_xb.data(), c.dim, 1);
+    return n == count ? m_logits.data() : nullptr;
+}
+
+LlamaSampler::LlamaSampler(float temperature, float topP)
+    : m_temperature(temperature)
+    , m_topP(qBound(0.0f, topP, 1.0f))
+    , m_rng(std::random_device{}())
+{
+}
+
+int LlamaSampler::sample(const float* logits, int size)
+{
+    // 权重损坏或数值溢出时 logits 中可能有 NaN / Inf，只在有限值中选择
+    int best = -1;
+    for (int i = 0; i < size; ++i) {
+        if (std::isfinite(logits[i]) && (best < 0 || logits[i] > logits[best])) {
+            best = i;
+        }
+    }
+    if (best < 0 || m_temperature <= 0.0f) {
+        return best;
+    }
+
+    const float maxLogit = logits[best];
+    std::vector<float> probs(size);
+    float sum = 0.0f;
+    for (int i = 0; i < size; ++i) {
+        probs[i] = std::isfinite(logits[i]) ? std::exp((logits[i] - maxLogit) / m_temperature) : 0.0f;
+        sum += probs[i];
+    }
+
+    // 概率低于该值的 token 全部去掉，总和也不超过 (1 - p)，剩下的仍足以凑满 top-p 集合。
+    // 先排除掉，避免对整个词表排序
+    const float cutoff = (1.0f - m_topP) * sum / size;
+    m_candidates.clear();
+    for (int i = 0; i < size; ++i) {
+        if (probs[i] > 0.0f && probs[i] >= cutoff) {
+            m_candidates.push_back({probs[i], i});
+        }
+    }
+    std::sort(m_candidates.begin(), m_candidates.end(), [](const auto& a, const auto& b) {
+        return a.first > b.first;
+    });
+
+    float kept = 0.0f;
+    size_t count = 0;
+    while (count < m_candidates.size()) {
+        kept += m_candidates[count++].first;
+        if (kept >= m_topP * sum) {
+            break;
+        }
+    }
+    if (count == 0 || !(kept > 0.0f)) {
+        return best;
+    }
+
+    float r = std::uniform_real_distribution<float>(0.0f, kept)(m_rng);
+    for (size_t i = 0; i < count; ++i) {
+        r -= m_candidates[i].first;
+        if (r <= 0.0f) {
+            return m_candidates[i].second;
+        }
+    }
+    return m_candidates[count - 1].second;
+}
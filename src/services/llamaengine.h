@@ -0,0 +1,174 @@
+#ifndef LLAMAENGINE_H
+#define LLAMAENGINE_H
+
+#include <QList>
+#include <QPair>
+#include <QString>
+#include <atomic>
+#include <memory>
+#include <random>
+#include <vector>
+#include "services/gguffile.h"
+#include "services/inferencepool.h"
+#include "services/kvcache.h"
+#include "services/llamatokenizer.h"
+#include "utils/quantkernels.h"
+
+/**
+ * @brief 本地 CPU 推理引擎
+ *
+ * 运行 llama 结构的 GGUF 模型（LLaMA、Mistral、Qwen2 等同一结构的模型）：
+ * RMSNorm、RoPE、分组查询注意力和 SwiGLU 前馈层。权重直接使用内存映射的
+ * 张量数据，支持 F32、F16、Q4_0 和 Q8_0。量化权重由 QuantKernels 按 CPU 支持的
+ * 指令集直接计算，不在内存中展开。
+ *
+ * beginSequence 开始一段新的输入，开头与缓存中已有前缀相同的部分直接复用（见 KvCache），
+ * 之后用 prefill 按批追加提示词，再用 forward 逐个追加生成的 token，都返回最后一个
+ * token 之后的 logits。一批 token 同时经过每一层，量化权重每行只读一次就与整批
+ * 激活相乘（QuantKernels::gemm），提示词阶段读取权重的次数降为逐个计算时的 1/kBatchSize。
+ * 每个矩阵按行分块、注意力按头在专用的 InferencePool 中并行计算。
+ * 同一个实例不能在多个线程中同时使用。
+ */
+class LlamaEngine
+{
+public:
+    struct Config {
+        int vocabSize = 0;
+        int dim = 0;
+        int hiddenDim = 0;
+        int layers = 0;
+        int heads = 0;
+        int kvHeads = 0;
+        int headDim = 0;
+        int contextLength = 0;     // 实际分配的上下文长度
+        float normEps = 1e-5f;
+        float ropeBase = 10000.0f;
+    };
+
+    // prefill 一次最多处理的 token 数
+    static constexpr int kBatchSize = 64;
+
+    LlamaEngine();
+    ~LlamaEngine();
+    LlamaEngine(const LlamaEngine&) = delete;
+    LlamaEngine& operator=(const LlamaEngine&) = delete;
+
+    // 加载模型，上下文长度取 maxContext 与模型训练长度中较小的一个。
+    // cancelled 置位后在下一步之前放弃加载并返回 false
+    bool load(const QString& path, int maxContext, QString* error = nullptr,
+              const std::atomic<bool>* cancelled = nullptr);
+    void unload();
+    // 参与计算的线程数（包括调用线程），0 表示使用全部逻辑核心
+    void setThreadCount(int threads);
+    int threadCount() const { return m_pool->threadCount(); }
+    bool isLoaded() const { return m_file.isOpen(); }
+    // 模型文件的指纹，持久化的键值缓存据此判断是否属于当前模型
+    quint64 modelHash() const { return m_modelHash; }
+    QString modelPath() const { return m_file.path(); }
+
+    const Config& config() const { return m_config; }
+    const LlamaTokenizer& tokenizer() const { return m_tokenizer; }
+
+    // 键值缓存的内存预算和存储精度，改变后清空缓存并返回 true
+    bool configureCache(qint64 budgetBytes, bool quantized);
+    KvCache::Stats cacheStats() const { return m_cache.stats(); }
+    // tokens 开头已在内存缓存中的 token 数，不改变缓存
+    int cachedPrefix(const QList<int>& tokens) const { return m_cache.matchLength(tokens); }
+    // 把当前序列的键值保存到文件，或从文件导入与 tokens 前缀相同的部分（见 KvCacheFile）
+    bool saveCache(const QString& path, const std::atomic<bool>* cancelled = nullptr) const;
+    int restoreCache(const QString& path, const QList<int>& tokens);
+
+    // 开始新序列，返回 tokens 开头已在缓存中的数量，调用方从该位置起依次 forward
+    int beginSequence(const QList<int>& tokens);
+    // 当前序列的长度，即下一个 token 的位置
+    int sequenceLength() const { return m_cache.length(); }
+    // 在序列末尾追加 token，返回长度为 vocabSize 的 logits，下次调用前有效。
+    // 上下文已满或缓存无法分配时返回 nullptr
+    const float* forward(int token);
+    // 在序列末尾追加 count 个（不超过 kBatchSize）token，返回最后一个 token 的 logits，
+    // 其余与 forward 相同。没能全部追加时已追加的部分仍然计算完成并保留在缓存中
+    const float* prefill(const int* tokens, int count);
+
+private:
+    struct Matrix {
+        const uchar* data = nullptr;
+        quint32 type = GgufFile::F32;
+        int rows = 0;
+        int cols = 0;
+        qint64 rowBytes = 0;
+    };
+
+    struct Layer {
+        const float* attentionNorm = nullptr;
+        Matrix query;
+        Matrix key;
+        Matrix value;
+        Matrix attentionOutput;
+        const float* queryBias = nullptr;
+        const float* keyBias = nullptr;
+        const float* valueBias = nullptr;
+        const float* ffnNorm = nullptr;
+        Matrix gate;
+        Matrix up;
+        Matrix down;
+    };
+
+    bool loadMatrix(const QByteArray& name, int rows, int cols, Matrix* matrix, QString* error) const;
+    bool loadVector(const QByteArray& name, int size, const float** vector, QString* error) const;
+
+    // 对 count 个向量计算 out[i][rows] = w * x[i]，x 和 out 的相邻向量分别相隔 xStride、outStride
+    void matmul(float* out, qint64 outStride, const Matrix& w, const float* x, qint64 xStride, int count) const;
+    // 第 i 个 token 位于 start + i，注意到它之前（含）的全部位置
+    void attention(int layer, int start, int count);
+    const float* evaluate(const int* tokens, int count);
+
+    GgufFile m_file;
+    std::unique_ptr<InferencePool> m_pool;
+    Config m_config;
+    LlamaTokenizer m_tokenizer;
+    QList<Layer> m_layers;
+    Matrix m_embedding;
+    Matrix m_output;
+    const float* m_outputNorm = nullptr;
+    bool m_neoxRope = false;
+    quint64 m_modelHash = 0;
+
+    KvCache m_cache;
+    qint64 m_cacheBudget = 1024LL * 1024 * 1024;
+    bool m_cacheQuantized = false;
+
+    // 每一批的中间结果，每个 token 一行
+    std::vector<float> m_x;
+    std::vector<float> m_xb;
+    std::vector<float> m_xb2;
+    std::vector<float> m_q;
+    std::vector<float> m_k;
+    std::vector<float> m_v;
+    std::vector<float> m_hb;
+    std::vector<float> m_hb2;
+    std::vector<float> m_scores;
+    std::vector<float> m_logits;
+    std::vector<float> m_ropeFrequencies;
+    // 量化后的 matmul 输入，每次 matmul 开始时重新填写
+    mutable std::vector<QuantKernels::ActivationBlock> m_activations;
+};
+
+/**
+ * @brief 按温度和 top-p 从 logits 中采样
+ */
+class LlamaSampler
+{
+public:
+    explicit LlamaSampler(float temperature = 0.7f, float topP = 0.95f);
+
+    // 温度为 0 时总是取概率最大的 token。没有一个有限的 logit 时返回 -1，调用方应结束生成
+    int sample(const float* logits, int size);
+
+private:
+    float m_temperature;
+    float m_topP;
+    std::mt19937 m_rng;
+    std::vector<QPair<float, int>> m_candidates;
+};
+
+#endif // LLAMAENGINE_H
@@ -0,0 +1,479 @@
+#include "llamatokenizer.h"
+#include <QDir>
+#include <QElapsedTimer>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QtConcurrent/QtConcurrent>
+#include <algorithm>
+#include <queue>
+#include "services/gguffile.h"
+#include "services/logger.h"
+
+namespace {
+// SentencePiece 用来表示空格的字符 ▁
+const char kSpaceMarker[] = "\xe2\x96\x81";
+const int kSpaceMarkerLength = 3;
+
+// 从 UTF-8 首字节得到字符的字节数
+int utf8Length(uchar lead)
+{
+    if (lead < 0x80) return 1;
+    if ((lead >> 5) == 0x6) return 2;
+    if ((lead >> 4) == 0xe) return 3;
+    if ((lead >> 3) == 0x1e) return 4;
+    return 1;
+}
+
+bool isSpaceMarker(const QByteArray& text, int pos)
+{
+    return pos + kSpaceMarkerLength <= text.size()
+        && memcmp(text.constData() + pos, kSpaceMarker, kSpaceMarkerLength) == 0;
+}
+
+quint64 fnv1a(quint64 hash, const uchar* data, qint64 size)
+{
+    for (qint64 i = 0; i < size; ++i) {
+        hash = (hash ^ data[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+enum class CharClass { Letter, Number, Space, Other };
+
+CharClass classify(char32_t c)
+{
+    if (QChar::isLetter(c)) return CharClass::Letter;
+    if (QChar::isNumber(c)) return CharClass::Number;
+    if (QChar::isSpace(c)) return CharClass::Space;
+    return CharClass::Other;
+}
+
+// 读取 pos 处的码位，units 为占用的 UTF-16 单元数
+char32_t codePointAt(const QString& text, int pos, int* units)
+{
+    const QChar c = text.at(pos);
+    if (c.isHighSurrogate() && pos + 1 < text.size() && text.at(pos + 1).isLowSurrogate()) {
+        *units = 2;
+        return QChar::surrogateToUcs4(c, text.at(pos + 1));
+    }
+    *units = 1;
+    return c.unicode();
+}
+
+// GPT-2 的预切分规则，与下面的正则表达式等价，但只扫描一遍文本：
+// 's|'t|'re|'ve|'m|'ll|'d| ?\p{L}+| ?\p{N}+| ?[^\s\p{L}\p{N}]+|\s+(?!\S)|\s+
+template <typename Piece>
+void pretokenize(const QString& text, Piece onPiece)
+{
+    const int size = int(text.size());
+    int pos = 0;
+    while (pos < size) {
+        // 缩写
+        if (text.at(pos) == QLatin1Char('\'') && pos + 1 < size) {
+            const QStringView rest = QStringView(text).mid(pos + 1, 2);
+            int length = 0;
+            if (rest.startsWith(QLatin1String("re")) || rest.startsWith(QLatin1String("ve"))
+                || rest.startsWith(QLatin1String("ll"))) {
+                length = 3;
+            } else if (rest.front() == QLatin1Char('s') || rest.front() == QLatin1Char('t')
+                       || rest.front() == QLatin1Char('m') || rest.front() == QLatin1Char('d')) {
+                length = 2;
+            }
+            if (length > 0) {
+                onPiece(pos, length);
+                pos += length;
+                continue;
+            }
+        }
+
+        // 可选的一个空格，之后是同一类字符组成的串
+        int units = 0;
+        int start = pos;
+        char32_t c = codePointAt(text, pos, &units);
+        CharClass kind = classify(c);
+        if (c == U' ' && pos + 1 < size) {
+            int nextUnits = 0;
+            CharClass next = classify(codePointAt(text, pos + 1, &nextUnits));
+            if (next != CharClass::Space) {
+                start = pos + 1;
+                kind = next;
+            }
+        }
+        if (kind != CharClass::Space) {
+            int end = start;
+            while (end < size && classify(codePointAt(text, end, &units)) == kind) {
+                end += units;
+            }
+            onPiece(pos, end - pos);
+            pos = end;
+            continue;
+        }
+
+        // 空白：后面还有非空白字符时最后一个留给下一段作前缀
+        int end = pos;
+        while (end < size && classify(codePointAt(text, end, &units)) == CharClass::Space) {
+            end += units;
+        }
+        if (end < size && end - pos >= 2) {
+            end -= text.at(end - 1).isLowSurrogate() ? 2 : 1;
+        }
+        onPiece(pos, end - pos);
+        pos = end;
+    }
+}
+}
+
+LlamaTokenizer::LlamaTokenizer()
+{
+    std::fill(std::begin(m_byteIds), std::end(m_byteIds), -1);
+    std::fill(std::begin(m_charToByte), std::end(m_charToByte), qint16(-1));
+}
+
+QString LlamaTokenizer::vocabCacheDirectory()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/vocab";
+}
+
+bool LlamaTokenizer::load(const GgufFile& file, QString* error)
+{
+    QByteArray model = file.value("tokenizer.ggml.model").toByteArray();
+    if (model == "llama") {
+        m_kind = Kind::SentencePiece;
+    } else if (model == "gpt2") {
+        m_kind = Kind::BytePairs;
+    } else {
+        if (error) {
+            *error = QString("不支持的分词器类型: %1").arg(QString::fromUtf8(model));
+        }
+        return false;
+    }
+
+    if (!loadVocab(file, error)) {
+        return false;
+    }
+
+    std::fill(std::begin(m_byteIds), std::end(m_byteIds), -1);
+    std::fill(std::begin(m_charToByte), std::end(m_charToByte), qint16(-1));
+    if (m_kind == Kind::BytePairs) {
+        // GPT-2 的 bytes_to_unicode：可见字节映射为自身，其余依次映射到 U+0100 之后
+        int next = 256;
+        for (int b = 0; b < 256; ++b) {
+            bool visible = (b >= 33 && b <= 126) || (b >= 161 && b <= 172) || (b >= 174 && b <= 255);
+            const int mapped = visible ? b : next++;
+            m_byteText[b] = QString(QChar(mapped)).toUtf8();
+            m_charToByte[mapped] = qint16(b);
+            m_byteIds[b] = m_vocab.find(m_byteText[b]);
+        }
+    } else {
+        for (int b = 0; b < 256; ++b) {
+            m_byteIds[b] = tokenId("<0x" + QByteArray::number(b, 16).rightJustified(2, '0').toUpper() + ">");
+        }
+    }
+
+    m_specialIds.clear();
+    for (int i = 0; i < m_vocab.size(); ++i) {
+        const int type = m_vocab.type(i);
+        if ((type == Control || type == UserDefined) && m_vocab.piece(i).size() > 1) {
+            m_specialIds.append(i);
+        }
+    }
+    std::sort(m_specialIds.begin(), m_specialIds.end(), [this](int a, int b) {
+        return m_vocab.piece(a).size() > m_vocab.piece(b).size();
+    });
+    m_specialTexts.clear();
+    for (int id : m_specialIds) {
+        m_specialTexts.append(QString::fromUtf8(m_vocab.piece(id)));
+    }
+
+    m_bos = file.value("tokenizer.ggml.bos_token_id", -1).toInt();
+    m_eos = file.value("tokenizer.ggml.eos_token_id", -1).toInt();
+    m_unknown = file.value("tokenizer.ggml.unknown_token_id", -1).toInt();
+    m_addBos = file.value("tokenizer.ggml.add_bos_token", m_kind == Kind::SentencePiece).toBool();
+    m_addSpacePrefix = file.value("tokenizer.ggml.add_space_prefix", true).toBool();
+    m_chatTemplate = QString::fromUtf8(file.value("tokenizer.chat_template").toByteArray());
+
+    m_stopIds.clear();
+    if (m_eos >= 0) {
+        m_stopIds.insert(m_eos);
+    }
+    for (const char* marker : {"<|im_end|>", "<|eot_id|>", "<|end|>", "<end_of_turn>"}) {
+        int id = tokenId(marker);
+        if (id >= 0) {
+            m_stopIds.insert(id);
+        }
+    }
+    return true;
+}
+
+bool LlamaTokenizer::loadVocab(const GgufFile& file, QString* error)
+{
+    const bool bytePairs = m_kind == Kind::BytePairs;
+    const GgufFile::ArrayRef tokens = file.array("tokenizer.ggml.tokens");
+    if (tokens.count == 0) {
+        if (error) {
+            *error = "模型文件中没有词表";
+        }
+        return false;
+    }
+
+    // 按词表在模型文件中的原始字节计算哈希，作为生成文件的名字和校验
+    quint64 hash = 14695981039346656037ULL;
+    hash = fnv1a(hash, reinterpret_cast<const uchar*>(&bytePairs), sizeof(bytePairs));
+    for (const char* key : {"tokenizer.ggml.tokens", "tokenizer.ggml.scores",
+                            "tokenizer.ggml.token_type", "tokenizer.ggml.merges"}) {
+        const GgufFile::ArrayRef array = file.array(key);
+        hash = fnv1a(hash, array.data, array.data ? array.end - array.data : 0);
+    }
+
+    const QString path = vocabCacheDirectory() + QString("/%1.vocab").arg(hash, 16, 16, QLatin1Char('0'));
+    if (m_vocab.open(path, hash)) {
+        return true;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    TokenVocab::Source source;
+    source.tokens = file.stringArray("tokenizer.ggml.tokens");
+    source.scores = file.floatArray("tokenizer.ggml.scores");
+    source.types = file.intArray("tokenizer.ggml.token_type");
+    if (bytePairs) {
+        source.merges = file.stringArray("tokenizer.ggml.merges");
+    }
+    source.bytePairs = bytePairs;
+    source.hash = hash;
+    const QByteArray data = TokenVocab::build(source);
+    if (data.isEmpty()) {
+        if (error) {
+            *error = "无法生成词表";
+        }
+        return false;
+    }
+
+    QDir().mkpath(vocabCacheDirectory());
+    QSaveFile out(path);
+    bool saved = out.open(QIODevice::WriteOnly) && out.write(data) == data.size() && out.commit();
+    if (!saved || !m_vocab.open(path, hash)) {
+        LOG_WARNING(QString("无法写入词表文件 %1，本次在内存中使用").arg(path));
+        m_vocab.adopt(data, hash);
+    }
+    LOG_INFO(QString("已生成词表文件: %1 个 token，%2 KB，用时 %3 ms")
+        .arg(source.tokens.size()).arg(data.size() / 1024).arg(timer.elapsed()));
+    return m_vocab.isOpen();
+}
+
+QList<int> LlamaTokenizer::encode(const QString& text, bool parseSpecial) const
+{
+    QList<int> out;
+    if (!parseSpecial || m_specialIds.isEmpty()) {
+        encodeFragment(text, true, out);
+        return out;
+    }
+
+    // 先找出控制词，其余部分按普通文本切分
+    int fragmentStart = 0;
+    int pos = 0;
+    while (pos < text.size()) {
+        int matched = -1;
+        if (text.at(pos) == QLatin1Char('<') || text.at(pos) == QLatin1Char('[')) {
+            const QStringView rest = QStringView(text).mid(pos);
+            for (int i = 0; i < m_specialTexts.size(); ++i) {
+                if (rest.startsWith(m_specialTexts.at(i))) {
+                    matched = i;
+                    break;
+                }
+            }
+        }
+        if (matched < 0) {
+            ++pos;
+            continue;
+        }
+        if (pos > fragmentStart) {
+            encodeFragment(text.mid(fragmentStart, pos - fragmentStart), fragmentStart == 0, out);
+        }
+        out.append(m_specialIds.at(matched));
+        pos += m_specialTexts.at(matched).size();
+        fragmentStart = pos;
+    }
+    if (fragmentStart < text.size()) {
+        encodeFragment(text.mid(fragmentStart), fragmentStart == 0, out);
+    }
+    return out;
+}
+
+QList<QList<int>> LlamaTokenizer::encodeBatch(const QStringList& texts, bool parseSpecial) const
+{
+    return QtConcurrent::blockingMapped<QList<QList<int>>>(texts, [this, parseSpecial](const QString& text) {
+        return encode(text, parseSpecial);
+    });
+}
+
+void LlamaTokenizer::encodeFragment(const QString& text, bool atStart, QList<int>& out) const
+{
+    if (text.isEmpty()) {
+        return;
+    }
+    if (m_kind == Kind::SentencePiece) {
+        encodeSentencePiece(text, atStart, out);
+    } else {
+        encodeBytePairs(text, out);
+    }
+}
+
+void LlamaTokenizer::merge(std::vector<Symbol>& symbols) const
+{
+    struct Candidate {
+        float priority;
+        int left;
+        int right;
+        int leftId;     // 入队时两边的 token，任一边合并过后不再匹配
+        int rightId;
+        int result;
+        bool operator<(const Candidate& other) const
+        {
+            // 优先级相同时靠左的优先
+            return priority < other.priority || (priority == other.priority && left > other.left);
+        }
+    };
+
+    if (symbols.size() < 2) {
+        return;
+    }
+    std::priority_queue<Candidate> queue;
+    auto tryPair = [&](int left) {
+        if (left < 0 || symbols[left].next < 0) {
+            return;
+        }
+        const Symbol& a = symbols[left];
+        const Symbol& b = symbols[a.next];
+        TokenVocab::Merge merge;
+        if (m_vocab.merge(a.id, b.id, &merge)) {
+            queue.push({merge.priority, left, a.next, a.id, b.id, merge.result});
+        }
+    };
+    for (int i = 0; i + 1 < int(symbols.size()); ++i) {
+        tryPair(i);
+    }
+
+    while (!queue.empty()) {
+        const Candidate best = queue.top();
+        queue.pop();
+        Symbol& left = symbols[best.left];
+        if (left.length == 0 || left.next != best.right || left.id != best.leftId
+            || symbols[best.right].id != best.rightId) {
+            continue;
+        }
+        Symbol& right = symbols[best.right];
+        left.id = best.result;
+        left.length += right.length;
+        right.length = 0;
+        right.id = -1;
+        left.next = right.next;
+        if (left.next >= 0) {
+            symbols[left.next].prev = best.left;
+        }
+        tryPair(left.prev);
+        tryPair(best.left);
+    }
+}
+
+void LlamaTokenizer::encodeSentencePiece(const QString& text, bool atStart, QList<int>& out) const
+{
+    QString normalized = (atStart && m_addSpacePrefix) ? QLatin1Char(' ') + text : text;
+    QByteArray utf8 = normalized.toUtf8().replace(' ', kSpaceMarker);
+
+    std::vector<Symbol> symbols;
+    auto flush = [&]() {
+        if (symbols.empty()) {
+            return;
+        }
+        symbols.back().next = -1;
+        merge(symbols);
+        for (int i = 0; i >= 0; i = symbols[i].next) {
+            const Symbol& symbol = symbols[i];
+            if (symbol.id >= 0) {
+                out.append(symbol.id);
+                continue;
+            }
+            // 词表中没有的字符按 UTF-8 字节回退
+            for (int b = 0; b < symbol.length; ++b) {
+                int byteId = m_byteIds[uchar(utf8.at(symbol.start + b))];
+                out.append(byteId >= 0 ? byteId : m_unknown);
+            }
+        }
+        symbols.clear();
+    };
+
+    // 每个词（▁ 开头，连续的 ▁ 算在一起）单独合并，片段短，合并的开销与文本长度成正比
+    bool previousMarker = false;
+    for (int pos = 0; pos < utf8.size();) {
+        const int length = qMin(utf8Length(uchar(utf8.at(pos))), int(utf8.size()) - pos);
+        const bool marker = isSpaceMarker(utf8, pos);
+        if (marker && !previousMarker) {
+            flush();
+        }
+        previousMarker = marker;
+        const int index = int(symbols.size());
+        symbols.push_back({index - 1, index + 1, m_vocab.find(utf8.constData() + pos, length), pos, length});
+        pos += length;
+    }
+    flush();
+}
+
+void LlamaTokenizer::encodeBytePairs(const QString& text, QList<int>& out) const
+{
+    std::vector<Symbol> symbols;
+    QByteArray word;
+    pretokenize(text, [&](int start, int length) {
+        const QByteArray raw = QStringView(text).mid(start, length).toUtf8();
+
+        // 整段就在词表中时直接使用
+        word.clear();
+        for (char byte : raw) {
+            word += m_byteText[uchar(byte)];
+        }
+        int whole = m_vocab.find(word);
+        if (whole >= 0) {
+            out.append(whole);
+            return;
+        }
+
+        symbols.clear();
+        for (int i = 0; i < raw.size(); ++i) {
+            symbols.push_back({i - 1, i + 1, m_byteIds[uchar(raw.at(i))], i, 1});
+        }
+        symbols.back().next = -1;
+        merge(symbols);
+        for (int i = 0; i >= 0; i = symbols[i].next) {
+            out.append(symbols[i].id >= 0 ? symbols[i].id : m_unknown);
+        }
+    });
+}
+
+QByteArray LlamaTokenizer::decode(int token) const
+{
+    if (token < 0 || token >= m_vocab.size()) {
+        return QByteArray();
+    }
+    int type = m_vocab.type(token);
+    if (type == Control || type == Unknown || type == Unused) {
+        return QByteArray();
+    }
+
+    const QByteArray piece = m_vocab.piece(token);
+    if (m_kind == Kind::SentencePiece) {
+        if (type == Byte && piece.size() == 6) {
+            return QByteArray(1, char(piece.mid(3, 2).toInt(nullptr, 16)));
+        }
+        QByteArray text(piece.constData(), piece.size());
+        return text.replace(kSpaceMarker, " ");
+    }
+
+    QByteArray bytes;
+    const QString mapped = QString::fromUtf8(piece);
+    bytes.reserve(mapped.size());
+    for (QChar c : mapped) {
+        const qint16 byte = c.unicode() < 512 ? m_charToByte[c.unicode()] : qint16(-1);
+        bytes.append(byte >= 0 ? char(byte) : '?');
+    }
+    return bytes;
+}
@@ -0,0 +1,94 @@
+#ifndef LLAMATOKENIZER_H
+#define LLAMATOKENIZER_H
+
+#include <QByteArray>
+#include <QList>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+#include <vector>
+#include "services/tokenvocab.h"
+
+class GgufFile;
+
+/**
+ * @brief GGUF 模型自带的分词器
+ *
+ * 从 tokenizer.ggml.* 元数据读取词表，支持两种模型：
+ * - llama（SentencePiece）：空格替换为 ▁，按词的分数合并，词表里没有的字符回退为 <0xXX> 字节
+ * - gpt2（字节级 BPE）：按 GPT-2 的规则预切分，字节映射为可见字符，按合并规则的优先级合并
+ *
+ * 词表第一次加载时生成紧凑的 TokenVocab 文件放在缓存目录，之后直接内存映射，
+ * 不再解析元数据、构造哈希表。合并只比较 token id：先把文本切成短的片段
+ * （BPE 按预切分规则，SentencePiece 按词首的 ▁），每个片段内用优先队列合并，
+ * 总耗时与文本长度成正比。
+ *
+ * 所有 encode 方法都是只读的，可以在多个线程中同时调用。
+ */
+class LlamaTokenizer
+{
+public:
+    LlamaTokenizer();
+
+    bool load(const GgufFile& file, QString* error = nullptr);
+
+    // parseSpecial 为 true 时把文本中出现的控制词（如 <|im_start|>）直接转换为对应的 id
+    QList<int> encode(const QString& text, bool parseSpecial = false) const;
+    // 在全局线程池中并行处理多段文本，结果与逐段 encode 相同
+    QList<QList<int>> encodeBatch(const QStringList& texts, bool parseSpecial = false) const;
+    // 单个 token 对应的原始字节，可能是不完整的 UTF-8 序列，控制词返回空
+    QByteArray decode(int token) const;
+
+    int vocabSize() const { return m_vocab.size(); }
+    int bos() const { return m_bos; }
+    int eos() const { return m_eos; }
+    bool addBos() const { return m_addBos; }
+    // 不在词表中时返回 -1
+    int tokenId(const QByteArray& text) const { return m_vocab.find(text); }
+    // 结束生成的 token：eos 以及对话模板的轮次结束标记
+    bool isEndOfGeneration(int token) const { return m_stopIds.contains(token); }
+    QString chatTemplate() const { return m_chatTemplate; }
+
+    // 生成的词表文件所在的目录
+    static QString vocabCacheDirectory();
+
+private:
+    enum class Kind { SentencePiece, BytePairs };
+
+    // 词表中 token 的类型
+    enum TokenType { Normal = 1, Unknown = 2, Control = 3, UserDefined = 4, Unused = 5, Byte = 6 };
+
+    struct Symbol {
+        int prev;
+        int next;
+        int id;         // -1 表示不在词表中，不参与合并
+        int start;      // 在输入中的字节位置
+        int length;
+    };
+
+    bool loadVocab(const GgufFile& file, QString* error);
+    void encodeFragment(const QString& text, bool atStart, QList<int>& out) const;
+    void encodeSentencePiece(const QString& text, bool atStart, QList<int>& out) const;
+    void encodeBytePairs(const QString& text, QList<int>& out) const;
+    // 反复合并优先级最高的相邻对，结束后按链表顺序保留长度不为 0 的符号
+    void merge(std::vector<Symbol>& symbols) const;
+
+    Kind m_kind = Kind::SentencePiece;
+    TokenVocab m_vocab;
+    QList<int> m_specialIds;                 // 可以出现在文本中的控制词，长的在前
+    QStringList m_specialTexts;              // 与 m_specialIds 对应的文本
+    // SentencePiece：字节回退用的 <0xXX> token；字节级 BPE：字节映射后的单字符 token
+    int m_byteIds[256];
+    QByteArray m_byteText[256];              // 字节级 BPE 的字节 -> 可见字符（UTF-8）
+    qint16 m_charToByte[512];                // 可见字符 -> 字节，-1 表示没有对应
+    bool m_addSpacePrefix = true;
+
+    int m_bos = -1;
+    int m_eos = -1;
+    int m_unknown = -1;
+    bool m_addBos = false;
+    QSet<int> m_stopIds;
+    QString m_chatTemplate;
+};
+
+#endif // LLAMATOKENIZER_H
@@ -1,5 +1,8 @@
 #include "llmservice.h"
 #include "services/logger.h"
+#include "services/tracer.h"
+#include <QFutureWatcher>
+#include <QtConcurrent/QtConcurrent>
 
 LLMService::LLMService(const QString& modelPath, QObject *parent)
     : QObject(parent)
@@ -26,6 +29,64 @@ void LLMService::cancelGeneration()
     LOG_INFO("模型生成已取消");
 }
 
+void LLMService::emitStreamChunk(const QString& chunk)
+{
+    // 未启用跟踪时也要计数，否则中途开启后两端的编号对不上
+    quint64 sequence = ++m_streamSequence;
+    TRACE_FLOW_BEGIN("stream chunk", Tracer::flowId(this, sequence));
+    emit streamResponseReceived(chunk);
+}
+
+QList<ImagePipeline::ImageHandle> LLMService::takeImages()
+{
+    QList<ImagePipeline::ImageHandle> images;
+    images.swap(m_images);
+    return images;
+}
+
+QList<LLMService::Turn> LLMService::takeHistory()
+{
+    QList<Turn> history;
+    history.swap(m_history);
+    return history;
+}
+
+void LLMService::encodeImages(const QList<ImagePipeline::ImageHandle>& images, int maxEdge,
+                              const std::function<void(const QList<ImageEncoder::Encoded>&)>& send,
+                              const std::function<void(const QString&)>& fail)
+{
+    using Result = QList<ImageEncoder::Encoded>;
+    auto* watcher = new QFutureWatcher<Result>(this);
+    connect(watcher, &QFutureWatcher<Result>::finished, this, [this, watcher, send, fail]() {
+        watcher->deleteLater();
+        const Result encoded = watcher->result();
+        // 编码失败的图片没有数据，请求中会变成空的 data URL，不发送请求
+        for (const ImageEncoder::Encoded& image : encoded) {
+            if (image.data.isEmpty()) {
+                QString error = QString("图片 %1 编码失败，消息未发送").arg(image.id);
+                LOG_ERROR(error);
+                fail(error);
+                return;
+            }
+        }
+        for (const ImageEncoder::Encoded& image : encoded) {
+            qint64 uploadBytes = ImageEncoder::base64Size(image.data.size());
+            LOG_INFO(QString("图片 %1 已编码为 %2x%3 %4，上传 %5 KB，耗时 %6 ms")
+                .arg(image.id)
+                .arg(image.size.width()).arg(image.size.height())
+                .arg(QString::fromLatin1(image.mimeType))
+                .arg(uploadBytes / 1024)
+                .arg(image.encodeMs));
+            emit imageEncoded(image.id, uploadBytes, image.encodeMs);
+        }
+        send(encoded);
+    });
+    AttachmentStore* store = m_attachmentStore;
+    watcher->setFuture(QtConcurrent::run([images, maxEdge, store]() {
+        return ImageEncoder::encodeAll(images, maxEdge, ImageEncoder::kDefaultQuality, store);
+    }));
+}
+
 void LLMService::setDeepThinkingMode(bool enabled)
 {
     if (m_isDeepThinking != enabled) {
@@ -4,12 +4,21 @@
 #include <QObject>
 #include <QFuture>
 #include <QString>
+#include <QList>
+#include <functional>
+#include "services/imageencoder.h"
 
 class LLMService : public QObject
 {
     Q_OBJECT
 
 public:
+    // 对话中已完成的一轮消息
+    struct Turn {
+        QString role;       // "user" 或 "assistant"
+        QString content;
+    };
+
     explicit LLMService(QObject *parent = nullptr);
     explicit LLMService(const QString& modelPath, QObject *parent = nullptr);
     virtual ~LLMService();
@@ -23,16 +32,54 @@ public:
     void setDeepThinkingMode(bool enabled);
     bool isDeepThinkingMode() const { return m_isDeepThinking; }
 
+    // 随下一次请求发送的图片
+    virtual bool supportsImages() const { return false; }
+    // store 不为空时复用其中缓存的编码结果
+    void setImages(const QList<ImagePipeline::ImageHandle>& images, AttachmentStore* store = nullptr)
+    {
+        m_images = images;
+        m_attachmentStore = store;
+    }
+
+    // 随下一次请求发送的历史消息（不含本次的提示），不支持的服务只使用最新的提示
+    virtual bool supportsHistory() const { return false; }
+    void setHistory(const QList<Turn>& history) { m_history = history; }
+    // 当前对话的目录，服务可以在其中保存与对话相关的状态，为空表示不保存
+    void setConversationPath(const QString& path) { m_conversationPath = path; }
+
 signals:
     void responseGenerated(const QString& response);
     void streamResponseReceived(const QString& partialResponse);
     void errorOccurred(const QString& error);
     void deepThinkingModeChanged(bool enabled);
+    // 每张图片编码完成后报告上传大小（base64 之后）和编码耗时
+    void imageEncoded(const QString& id, qint64 uploadBytes, qint64 encodeMs);
+    // 提示词共 promptTokens 个 token，其中 cachedTokens 个直接复用了缓存的键值
+    void promptCacheReported(int promptTokens, int cachedTokens);
+    // 本地模型分块计算提示词时，每块之后报告已完成的 token 数和速度
+    void prefillProgress(int done, int total, double tokensPerSecond);
 
 protected:
+    // 发出流式片段，并记录连到界面线程处理它的流事件
+    void emitStreamChunk(const QString& chunk);
+    // 取出待发送的图片，之后的请求不再携带
+    QList<ImagePipeline::ImageHandle> takeImages();
+    // 取出历史消息，之后的请求不再携带
+    QList<Turn> takeHistory();
+    // 在后台把图片缩小到 maxEdge 并重新编码，完成后在当前线程调用 send。
+    // 有图片编码失败时不调用 send，改为以错误信息调用 fail
+    void encodeImages(const QList<ImagePipeline::ImageHandle>& images, int maxEdge,
+                      const std::function<void(const QList<ImageEncoder::Encoded>&)>& send,
+                      const std::function<void(const QString&)>& fail);
+
     QString m_modelPath;
     bool m_isCancelled;
     bool m_isDeepThinking;
+    QList<ImagePipeline::ImageHandle> m_images;
+    AttachmentStore* m_attachmentStore = nullptr;
+    QList<Turn> m_history;
+    QString m_conversationPath;
+    quint64 m_streamSequence = 0;  // 已发出的流式片段数，与 ChatViewModel 的计数对应
 };
 
 #endif // LLMSERVICE_H
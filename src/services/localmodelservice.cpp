@@ -1,43 +1,308 @@
 #include "localmodelservice.h"
-#include <QDebug>
-#include <QFile>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QStringDecoder>
+#include <stdexcept>
+#include "models/settingsmodel.h"
+#include "services/llamaengine.h"
+#include "services/logger.h"
+#include "services/tracer.h"
+
+namespace {
+// 采样时保留累计概率前 95% 的 token
+const float kTopP = 0.95f;
+}
 
 LocalModelService::LocalModelService(const QString& modelPath, QObject *parent)
-    : LLMService(parent)
-    , m_modelPath(modelPath)
+    : LLMService(modelPath, parent)
+    , m_engine(new LlamaEngine)
 {
-    // TODO: Initialize local model (e.g., load ONNX model)
+    m_worker.setMaxThreadCount(1);
+
     if (!isAvailable()) {
-        qWarning() << "Local model not available at" << m_modelPath;
+        LOG_WARNING(QString("本地模型不可用: %1").arg(m_modelPath));
     }
 }
 
 LocalModelService::~LocalModelService()
 {
-    // TODO: Clean up local model resources
+    // 加载和保存缓存都会检查标记，等待的时间不超过一层权重或一页缓存
+    m_shuttingDown = true;
+    if (m_cancelFlag) {
+        m_cancelFlag->store(true);
+    }
+    m_worker.waitForDone();
 }
 
 QFuture<QString> LocalModelService::generateResponse(const QString& prompt)
 {
+    LOG_INFO("发送本地模型请求");
     QFutureInterface<QString> future;
+    future.reportStarted();
+    m_isCancelled = false;
+
+    if (!takeImages().isEmpty()) {
+        LOG_WARNING("本地模型不支持图片，已忽略");
+    }
+
+    // 设置只在界面线程读取
+    const SettingsModel& settings = SettingsModel::instance();
+    Request request;
+    request.prompt = prompt;
+    request.history = takeHistory();
+    if (!m_conversationPath.isEmpty()) {
+        request.cachePath = m_conversationPath + "/kvcache.bin";
+    }
+    request.systemPrompt = settings.rolePrompt();
+    request.temperature = float(settings.temperature());
+    request.maxTokens = qMax(1, settings.maxTokens());
+    request.contextLength = settings.contextWindow();
+    request.threads = settings.inferenceThreads();
+    request.cacheBytes = qint64(settings.kvCacheMB()) * 1024 * 1024;
+    request.cache8Bit = settings.kvCache8Bit();
 
-    // TODO: Implement local model inference
-    // This is a placeholder implementation
-    QString response = QString("Local model response to: %1").arg(prompt);
+    auto cancelled = std::make_shared<std::atomic<bool>>(false);
+    m_cancelFlag = cancelled;
 
-    future.reportFinished(&response);
+    m_worker.start([this, future, request, cancelled]() mutable {
+        try {
+            QString response = generate(request, *cancelled);
+            // 在界面线程中结束，ChatViewModel 的回调随之在界面线程执行
+            QMetaObject::invokeMethod(this, [future, response]() mutable {
+                future.reportResult(response);
+                future.reportFinished();
+            }, Qt::QueuedConnection);
+            // 回答已经交出，再把键值缓存写到对话目录
+            if (!request.cachePath.isEmpty()) {
+                m_engine->saveCache(request.cachePath, &m_shuttingDown);
+            }
+        } catch (const std::exception& e) {
+            QString error = QString::fromUtf8(e.what());
+            LOG_ERROR(QString("本地模型生成失败: %1").arg(error));
+            QMetaObject::invokeMethod(this, [future, error]() mutable {
+                future.reportException(std::make_exception_ptr(std::runtime_error(error.toStdString())));
+                future.reportFinished();
+            }, Qt::QueuedConnection);
+        }
+    });
 
     return future.future();
 }
 
+QString LocalModelService::generate(const Request& request, const std::atomic<bool>& cancelled)
+{
+    TRACE_SCOPE_CAT("LocalModelService::generate", "inference");
+
+    m_engine->setThreadCount(request.threads);
+    if (m_engine->configureCache(request.cacheBytes, request.cache8Bit)) {
+        m_syncedCachePath.clear();
+    }
+    if (!m_engine->isLoaded() || m_loadedContext != request.contextLength) {
+        m_syncedCachePath.clear();
+        QString error;
+        if (!m_engine->load(m_modelPath, request.contextLength, &error, &cancelled)) {
+            if (cancelled) {
+                return QString();
+            }
+            throw std::runtime_error(error.toStdString());
+        }
+        m_loadedContext = request.contextLength;
+    }
+
+    const LlamaTokenizer& tokenizer = m_engine->tokenizer();
+    const LlamaEngine::Config& config = m_engine->config();
+
+    // 超出上下文时从最早的历史消息开始丢弃
+    QList<int> tokens;
+    for (int firstTurn = 0; ; ++firstTurn) {
+        tokens.clear();
+        if (tokenizer.addBos() && tokenizer.bos() >= 0) {
+            tokens.append(tokenizer.bos());
+        }
+        tokens += tokenizer.encode(formatPrompt(request, firstTurn), true);
+        if (firstTurn == 0 && tokens.size() >= config.contextLength && !request.history.isEmpty()) {
+            // 并行统计每条历史消息的 token 数，直接跳到大致够用的位置，不再逐条重新编码整段提示词
+            QStringList contents;
+            for (const Turn& turn : request.history) {
+                contents.append(turn.content);
+            }
+            const QList<QList<int>> counts = tokenizer.encodeBatch(contents);
+            int excess = tokens.size() - config.contextLength + 1;
+            int skip = 0;
+            while (skip < counts.size() && excess > 0) {
+                excess -= counts.at(skip++).size();
+            }
+            firstTurn = skip - 1;
+            continue;
+        }
+        if (tokens.size() < config.contextLength) {
+            if (firstTurn > 0) {
+                LOG_INFO(QString("对话超出上下文长度，丢弃了最早的 %1 条消息").arg(firstTurn));
+            }
+            break;
+        }
+        if (firstTurn >= request.history.size()) {
+            throw std::runtime_error(QString("提示词有 %1 个 token，超过了上下文长度 %2")
+                .arg(tokens.size()).arg(config.contextLength).toStdString());
+        }
+    }
+
+    // 只在切换过对话、换过模型或缓存被清空后从对话目录导入。同一对话的后续各轮
+    // 内存中的缓存已经包含文件中的全部内容，不必再读文件
+    const bool synced = request.cachePath == m_syncedCachePath
+        && m_engine->modelHash() == m_syncedModelHash;
+    if (!request.cachePath.isEmpty() && !synced
+        && m_engine->cachedPrefix(tokens) + KvCache::kPageTokens <= tokens.size()) {
+        m_engine->restoreCache(request.cachePath, tokens);
+    }
+    m_syncedCachePath = request.cachePath;
+    m_syncedModelHash = m_engine->modelHash();
+
+    // 与缓存中相同的前缀不再计算
+    const int cachedTokens = m_engine->beginSequence(tokens);
+    emit promptCacheReported(tokens.size(), cachedTokens);
+
+    // 提示词按批计算，批与批之间检查取消并报告进度，取消最迟在一批之后生效。
+    // 已经算完的批留在缓存中，取消后重新发送时直接复用
+    QElapsedTimer timer;
+    timer.start();
+    const float* logits = nullptr;
+    const int prefillTokens = int(tokens.size()) - cachedTokens;
+    for (int i = cachedTokens; i < tokens.size(); i += LlamaEngine::kBatchSize) {
+        if (cancelled) {
+            LOG_INFO(QString("已取消提示词计算，完成 %1 / %2 token").arg(i - cachedTokens).arg(prefillTokens));
+            return QString();
+        }
+        const int count = qMin(LlamaEngine::kBatchSize, int(tokens.size()) - i);
+        logits = m_engine->prefill(tokens.constData() + i, count);
+        if (!logits) {
+            throw std::runtime_error("键值缓存内存不足，请调大缓存上限");
+        }
+        const int done = i + count - cachedTokens;
+        emit prefillProgress(done, prefillTokens, done * 1000.0 / qMax<qint64>(1, timer.elapsed()));
+    }
+    qint64 prefillMs = timer.restart();
+
+    LlamaSampler sampler(request.temperature, kTopP);
+    // token 可能只含半个 UTF-8 字符，解码器保留不完整的部分到下一个 token
+    QStringDecoder decoder(QStringDecoder::Utf8);
+    QString response;
+    int generated = 0;
+    while (generated < request.maxTokens && m_engine->sequenceLength() < config.contextLength && !cancelled) {
+        int next = sampler.sample(logits, config.vocabSize);
+        if (next < 0) {
+            LOG_WARNING("模型输出中没有有效的 logit，提前结束生成");
+            break;
+        }
+        if (tokenizer.isEndOfGeneration(next)) {
+            break;
+        }
+        ++generated;
+
+        QString text = decoder.decode(tokenizer.decode(next));
+        if (response.isEmpty()) {
+            // 模板末尾之后的第一个词通常带有前导空格
+            while (!text.isEmpty() && text.front().isSpace()) {
+                text.remove(0, 1);
+            }
+        }
+        if (!text.isEmpty()) {
+            response += text;
+            emitStreamChunk(text);
+        }
+        logits = m_engine->forward(next);
+        if (!logits) {
+            break;
+        }
+    }
+
+    qint64 decodeMs = qMax<qint64>(1, timer.elapsed());
+    const KvCache::Stats cache = m_engine->cacheStats();
+    LOG_INFO(QString("本地模型完成: 提示 %1 token（复用 %2）用时 %3 ms，生成 %4 token，%5 token/s，%6 线程%7")
+        .arg(tokens.size()).arg(cachedTokens).arg(prefillMs).arg(generated)
+        .arg(generated * 1000.0 / decodeMs, 0, 'f', 1)
+        .arg(m_engine->threadCount())
+        .arg(cancelled ? "（已取消）" : ""));
+    LOG_INFO(QString("键值缓存: 前缀命中率 %1%，使用 %2 页，保留 %3 页，共 %4 MB，已淘汰 %5 页")
+        .arg(cache.hitRate() * 100.0, 0, 'f', 1)
+        .arg(cache.activePages).arg(cache.cachedPages)
+        .arg(cache.bytes / 1048576)
+        .arg(cache.evictedPages));
+    return response;
+}
+
+QString LocalModelService::formatPrompt(const Request& request, int firstTurn) const
+{
+    const QString chatTemplate = m_engine->tokenizer().chatTemplate();
+    const QString& system = request.systemPrompt;
+    // 丢弃历史后不能以助手的回答开头
+    QList<Turn> turns = request.history.mid(firstTurn);
+    while (!turns.isEmpty() && turns.first().role != "user") {
+        turns.removeFirst();
+    }
+    turns.append({"user", request.prompt});
+
+    QString text;
+    if (chatTemplate.contains("<|im_start|>")) {
+        if (!system.isEmpty()) {
+            text += QString("<|im_start|>system\n%1<|im_end|>\n").arg(system);
+        }
+        for (const Turn& turn : turns) {
+            text += QString("<|im_start|>%1\n%2<|im_end|>\n").arg(turn.role, turn.content);
+        }
+        return text + "<|im_start|>assistant\n";
+    }
+    if (chatTemplate.contains("<|start_header_id|>")) {
+        if (!system.isEmpty()) {
+            text += QString("<|start_header_id|>system<|end_header_id|>\n\n%1<|eot_id|>").arg(system);
+        }
+        for (const Turn& turn : turns) {
+            text += QString("<|start_header_id|>%1<|end_header_id|>\n\n%2<|eot_id|>").arg(turn.role, turn.content);
+        }
+        return text + "<|start_header_id|>assistant<|end_header_id|>\n\n";
+    }
+    if (chatTemplate.contains("[INST]")) {
+        // 系统提示放在第一条用户消息里，每轮回答之后结束一段再开始下一段
+        bool first = true;
+        for (const Turn& turn : turns) {
+            if (turn.role == "user") {
+                if (first && !system.isEmpty()) {
+                    text += QString("[INST] <<SYS>>\n%1\n<</SYS>>\n\n%2 [/INST]").arg(system, turn.content);
+                } else {
+                    text += QString("[INST] %1 [/INST]").arg(turn.content);
+                }
+                first = false;
+            } else {
+                text += QString(" %1 </s><s>").arg(turn.content);
+            }
+        }
+        return text;
+    }
+    // 没有模板的基础模型直接续写
+    QStringList parts;
+    if (!system.isEmpty()) {
+        parts.append(system);
+    }
+    for (const Turn& turn : turns) {
+        parts.append(turn.content);
+    }
+    return parts.join("\n\n");
+}
+
+void LocalModelService::cancelGeneration()
+{
+    if (m_cancelFlag) {
+        m_cancelFlag->store(true);
+    }
+    LLMService::cancelGeneration();
+}
+
 bool LocalModelService::isAvailable() const
 {
-    // TODO: Implement a proper check for local model availability
-    // This might involve checking file existence and model integrity
-    return QFile::exists(m_modelPath); // Basic check: file exists
+    return GgufFile::probe(m_modelPath);
 }
 
 QString LocalModelService::getModelName() const
 {
-    return m_modelPath.isEmpty() ? "Local Model" : m_modelPath;
+    return m_modelPath.isEmpty() ? "Local Model" : QFileInfo(m_modelPath).completeBaseName();
 }
@@ -4,23 +4,67 @@
 #include "llmservice.h"
 #include <QFutureInterface>
 #include <QString>
+#include <QThreadPool>
+#include <QScopedPointer>
+#include <atomic>
+#include <memory>
 
+class LlamaEngine;
+
+/**
+ * @brief 本地模型服务
+ *
+ * 在本机 CPU 上运行 GGUF 模型。模型在第一次请求时于后台线程中加载（内存映射，
+ * 不整体读入），之后一直保留。生成在单线程的线程池中进行，每解码出完整的字符
+ * 就作为流式片段发出，遵循设置中的温度和最大输出长度，可以随时取消。
+ *
+ * 提示词包含完整的对话历史。引擎的键值缓存保留之前各轮的结果，下一轮只需
+ * 计算新增的 token；历史超出上下文时从最早的消息开始丢弃。每次回答之后键值缓存
+ * 保存到对话目录，重启或切换回旧对话时从文件导入，不必重新计算整段对话。
+ */
 class LocalModelService : public LLMService
 {
     Q_OBJECT
 
 public:
-
     explicit LocalModelService(const QString& modelPath, QObject *parent = nullptr);
     ~LocalModelService() override;
 
     QFuture<QString> generateResponse(const QString& prompt) override;
     bool isAvailable() const override;
     QString getModelName() const override;
+    void cancelGeneration() override;
+    bool supportsHistory() const override { return true; }
 
 private:
-    QString m_modelPath;
-    // TODO: Add local model related members (e.g., ONNX Runtime session, model object)
+    struct Request {
+        QString prompt;
+        QString systemPrompt;
+        QList<Turn> history;
+        float temperature = 0.7f;
+        int maxTokens = 2048;
+        int contextLength = 4096;
+        int threads = 0;
+        qint64 cacheBytes = 0;
+        bool cache8Bit = false;
+        QString cachePath;      // 对话目录中的键值缓存文件，为空时不保存
+    };
+
+    // 在后台线程中执行，返回完整回答，出错时抛出异常
+    QString generate(const Request& request, const std::atomic<bool>& cancelled);
+    // 按模型自带的对话模板组织提示词，历史从第 firstTurn 条开始
+    QString formatPrompt(const Request& request, int firstTurn) const;
+
+    QThreadPool m_worker;                 // 单线程，保证同一时间只有一个请求使用引擎
+    QScopedPointer<LlamaEngine> m_engine; // 只在 m_worker 中访问
+    int m_loadedContext = 0;
+    // 内存中的键值缓存最近一次与哪个对话文件、哪个模型同步过，只在 m_worker 中访问
+    QString m_syncedCachePath;
+    quint64 m_syncedModelHash = 0;
+    // 每个请求一个取消标记，取消后立即发出的新请求不受影响
+    std::shared_ptr<std::atomic<bool>> m_cancelFlag;
+    // 析构时置位，让后台线程中的模型加载和键值缓存保存尽快结束，不拖住界面线程
+    std::atomic<bool> m_shuttingDown{false};
 };
 
 #endif // LOCALMODELSERVICE_H
@@ -61,6 +61,11 @@ void Logger::writeLog(Level level, const QString& message)
         return;
     }
 
+    {
+        QMutexLocker lastLocker(&m_lastMessageMutex);
+        m_lastMessage = message;
+    }
+
     QString levelStr = levelToString(level);
     QString formattedMessage = QString("[%1] [%2] %3")
         .arg(QDateTime::currentDateTime().toString("yyyy-MM-dd hh:mm:ss.zzz"))
@@ -83,16 +88,25 @@ void Logger::writeLog(Level level, const QString& message)
             break;
     }
 
-    // 写入文件
+    // 写入文件，后台线程也会写日志
+    static QMutex fileMutex;
+    QMutexLocker locker(&fileMutex);
     if (m_logFile.isOpen()) {
         m_logStream << formattedMessage << "\n";
         m_logStream.flush();
     }
+    locker.unlock();
 
     // 发送信号
     emit logMessage(level, message);
 }
 
+QString Logger::lastMessage() const
+{
+    QMutexLocker locker(&m_lastMessageMutex);
+    return m_lastMessage;
+}
+
 QString Logger::levelToString(Level level) const
 {
     switch (level) {
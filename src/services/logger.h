@@ -8,6 +8,7 @@
 #include <QDateTime>
 #include <QDir>
 #include <QCoreApplication>
+#include <QMutex>
 
 class Logger : public QObject
 {
@@ -37,6 +38,9 @@ public:
     void warning(const QString& message);
     void error(const QString& message);
 
+    // 最近一条日志，卡顿检测用来说明当时在做什么，可以在任意线程调用
+    QString lastMessage() const;
+
 signals:
     void logMessage(Level level, const QString& message);
 
@@ -52,6 +56,8 @@ private:
     Level m_level = Level::Debug;
     QFile m_logFile;
     QTextStream m_logStream;
+    mutable QMutex m_lastMessageMutex;
+    QString m_lastMessage;
     static bool m_initialized;
 };
 
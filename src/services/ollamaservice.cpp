@@ -10,6 +10,12 @@
 #include <exception>
 #include <stdexcept>
 #include "services/logger.h"
+#include "services/tracer.h"
+
+namespace {
+// 发送前把图片长边缩小到该值，视觉模型会在内部继续缩放，更大的图片只会增加上传量
+const int kMaxImageEdge = 1344;
+}
 
 OllamaService::OllamaService(const QString& modelName, QObject *parent)
     : LLMService(parent)
@@ -40,6 +46,8 @@ QFuture<QString> OllamaService::generateResponse(const QString& prompt)
     QFutureInterface<QString> future;
     m_currentFuture = future;
     m_currentResponse.clear();  // 清空当前响应
+    m_isCancelled = false;
+    QList<ImagePipeline::ImageHandle> images = takeImages();
 
     // 再次检查服务可用性
     if (!isAvailable()) {
@@ -62,6 +70,15 @@ QFuture<QString> OllamaService::generateResponse(const QString& prompt)
     QString fullPrompt = QString("请用中文回复以下问题：\n%1").arg(prompt);
     json["prompt"] = fullPrompt;
     json["stream"] = true;  // 启用流式输出
+
+    // 图片放在 images 字段中，base64 数据在发送时写入占位字符串的位置
+    if (!images.isEmpty()) {
+        QJsonArray imageArray;
+        for (int i = 0; i < images.size(); ++i) {
+            imageArray.append(ImageRequestBody::placeholder(i));
+        }
+        json["images"] = imageArray;
+    }
     
     // 默认关闭深度思考模式
     QJsonObject options;
@@ -75,7 +92,36 @@ QFuture<QString> OllamaService::generateResponse(const QString& prompt)
     QByteArray jsonData = QJsonDocument(json).toJson();
     LOG_INFO(QString("Ollama 请求数据: %1").arg(QString(jsonData)));
 
-    QNetworkReply* reply = m_networkManager->post(request, jsonData);
+    if (images.isEmpty()) {
+        startRequest(request, jsonData, {});
+    } else {
+        // 图片在后台缩小并编码，完成后再发送请求
+        encodeImages(images, kMaxImageEdge, [this, request, jsonData](const QList<ImageEncoder::Encoded>& encoded) {
+            if (m_isCancelled) {
+                m_currentFuture.reportResult(QString());
+                m_currentFuture.reportFinished();
+                return;
+            }
+            startRequest(request, jsonData, encoded);
+        }, [this](const QString& error) {
+            if (m_isCancelled) {
+                m_currentFuture.reportResult(QString());
+                m_currentFuture.reportFinished();
+            } else if (m_currentFuture.isRunning()) {
+                m_currentFuture.reportException(std::make_exception_ptr(std::runtime_error(error.toStdString())));
+                m_currentFuture.reportFinished();
+            }
+        });
+    }
+
+    future.reportStarted();
+    return future.future();
+}
+
+void OllamaService::startRequest(const QNetworkRequest& request, const QByteArray& jsonData,
+                                 const QList<ImageEncoder::Encoded>& images)
+{
+    QNetworkReply* reply = ImageRequestBody::post(m_networkManager, request, jsonData, images);
 
     // 设置单个请求的超时
     QTimer::singleShot(120000, reply, [reply]() {  // 120秒
@@ -113,12 +159,15 @@ QFuture<QString> OllamaService::generateResponse(const QString& prompt)
     // 连接数据接收信号
     connect(reply, &QNetworkReply::readyRead,
             this, [this, reply]() {
+        TRACE_SCOPE_CAT("OllamaService::readyRead", "network");
         QByteArray data = reply->readAll();
+        TRACE_COUNTER("ollama bytes read", data.size());
         QStringList lines = QString::fromUtf8(data).split('\n', Qt::SkipEmptyParts);
         
         for (const QString& line : lines) {
             if (line.trimmed().isEmpty()) continue;
             
+            TRACE_SCOPE_CAT("OllamaService::parseLine", "parse");
             QJsonParseError parseError;
             QJsonDocument doc = QJsonDocument::fromJson(line.toUtf8(), &parseError);
             
@@ -130,7 +179,7 @@ QFuture<QString> OllamaService::generateResponse(const QString& prompt)
                     LOG_INFO(QString("收到响应片段: %1").arg(chunk));
                     
                     // 发送流式响应信号
-                    emit streamResponseReceived(m_currentResponse);
+                    emitStreamChunk(m_currentResponse);
                     
                     // 报告当前累积的响应
                     if (m_currentFuture.isRunning()) {
@@ -162,13 +211,11 @@ QFuture<QString> OllamaService::generateResponse(const QString& prompt)
             this, [this, reply]() {
         reply->deleteLater();
     });
-
-    future.reportStarted();
-    return future.future();
 }
 
 bool OllamaService::isAvailable() const
 {
+    TRACE_SCOPE_CAT("OllamaService::isAvailable", "network");
     // 检查 Ollama 服务是否运行
     QProcess process;
     process.start("ollama", QStringList() << "list");
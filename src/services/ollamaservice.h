@@ -18,11 +18,15 @@ public:
     QFuture<QString> generateResponse(const QString& prompt) override;
     bool isAvailable() const override;
     QString getModelName() const override;
+    bool supportsImages() const override { return true; }
 
 private slots:
     void handleResponse(QNetworkReply* reply);
 
 private:
+    void startRequest(const QNetworkRequest& request, const QByteArray& jsonData,
+                      const QList<ImageEncoder::Encoded>& images);
+
     QString m_modelName;
     QString m_currentResponse;  // 用于累积流式响应
     QNetworkAccessManager* m_networkManager;
@@ -0,0 +1,704 @@
+#include "searchindex.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QSet>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QStandardPaths>
+#include <QMutexLocker>
+#include <QtEndian>
+#include <algorithm>
+#include <cstring>
+#include "services/logger.h"
+
+namespace {
+
+const quint32 kSegmentMagic = 0x49534443;  // "CDSI"
+const quint32 kSegmentVersion = 1;
+const qint64 kSegmentHeaderSize = 16;
+const qint64 kTermEntrySize = 24;          // 词偏移(4) + 词长度(4) + 倒排偏移(8) + 倒排数量(4) + 保留(4)
+
+// 待写段达到该数量的倒排项后写入磁盘
+const int kFlushPostings = 200000;
+// 段数超过该值时合并为一个
+const int kMaxSegments = 8;
+// 补齐索引时每次读取的消息数
+const int kSyncBatch = 256;
+const int kMaxTermLength = 64;
+
+bool isCjk(QChar ch)
+{
+    switch (ch.script()) {
+        case QChar::Script_Han:
+        case QChar::Script_Hiragana:
+        case QChar::Script_Katakana:
+        case QChar::Script_Hangul:
+            return true;
+        default:
+            return false;
+    }
+}
+
+quint64 documentId(int conversation, int index)
+{
+    return (quint64(quint32(conversation)) << 32) | quint32(index);
+}
+
+int compareTerm(const char* data, int length, const QByteArray& term)
+{
+    int result = std::memcmp(data, term.constData(), size_t(qMin(length, int(term.size()))));
+    return result != 0 ? result : length - int(term.size());
+}
+
+} // namespace
+
+// 内存映射的只读段文件
+struct SearchIndex::Segment
+{
+    QString name;
+    QFile file;
+    const uchar* map = nullptr;
+    qint64 size = 0;
+    quint32 termCount = 0;
+
+    ~Segment()
+    {
+        if (map) {
+            file.unmap(const_cast<uchar*>(map));
+        }
+    }
+
+    bool open(const QString& path)
+    {
+        file.setFileName(path);
+        if (!file.open(QIODevice::ReadOnly)) {
+            return false;
+        }
+        size = file.size();
+        if (size < kSegmentHeaderSize) {
+            return false;
+        }
+        map = file.map(0, size);
+        if (!map || qFromLittleEndian<quint32>(map) != kSegmentMagic
+            || qFromLittleEndian<quint32>(map + 4) != kSegmentVersion) {
+            return false;
+        }
+        termCount = qFromLittleEndian<quint32>(map + 8);
+        return kSegmentHeaderSize + qint64(termCount) * kTermEntrySize <= size;
+    }
+
+    const uchar* entry(int i) const
+    {
+        return map + kSegmentHeaderSize + qint64(i) * kTermEntrySize;
+    }
+
+    QByteArray termAt(int i) const
+    {
+        quint32 offset = qFromLittleEndian<quint32>(entry(i));
+        quint32 length = qFromLittleEndian<quint32>(entry(i) + 4);
+        if (qint64(offset) + length > size) {
+            return QByteArray();
+        }
+        return QByteArray(reinterpret_cast<const char*>(map + offset), int(length));
+    }
+
+    int find(const QByteArray& term) const
+    {
+        int low = 0;
+        int high = int(termCount) - 1;
+        while (low <= high) {
+            int mid = low + (high - low) / 2;
+            quint32 offset = qFromLittleEndian<quint32>(entry(mid));
+            quint32 length = qFromLittleEndian<quint32>(entry(mid) + 4);
+            if (qint64(offset) + length > size) {
+                return -1;
+            }
+            int cmp = compareTerm(reinterpret_cast<const char*>(map + offset), int(length), term);
+            if (cmp == 0) {
+                return mid;
+            }
+            if (cmp < 0) {
+                low = mid + 1;
+            } else {
+                high = mid - 1;
+            }
+        }
+        return -1;
+    }
+
+    void appendPostings(int i, Postings& out) const
+    {
+        quint64 offset = qFromLittleEndian<quint64>(entry(i) + 8);
+        quint32 count = qFromLittleEndian<quint32>(entry(i) + 16);
+        if (qint64(offset) + qint64(count) * 8 > size) {
+            return;
+        }
+        const uchar* p = map + offset;
+        out.reserve(out.size() + int(count));
+        for (quint32 k = 0; k < count; ++k, p += 8) {
+            out.append(qFromLittleEndian<quint64>(p));
+        }
+    }
+};
+
+SearchIndex::SearchIndex(const QString& rootPath, QObject *parent)
+    : QObject(parent)
+    , m_rootPath(rootPath.isEmpty() ? defaultRootPath() : rootPath)
+{
+    // 单线程保证索引更新按提交顺序执行
+    m_worker.setMaxThreadCount(1);
+    QDir().mkpath(m_rootPath);
+    load();
+}
+
+SearchIndex::~SearchIndex()
+{
+    flushAndWait();
+}
+
+QString SearchIndex::defaultRootPath()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/search";
+}
+
+QStringList SearchIndex::tokenize(const QString& text, bool query)
+{
+    QStringList terms;
+    const int n = text.size();
+    int i = 0;
+    while (i < n) {
+        QChar ch = text.at(i);
+        if (isCjk(ch)) {
+            int start = i;
+            while (i < n && isCjk(text.at(i))) {
+                ++i;
+            }
+            int length = i - start;
+            for (int k = start; k < i; ++k) {
+                if (!query || length == 1) {
+                    terms.append(text.mid(k, 1));
+                }
+                if (k + 1 < i) {
+                    terms.append(text.mid(k, 2));
+                }
+            }
+        } else if (ch.isLetterOrNumber()) {
+            int start = i;
+            while (i < n && text.at(i).isLetterOrNumber() && !isCjk(text.at(i))) {
+                ++i;
+            }
+            if (i - start <= kMaxTermLength) {
+                terms.append(text.mid(start, i - start).toLower());
+            }
+        } else {
+            ++i;
+        }
+    }
+    return terms;
+}
+
+void SearchIndex::load()
+{
+    QFile stateFile(m_rootPath + "/state.json");
+    if (stateFile.open(QIODevice::ReadOnly)) {
+        QJsonObject state = QJsonDocument::fromJson(stateFile.readAll()).object();
+        m_nextSegment = state["nextSegment"].toInt();
+
+        for (const QJsonValue& value : state["conversations"].toArray()) {
+            // 已删除的对话保留空位，编号不变
+            if (!value.toString().isEmpty()) {
+                m_conversationNumbers.insert(value.toString(), m_conversations.size());
+            }
+            m_conversations.append(value.toString());
+        }
+
+        QJsonObject indexed = state["indexed"].toObject();
+        for (auto it = indexed.begin(); it != indexed.end(); ++it) {
+            m_indexedCounts.insert(it.key(), it.value().toInt());
+        }
+        m_committedCounts = m_indexedCounts;
+
+        QJsonObject synced = state["synced"].toObject();
+        for (auto it = synced.begin(); it != synced.end(); ++it) {
+            m_syncStamps.insert(it.key(), qint64(it.value().toDouble()));
+        }
+
+        for (const QJsonValue& value : state["segments"].toArray()) {
+            QSharedPointer<Segment> segment(new Segment);
+            segment->name = value.toString();
+            if (segment->open(m_rootPath + "/" + segment->name)) {
+                m_segments.append(segment);
+            } else {
+                LOG_WARNING(QString("搜索索引段无法打开: %1").arg(segment->name));
+            }
+        }
+    }
+
+    // state.json 是提交点，其中没有列出的段属于未完成的写入或合并
+    QSet<QString> live;
+    for (const auto& segment : m_segments) {
+        live.insert(segment->name);
+    }
+    const QStringList files = QDir(m_rootPath).entryList(QStringList() << "seg-*.idx", QDir::Files);
+    for (const QString& name : files) {
+        if (!live.contains(name)) {
+            QFile::remove(m_rootPath + "/" + name);
+        }
+    }
+
+    LOG_INFO(QString("搜索索引已加载，%1 个段，%2 个对话")
+        .arg(m_segments.size())
+        .arg(m_conversations.size()));
+}
+
+QList<SearchIndex::Hit> SearchIndex::search(const QString& query, int limit) const
+{
+    QStringList terms = tokenize(query, true);
+    terms.removeDuplicates();
+    if (terms.isEmpty()) {
+        return QList<Hit>();
+    }
+
+    QMutexLocker locker(&m_mutex);
+    QList<Postings> lists;
+    for (const QString& term : terms) {
+        Postings postings = postingsFor(term.toUtf8());
+        if (postings.isEmpty()) {
+            return QList<Hit>();
+        }
+        lists.append(postings);
+    }
+
+    // 从最短的倒排表开始求交集
+    std::sort(lists.begin(), lists.end(), [](const Postings& a, const Postings& b) {
+        return a.size() < b.size();
+    });
+    Postings result = lists.first();
+    for (int i = 1; i < lists.size() && !result.isEmpty(); ++i) {
+        Postings next;
+        std::set_intersection(result.cbegin(), result.cend(),
+                              lists.at(i).cbegin(), lists.at(i).cend(),
+                              std::back_inserter(next));
+        result.swap(next);
+    }
+
+    QList<Hit> hits;
+    for (auto it = result.crbegin(); it != result.crend() && hits.size() < limit; ++it) {
+        Hit hit;
+        hit.conversationId = m_conversations.value(int(*it >> 32));
+        if (hit.conversationId.isEmpty()) {
+            // 已删除的对话，倒排项等合并时清除
+            continue;
+        }
+        hit.messageIndex = int(*it & 0xFFFFFFFFu);
+        hits.append(hit);
+    }
+    return hits;
+}
+
+SearchIndex::Postings SearchIndex::postingsFor(const QByteArray& term) const
+{
+    Postings postings;
+    for (const auto& segment : m_segments) {
+        int i = segment->find(term);
+        if (i >= 0) {
+            segment->appendPostings(i, postings);
+        }
+    }
+    auto flushing = m_flushing.constFind(term);
+    if (flushing != m_flushing.constEnd()) {
+        postings += flushing.value();
+    }
+    auto pending = m_pending.constFind(term);
+    if (pending != m_pending.constEnd()) {
+        postings += pending.value();
+    }
+
+    std::sort(postings.begin(), postings.end());
+    postings.erase(std::unique(postings.begin(), postings.end()), postings.end());
+    return postings;
+}
+
+void SearchIndex::addMessage(const QString& conversationId, int index, const QString& content)
+{
+    m_worker.start([this, conversationId, index, content]() {
+        {
+            QMutexLocker locker(&m_mutex);
+            indexDocument(conversationId, index, content);
+        }
+        flushIfNeeded(false);
+    });
+}
+
+void SearchIndex::syncConversation(const QSharedPointer<ConversationFile>& file)
+{
+    m_worker.start([this, file]() {
+        indexFile(file.data());
+        flushIfNeeded(false);
+    });
+}
+
+void SearchIndex::syncConversations(const QString& storeRoot, const QStringList& ids)
+{
+    m_worker.start([this, storeRoot, ids]() {
+        for (const QString& id : ids) {
+            QString path = storeRoot + "/" + id;
+            qint64 stamp = qMax(QFileInfo(path + "/journal.bin").lastModified().toMSecsSinceEpoch(),
+                                QFileInfo(path + "/messages.idx").lastModified().toMSecsSinceEpoch());
+            {
+                QMutexLocker locker(&m_mutex);
+                if (m_syncStamps.value(id, -1) == stamp) {
+                    continue;
+                }
+            }
+
+            ConversationFile file(path);
+            if (file.openReadOnly()) {
+                indexFile(&file);
+                file.close();
+                QMutexLocker locker(&m_mutex);
+                m_pendingStamps.insert(id, stamp);
+            }
+        }
+        flushIfNeeded(true);
+    });
+}
+
+void SearchIndex::removeConversation(const QString& conversationId)
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_removedIds.insert(conversationId);
+        int conversation = m_conversationNumbers.value(conversationId, -1);
+        if (conversation < 0) {
+            return;
+        }
+        m_conversationNumbers.remove(conversationId);
+        m_conversations[conversation] = QString();
+        m_indexedCounts.remove(conversationId);
+        m_committedCounts.remove(conversationId);
+        m_syncStamps.remove(conversationId);
+        m_pendingStamps.remove(conversationId);
+
+        // 待写段中的倒排项直接去掉
+        for (auto it = m_pending.begin(); it != m_pending.end();) {
+            Postings& postings = it.value();
+            auto removed = std::remove_if(postings.begin(), postings.end(), [conversation](quint64 doc) {
+                return int(doc >> 32) == conversation;
+            });
+            m_pendingPostings -= int(postings.end() - removed);
+            postings.erase(removed, postings.end());
+            it = postings.isEmpty() ? m_pending.erase(it) : std::next(it);
+        }
+    }
+
+    m_worker.start([this]() {
+        QMutexLocker locker(&m_mutex);
+        saveState();
+    });
+}
+
+void SearchIndex::flushAndWait()
+{
+    m_worker.start([this]() {
+        flushIfNeeded(true);
+    });
+    m_worker.waitForDone();
+}
+
+void SearchIndex::indexDocument(const QString& conversationId, int index, const QString& content)
+{
+    // 已经索引过的消息不重复索引
+    if (index < m_indexedCounts.value(conversationId) || m_removedIds.contains(conversationId)) {
+        return;
+    }
+
+    int conversation = m_conversationNumbers.value(conversationId, -1);
+    if (conversation < 0) {
+        conversation = m_conversations.size();
+        m_conversations.append(conversationId);
+        m_conversationNumbers.insert(conversationId, conversation);
+    }
+
+    QStringList terms = tokenize(content, false);
+    terms.removeDuplicates();
+    quint64 doc = documentId(conversation, index);
+    for (const QString& term : terms) {
+        m_pending[term.toUtf8()].append(doc);
+    }
+    m_pendingPostings += terms.size();
+    m_indexedCounts[conversationId] = index + 1;
+}
+
+void SearchIndex::indexFile(ConversationFile* file)
+{
+    QString id = file->id();
+    int total = file->messageCount();
+    int first = 0;
+    {
+        QMutexLocker locker(&m_mutex);
+        first = m_indexedCounts.value(id);
+    }
+
+    for (int i = first; i < total; i += kSyncBatch) {
+        const QList<ChatModel::Message> messages = file->readMessages(i, kSyncBatch);
+        QMutexLocker locker(&m_mutex);
+        for (int k = 0; k < messages.size(); ++k) {
+            // 未完成的回答等完成后再索引
+            if (!messages.at(k).complete) {
+                return;
+            }
+            indexDocument(id, i + k, messages.at(k).content);
+        }
+    }
+}
+
+void SearchIndex::flushIfNeeded(bool force)
+{
+    bool flush = false;
+    {
+        QMutexLocker locker(&m_mutex);
+        if (m_pendingPostings >= kFlushPostings || (force && !m_pending.isEmpty())) {
+            flush = true;
+        } else if (force && !m_pendingStamps.isEmpty() && m_pending.isEmpty()) {
+            // 没有新消息，只需要记录这些对话已经检查过
+            m_syncStamps.insert(m_pendingStamps);
+            m_pendingStamps.clear();
+            saveState();
+        }
+    }
+    if (flush) {
+        flushPending();
+    }
+
+    bool merge = false;
+    {
+        QMutexLocker locker(&m_mutex);
+        merge = m_segments.size() > kMaxSegments;
+    }
+    if (merge) {
+        mergeSegments();
+    }
+}
+
+void SearchIndex::flushPending()
+{
+    // 只在 m_worker 中调用，同一时间只有一次写入。待写段在锁内换出，
+    // 排序和写文件不持有锁，期间的查询从 m_flushing 中读取
+    QMap<QByteArray, Postings> terms;
+    QHash<QString, int> counts;
+    QHash<QString, qint64> stamps;
+    int postings = 0;
+    QString name;
+    {
+        QMutexLocker locker(&m_mutex);
+        m_flushing.swap(m_pending);
+        terms = m_flushing;
+        postings = m_pendingPostings;
+        m_pendingPostings = 0;
+        counts = m_indexedCounts;
+        stamps.swap(m_pendingStamps);
+        name = QString("seg-%1.idx").arg(m_nextSegment++, 6, 10, QChar('0'));
+    }
+
+    // 修改的是局部副本，m_flushing 保持不变
+    for (auto it = terms.begin(); it != terms.end(); ++it) {
+        std::sort(it.value().begin(), it.value().end());
+    }
+
+    QSharedPointer<Segment> segment;
+    if (writeSegment(name, terms)) {
+        segment.reset(new Segment);
+        segment->name = name;
+        if (!segment->open(m_rootPath + "/" + name)) {
+            LOG_ERROR(QString("搜索索引段无法打开: %1").arg(name));
+            segment.reset();
+        }
+    }
+
+    QMutexLocker locker(&m_mutex);
+    if (!segment) {
+        // 写入失败，换出的内容放回待写段，下次再写
+        for (auto it = m_flushing.begin(); it != m_flushing.end(); ++it) {
+            m_pending[it.key()] += it.value();
+        }
+        m_pendingPostings += postings;
+        for (auto it = stamps.cbegin(); it != stamps.cend(); ++it) {
+            if (!m_pendingStamps.contains(it.key())) {
+                m_pendingStamps.insert(it.key(), it.value());
+            }
+        }
+        m_flushing.clear();
+        return;
+    }
+
+    m_segments.append(segment);
+    m_flushing.clear();
+    // 写入期间删除的对话不再记录
+    for (auto it = counts.cbegin(); it != counts.cend(); ++it) {
+        if (!m_removedIds.contains(it.key())) {
+            m_committedCounts.insert(it.key(), it.value());
+        }
+    }
+    for (auto it = stamps.cbegin(); it != stamps.cend(); ++it) {
+        if (!m_removedIds.contains(it.key())) {
+            m_syncStamps.insert(it.key(), it.value());
+        }
+    }
+    saveState();
+}
+
+void SearchIndex::mergeSegments()
+{
+    // 段文件不可变，合并期间不需要持有锁，查询仍然使用旧段
+    QList<QSharedPointer<Segment>> sources;
+    QString name;
+    QSet<int> removed;
+    {
+        QMutexLocker locker(&m_mutex);
+        sources = m_segments;
+        name = QString("seg-%1.idx").arg(m_nextSegment++, 6, 10, QChar('0'));
+        for (int i = 0; i < m_conversations.size(); ++i) {
+            if (m_conversations.at(i).isEmpty()) {
+                removed.insert(i);
+            }
+        }
+    }
+
+    // 已删除对话的倒排项在合并时丢弃
+    QMap<QByteArray, Postings> terms;
+    for (const auto& segment : sources) {
+        for (int i = 0; i < int(segment->termCount); ++i) {
+            Postings postings;
+            segment->appendPostings(i, postings);
+            postings.erase(std::remove_if(postings.begin(), postings.end(), [&removed](quint64 doc) {
+                return removed.contains(int(doc >> 32));
+            }), postings.end());
+            if (!postings.isEmpty()) {
+                terms[segment->termAt(i)] += postings;
+            }
+        }
+    }
+    for (auto it = terms.begin(); it != terms.end(); ++it) {
+        std::sort(it.value().begin(), it.value().end());
+    }
+
+    if (!writeSegment(name, terms)) {
+        return;
+    }
+
+    QSharedPointer<Segment> merged(new Segment);
+    merged->name = name;
+    if (!merged->open(m_rootPath + "/" + name)) {
+        LOG_ERROR(QString("搜索索引段无法打开: %1").arg(name));
+        return;
+    }
+
+    QStringList obsolete;
+    {
+        QMutexLocker locker(&m_mutex);
+        for (const auto& segment : sources) {
+            m_segments.removeOne(segment);
+            obsolete.append(segment->name);
+        }
+        m_segments.prepend(merged);
+        saveState();
+    }
+
+    sources.clear();
+    for (const QString& file : obsolete) {
+        QFile::remove(m_rootPath + "/" + file);
+    }
+    LOG_INFO(QString("搜索索引已合并 %1 个段，共 %2 个词").arg(obsolete.size()).arg(terms.size()));
+}
+
+bool SearchIndex::writeSegment(const QString& name, const QMap<QByteArray, Postings>& terms)
+{
+    // 布局：头部、定长词表、词字符串、按 8 字节对齐的倒排表
+    quint32 termCount = quint32(terms.size());
+    qint64 stringsOffset = kSegmentHeaderSize + qint64(termCount) * kTermEntrySize;
+    qint64 stringsSize = 0;
+    for (auto it = terms.cbegin(); it != terms.cend(); ++it) {
+        stringsSize += it.key().size();
+    }
+    qint64 postingsOffset = (stringsOffset + stringsSize + 7) & ~qint64(7);
+
+    QByteArray header(kSegmentHeaderSize, '\0');
+    qToLittleEndian<quint32>(kSegmentMagic, header.data());
+    qToLittleEndian<quint32>(kSegmentVersion, header.data() + 4);
+    qToLittleEndian<quint32>(termCount, header.data() + 8);
+
+    QByteArray table(qint64(termCount) * kTermEntrySize, '\0');
+    QByteArray strings;
+    strings.reserve(postingsOffset - stringsOffset);
+    QByteArray postings;
+
+    char* entry = table.data();
+    qint64 postingPos = postingsOffset;
+    for (auto it = terms.cbegin(); it != terms.cend(); ++it, entry += kTermEntrySize) {
+        qToLittleEndian<quint32>(quint32(stringsOffset + strings.size()), entry);
+        qToLittleEndian<quint32>(quint32(it.key().size()), entry + 4);
+        qToLittleEndian<quint64>(quint64(postingPos), entry + 8);
+        qToLittleEndian<quint32>(quint32(it.value().size()), entry + 16);
+        strings.append(it.key());
+
+        char buffer[8];
+        for (quint64 doc : it.value()) {
+            qToLittleEndian<quint64>(doc, buffer);
+            postings.append(buffer, 8);
+        }
+        postingPos += qint64(it.value().size()) * 8;
+    }
+    strings.append(QByteArray(postingsOffset - stringsOffset - strings.size(), '\0'));
+
+    QSaveFile file(m_rootPath + "/" + name);
+    if (!file.open(QIODevice::WriteOnly)) {
+        LOG_ERROR(QString("无法写入搜索索引段 %1: %2").arg(name, file.errorString()));
+        return false;
+    }
+    file.write(header);
+    file.write(table);
+    file.write(strings);
+    file.write(postings);
+    if (!file.commit()) {
+        LOG_ERROR(QString("无法写入搜索索引段 %1: %2").arg(name, file.errorString()));
+        return false;
+    }
+    return true;
+}
+
+void SearchIndex::saveState()
+{
+    QJsonObject state;
+    state["nextSegment"] = m_nextSegment;
+
+    QJsonArray segments;
+    for (const auto& segment : m_segments) {
+        segments.append(segment->name);
+    }
+    state["segments"] = segments;
+    state["conversations"] = QJsonArray::fromStringList(m_conversations);
+
+    QJsonObject indexed;
+    for (auto it = m_committedCounts.cbegin(); it != m_committedCounts.cend(); ++it) {
+        indexed[it.key()] = it.value();
+    }
+    state["indexed"] = indexed;
+
+    QJsonObject synced;
+    for (auto it = m_syncStamps.cbegin(); it != m_syncStamps.cend(); ++it) {
+        synced[it.key()] = double(it.value());
+    }
+    state["synced"] = synced;
+
+    QSaveFile file(m_rootPath + "/state.json");
+    if (file.open(QIODevice::WriteOnly)) {
+        file.write(QJsonDocument(state).toJson(QJsonDocument::Compact));
+        if (!file.commit()) {
+            LOG_ERROR(QString("无法保存搜索索引状态: %1").arg(file.errorString()));
+        }
+    }
+}
@@ -0,0 +1,95 @@
+#ifndef SEARCHINDEX_H
+#define SEARCHINDEX_H
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QList>
+#include <QMap>
+#include <QHash>
+#include <QSet>
+#include <QVector>
+#include <QMutex>
+#include <QThreadPool>
+#include <QSharedPointer>
+#include "services/conversationfile.h"
+
+/**
+ * @brief 全部对话的全文索引
+ *
+ * 倒排索引以不可变的段文件保存在磁盘上，段内的词表按字节序排列，
+ * 通过内存映射二分查找。中日韩文字按单字和相邻两字切分，其他文字
+ * 按单词切分并转为小写。新消息先进入内存中的待写段，积累到一定数量
+ * 后在后台写成新段，段过多时合并。
+ *
+ * 查询在调用线程执行，写入和合并都在内部的后台线程中进行。
+ */
+class SearchIndex : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Hit {
+        QString conversationId;
+        int messageIndex = -1;
+    };
+
+    explicit SearchIndex(const QString& rootPath = QString(), QObject *parent = nullptr);
+    ~SearchIndex();
+
+    static QString defaultRootPath();
+
+    // 返回同时包含所有查询词的消息，从新到旧最多 limit 条
+    QList<Hit> search(const QString& query, int limit = 200) const;
+
+    // 增量索引一条已完成的消息
+    void addMessage(const QString& conversationId, int index, const QString& content);
+
+    // 补齐对话中尚未索引的消息，file 为已打开的对话
+    void syncConversation(const QSharedPointer<ConversationFile>& file);
+    // 以只读方式逐个打开对话目录，补齐尚未索引的消息
+    void syncConversations(const QString& storeRoot, const QStringList& ids);
+
+    // 删除对话的索引。立即从查询结果中去掉，磁盘上的倒排项在下次合并段时清除
+    void removeConversation(const QString& conversationId);
+
+    // 把待写段写入磁盘并等待后台任务结束
+    void flushAndWait();
+
+private:
+    struct Segment;
+    using Postings = QVector<quint64>;
+
+    // 建索引时中日韩文字同时切出单字和两字词，查询时只用两字词（单字查询除外）
+    static QStringList tokenize(const QString& text, bool query);
+
+    void load();
+    void indexDocument(const QString& conversationId, int index, const QString& content);
+    void indexFile(ConversationFile* file);
+    void flushIfNeeded(bool force);
+    void flushPending();
+    void mergeSegments();
+    bool writeSegment(const QString& name, const QMap<QByteArray, Postings>& terms);
+    void saveState();
+    Postings postingsFor(const QByteArray& term) const;
+
+    QString m_rootPath;
+    mutable QMutex m_mutex;
+    QThreadPool m_worker;
+
+    QList<QSharedPointer<Segment>> m_segments;
+    QMap<QByteArray, Postings> m_pending;
+    QMap<QByteArray, Postings> m_flushing;  // 正在写入磁盘的待写段，写完之前查询仍然使用
+    int m_pendingPostings = 0;
+    int m_nextSegment = 0;
+
+    QStringList m_conversations;          // 编号 -> 对话 ID，已删除的对话为空字符串
+    QSet<QString> m_removedIds;           // 本次运行中删除的对话，排队中的索引任务不再加入
+    QHash<QString, int> m_conversationNumbers;
+    QHash<QString, int> m_indexedCounts;  // 每个对话已索引的消息数，包括待写段
+    QHash<QString, int> m_committedCounts;  // 已写入磁盘段的消息数
+    QHash<QString, qint64> m_syncStamps;    // 补齐索引时对话文件的修改时间，未变化的对话不再打开
+    QHash<QString, qint64> m_pendingStamps;
+};
+
+#endif // SEARCHINDEX_H
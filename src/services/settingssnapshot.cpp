@@ -0,0 +1,95 @@
+#include "settingssnapshot.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QCborMap>
+#include <QCborValue>
+#include <QCryptographicHash>
+#include "services/logger.h"
+
+namespace {
+// 快照格式变化时递增，旧快照自动失效
+const int kSnapshotVersion = 1;
+}
+
+QString SettingsSnapshot::pathFor(const QString& settingsPath)
+{
+    return QFileInfo(settingsPath).absolutePath() + "/settings.cache";
+}
+
+QByteArray SettingsSnapshot::hashOf(const QByteArray& data)
+{
+    return QCryptographicHash::hash(data, QCryptographicHash::Sha256);
+}
+
+void SettingsSnapshot::clear()
+{
+    m_encoded.clear();
+    m_decoded.clear();
+}
+
+bool SettingsSnapshot::load(const QString& path, const QByteArray& jsonData, const QDateTime& jsonModified)
+{
+    clear();
+
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    QCborMap root = QCborValue::fromCbor(file.readAll()).toMap();
+    if (root.value(QStringLiteral("version")).toInteger() != kSnapshotVersion
+        || root.value(QStringLiteral("size")).toInteger() != jsonData.size()
+        || root.value(QStringLiteral("modified")).toInteger() != jsonModified.toMSecsSinceEpoch()
+        || root.value(QStringLiteral("hash")).toByteArray() != hashOf(jsonData)) {
+        LOG_INFO("设置快照已失效，重新解析 settings.json");
+        return false;
+    }
+
+    // 只取出各分区的编码，不解码
+    const QCborMap sections = root.value(QStringLiteral("sections")).toMap();
+    for (auto it = sections.begin(); it != sections.end(); ++it) {
+        m_encoded.insert(it.key().toString(), it.value().toByteArray());
+    }
+    return true;
+}
+
+QJsonObject SettingsSnapshot::section(const QString& name)
+{
+    auto decoded = m_decoded.constFind(name);
+    if (decoded != m_decoded.constEnd()) {
+        return decoded.value();
+    }
+
+    QJsonObject values = QCborValue::fromCbor(m_encoded.value(name)).toMap().toJsonObject();
+    m_decoded.insert(name, values);
+    return values;
+}
+
+bool SettingsSnapshot::write(const QString& path, const QByteArray& jsonData, const QDateTime& jsonModified,
+                             const QMap<QString, QJsonObject>& sections)
+{
+    QCborMap encoded;
+    for (auto it = sections.cbegin(); it != sections.cend(); ++it) {
+        encoded.insert(it.key(), QCborMap::fromJsonObject(it.value()).toCborValue().toCbor());
+    }
+
+    QCborMap root;
+    root.insert(QStringLiteral("version"), kSnapshotVersion);
+    root.insert(QStringLiteral("size"), jsonData.size());
+    root.insert(QStringLiteral("modified"), jsonModified.toMSecsSinceEpoch());
+    root.insert(QStringLiteral("hash"), hashOf(jsonData));
+    root.insert(QStringLiteral("sections"), encoded);
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        LOG_WARNING(QString("无法写入设置快照: %1").arg(file.errorString()));
+        return false;
+    }
+    file.write(root.toCborValue().toCbor());
+    if (!file.commit()) {
+        LOG_WARNING(QString("无法写入设置快照: %1").arg(file.errorString()));
+        return false;
+    }
+    return true;
+}
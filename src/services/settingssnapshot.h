@@ -0,0 +1,41 @@
+#ifndef SETTINGSSNAPSHOT_H
+#define SETTINGSSNAPSHOT_H
+
+#include <QString>
+#include <QHash>
+#include <QMap>
+#include <QByteArray>
+#include <QDateTime>
+#include <QJsonObject>
+
+/**
+ * @brief 设置的二进制快照
+ *
+ * settings.json 仍是可以手工编辑的原始数据，快照只用于加快启动。快照以 CBOR
+ * 保存各个分区，记录对应 JSON 文件的修改时间、大小和哈希，三者任一不一致时
+ * 视为失效，回到解析 JSON。每个分区单独编码，第一次访问时才解码。
+ */
+class SettingsSnapshot
+{
+public:
+    static QString pathFor(const QString& settingsPath);
+
+    // 读取快照并与 JSON 文件内容核对，失效时返回 false
+    bool load(const QString& path, const QByteArray& jsonData, const QDateTime& jsonModified);
+    void clear();
+
+    bool contains(const QString& section) const { return m_encoded.contains(section); }
+    // 第一次访问时解码
+    QJsonObject section(const QString& name);
+
+    static bool write(const QString& path, const QByteArray& jsonData, const QDateTime& jsonModified,
+                      const QMap<QString, QJsonObject>& sections);
+
+private:
+    static QByteArray hashOf(const QByteArray& data);
+
+    QHash<QString, QByteArray> m_encoded;
+    QHash<QString, QJsonObject> m_decoded;
+};
+
+#endif // SETTINGSSNAPSHOT_H
@@ -0,0 +1,130 @@
+#include "settingswriter.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QJsonDocument>
+#include <QElapsedTimer>
+#include <QMutexLocker>
+#include "services/settingssnapshot.h"
+#include "services/logger.h"
+#include "services/tracer.h"
+
+SettingsWriter::SettingsWriter(const QString& path, QObject *parent)
+    : QObject(parent)
+    , m_path(path)
+{
+    // 单线程保证写入顺序与提交顺序一致
+    m_worker.setMaxThreadCount(1);
+}
+
+SettingsWriter::~SettingsWriter()
+{
+    m_worker.waitForDone();
+}
+
+void SettingsWriter::setSection(const QString& name, const QJsonObject& values)
+{
+    m_sections.insert(name, values);
+}
+
+void SettingsWriter::setCacheSection(const QString& name, const QJsonObject& values)
+{
+    m_cacheSections.insert(name, values);
+}
+
+void SettingsWriter::commit()
+{
+    submit(true);
+}
+
+void SettingsWriter::commitSnapshot()
+{
+    submit(false);
+}
+
+void SettingsWriter::submit(bool writeJson)
+{
+    // 各分区的值是隐式共享的，复制时不会深拷贝
+    QMutexLocker locker(&m_mutex);
+    m_pending.sections = m_sections;
+    m_pending.cacheSections = m_cacheSections;
+    m_pending.writeJson = m_pending.writeJson || writeJson;
+    m_hasPending = true;
+    if (!m_running) {
+        m_running = true;
+        m_worker.start([this]() { writePending(); });
+    }
+}
+
+void SettingsWriter::waitForDone()
+{
+    m_worker.waitForDone();
+}
+
+void SettingsWriter::writePending()
+{
+    forever {
+        Job job;
+        {
+            QMutexLocker locker(&m_mutex);
+            if (!m_hasPending) {
+                m_running = false;
+                return;
+            }
+            job = m_pending;
+            m_pending = Job();
+            m_hasPending = false;
+        }
+
+        TRACE_SCOPE_CAT("SettingsWriter::write", "settings");
+        QElapsedTimer timer;
+        timer.start();
+
+        QByteArray json;
+        if (job.writeJson) {
+            QJsonObject root;
+            for (const QJsonObject& section : std::as_const(job.sections)) {
+                for (auto it = section.begin(); it != section.end(); ++it) {
+                    root.insert(it.key(), it.value());
+                }
+            }
+            json = QJsonDocument(root).toJson();
+
+            QSaveFile file(m_path);
+            bool ok = !m_path.isEmpty() && file.open(QIODevice::WriteOnly);
+            if (ok) {
+                file.write(json);
+                ok = file.commit();
+            }
+            if (!ok) {
+                QString error = tr("无法保存配置文件: %1").arg(file.errorString());
+                LOG_ERROR(error);
+                emit errorOccurred(error);
+                continue;
+            }
+        } else {
+            QFile file(m_path);
+            if (!file.open(QIODevice::ReadOnly)) {
+                continue;
+            }
+            json = file.readAll();
+        }
+
+        // 快照与刚写入的 JSON 对应，下次启动时据此核对
+        QMap<QString, QJsonObject> sections = job.sections;
+        sections.insert(job.cacheSections);
+        SettingsSnapshot::write(SettingsSnapshot::pathFor(m_path), json,
+                                QFileInfo(m_path).lastModified(), sections);
+
+        if (!job.writeJson) {
+            continue;
+        }
+
+        qint64 elapsed = timer.elapsed();
+        int count = ++m_writeCount;
+        m_lastWriteMs = elapsed;
+        TRACE_COUNTER("settings write ms", elapsed);
+        LOG_DEBUG(QString("设置已保存（第 %1 次），耗时 %2 ms").arg(count).arg(elapsed));
+        emit written(count, elapsed);
+    }
+}
@@ -0,0 +1,69 @@
+#ifndef SETTINGSWRITER_H
+#define SETTINGSWRITER_H
+
+#include <QObject>
+#include <QMap>
+#include <QMutex>
+#include <QJsonObject>
+#include <QThreadPool>
+#include <atomic>
+
+/**
+ * @brief 设置文件的后台写入
+ *
+ * 设置按分区（若干顶层键）提交，只有变化的分区需要重新生成，其余分区沿用
+ * 上次的内容。序列化和写文件在单线程的后台线程池中进行，先写临时文件再
+ * 替换，写到一半退出不会损坏原文件。写入尚未开始时再次提交只保留最新的一份，
+ * 连续的修改合并为一次写入。每次写入 JSON 后同时更新二进制快照。
+ */
+class SettingsWriter : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit SettingsWriter(const QString& path, QObject *parent = nullptr);
+    ~SettingsWriter();
+
+    // 替换一个分区的内容，在界面线程调用
+    void setSection(const QString& name, const QJsonObject& values);
+    // 只保存在快照中、不写入 JSON 的分区，与 setSection 同名时快照中使用这一份
+    void setCacheSection(const QString& name, const QJsonObject& values);
+    // 把所有分区合并后交给后台线程写入
+    void commit();
+    // JSON 已是最新时只重写快照，例如快照失效后重新解析了 JSON
+    void commitSnapshot();
+    // 等待所有写入完成，用于退出
+    void waitForDone();
+
+    int writeCount() const { return m_writeCount.load(); }
+    qint64 lastWriteMs() const { return m_lastWriteMs.load(); }
+
+signals:
+    void written(int count, qint64 elapsedMs);
+    void errorOccurred(const QString& error);
+
+private:
+    struct Job {
+        QMap<QString, QJsonObject> sections;
+        QMap<QString, QJsonObject> cacheSections;
+        bool writeJson = false;
+    };
+
+    void submit(bool writeJson);
+    void writePending();
+
+    QString m_path;
+    QMap<QString, QJsonObject> m_sections;
+    QMap<QString, QJsonObject> m_cacheSections;
+
+    QMutex m_mutex;
+    Job m_pending;
+    bool m_hasPending = false;
+    bool m_running = false;
+    QThreadPool m_worker;
+
+    std::atomic<int> m_writeCount{0};
+    std::atomic<qint64> m_lastWriteMs{0};
+};
+
+#endif // SETTINGSWRITER_H
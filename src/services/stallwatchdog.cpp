@@ -0,0 +1,147 @@
+#include "stallwatchdog.h"
+#include <QMutexLocker>
+#include <climits>
+#include "services/logger.h"
+#include "services/tracer.h"
+
+namespace {
+// 界面线程打点间隔
+const int kHeartbeatMs = 50;
+// 监视线程检查间隔
+const int kPollMs = 20;
+const int kDefaultThresholdMs = 100;
+// 只保留最近 10 分钟的卡顿，最多 500 条
+const int kWindowMinutes = 10;
+const int kMaxStalls = 500;
+}
+
+StallWatchdog::StallWatchdog(QObject *parent)
+    : QObject(parent)
+    , m_thresholdMs(kDefaultThresholdMs)
+{
+    m_clock.start();
+    m_lastBeatMs.store(m_clock.elapsed());
+
+    m_heartbeat.setInterval(kHeartbeatMs);
+    m_heartbeat.setTimerType(Qt::PreciseTimer);
+    connect(&m_heartbeat, &QTimer::timeout, this, &StallWatchdog::beat);
+    m_heartbeat.start();
+
+    m_thread = QThread::create([this]() { watch(); });
+    m_thread->setObjectName("StallWatchdog");
+    m_thread->start(QThread::LowPriority);
+}
+
+StallWatchdog::~StallWatchdog()
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_stopping = true;
+        m_wake.wakeAll();
+    }
+    m_thread->wait();
+    delete m_thread;
+}
+
+void StallWatchdog::beat()
+{
+    qint64 now = m_clock.elapsed();
+    qint64 last = m_lastBeatMs.exchange(now);
+
+    // 定时器本身的间隔不算卡顿
+    qint64 stalledMs = now - last - kHeartbeatMs;
+    if (stalledMs < thresholdMs()) {
+        return;
+    }
+
+    QString context;
+    {
+        QMutexLocker locker(&m_mutex);
+        if (m_capturedBeatMs == last) {
+            context = m_capturedContext;
+        }
+        m_capturedBeatMs = -1;
+        m_capturedContext.clear();
+    }
+    if (context.isEmpty()) {
+        context = tr("未知");
+    }
+
+    m_stalls.append({QDateTime::currentDateTime(), stalledMs, context});
+    prune();
+
+    TRACE_COUNTER("gui stall ms", stalledMs);
+    LOG_WARNING(QString("界面线程卡顿 %1 ms: %2").arg(stalledMs).arg(context));
+    emit stallDetected(stalledMs, context);
+}
+
+void StallWatchdog::watch()
+{
+    QMutexLocker locker(&m_mutex);
+    while (!m_stopping) {
+        m_wake.wait(&m_mutex, kPollMs);
+        if (m_stopping) {
+            break;
+        }
+
+        qint64 last = m_lastBeatMs.load();
+        qint64 stalledMs = m_clock.elapsed() - last - kHeartbeatMs;
+        if (stalledMs < thresholdMs() || m_capturedBeatMs == last) {
+            continue;
+        }
+
+        // 刚超过阈值时记下界面线程在做什么，之后同一次卡顿不再重复记录
+        QStringList spans = Tracer::instance().mainThreadSpans();
+        m_capturedContext = spans.isEmpty()
+            ? tr("最近日志: %1").arg(Logger::instance().lastMessage())
+            : spans.join(" > ");
+        m_capturedBeatMs = last;
+    }
+}
+
+void StallWatchdog::prune()
+{
+    QDateTime oldest = QDateTime::currentDateTime().addSecs(-kWindowMinutes * 60);
+    while (!m_stalls.isEmpty()
+           && (m_stalls.size() > kMaxStalls || m_stalls.first().time < oldest)) {
+        m_stalls.removeFirst();
+    }
+}
+
+QList<StallWatchdog::Stall> StallWatchdog::recentStalls() const
+{
+    // 距上次卡顿已经很久时 m_stalls 里可能还有过期的记录
+    QDateTime oldest = QDateTime::currentDateTime().addSecs(-kWindowMinutes * 60);
+    QList<Stall> stalls;
+    for (const Stall& stall : m_stalls) {
+        if (stall.time >= oldest) {
+            stalls.append(stall);
+        }
+    }
+    return stalls;
+}
+
+QList<int> StallWatchdog::bucketLimits()
+{
+    return {250, 500, 1000, 2000, 5000, INT_MAX};
+}
+
+int StallWatchdog::windowMinutes()
+{
+    return kWindowMinutes;
+}
+
+QList<int> StallWatchdog::histogram() const
+{
+    const QList<int> limits = bucketLimits();
+    QList<int> counts(limits.size(), 0);
+    for (const Stall& stall : recentStalls()) {
+        for (int i = 0; i < limits.size(); ++i) {
+            if (stall.durationMs < limits.at(i)) {
+                ++counts[i];
+                break;
+            }
+        }
+    }
+    return counts;
+}
@@ -0,0 +1,69 @@
+#ifndef STALLWATCHDOG_H
+#define STALLWATCHDOG_H
+
+#include <QObject>
+#include <QTimer>
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QElapsedTimer>
+#include <QDateTime>
+#include <QList>
+#include <atomic>
+
+/**
+ * @brief 界面线程卡顿检测
+ *
+ * 界面线程用定时器定期打点，监视线程检查距上次打点的时间。超过阈值时监视线程
+ * 记下界面线程正在做什么：启用性能跟踪时是打开的区间，否则是最近一条日志。
+ * 界面线程恢复后根据两次打点的间隔算出卡顿时长，连同记下的内容一起保存。
+ * 只保留最近一段时间的记录，按时长分桶统计。
+ */
+class StallWatchdog : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Stall {
+        QDateTime time;        // 卡顿结束的时间
+        qint64 durationMs;
+        QString context;
+    };
+
+    explicit StallWatchdog(QObject *parent = nullptr);
+    ~StallWatchdog();
+
+    int thresholdMs() const { return m_thresholdMs.load(); }
+    void setThresholdMs(int ms) { m_thresholdMs.store(ms); }
+
+    // 统计窗口内的卡顿，按时间先后排列
+    QList<Stall> recentStalls() const;
+    // 各区间的卡顿次数，第 i 个区间为 [bucketLimits()[i-1], bucketLimits()[i])
+    QList<int> histogram() const;
+    static QList<int> bucketLimits();
+    static int windowMinutes();
+
+signals:
+    void stallDetected(qint64 durationMs, const QString& context);
+
+private:
+    void beat();
+    void watch();
+    void prune();
+
+    QElapsedTimer m_clock;
+    QTimer m_heartbeat;
+    QThread* m_thread = nullptr;
+    std::atomic<qint64> m_lastBeatMs{0};
+    std::atomic<int> m_thresholdMs;
+
+    QMutex m_mutex;
+    QWaitCondition m_wake;
+    bool m_stopping = false;          // 以下由 m_mutex 保护
+    qint64 m_capturedBeatMs = -1;     // 已经记下内容的那次打点
+    QString m_capturedContext;
+
+    QList<Stall> m_stalls;            // 只在界面线程访问
+};
+
+#endif // STALLWATCHDOG_H
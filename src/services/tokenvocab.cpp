@@ -0,0 +1,457 @@
+#include "tokenvocab.h"
+#include <QHash>
+#include <QSet>
+#include <QtEndian>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+#include "services/logger.h"
+
+namespace {
+const quint32 kMagic = 0x42565443;     // "CTVB"，小端
+const quint32 kVersion = 1;
+const qint64 kHeaderSize = 64;
+// 一个桶尝试的种子数上限，超过后换一个盐重新生成
+const quint32 kMaxSeeds = 1 << 16;
+const int kMaxSalts = 8;
+const quint64 kGolden = 0x9e3779b97f4a7c15ULL;
+
+quint64 mix(quint64 x)
+{
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+quint64 hashBytes(const char* data, int length, quint32 salt)
+{
+    quint64 hash = 14695981039346656037ULL ^ (quint64(salt) * kGolden);
+    for (int i = 0; i < length; ++i) {
+        hash = (hash ^ uchar(data[i])) * 1099511628211ULL;
+    }
+    return mix(hash);
+}
+
+quint64 hashPair(int left, int right, quint32 salt)
+{
+    return mix((quint64(quint32(left)) << 32 | quint32(right)) ^ (quint64(salt) * kGolden));
+}
+
+quint32 bucketOf(quint64 hash, quint32 buckets)
+{
+    return quint32((hash >> 32) % buckets);
+}
+
+quint32 slotOf(quint64 hash, quint32 seed, quint32 slots)
+{
+    return quint32(mix(hash + quint64(seed) * kGolden) % slots);
+}
+
+// 为 hashes 生成完美哈希：每个桶一个种子，slots[槽位] = 键的序号，空槽为 -1
+bool buildPerfectHash(const std::vector<quint64>& hashes, std::vector<quint32>* seeds,
+                      std::vector<qint32>* slots)
+{
+    const quint32 count = quint32(hashes.size());
+    const quint32 bucketCount = qMax<quint32>(1, count / 4);
+    const quint32 slotCount = qMax<quint32>(1, count + count / 4);
+    seeds->assign(bucketCount, 0);
+    slots->assign(slotCount, -1);
+
+    std::vector<std::vector<quint32>> buckets(bucketCount);
+    for (quint32 i = 0; i < count; ++i) {
+        buckets[bucketOf(hashes[i], bucketCount)].push_back(i);
+    }
+    // 大的桶先放，空槽多的时候更容易找到种子
+    std::vector<quint32> order(bucketCount);
+    for (quint32 b = 0; b < bucketCount; ++b) {
+        order[b] = b;
+    }
+    std::sort(order.begin(), order.end(), [&buckets](quint32 a, quint32 b) {
+        return buckets[a].size() > buckets[b].size();
+    });
+
+    std::vector<quint32> placed;
+    for (quint32 bucket : order) {
+        const std::vector<quint32>& keys = buckets[bucket];
+        if (keys.empty()) {
+            break;
+        }
+        bool found = false;
+        for (quint32 seed = 0; seed < kMaxSeeds && !found; ++seed) {
+            placed.clear();
+            found = true;
+            for (quint32 key : keys) {
+                quint32 slot = slotOf(hashes[key], seed, slotCount);
+                if ((*slots)[slot] >= 0 || std::find(placed.begin(), placed.end(), slot) != placed.end()) {
+                    found = false;
+                    break;
+                }
+                placed.push_back(slot);
+            }
+            if (found) {
+                (*seeds)[bucket] = seed;
+                for (size_t i = 0; i < keys.size(); ++i) {
+                    (*slots)[placed[i]] = qint32(keys[i]);
+                }
+            }
+        }
+        if (!found) {
+            return false;
+        }
+    }
+    return true;
+}
+
+qint64 align8(qint64 offset)
+{
+    return (offset + 7) & ~qint64(7);
+}
+}
+
+struct TokenVocab::Token {
+    quint32 offset;
+    quint16 length;
+    quint8 type;
+    quint8 reserved;
+    float score;
+};
+
+struct TokenVocab::Pair {
+    qint32 left;
+    qint32 right;
+    qint32 result;
+    float priority;
+};
+
+namespace {
+struct Counts {
+    quint32 salt = 0;
+    quint32 tokens = 0;
+    quint32 stringBytes = 0;
+    quint32 tokenBuckets = 0;
+    quint32 tokenSlots = 0;
+    quint32 pairs = 0;
+    quint32 pairBuckets = 0;
+    quint32 pairSlots = 0;
+};
+
+// 各段在文件中的位置，由数量唯一确定
+struct Layout {
+    qint64 tokens;
+    qint64 strings;
+    qint64 tokenSeeds;
+    qint64 tokenSlots;
+    qint64 pairs;
+    qint64 pairSeeds;
+    qint64 pairSlots;
+    qint64 total;
+};
+
+template <typename TokenRecord, typename PairRecord>
+Layout layoutFor(const Counts& c)
+{
+    Layout layout;
+    layout.tokens = kHeaderSize;
+    layout.strings = layout.tokens + qint64(c.tokens) * qint64(sizeof(TokenRecord));
+    layout.tokenSeeds = align8(layout.strings + c.stringBytes);
+    layout.tokenSlots = layout.tokenSeeds + qint64(c.tokenBuckets) * 4;
+    layout.pairs = align8(layout.tokenSlots + qint64(c.tokenSlots) * 4);
+    layout.pairSeeds = layout.pairs + qint64(c.pairs) * qint64(sizeof(PairRecord));
+    layout.pairSlots = layout.pairSeeds + qint64(c.pairBuckets) * 4;
+    layout.total = layout.pairSlots + qint64(c.pairSlots) * 4;
+    return layout;
+}
+
+// SentencePiece 的 token 是否可以由合并得到
+bool mergeable(qint32 type)
+{
+    return type == 1 || type == 4;   // Normal、UserDefined
+}
+}
+
+TokenVocab::TokenVocab()
+{
+}
+
+TokenVocab::~TokenVocab()
+{
+    close();
+}
+
+QByteArray TokenVocab::build(const Source& source)
+{
+    const int tokenCount = source.tokens.size();
+
+    // 重复的字符串以后出现的为准
+    QHash<QByteArray, int> ids;
+    ids.reserve(tokenCount);
+    for (int i = 0; i < tokenCount; ++i) {
+        ids.insert(source.tokens.at(i), i);
+    }
+    auto idOf = [&ids](const QByteArray& text) { return ids.value(text, -1); };
+
+    std::vector<Pair> pairs;
+    QSet<quint64> seenPairs;
+    auto addPair = [&](int left, int right, int result, float priority) {
+        quint64 key = quint64(quint32(left)) << 32 | quint32(right);
+        if (left >= 0 && right >= 0 && result >= 0 && !seenPairs.contains(key)) {
+            seenPairs.insert(key);
+            pairs.push_back({left, right, result, priority});
+        }
+    };
+    if (source.bytePairs) {
+        for (int rank = 0; rank < source.merges.size(); ++rank) {
+            const QByteArray& merge = source.merges.at(rank);
+            int space = merge.indexOf(' ', 1);
+            if (space < 0) {
+                continue;
+            }
+            const QByteArray left = merge.left(space);
+            const QByteArray right = merge.mid(space + 1);
+            addPair(idOf(left), idOf(right), idOf(left + right), -float(rank));
+        }
+    } else {
+        // 每个 token 在每个字符边界拆成两段，两段都在词表中时记为一次合并
+        for (auto it = ids.constBegin(); it != ids.constEnd(); ++it) {
+            const QByteArray& text = it.key();
+            if (!mergeable(source.types.value(it.value(), 1))) {
+                continue;
+            }
+            for (int split = 1; split < text.size(); ++split) {
+                if ((uchar(text.at(split)) & 0xc0) == 0x80) {
+                    continue;
+                }
+                addPair(idOf(text.left(split)), idOf(text.mid(split)), it.value(),
+                        source.scores.value(it.value()));
+            }
+        }
+    }
+
+    // 只有最后一次出现的重复字符串进入哈希表
+    std::vector<quint32> hashedTokens;
+    hashedTokens.reserve(ids.size());
+    for (auto it = ids.constBegin(); it != ids.constEnd(); ++it) {
+        hashedTokens.push_back(quint32(it.value()));
+    }
+
+    Counts counts;
+    std::vector<quint32> tokenSeeds;
+    std::vector<qint32> tokenSlots;
+    std::vector<quint32> pairSeeds;
+    std::vector<qint32> pairSlots;
+    bool built = false;
+    for (int salt = 0; salt < kMaxSalts && !built; ++salt) {
+        std::vector<quint64> hashes;
+        hashes.reserve(hashedTokens.size());
+        for (quint32 id : hashedTokens) {
+            const QByteArray& text = source.tokens.at(id);
+            hashes.push_back(hashBytes(text.constData(), int(text.size()), quint32(salt)));
+        }
+        if (!buildPerfectHash(hashes, &tokenSeeds, &tokenSlots)) {
+            continue;
+        }
+        // 槽位里先放的是 hashedTokens 的序号，换成 token id
+        for (qint32& slot : tokenSlots) {
+            if (slot >= 0) {
+                slot = qint32(hashedTokens[slot]);
+            }
+        }
+
+        hashes.clear();
+        for (const Pair& pair : pairs) {
+            hashes.push_back(hashPair(pair.left, pair.right, quint32(salt)));
+        }
+        built = buildPerfectHash(hashes, &pairSeeds, &pairSlots);
+        counts.salt = quint32(salt);
+    }
+    if (!built) {
+        LOG_ERROR("无法为词表生成完美哈希");
+        return QByteArray();
+    }
+
+    QByteArray strings;
+    for (const QByteArray& token : source.tokens) {
+        strings += token;
+    }
+    counts.tokens = quint32(tokenCount);
+    counts.stringBytes = quint32(strings.size());
+    counts.tokenBuckets = quint32(tokenSeeds.size());
+    counts.tokenSlots = quint32(tokenSlots.size());
+    counts.pairs = quint32(pairs.size());
+    counts.pairBuckets = quint32(pairSeeds.size());
+    counts.pairSlots = quint32(pairSlots.size());
+    const Layout layout = layoutFor<Token, Pair>(counts);
+
+    QByteArray data(layout.total, '\0');
+    uchar* p = reinterpret_cast<uchar*>(data.data());
+    qToLittleEndian<quint32>(kMagic, p);
+    qToLittleEndian<quint32>(kVersion, p + 4);
+    qToLittleEndian<quint64>(source.hash, p + 8);
+    qToLittleEndian<quint32>(counts.salt, p + 16);
+    qToLittleEndian<quint32>(counts.tokens, p + 20);
+    qToLittleEndian<quint32>(counts.stringBytes, p + 24);
+    qToLittleEndian<quint32>(counts.tokenBuckets, p + 28);
+    qToLittleEndian<quint32>(counts.tokenSlots, p + 32);
+    qToLittleEndian<quint32>(counts.pairs, p + 36);
+    qToLittleEndian<quint32>(counts.pairBuckets, p + 40);
+    qToLittleEndian<quint32>(counts.pairSlots, p + 44);
+
+    Token* tokens = reinterpret_cast<Token*>(p + layout.tokens);
+    quint32 offset = 0;
+    for (int i = 0; i < tokenCount; ++i) {
+        const QByteArray& text = source.tokens.at(i);
+        tokens[i] = {offset, quint16(qMin<qsizetype>(text.size(), 0xffff)),
+                     quint8(source.types.value(i, 1)), 0, source.scores.value(i)};
+        offset += quint32(text.size());
+    }
+    memcpy(p + layout.strings, strings.constData(), strings.size());
+    memcpy(p + layout.tokenSeeds, tokenSeeds.data(), tokenSeeds.size() * 4);
+    memcpy(p + layout.tokenSlots, tokenSlots.data(), tokenSlots.size() * 4);
+    if (!pairs.empty()) {
+        memcpy(p + layout.pairs, pairs.data(), pairs.size() * sizeof(Pair));
+    }
+    memcpy(p + layout.pairSeeds, pairSeeds.data(), pairSeeds.size() * 4);
+    memcpy(p + layout.pairSlots, pairSlots.data(), pairSlots.size() * 4);
+    return data;
+}
+
+bool TokenVocab::open(const QString& path, quint64 hash)
+{
+    close();
+    m_file.setFileName(path);
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    const qint64 size = m_file.size();
+    const uchar* data = size >= kHeaderSize ? m_file.map(0, size) : nullptr;
+    if (!data || !attach(data, size, hash)) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool TokenVocab::adopt(const QByteArray& data, quint64 hash)
+{
+    close();
+    m_owned = data;
+    if (!attach(reinterpret_cast<const uchar*>(m_owned.constData()), m_owned.size(), hash)) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void TokenVocab::close()
+{
+    if (m_file.isOpen()) {
+        m_file.close();   // 同时解除映射
+    }
+    m_owned.clear();
+    m_data = nullptr;
+    m_tokenCount = 0;
+    m_tokenSlotCount = 0;
+    m_pairSlotCount = 0;
+}
+
+bool TokenVocab::attach(const uchar* data, qint64 size, quint64 hash)
+{
+    if (size < kHeaderSize || qFromLittleEndian<quint32>(data) != kMagic
+        || qFromLittleEndian<quint32>(data + 4) != kVersion
+        || qFromLittleEndian<quint64>(data + 8) != hash) {
+        return false;
+    }
+    Counts counts;
+    counts.salt = qFromLittleEndian<quint32>(data + 16);
+    counts.tokens = qFromLittleEndian<quint32>(data + 20);
+    counts.stringBytes = qFromLittleEndian<quint32>(data + 24);
+    counts.tokenBuckets = qFromLittleEndian<quint32>(data + 28);
+    counts.tokenSlots = qFromLittleEndian<quint32>(data + 32);
+    counts.pairs = qFromLittleEndian<quint32>(data + 36);
+    counts.pairBuckets = qFromLittleEndian<quint32>(data + 40);
+    counts.pairSlots = qFromLittleEndian<quint32>(data + 44);
+    const Layout layout = layoutFor<Token, Pair>(counts);
+    if (layout.total > size || counts.tokenBuckets == 0 || counts.tokenSlots == 0
+        || counts.pairBuckets == 0 || counts.pairSlots == 0) {
+        return false;
+    }
+
+    m_data = data;
+    m_salt = counts.salt;
+    m_tokenCount = int(counts.tokens);
+    m_tokens = reinterpret_cast<const Token*>(data + layout.tokens);
+    m_strings = reinterpret_cast<const char*>(data + layout.strings);
+    m_stringBytes = counts.stringBytes;
+    m_tokenBuckets = counts.tokenBuckets;
+    m_tokenSlotCount = counts.tokenSlots;
+    m_tokenSeeds = reinterpret_cast<const quint32*>(data + layout.tokenSeeds);
+    m_tokenSlots = reinterpret_cast<const qint32*>(data + layout.tokenSlots);
+    m_pairs = reinterpret_cast<const Pair*>(data + layout.pairs);
+    m_pairCount = counts.pairs;
+    m_pairBuckets = counts.pairBuckets;
+    m_pairSlotCount = counts.pairSlots;
+    m_pairSeeds = reinterpret_cast<const quint32*>(data + layout.pairSeeds);
+    m_pairSlots = reinterpret_cast<const qint32*>(data + layout.pairSlots);
+    return true;
+}
+
+QByteArray TokenVocab::piece(int id) const
+{
+    if (id < 0 || id >= m_tokenCount) {
+        return QByteArray();
+    }
+    const Token& token = m_tokens[id];
+    if (quint64(token.offset) + token.length > m_stringBytes) {
+        return QByteArray();
+    }
+    return QByteArray::fromRawData(m_strings + token.offset, token.length);
+}
+
+float TokenVocab::score(int id) const
+{
+    return id >= 0 && id < m_tokenCount ? m_tokens[id].score : 0.0f;
+}
+
+int TokenVocab::type(int id) const
+{
+    return id >= 0 && id < m_tokenCount ? m_tokens[id].type : 0;
+}
+
+int TokenVocab::find(const char* data, int length) const
+{
+    if (m_tokenSlotCount == 0) {
+        return -1;
+    }
+    const quint64 hash = hashBytes(data, length, m_salt);
+    const quint32 seed = m_tokenSeeds[bucketOf(hash, m_tokenBuckets)];
+    const qint32 id = m_tokenSlots[slotOf(hash, seed, m_tokenSlotCount)];
+    if (id < 0 || id >= m_tokenCount) {
+        return -1;
+    }
+    // 不在词表中的字符串也会落到某个槽位，需要核对
+    const QByteArray candidate = piece(id);
+    return candidate.size() == length && memcmp(candidate.constData(), data, length) == 0 ? id : -1;
+}
+
+bool TokenVocab::merge(int left, int right, Merge* merge) const
+{
+    if (m_pairSlotCount == 0 || left < 0 || right < 0) {
+        return false;
+    }
+    const quint64 hash = hashPair(left, right, m_salt);
+    const quint32 seed = m_pairSeeds[bucketOf(hash, m_pairBuckets)];
+    const qint32 index = m_pairSlots[slotOf(hash, seed, m_pairSlotCount)];
+    if (index < 0 || quint32(index) >= m_pairCount) {
+        return false;
+    }
+    const Pair& pair = m_pairs[index];
+    if (pair.left != left || pair.right != right) {
+        return false;
+    }
+    merge->result = pair.result;
+    merge->priority = pair.priority;
+    return true;
+}
@@ -0,0 +1,92 @@
+#ifndef TOKENVOCAB_H
+#define TOKENVOCAB_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QList>
+#include <QString>
+
+/**
+ * @brief 内存映射的紧凑词表
+ *
+ * 分词器需要的全部数据放在一个文件里，打开时只做映射，不构造任何容器：
+ *   - token 表：每个 token 的字符串位置、长度、类型和分数
+ *   - 合并表：(左 token, 右 token) -> (合并结果, 优先级)。字节级 BPE 来自 merges，
+ *     SentencePiece 由词表中每个 token 的两段拆分得到，合并时只比较 id，不再拼接字符串
+ *   - 两张完美哈希表（hash and displace）：字符串 -> token，token 对 -> 合并表项。
+ *     每个键先按一个哈希分桶，桶内共用一个种子，再用带种子的哈希落到互不冲突的槽位，
+ *     查找固定为两次哈希、一次比较
+ *
+ * 文件由模型中的词表生成一次，之后按词表内容的哈希从缓存目录直接映射。
+ * 数组按本机字节序存放，文件头记录版本和来源哈希，不匹配时重新生成。
+ */
+class TokenVocab
+{
+public:
+    // 生成词表文件所需的原始数据
+    struct Source {
+        QList<QByteArray> tokens;
+        QList<float> scores;
+        QList<qint32> types;
+        QList<QByteArray> merges;       // 字节级 BPE 的 "左 右"，按优先级排列
+        bool bytePairs = false;         // false 表示 SentencePiece
+        quint64 hash = 0;               // 来源内容的哈希，打开缓存文件时用来校验
+    };
+
+    struct Merge {
+        int result = -1;
+        float priority = 0.0f;          // 越大越先合并
+    };
+
+    TokenVocab();
+    ~TokenVocab();
+    TokenVocab(const TokenVocab&) = delete;
+    TokenVocab& operator=(const TokenVocab&) = delete;
+
+    static QByteArray build(const Source& source);
+    // 映射 path 中的词表，来源哈希不同或格式错误时返回 false
+    bool open(const QString& path, quint64 hash);
+    // 直接使用内存中的词表数据（缓存目录不可写时）
+    bool adopt(const QByteArray& data, quint64 hash);
+    void close();
+    bool isOpen() const { return m_data != nullptr; }
+
+    int size() const { return m_tokenCount; }
+    QByteArray piece(int id) const;
+    float score(int id) const;
+    int type(int id) const;
+
+    // 查找字符串对应的 token，不存在时返回 -1
+    int find(const char* data, int length) const;
+    int find(const QByteArray& text) const { return find(text.constData(), int(text.size())); }
+    // 查找两个相邻 token 的合并结果
+    bool merge(int left, int right, Merge* merge) const;
+
+private:
+    struct Token;
+    struct Pair;
+
+    bool attach(const uchar* data, qint64 size, quint64 hash);
+
+    QFile m_file;
+    QByteArray m_owned;
+    const uchar* m_data = nullptr;
+    quint32 m_salt = 0;
+
+    int m_tokenCount = 0;
+    const Token* m_tokens = nullptr;
+    const char* m_strings = nullptr;
+    quint32 m_stringBytes = 0;
+    const quint32* m_tokenSeeds = nullptr;
+    const qint32* m_tokenSlots = nullptr;
+    quint32 m_tokenBuckets = 0;
+    quint32 m_tokenSlotCount = 0;
+    const Pair* m_pairs = nullptr;
+    quint32 m_pairCount = 0;
+    const quint32* m_pairSeeds = nullptr;
+    const qint32* m_pairSlots = nullptr;
+    quint32 m_pairBuckets = 0;
+    quint32 m_pairSlotCount = 0;
+};
+
+#endif // TOKENVOCAB_H
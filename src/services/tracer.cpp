@@ -0,0 +1,254 @@
+#include "tracer.h"
+#include <QCoreApplication>
+#include <QThread>
+#include <QSaveFile>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QJsonDocument>
+#include <QMutexLocker>
+#include "services/logger.h"
+
+namespace {
+quint64 currentThreadId()
+{
+    return static_cast<quint64>(reinterpret_cast<quintptr>(QThread::currentThreadId()));
+}
+}
+
+Tracer::ThreadBuffer::~ThreadBuffer()
+{
+    for (std::atomic<Event*>& chunk : chunks) {
+        delete[] chunk.load(std::memory_order_relaxed);
+    }
+}
+
+Tracer& Tracer::instance()
+{
+    static Tracer instance;
+    return instance;
+}
+
+Tracer::Tracer()
+{
+    m_clock.start();
+}
+
+Tracer::~Tracer()
+{
+    qDeleteAll(m_buffers);
+}
+
+void Tracer::start()
+{
+    // 各线程下次记录时发现代数变化，从缓冲区开头重新写
+    m_generation.fetch_add(1, std::memory_order_release);
+    m_dropped.store(0, std::memory_order_relaxed);
+    m_enabled.store(true, std::memory_order_relaxed);
+    LOG_INFO("性能跟踪已开始");
+}
+
+void Tracer::stop()
+{
+    m_enabled.store(false, std::memory_order_relaxed);
+    LOG_INFO("性能跟踪已停止");
+}
+
+void Tracer::addSpan(const char* name, const char* category, qint64 startUs, qint64 durationUs)
+{
+    if (!isEnabled()) {
+        return;
+    }
+    append({name, category, 'X', startUs, durationUs, 0, 0.0});
+}
+
+void Tracer::addInstant(const char* name, const char* category)
+{
+    if (!isEnabled()) {
+        return;
+    }
+    append({name, category, 'i', nowUs(), 0, 0, 0.0});
+}
+
+void Tracer::addCounter(const char* name, double value)
+{
+    if (!isEnabled()) {
+        return;
+    }
+    append({name, "counter", 'C', nowUs(), 0, 0, value});
+}
+
+void Tracer::addFlow(const char* name, char phase, quint64 id)
+{
+    if (!isEnabled()) {
+        return;
+    }
+    append({name, "flow", phase, nowUs(), 0, id, 0.0});
+}
+
+Tracer::ThreadBuffer* Tracer::threadBuffer()
+{
+    // 每个线程第一次记录时登记，线程退出后缓冲区仍由 Tracer 持有
+    thread_local ThreadBuffer* buffer = nullptr;
+    if (!buffer) {
+        buffer = new ThreadBuffer;
+        buffer->threadId = currentThreadId();
+        buffer->isMainThread = QCoreApplication::instance()
+            && QThread::currentThread() == QCoreApplication::instance()->thread();
+        QMutexLocker locker(&m_buffersMutex);
+        m_buffers.append(buffer);
+        if (buffer->isMainThread) {
+            m_mainBuffer.store(buffer, std::memory_order_release);
+        }
+    }
+    return buffer;
+}
+
+void Tracer::enterSpan(const char* name)
+{
+    ThreadBuffer* buffer = threadBuffer();
+    int depth = buffer->depth.load(std::memory_order_relaxed);
+    if (depth < ThreadBuffer::kMaxDepth) {
+        buffer->openSpans[depth].store(name, std::memory_order_relaxed);
+    }
+    buffer->depth.store(depth + 1, std::memory_order_release);
+}
+
+void Tracer::leaveSpan()
+{
+    ThreadBuffer* buffer = threadBuffer();
+    int depth = buffer->depth.load(std::memory_order_relaxed);
+    if (depth > 0) {
+        buffer->depth.store(depth - 1, std::memory_order_release);
+    }
+}
+
+QStringList Tracer::mainThreadSpans() const
+{
+    QStringList spans;
+    const ThreadBuffer* buffer = m_mainBuffer.load(std::memory_order_acquire);
+    if (!buffer) {
+        return spans;
+    }
+
+    // 名称都是字符串常量，读到刚退出的区间也不会访问无效内存
+    int depth = qMin(buffer->depth.load(std::memory_order_acquire), int(ThreadBuffer::kMaxDepth));
+    for (int i = 0; i < depth; ++i) {
+        if (const char* name = buffer->openSpans[i].load(std::memory_order_relaxed)) {
+            spans.append(QString::fromUtf8(name));
+        }
+    }
+    return spans;
+}
+
+void Tracer::append(const Event& event)
+{
+    ThreadBuffer* buffer = threadBuffer();
+
+    // 只有本线程写 size 和块，其他线程只读
+    quint64 generation = m_generation.load(std::memory_order_acquire);
+    int index = buffer->size.load(std::memory_order_relaxed);
+    if (buffer->generation.load(std::memory_order_relaxed) != generation) {
+        // 先清零长度再发布代数，导出时不会把上一轮的事件当成这一轮的
+        index = 0;
+        buffer->size.store(0, std::memory_order_release);
+        buffer->generation.store(generation, std::memory_order_release);
+    }
+
+    int chunkIndex = index / ThreadBuffer::kChunkSize;
+    if (chunkIndex >= ThreadBuffer::kMaxChunks) {
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    Event* chunk = buffer->chunks[chunkIndex].load(std::memory_order_relaxed);
+    if (!chunk) {
+        chunk = new Event[ThreadBuffer::kChunkSize];
+        buffer->chunks[chunkIndex].store(chunk, std::memory_order_release);
+    }
+    chunk[index % ThreadBuffer::kChunkSize] = event;
+    buffer->size.store(index + 1, std::memory_order_release);
+}
+
+bool Tracer::writeTo(const QString& path) const
+{
+    QList<ThreadBuffer*> buffers;
+    {
+        QMutexLocker locker(&m_buffersMutex);
+        buffers = m_buffers;
+    }
+
+    const qint64 pid = QCoreApplication::applicationPid();
+    const quint64 generation = m_generation.load(std::memory_order_acquire);
+    QJsonArray traceEvents;
+    int count = 0;
+
+    for (const ThreadBuffer* buffer : std::as_const(buffers)) {
+        if (buffer->generation.load(std::memory_order_acquire) != generation) {
+            continue;
+        }
+        const qint64 tid = static_cast<qint64>(buffer->threadId);
+
+        QJsonObject threadName;
+        threadName["name"] = "thread_name";
+        threadName["ph"] = "M";
+        threadName["pid"] = pid;
+        threadName["tid"] = tid;
+        threadName["args"] = QJsonObject{{"name", buffer->isMainThread ? QString("GUI") : QString("worker %1").arg(tid)}};
+        traceEvents.append(threadName);
+
+        // 之后写入的事件不在这次导出的范围内
+        const int size = buffer->size.load(std::memory_order_acquire);
+        for (int i = 0; i < size; ++i) {
+            const Event* chunk = buffer->chunks[i / ThreadBuffer::kChunkSize].load(std::memory_order_acquire);
+            const Event& event = chunk[i % ThreadBuffer::kChunkSize];
+
+            QJsonObject obj;
+            obj["name"] = QString::fromUtf8(event.name);
+            obj["cat"] = QString::fromUtf8(event.category);
+            obj["ph"] = QString(QChar(event.phase));
+            obj["ts"] = event.startUs;
+            obj["pid"] = pid;
+            obj["tid"] = tid;
+            switch (event.phase) {
+                case 'X':
+                    obj["dur"] = event.durationUs;
+                    break;
+                case 'i':
+                    obj["s"] = "t";  // 瞬时事件只画在所在线程上
+                    break;
+                case 'C':
+                    obj["args"] = QJsonObject{{"value", event.value}};
+                    break;
+                default:
+                    // 64 位 id 超出 JSON 数字的精度，写成字符串
+                    obj["id"] = QString("0x%1").arg(event.id, 0, 16);
+                    if (event.phase == 'f') {
+                        obj["bp"] = "e";  // 结束点连到所在的区间
+                    }
+                    break;
+            }
+            traceEvents.append(obj);
+            ++count;
+        }
+    }
+
+    QJsonObject root;
+    root["traceEvents"] = traceEvents;
+    root["displayTimeUnit"] = "ms";
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        LOG_WARNING(QString("无法写入跟踪文件: %1").arg(file.errorString()));
+        return false;
+    }
+    file.write(QJsonDocument(root).toJson(QJsonDocument::Compact));
+    if (!file.commit()) {
+        LOG_WARNING(QString("无法写入跟踪文件: %1").arg(file.errorString()));
+        return false;
+    }
+
+    qint64 dropped = droppedEvents();
+    LOG_INFO(QString("已写入跟踪文件: %1，共 %2 个事件%3").arg(path).arg(count)
+             .arg(dropped > 0 ? QString("，缓冲区已满丢弃 %1 个").arg(dropped) : QString()));
+    return true;
+}
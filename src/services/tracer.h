@@ -0,0 +1,161 @@
+#ifndef TRACER_H
+#define TRACER_H
+
+#include <QString>
+#include <QList>
+#include <QStringList>
+#include <QMutex>
+#include <QElapsedTimer>
+#include <atomic>
+
+/**
+ * @brief 性能跟踪
+ *
+ * 记录区间、瞬时事件、计数器和跨线程/跨事件循环的流事件，导出为 Chrome trace
+ * 格式（chrome://tracing 或 Perfetto 可以直接打开）。可以在运行时开始和停止。
+ *
+ * 每个线程写自己的缓冲区，记录事件不加锁：缓冲区由固定大小的块组成，写入后
+ * 以 release 发布长度，导出时按 acquire 读到的长度复制。只有线程第一次记录时
+ * 登记缓冲区需要加锁。未启用时每个宏只读一次原子变量。
+ *
+ * 启用时还记录每个线程当前打开的区间，卡顿检测据此报告界面线程正在做什么。
+ *
+ * 时间从 Tracer 第一次被访问时算起，main 一开始就访问它，因此等于进程启动后的时间。
+ * 名称和分类只保存指针，必须是字符串常量。
+ */
+class Tracer
+{
+public:
+    static Tracer& instance();
+
+    // 开始新一轮记录，之前的事件作废
+    void start();
+    void stop();
+    bool isEnabled() const { return m_enabled.load(std::memory_order_relaxed); }
+
+    // 启动后经过的微秒数
+    qint64 nowUs() const { return m_clock.nsecsElapsed() / 1000; }
+
+    void addSpan(const char* name, const char* category, qint64 startUs, qint64 durationUs);
+    void addInstant(const char* name, const char* category);
+    void addCounter(const char* name, double value);
+    // phase 为 's' 开始、't' 经过、'f' 结束，同一个 id 的事件连成箭头
+    void addFlow(const char* name, char phase, quint64 id);
+
+    // 队列连接两端各自按相同顺序编号时，得到相同的流 id
+    static quint64 flowId(const void* channel, quint64 sequence)
+    {
+        return (static_cast<quint64>(reinterpret_cast<quintptr>(channel)) << 16) ^ sequence;
+    }
+
+    // 记录当前线程打开和关闭的区间，由 TraceSpan 调用
+    void enterSpan(const char* name);
+    void leaveSpan();
+    // 界面线程当前打开的区间，由外到内，可以在任意线程调用
+    QStringList mainThreadSpans() const;
+
+    // 缓冲区写满后丢弃的事件数
+    qint64 droppedEvents() const { return m_dropped.load(std::memory_order_relaxed); }
+
+    // 写出 Chrome trace JSON，失败时返回 false
+    bool writeTo(const QString& path) const;
+
+private:
+    struct Event {
+        const char* name;
+        const char* category;
+        char phase;          // 'X' 区间，'i' 瞬时事件，'C' 计数器，'s'/'t'/'f' 流事件
+        qint64 startUs;
+        qint64 durationUs;
+        quint64 id;
+        double value;
+    };
+
+    struct ThreadBuffer {
+        static constexpr int kChunkSize = 4096;
+        static constexpr int kMaxChunks = 256;
+        static constexpr int kMaxDepth = 32;
+
+        quint64 threadId = 0;
+        bool isMainThread = false;
+        std::atomic<quint64> generation{0};
+        std::atomic<int> size{0};
+        std::atomic<Event*> chunks[kMaxChunks] = {};
+        std::atomic<int> depth{0};
+        std::atomic<const char*> openSpans[kMaxDepth] = {};
+
+        ~ThreadBuffer();
+    };
+
+    Tracer();
+    ~Tracer();
+    Tracer(const Tracer&) = delete;
+    Tracer& operator=(const Tracer&) = delete;
+
+    ThreadBuffer* threadBuffer();
+    void append(const Event& event);
+
+    QElapsedTimer m_clock;
+    std::atomic<bool> m_enabled{false};
+    std::atomic<quint64> m_generation{0};
+    std::atomic<qint64> m_dropped{0};
+
+    mutable QMutex m_buffersMutex;   // 只保护缓冲区列表
+    QList<ThreadBuffer*> m_buffers;
+    std::atomic<ThreadBuffer*> m_mainBuffer{nullptr};
+};
+
+/**
+ * @brief 作用域区间，构造时开始，析构时结束
+ */
+class TraceSpan
+{
+public:
+    explicit TraceSpan(const char* name, const char* category = "app")
+        : m_name(name)
+        , m_category(category)
+        , m_startUs(-1)
+    {
+        Tracer& tracer = Tracer::instance();
+        if (tracer.isEnabled()) {
+            tracer.enterSpan(name);
+            m_startUs = tracer.nowUs();
+        }
+    }
+
+    ~TraceSpan()
+    {
+        if (m_startUs >= 0) {
+            Tracer& tracer = Tracer::instance();
+            tracer.leaveSpan();
+            tracer.addSpan(m_name, m_category, m_startUs, tracer.nowUs() - m_startUs);
+        }
+    }
+
+private:
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+    const char* m_name;
+    const char* m_category;
+    qint64 m_startUs;
+};
+
+#define TRACE_CONCAT_IMPL(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_IMPL(a, b)
+
+// 便捷宏
+#define TRACE_SCOPE(name) TraceSpan TRACE_CONCAT(traceSpan_, __LINE__)(name)
+#define TRACE_SCOPE_CAT(name, category) TraceSpan TRACE_CONCAT(traceSpan_, __LINE__)(name, category)
+#define TRACE_INSTANT(name) \
+    do { if (Tracer::instance().isEnabled()) Tracer::instance().addInstant(name, "app"); } while (0)
+#define TRACE_COUNTER(name, value) \
+    do { if (Tracer::instance().isEnabled()) Tracer::instance().addCounter(name, value); } while (0)
+#define TRACE_FLOW_BEGIN(name, id) \
+    do { if (Tracer::instance().isEnabled()) Tracer::instance().addFlow(name, 's', id); } while (0)
+#define TRACE_FLOW_STEP(name, id) \
+    do { if (Tracer::instance().isEnabled()) Tracer::instance().addFlow(name, 't', id); } while (0)
+#define TRACE_FLOW_END(name, id) \
+    do { if (Tracer::instance().isEnabled()) Tracer::instance().addFlow(name, 'f', id); } while (0)
+
+#endif // TRACER_H
@@ -5,6 +5,11 @@
 #include <QSettings>
 #include <QStyle>
 #include <QStyleFactory>
+#include <QStyleHints>
+#include <QProcess>
+#include <QEvent>
+#include <QElapsedTimer>
+#include "services/tracer.h"
 
 ThemeManager& ThemeManager::instance()
 {
@@ -15,7 +20,25 @@ ThemeManager& ThemeManager::instance()
 ThemeManager::ThemeManager(QObject *parent)
     : QObject(parent)
     , m_currentTheme(Theme::System)
+    , m_hasAppliedStyle(false)
+    , m_appliedDark(false)
+    , m_systemDark(false)
+    , m_isDark(false)
 {
+    m_systemDark = querySystemDarkMode();
+
+    // 系统主题变化时可能连续收到多个事件，合并为一次检测
+    m_systemRefreshTimer.setSingleShot(true);
+    m_systemRefreshTimer.setInterval(0);
+    connect(&m_systemRefreshTimer, &QTimer::timeout, this, &ThemeManager::refreshSystemDarkMode);
+
+#if QT_VERSION >= QT_VERSION_CHECK(6, 5, 0)
+    connect(QGuiApplication::styleHints(), &QStyleHints::colorSchemeChanged,
+            &m_systemRefreshTimer, qOverload<>(&QTimer::start));
+#endif
+    // 安装在应用对象上可以收到发给所有窗口的主题变化事件
+    qApp->installEventFilter(this);
+
     loadTheme();
 }
 
@@ -28,6 +51,7 @@ void ThemeManager::setTheme(Theme theme)
 {
     if (m_currentTheme != theme) {
         m_currentTheme = theme;
+        updateResolvedTheme();
         applyTheme();
         saveTheme();
         emit themeChanged(theme);
@@ -45,90 +69,103 @@ QString ThemeManager::currentStyleSheet() const
     return m_currentStyleSheet;
 }
 
-QString ThemeManager::getUserBubbleStyle() const
+void ThemeManager::updateResolvedTheme()
 {
-    // 根据当前主题返回用户气泡样式类名
-    bool isDark = (m_currentTheme == Theme::Dark) || 
-                  (m_currentTheme == Theme::System && isSystemDarkMode());
-    return isDark ? "user-bubble-dark" : "user-bubble-light";
+    m_isDark = (m_currentTheme == Theme::Dark) ||
+               (m_currentTheme == Theme::System && m_systemDark);
+    if (m_isDark) {
+        m_chatPalette.userBubble = QColor("#2C4F70");
+        m_chatPalette.aiBubble = QColor("#383838");
+        m_chatPalette.bubbleBorder = QColor(0, 0, 0, 76);
+    } else {
+        m_chatPalette.userBubble = QColor("#e1f3fb");
+        m_chatPalette.aiBubble = QColor("#f0f0f0");
+        m_chatPalette.bubbleBorder = QColor(0, 0, 0, 25);
+    }
 }
 
-QString ThemeManager::getAIBubbleStyle() const
+bool ThemeManager::eventFilter(QObject* watched, QEvent* event)
 {
-    // 根据当前主题返回AI气泡样式类名
-    bool isDark = (m_currentTheme == Theme::Dark) || 
-                  (m_currentTheme == Theme::System && isSystemDarkMode());
-    return isDark ? "ai-bubble-dark" : "ai-bubble-light";
+    if (event->type() == QEvent::ThemeChange || event->type() == QEvent::ApplicationPaletteChange) {
+        m_systemRefreshTimer.start();
+    }
+    return QObject::eventFilter(watched, event);
 }
 
-void ThemeManager::applyTheme()
+void ThemeManager::refreshSystemDarkMode()
 {
-    QString themeFile;
-    switch (m_currentTheme) {
-        case Theme::Light:
-            themeFile = "themes/light.qss";
-            break;
-        case Theme::Dark:
-            themeFile = "themes/dark.qss";
-            break;
-        case Theme::System:
-            themeFile = isSystemDarkMode() ? "themes/dark.qss" : "themes/light.qss";
-            break;
+    bool systemDark = querySystemDarkMode();
+    if (systemDark == m_systemDark) {
+        return;
     }
-    
-    // 同时加载聊天气泡样式文件
-    QString chatBubblesFile = "themes/chat_bubbles.css";
-
-    // 获取应用程序目录
-    QString appDir = QCoreApplication::applicationDirPath();
-    QString fullPath = QDir(appDir).absoluteFilePath(themeFile);
-    QString bubblePath = QDir(appDir).absoluteFilePath(chatBubblesFile);
-    LOG_INFO(QString("正在加载主题文件: %1").arg(fullPath));
-    LOG_INFO(QString("正在加载聊天气泡样式: %1").arg(bubblePath));
-
-    // 读取主题文件
-    QString styleSheet;
-    QFile file(fullPath);
-    if (file.open(QFile::ReadOnly | QFile::Text)) {
-        styleSheet = QString::fromUtf8(file.readAll());
-        file.close();
-
-        // 检查样式表内容是否为空
-        if (styleSheet.isEmpty()) {
-            LOG_ERROR(QString("主题文件为空: %1").arg(fullPath));
-            return;
+
+    m_systemDark = systemDark;
+    LOG_INFO(QString("系统主题已变为%1").arg(systemDark ? "深色" : "浅色"));
+    if (m_currentTheme == Theme::System) {
+        updateResolvedTheme();
+        applyTheme();
+        emit themeChanged(m_currentTheme);
+    }
+}
+
+QString ThemeManager::loadStyleResource(const QString& path)
+{
+    QFile file(path);
+    if (!file.open(QFile::ReadOnly | QFile::Text)) {
+        LOG_ERROR(QString("无法打开样式资源: %1, 错误: %2").arg(path, file.errorString()));
+        return QString();
+    }
+    return QString::fromUtf8(file.readAll());
+}
+
+QString ThemeManager::styleSheetFor(bool dark)
+{
+    // 每套样式只从资源中读取一次
+    QString& cached = dark ? m_darkStyleSheet : m_lightStyleSheet;
+    if (cached.isNull()) {
+        cached = loadStyleResource(dark ? ":/src/themes/dark.qss" : ":/src/themes/light.qss");
+        if (cached.isNull()) {
+            cached = QString("");
         }
-    } else {
-        LOG_ERROR(QString("无法打开主题文件: %1, 错误: %2")
-            .arg(fullPath)
-            .arg(file.errorString()));
-        return;
     }
-    
-    // 读取聊天气泡样式文件并合并
-    QFile bubbleFile(bubblePath);
-    if (bubbleFile.open(QFile::ReadOnly | QFile::Text)) {
-        QString bubbleStyleSheet = QString::fromUtf8(bubbleFile.readAll());
-        bubbleFile.close();
-        
-        if (!bubbleStyleSheet.isEmpty()) {
-            styleSheet += "\n" + bubbleStyleSheet;
-            LOG_INFO("成功加载聊天气泡样式");
+    return cached;
+}
+
+QString ThemeManager::chatStyleSheet()
+{
+    // 文档样式只描述排版，与当前主题无关，气泡颜色见 chatPalette()
+    if (m_chatStyleSheet.isNull()) {
+        m_chatStyleSheet = loadStyleResource(":/src/themes/chat_bubbles.css");
+        if (m_chatStyleSheet.isNull()) {
+            m_chatStyleSheet = QString("");
         }
-    } else {
-        LOG_WARNING(QString("无法打开聊天气泡样式文件: %1, 错误: %2")
-            .arg(bubblePath)
-            .arg(bubbleFile.errorString()));
+    }
+    return m_chatStyleSheet;
+}
+
+void ThemeManager::applyTheme()
+{
+    // 浅色和跟随系统（浅色）之间切换时样式不变，不需要重新设置
+    if (m_hasAppliedStyle && m_appliedDark == m_isDark) {
+        return;
     }
 
-    // 尝试应用样式表
-    try {
-        qApp->setStyleSheet(styleSheet);
-        m_currentStyleSheet = styleSheet;
-        LOG_INFO(QString("成功加载主题: %1").arg(themeFile));
-    } catch (const std::exception& e) {
-        LOG_ERROR(QString("应用主题时发生错误: %1").arg(e.what()));
+    QString styleSheet = styleSheetFor(m_isDark);
+    if (styleSheet.isEmpty()) {
+        LOG_ERROR(QString("主题样式为空: %1").arg(m_isDark ? "dark" : "light"));
+        return;
     }
+
+    QElapsedTimer timer;
+    timer.start();
+    qApp->setStyleSheet(styleSheet);
+    m_currentStyleSheet = styleSheet;
+    m_hasAppliedStyle = true;
+    m_appliedDark = m_isDark;
+    LOG_INFO(QString("成功应用%1主题，耗时 %2 ms").arg(m_isDark ? "深色" : "浅色").arg(timer.elapsed()));
+
+    // 设置样式表本身会引起调色板变化事件，不需要因此重新检测系统主题
+    m_systemRefreshTimer.stop();
 }
 
 void ThemeManager::saveTheme()
@@ -141,11 +178,21 @@ void ThemeManager::loadTheme()
 {
     QSettings settings;
     m_currentTheme = static_cast<Theme>(settings.value("theme", static_cast<int>(Theme::System)).toInt());
+    updateResolvedTheme();
     applyTheme();
 }
 
-bool ThemeManager::isSystemDarkMode() const
+bool ThemeManager::querySystemDarkMode() const
 {
+    TRACE_SCOPE_CAT("ThemeManager::querySystemDarkMode", "theme");
+#if QT_VERSION >= QT_VERSION_CHECK(6, 5, 0)
+    // 平台插件能给出配色方案时不需要再查询系统设置
+    Qt::ColorScheme scheme = QGuiApplication::styleHints()->colorScheme();
+    if (scheme != Qt::ColorScheme::Unknown) {
+        return scheme == Qt::ColorScheme::Dark;
+    }
+#endif
+
 #ifdef Q_OS_WIN
     QSettings settings("HKEY_CURRENT_USER\\Software\\Microsoft\\Windows\\CurrentVersion\\Themes\\Personalize", QSettings::NativeFormat);
     return settings.value("AppsUseLightTheme", 1).toInt() == 0;
@@ -3,6 +3,8 @@
 
 #include <QObject>
 #include <QString>
+#include <QTimer>
+#include <QColor>
 #include "services/logger.h"
 
 class ThemeManager : public QObject
@@ -17,13 +19,23 @@ public:
     };
     Q_ENUM(Theme)
 
+    // 聊天气泡的颜色，由聊天区域绘制时使用，不写入消息的 HTML
+    struct ChatPalette {
+        QColor userBubble;
+        QColor aiBubble;
+        QColor bubbleBorder;
+    };
+
     static ThemeManager& instance();
 
     Theme currentTheme() const;
     QString currentStyleSheet() const;
-    // 获取聊天气泡样式
-    QString getUserBubbleStyle() const;
-    QString getAIBubbleStyle() const;
+    // 聊天记录文档使用的气泡样式
+    QString chatStyleSheet();
+    // 当前实际使用的是否为深色样式（跟随系统时取系统设置）
+    bool isDarkMode() const { return m_isDark; }
+    // 当前主题的气泡颜色
+    const ChatPalette& chatPalette() const { return m_chatPalette; }
 
 public slots:
     void setTheme(Theme theme);
@@ -31,17 +43,39 @@ public slots:
 signals:
     void themeChanged(Theme theme);
 
+protected:
+    bool eventFilter(QObject* watched, QEvent* event) override;
+
+private slots:
+    void refreshSystemDarkMode();
+
 private:
     explicit ThemeManager(QObject *parent = nullptr);
     ~ThemeManager();
 
     void applyTheme();
+    QString styleSheetFor(bool dark);
+    static QString loadStyleResource(const QString& path);
     void saveTheme();
     void loadTheme();
-    bool isSystemDarkMode() const;
+    bool querySystemDarkMode() const;
+    void updateResolvedTheme();
 
     Theme m_currentTheme;
     QString m_currentStyleSheet;
+
+    // 从资源中读取的样式，首次使用时加载
+    QString m_lightStyleSheet;
+    QString m_darkStyleSheet;
+    QString m_chatStyleSheet;
+    bool m_hasAppliedStyle;
+    bool m_appliedDark;
+
+    // 系统深色模式只在启动和系统主题变化时检测一次
+    bool m_systemDark;
+    bool m_isDark;
+    ChatPalette m_chatPalette;
+    QTimer m_systemRefreshTimer;
 };
 
 #endif // THEME_H 
\ No newline at end of file
@@ -0,0 +1,442 @@
+#include "imageresize.h"
+#include <QVector>
+#include <QVarLengthArray>
+#include <QThread>
+#include <QtConcurrent/QtConcurrent>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define CHATDOT_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define CHATDOT_TARGET(features)
+#else
+#define CHATDOT_TARGET(features) __attribute__((target(features)))
+#endif
+#endif
+
+namespace {
+
+// 每个分块至少包含的输出行数，太小时线程调度的开销超过计算量
+const int kMinBandRows = 16;
+
+std::atomic_bool g_forceScalar{false};
+
+// 输出像素 i 使用输入像素 start[i] 起的 count[i] 个，权重从 weights[i * taps] 开始
+struct Coefficients {
+    int taps = 0;
+    QVector<int> start;
+    QVector<int> count;
+    QVector<float> weights;
+};
+
+float boxFilter(float x)
+{
+    return (x > -0.5f && x <= 0.5f) ? 1.0f : 0.0f;
+}
+
+float sinc(float x)
+{
+    if (x == 0.0f) {
+        return 1.0f;
+    }
+    x *= 3.14159265358979f;
+    return std::sin(x) / x;
+}
+
+float lanczos3(float x)
+{
+    return (x > -3.0f && x < 3.0f) ? sinc(x) * sinc(x / 3.0f) : 0.0f;
+}
+
+Coefficients computeCoefficients(int inSize, int outSize, ImageResize::Filter filter)
+{
+    double scale = double(inSize) / outSize;
+    // 缩小时按比例放宽滤波器，使每个输出像素覆盖对应的整块输入区域
+    double filterScale = qMax(scale, 1.0);
+    double support = (filter == ImageResize::Filter::Area ? 0.5 : 3.0) * filterScale;
+
+    Coefficients c;
+    c.taps = int(std::ceil(support)) * 2 + 1;
+    c.start.resize(outSize);
+    c.count.resize(outSize);
+    c.weights.fill(0.0f, outSize * c.taps);
+
+    for (int i = 0; i < outSize; ++i) {
+        double center = (i + 0.5) * scale;
+        int first = qMax(int(center - support + 0.5), 0);
+        int last = qMin(int(center + support + 0.5), inSize);
+        int count = qBound(1, last - first, c.taps);
+        first = qMin(first, inSize - count);
+
+        float* w = c.weights.data() + i * c.taps;
+        double total = 0.0;
+        for (int k = 0; k < count; ++k) {
+            float x = float((first + k - center + 0.5) / filterScale);
+            w[k] = filter == ImageResize::Filter::Area ? boxFilter(x) : lanczos3(x);
+            total += w[k];
+        }
+        for (int k = 0; k < count; ++k) {
+            w[k] = total != 0.0 ? float(w[k] / total) : (k == 0 ? 1.0f : 0.0f);
+        }
+        c.start[i] = first;
+        c.count[i] = count;
+    }
+    return c;
+}
+
+// 与 SIMD 的 cvtps 指令一样按最近偶数舍入，各实现的结果相同
+inline uchar clampByte(float value)
+{
+    long rounded = std::lrintf(value);
+    return rounded <= 0 ? 0 : (rounded >= 255 ? 255 : uchar(rounded));
+}
+
+// ---- 标量实现 ----
+
+void horizontalScalar(const uchar* src, uchar* dst, int outWidth, const Coefficients& c)
+{
+    for (int x = 0; x < outWidth; ++x) {
+        const uchar* in = src + c.start[x] * 4;
+        const float* w = c.weights.constData() + x * c.taps;
+        float sum[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+        for (int k = 0; k < c.count[x]; ++k, in += 4) {
+            for (int ch = 0; ch < 4; ++ch) {
+                sum[ch] = sum[ch] + in[ch] * w[k];
+            }
+        }
+        for (int ch = 0; ch < 4; ++ch) {
+            dst[ch] = clampByte(sum[ch]);
+        }
+        dst += 4;
+    }
+}
+
+void verticalScalar(const uchar* const* rows, const float* weights, int count, uchar* dst, int bytes)
+{
+    for (int i = 0; i < bytes; ++i) {
+        float sum = 0.0f;
+        for (int k = 0; k < count; ++k) {
+            sum = sum + rows[k][i] * weights[k];
+        }
+        dst[i] = clampByte(sum);
+    }
+}
+
+void packRgbScalar(const uchar* src, uchar* dst, int pixels, bool swapRedBlue)
+{
+    int red = swapRedBlue ? 2 : 0;
+    int blue = swapRedBlue ? 0 : 2;
+    for (int p = 0; p < pixels; ++p, src += 4, dst += 3) {
+        dst[0] = src[red];
+        dst[1] = src[1];
+        dst[2] = src[blue];
+    }
+}
+
+#ifdef CHATDOT_X86
+
+// ---- SSE4.1 实现 ----
+
+CHATDOT_TARGET("sse4.1")
+inline __m128 loadPixelSse41(const uchar* p)
+{
+    int value;
+    std::memcpy(&value, p, 4);
+    return _mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(value)));
+}
+
+CHATDOT_TARGET("sse4.1")
+inline void storePixelSse41(uchar* p, __m128 sum)
+{
+    __m128i v = _mm_cvtps_epi32(sum);
+    v = _mm_packus_epi32(v, v);
+    v = _mm_packus_epi16(v, v);
+    int value = _mm_cvtsi128_si32(v);
+    std::memcpy(p, &value, 4);
+}
+
+CHATDOT_TARGET("sse4.1")
+void horizontalSse41(const uchar* src, uchar* dst, int outWidth, const Coefficients& c)
+{
+    for (int x = 0; x < outWidth; ++x) {
+        const uchar* in = src + c.start[x] * 4;
+        const float* w = c.weights.constData() + x * c.taps;
+        __m128 sum = _mm_setzero_ps();
+        for (int k = 0; k < c.count[x]; ++k, in += 4) {
+            sum = _mm_add_ps(sum, _mm_mul_ps(loadPixelSse41(in), _mm_set1_ps(w[k])));
+        }
+        storePixelSse41(dst, sum);
+        dst += 4;
+    }
+}
+
+CHATDOT_TARGET("sse4.1")
+void verticalSse41(const uchar* const* rows, const float* weights, int count, uchar* dst, int bytes)
+{
+    for (int i = 0; i < bytes; i += 4) {
+        __m128 sum = _mm_setzero_ps();
+        for (int k = 0; k < count; ++k) {
+            sum = _mm_add_ps(sum, _mm_mul_ps(loadPixelSse41(rows[k] + i), _mm_set1_ps(weights[k])));
+        }
+        storePixelSse41(dst + i, sum);
+    }
+}
+
+CHATDOT_TARGET("sse4.1")
+void packRgbSse41(const uchar* src, uchar* dst, int pixels, bool swapRedBlue)
+{
+    // 一次处理 4 个像素：16 字节输入，12 字节输出
+    const __m128i mask = swapRedBlue
+        ? _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1)
+        : _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    int p = 0;
+    for (; p + 4 <= pixels; p += 4, src += 16, dst += 12) {
+        __m128i v = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src)), mask);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(dst), v);
+        int tail = _mm_cvtsi128_si32(_mm_srli_si128(v, 8));
+        std::memcpy(dst + 8, &tail, 4);
+    }
+    packRgbScalar(src, dst, pixels - p, swapRedBlue);
+}
+
+// ---- AVX2 实现：垂直方向一次处理 8 个字节，水平方向与 SSE4.1 相同 ----
+
+CHATDOT_TARGET("avx2")
+void verticalAvx2(const uchar* const* rows, const float* weights, int count, uchar* dst, int bytes)
+{
+    int i = 0;
+    for (; i + 8 <= bytes; i += 8) {
+        __m256 sum = _mm256_setzero_ps();
+        for (int k = 0; k < count; ++k) {
+            __m128i raw = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(rows[k] + i));
+            __m256 value = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(raw));
+            sum = _mm256_add_ps(sum, _mm256_mul_ps(value, _mm256_set1_ps(weights[k])));
+        }
+        __m256i rounded = _mm256_cvtps_epi32(sum);
+        __m128i packed = _mm_packus_epi32(_mm256_castsi256_si128(rounded),
+                                          _mm256_extracti128_si256(rounded, 1));
+        packed = _mm_packus_epi16(packed, packed);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + i), packed);
+    }
+    if (i < bytes) {
+        QVarLengthArray<const uchar*, 64> offsetRows(count);
+        for (int k = 0; k < count; ++k) {
+            offsetRows[k] = rows[k] + i;
+        }
+        verticalSse41(offsetRows.constData(), weights, count, dst + i, bytes - i);
+    }
+}
+
+bool cpuSupportsAvx2()
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 1);
+    bool osSaves = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && ((_xgetbv(0) & 0x6) == 0x6);
+    __cpuidex(info, 7, 0);
+    return osSaves && (info[1] & (1 << 5));
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+bool cpuSupportsSse41()
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] & (1 << 19)) != 0;
+#else
+    return __builtin_cpu_supports("sse4.1");
+#endif
+}
+
+#endif // CHATDOT_X86
+
+struct Kernels {
+    void (*horizontal)(const uchar* src, uchar* dst, int outWidth, const Coefficients& c);
+    void (*vertical)(const uchar* const* rows, const float* weights, int count, uchar* dst, int bytes);
+    void (*packRgb)(const uchar* src, uchar* dst, int pixels, bool swapRedBlue);
+    const char* name;
+};
+
+const Kernels kScalarKernels = {horizontalScalar, verticalScalar, packRgbScalar, "scalar"};
+
+Kernels selectKernels()
+{
+#ifdef CHATDOT_X86
+    if (cpuSupportsAvx2()) {
+        return {horizontalSse41, verticalAvx2, packRgbSse41, "avx2"};
+    }
+    if (cpuSupportsSse41()) {
+        return {horizontalSse41, verticalSse41, packRgbSse41, "sse4.1"};
+    }
+#endif
+    return kScalarKernels;
+}
+
+const Kernels& activeKernels()
+{
+    // CPU 特性只检测一次
+    static const Kernels best = selectKernels();
+    return g_forceScalar ? kScalarKernels : best;
+}
+
+// 预乘格式的一行滤波结果：Lanczos 的过冲可能使颜色超过 alpha，先截到 alpha 以内；
+// 输出不带透明通道时再合成到白色背景上（预乘后只需加上 255 - alpha）
+void finishPremultipliedRow(uchar* row, int pixels, bool onWhite)
+{
+    for (int p = 0; p < pixels; ++p, row += 4) {
+        const uchar alpha = row[3];
+        for (int ch = 0; ch < 3; ++ch) {
+            uchar value = qMin(row[ch], alpha);
+            row[ch] = onWhite ? uchar(value + (255 - alpha)) : value;
+        }
+    }
+}
+
+} // namespace
+
+QImage ImageResize::resize(const QImage& source, const QSize& targetSize, Filter filter, bool keepAlpha)
+{
+    if (source.isNull() || targetSize.isEmpty()) {
+        return QImage();
+    }
+
+    // 核心只处理每像素 4 字节的格式。小端机器上 RGB32/ARGB32 在内存中是 BGRA，
+    // 直接处理并在输出时交换红蓝通道，省去一次整图转换。
+    // 带透明通道的图片按预乘 alpha 滤波，完全透明的像素不会把它的颜色混进相邻像素
+    QImage input = source;
+    bool bgra = false;
+    switch (input.format()) {
+        case QImage::Format_RGBX8888:
+        case QImage::Format_RGBA8888_Premultiplied:
+            break;
+        case QImage::Format_RGBA8888:
+            input = input.convertToFormat(QImage::Format_RGBA8888_Premultiplied);
+            break;
+        case QImage::Format_RGB32:
+        case QImage::Format_ARGB32:
+        case QImage::Format_ARGB32_Premultiplied:
+            if (Q_BYTE_ORDER == Q_LITTLE_ENDIAN) {
+                bgra = true;
+                if (input.format() == QImage::Format_ARGB32) {
+                    input = input.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+                }
+            } else {
+                input = input.convertToFormat(input.hasAlphaChannel() ? QImage::Format_RGBA8888_Premultiplied
+                                                                      : QImage::Format_RGBX8888);
+            }
+            break;
+        default:
+            input = input.convertToFormat(input.hasAlphaChannel() ? QImage::Format_RGBA8888_Premultiplied
+                                                                  : QImage::Format_RGBX8888);
+            break;
+    }
+    const bool hasAlpha = input.hasAlphaChannel();
+
+    // 透明通道保留在预乘格式中，全部完成后再转换回普通的 ARGB32 / RGBA8888
+    QImage::Format outputFormat = QImage::Format_RGB888;
+    if (keepAlpha) {
+        outputFormat = bgra ? QImage::Format_ARGB32_Premultiplied : QImage::Format_RGBA8888_Premultiplied;
+    }
+    QImage output(targetSize, outputFormat);
+    if (output.isNull() || input.isNull()) {
+        return QImage();
+    }
+
+    const int outWidth = targetSize.width();
+    const int outHeight = targetSize.height();
+    const Coefficients horizontal = computeCoefficients(input.width(), outWidth, filter);
+    const Coefficients vertical = computeCoefficients(input.height(), outHeight, filter);
+    const Kernels& kernels = activeKernels();
+
+    const uchar* inBits = input.constBits();
+    const qsizetype inStride = input.bytesPerLine();
+    uchar* outBits = output.bits();
+    const qsizetype outStride = output.bytesPerLine();
+    const int rowBytes = outWidth * 4;
+
+    // 按输出行分块并行处理，每块先水平缩放它用到的输入行，再垂直合成
+    int bandCount = qBound(1, QThread::idealThreadCount() * 2, qMax(1, outHeight / kMinBandRows));
+    QVector<int> bands(bandCount);
+    std::iota(bands.begin(), bands.end(), 0);
+
+    QtConcurrent::blockingMap(bands, [&](int band) {
+        int y0 = int(qint64(band) * outHeight / bandCount);
+        int y1 = int(qint64(band + 1) * outHeight / bandCount);
+        if (y0 >= y1) {
+            return;
+        }
+
+        int first = vertical.start[y0];
+        int last = first;
+        for (int y = y0; y < y1; ++y) {
+            first = qMin(first, vertical.start[y]);
+            last = qMax(last, vertical.start[y] + vertical.count[y]);
+        }
+
+        QVector<uchar> scaledRows(qsizetype(last - first) * rowBytes);
+        for (int r = first; r < last; ++r) {
+            kernels.horizontal(inBits + r * inStride, scaledRows.data() + qsizetype(r - first) * rowBytes,
+                               outWidth, horizontal);
+        }
+
+        QVector<uchar> rgbaRow(keepAlpha ? 0 : rowBytes);
+        QVarLengthArray<const uchar*, 64> rows(vertical.taps);
+        for (int y = y0; y < y1; ++y) {
+            int count = vertical.count[y];
+            for (int k = 0; k < count; ++k) {
+                rows[k] = scaledRows.constData() + qsizetype(vertical.start[y] + k - first) * rowBytes;
+            }
+            uchar* target = outBits + y * outStride;
+            uchar* row = keepAlpha ? target : rgbaRow.data();
+            kernels.vertical(rows.constData(), vertical.weights.constData() + y * vertical.taps,
+                             count, row, rowBytes);
+            if (hasAlpha) {
+                finishPremultipliedRow(row, outWidth, !keepAlpha);
+            }
+            if (!keepAlpha) {
+                kernels.packRgb(row, target, outWidth, bgra);
+            }
+        }
+    });
+
+    if (keepAlpha) {
+        return output.convertToFormat(bgra ? QImage::Format_ARGB32 : QImage::Format_RGBA8888);
+    }
+    return output;
+}
+
+QImage ImageResize::fitWithin(const QImage& source, int maxEdge, Filter filter, bool keepAlpha)
+{
+    if (source.isNull()) {
+        return QImage();
+    }
+
+    QSize size = source.size();
+    if (maxEdge > 0 && qMax(size.width(), size.height()) > maxEdge) {
+        size = size.scaled(maxEdge, maxEdge, Qt::KeepAspectRatio);
+        return resize(source, size.expandedTo(QSize(1, 1)), filter, keepAlpha);
+    }
+    if (!keepAlpha && source.hasAlphaChannel()) {
+        // 直接转换为 RGB888 会丢掉 alpha 而保留透明像素的颜色，按原尺寸走一遍合成到白色背景
+        return resize(source, size, Filter::Area, false);
+    }
+    return source.convertToFormat(keepAlpha ? QImage::Format_RGBA8888 : QImage::Format_RGB888);
+}
+
+QString ImageResize::kernelName()
+{
+    return QString::fromLatin1(activeKernels().name);
+}
+
+void ImageResize::setForceScalar(bool force)
+{
+    g_forceScalar = force;
+}
@@ -0,0 +1,37 @@
+#ifndef IMAGERESIZE_H
+#define IMAGERESIZE_H
+
+#include <QImage>
+#include <QSize>
+#include <QString>
+
+/**
+ * @brief 图片缩小
+ *
+ * 可分离的两遍重采样（先水平后垂直），按行分块在多个线程中并行处理。
+ * 运行时根据 CPU 选择 AVX2、SSE4.1 或标量实现，结果一致。
+ * 用于上传前的缩放和缩略图，比 QImage::scaled 的平滑缩放快，且不在界面线程中调用。
+ */
+class ImageResize
+{
+public:
+    enum class Filter {
+        Area,       // 区域平均，缩小倍数大时效果和速度都最好
+        Lanczos3
+    };
+
+    // 缩放到 targetSize。keepAlpha 为 false 时输出 RGB888（透明部分合成到白色背景上），
+    // 否则输出非预乘的 ARGB32 / RGBA8888。滤波在预乘 alpha 下进行
+    static QImage resize(const QImage& source, const QSize& targetSize,
+                         Filter filter = Filter::Area, bool keepAlpha = false);
+    // 保持宽高比，使长边不超过 maxEdge；本来就更小时只做格式转换
+    static QImage fitWithin(const QImage& source, int maxEdge,
+                            Filter filter = Filter::Area, bool keepAlpha = false);
+
+    // 当前使用的实现："avx2"、"sse4.1" 或 "scalar"
+    static QString kernelName();
+    // 测试和性能对比时强制使用标量实现
+    static void setForceScalar(bool force);
+};
+
+#endif // IMAGERESIZE_H
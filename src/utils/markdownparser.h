@@ -3,6 +3,7 @@
 
 #include <QString>
 #include <QRegularExpression>
+#include "services/tracer.h"
 
 /**
  * @brief 简单的Markdown解析器类
@@ -18,6 +19,7 @@ public:
      * @return 转换后的HTML文本
      */
     static QString toHtml(const QString& markdown) {
+        TRACE_SCOPE_CAT("MarkdownParser::toHtml", "parse");
         QString html = markdown;
         
         // 转义HTML特殊字符，但保留Markdown语法
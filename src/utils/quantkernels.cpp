@@ -0,0 +1,338 @@
+#include "quantkernels.h"
+#include <QFloat16>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define CHATDOT_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define CHATDOT_TARGET(features)
+#else
+#define CHATDOT_TARGET(features) __attribute__((target(features)))
+#endif
+#endif
+
+namespace {
+
+using ActivationBlock = QuantKernels::ActivationBlock;
+using DotFunction = float (*)(const uchar* row, const ActivationBlock* x, int blocks);
+
+const int kQ4Bytes = 18;
+const int kQ8Bytes = 34;
+
+std::atomic<int> g_maxIsa{int(QuantKernels::Isa::Avx512Vnni)};
+
+inline float halfToFloat(const uchar* p)
+{
+    qfloat16 value;
+    memcpy(&value, p, sizeof(value));
+    return float(value);
+}
+
+float dotQ4Scalar(const uchar* row, const ActivationBlock* x, int blocks)
+{
+    float sum = 0.0f;
+    for (int b = 0; b < blocks; ++b) {
+        const uchar* block = row + b * kQ4Bytes;
+        const uchar* qs = block + 2;
+        const qint8* ys = x[b].values;
+        int dot = 0;
+        for (int j = 0; j < 16; ++j) {
+            dot += (qs[j] & 0x0f) * ys[j] + (qs[j] >> 4) * ys[j + 16];
+        }
+        sum += halfToFloat(block) * x[b].scale * (dot - 8 * x[b].sum);
+    }
+    return sum;
+}
+
+float dotQ8Scalar(const uchar* row, const ActivationBlock* x, int blocks)
+{
+    float sum = 0.0f;
+    for (int b = 0; b < blocks; ++b) {
+        const uchar* block = row + b * kQ8Bytes;
+        const qint8* ws = reinterpret_cast<const qint8*>(block + 2);
+        const qint8* ys = x[b].values;
+        int dot = 0;
+        for (int j = 0; j < 32; ++j) {
+            dot += ws[j] * ys[j];
+        }
+        sum += halfToFloat(block) * x[b].scale * dot;
+    }
+    return sum;
+}
+
+#ifdef CHATDOT_X86
+
+CHATDOT_TARGET("avx2,fma")
+inline float horizontalSum(__m256 v)
+{
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_movehdup_ps(sum));
+    return _mm_cvtss_f32(sum);
+}
+
+// 16 字节的 Q4_0 值展开为 32 个 0..15 的字节，低 4 位在前半，高 4 位在后半
+CHATDOT_TARGET("avx2,fma")
+inline __m256i unpackQ4(const uchar* qs)
+{
+    __m128i packed = _mm_loadu_si128(reinterpret_cast<const __m128i*>(qs));
+    __m256i both = _mm256_set_m128i(_mm_srli_epi16(packed, 4), packed);
+    return _mm256_and_si256(both, _mm256_set1_epi8(0x0f));
+}
+
+CHATDOT_TARGET("avx2,fma")
+float dotQ4Avx2(const uchar* row, const ActivationBlock* x, int blocks)
+{
+    const __m256i ones = _mm256_set1_epi16(1);
+    __m256 acc = _mm256_setzero_ps();
+    float offset = 0.0f;
+    for (int b = 0; b < blocks; ++b) {
+        const uchar* block = row + b * kQ4Bytes;
+        __m256i q = unpackQ4(block + 2);
+        __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(x[b].values));
+        // 无符号 4 位值乘有符号激活，两两相加后不会溢出 16 位
+        __m256i dot = _mm256_madd_epi16(_mm256_maddubs_epi16(q, y), ones);
+        float scale = halfToFloat(block) * x[b].scale;
+        acc = _mm256_fmadd_ps(_mm256_set1_ps(scale), _mm256_cvtepi32_ps(dot), acc);
+        offset += scale * 8 * x[b].sum;
+    }
+    return horizontalSum(acc) - offset;
+}
+
+CHATDOT_TARGET("avx2,fma")
+float dotQ8Avx2(const uchar* row, const ActivationBlock* x, int blocks)
+{
+    const __m256i ones = _mm256_set1_epi16(1);
+    __m256 acc = _mm256_setzero_ps();
+    for (int b = 0; b < blocks; ++b) {
+        const uchar* block = row + b * kQ8Bytes;
+        __m256i w = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + 2));
+        __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(x[b].values));
+        // vpmaddubsw 要求一侧无符号：取权重的绝对值，把符号转移到激活上
+        __m256i absW = _mm256_sign_epi8(w, w);
+        __m256i signedY = _mm256_sign_epi8(y, w);
+        __m256i dot = _mm256_madd_epi16(_mm256_maddubs_epi16(absW, signedY), ones);
+        float scale = halfToFloat(block) * x[b].scale;
+        acc = _mm256_fmadd_ps(_mm256_set1_ps(scale), _mm256_cvtepi32_ps(dot), acc);
+    }
+    return horizontalSum(acc);
+}
+
+#define CHATDOT_AVX512 "avx512f,avx512bw,avx512vl,avx512dq,avx512vnni,avx2,fma"
+
+// 两个块拼成一个 512 位向量
+CHATDOT_TARGET(CHATDOT_AVX512)
+inline __m512i combine(__m256i low, __m256i high)
+{
+    return _mm512_inserti64x4(_mm512_castsi256_si512(low), high, 1);
+}
+
+CHATDOT_TARGET(CHATDOT_AVX512)
+inline __m512i loadActivationPair(const ActivationBlock* x)
+{
+    return combine(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(x[0].values)),
+                   _mm256_loadu_si256(reinterpret_cast<const __m256i*>(x[1].values)));
+}
+
+CHATDOT_TARGET(CHATDOT_AVX512)
+inline __m512 scalePair(float first, float second)
+{
+    return _mm512_insertf32x8(_mm512_set1_ps(first), _mm256_set1_ps(second), 1);
+}
+
+CHATDOT_TARGET(CHATDOT_AVX512)
+float dotQ4Avx512(const uchar* row, const ActivationBlock* x, int blocks)
+{
+    __m512 acc = _mm512_setzero_ps();
+    float offset = 0.0f;
+    int b = 0;
+    for (; b + 1 < blocks; b += 2) {
+        const uchar* first = row + b * kQ4Bytes;
+        const uchar* second = first + kQ4Bytes;
+        __m512i q = combine(unpackQ4(first + 2), unpackQ4(second + 2));
+        __m512i dot = _mm512_dpbusd_epi32(_mm512_setzero_si512(), q, loadActivationPair(x + b));
+        float s0 = halfToFloat(first) * x[b].scale;
+        float s1 = halfToFloat(second) * x[b + 1].scale;
+        acc = _mm512_fmadd_ps(scalePair(s0, s1), _mm512_cvtepi32_ps(dot), acc);
+        offset += 8 * (s0 * x[b].sum + s1 * x[b + 1].sum);
+    }
+    float sum = _mm512_reduce_add_ps(acc) - offset;
+    if (b < blocks) {
+        sum += dotQ4Avx2(row + b * kQ4Bytes, x + b, blocks - b);
+    }
+    return sum;
+}
+
+CHATDOT_TARGET(CHATDOT_AVX512)
+float dotQ8Avx512(const uchar* row, const ActivationBlock* x, int blocks)
+{
+    // vpdpbusd 的第一个操作数无符号：激活加 128 变为无符号，再减去 128 * 权重之和
+    const __m512i bias = _mm512_set1_epi8(char(0x80));
+    __m512 acc = _mm512_setzero_ps();
+    int b = 0;
+    for (; b + 1 < blocks; b += 2) {
+        const uchar* first = row + b * kQ8Bytes;
+        const uchar* second = first + kQ8Bytes;
+        __m512i w = combine(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(first + 2)),
+                            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(second + 2)));
+        __m512i y = _mm512_xor_si512(loadActivationPair(x + b), bias);
+        __m512i dot = _mm512_sub_epi32(_mm512_dpbusd_epi32(_mm512_setzero_si512(), y, w),
+                                       _mm512_dpbusd_epi32(_mm512_setzero_si512(), bias, w));
+        float s0 = halfToFloat(first) * x[b].scale;
+        float s1 = halfToFloat(second) * x[b + 1].scale;
+        acc = _mm512_fmadd_ps(scalePair(s0, s1), _mm512_cvtepi32_ps(dot), acc);
+    }
+    float sum = _mm512_reduce_add_ps(acc);
+    if (b < blocks) {
+        sum += dotQ8Avx2(row + b * kQ8Bytes, x + b, blocks - b);
+    }
+    return sum;
+}
+
+bool cpuSupportsAvx2()
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 1);
+    bool osSaves = (info[2] & (1 << 27)) && ((_xgetbv(0) & 0x6) == 0x6);
+    bool fma = (info[2] & (1 << 12)) != 0;
+    __cpuidex(info, 7, 0);
+    return osSaves && fma && (info[1] & (1 << 5));
+#else
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+}
+
+bool cpuSupportsAvx512Vnni()
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 1);
+    // 操作系统需要保存 opmask 和 zmm 寄存器
+    bool osSaves = (info[2] & (1 << 27)) && ((_xgetbv(0) & 0xe6) == 0xe6);
+    __cpuidex(info, 7, 0);
+    const int ebxBits = (1 << 16) | (1 << 17) | (1 << 30) | (1 << 31);   // F、DQ、BW、VL
+    return osSaves && (info[1] & ebxBits) == ebxBits && (info[2] & (1 << 11));
+#else
+    return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")
+        && __builtin_cpu_supports("avx512vl") && __builtin_cpu_supports("avx512dq")
+        && __builtin_cpu_supports("avx512vnni");
+#endif
+}
+
+#endif // CHATDOT_X86
+
+struct Kernels {
+    DotFunction dotQ4;
+    DotFunction dotQ8;
+    QuantKernels::Isa isa;
+};
+
+const Kernels kScalarKernels = {dotQ4Scalar, dotQ8Scalar, QuantKernels::Isa::Scalar};
+
+QList<Kernels> availableKernels()
+{
+    QList<Kernels> kernels = {kScalarKernels};
+#ifdef CHATDOT_X86
+    if (cpuSupportsAvx2()) {
+        kernels.append({dotQ4Avx2, dotQ8Avx2, QuantKernels::Isa::Avx2});
+        if (cpuSupportsAvx512Vnni()) {
+            kernels.append({dotQ4Avx512, dotQ8Avx512, QuantKernels::Isa::Avx512Vnni});
+        }
+    }
+#endif
+    return kernels;
+}
+
+const Kernels& activeKernels()
+{
+    // CPU 特性只检测一次
+    static const QList<Kernels> available = availableKernels();
+    const int maxIsa = g_maxIsa.load(std::memory_order_relaxed);
+    for (int i = available.size() - 1; i > 0; --i) {
+        if (int(available.at(i).isa) <= maxIsa) {
+            return available.at(i);
+        }
+    }
+    return available.first();
+}
+
+} // namespace
+
+void QuantKernels::quantize(const float* x, int cols, ActivationBlock* out)
+{
+    for (int b = 0; b < cols / kBlockSize; ++b) {
+        const float* xs = x + b * kBlockSize;
+        float maxAbs = 0.0f;
+        for (int j = 0; j < kBlockSize; ++j) {
+            maxAbs = qMax(maxAbs, std::fabs(xs[j]));
+        }
+        ActivationBlock& block = out[b];
+        block.scale = maxAbs / 127.0f;
+        const float inverse = maxAbs > 0.0f ? 127.0f / maxAbs : 0.0f;
+        qint32 sum = 0;
+        for (int j = 0; j < kBlockSize; ++j) {
+            block.values[j] = qint8(std::lround(xs[j] * inverse));
+            sum += block.values[j];
+        }
+        block.sum = sum;
+    }
+}
+
+void QuantKernels::gemv(quint32 type, const uchar* weights, qint64 rowBytes, int rows,
+                        const ActivationBlock* x, int cols, float* out)
+{
+    const Kernels& kernels = activeKernels();
+    const DotFunction dot = type == Q4_0 ? kernels.dotQ4 : kernels.dotQ8;
+    const int blocks = cols / kBlockSize;
+    for (int r = 0; r < rows; ++r) {
+        out[r] = dot(weights + r * rowBytes, x, blocks);
+    }
+}
+
+void QuantKernels::gemm(quint32 type, const uchar* weights, qint64 rowBytes, int rows,
+                        const ActivationBlock* x, int count, int cols, float* out, qint64 outStride)
+{
+    const Kernels& kernels = activeKernels();
+    const DotFunction dot = type == Q4_0 ? kernels.dotQ4 : kernels.dotQ8;
+    const int blocks = cols / kBlockSize;
+    // 一行权重在缓存中时依次与所有向量相乘
+    for (int r = 0; r < rows; ++r) {
+        const uchar* row = weights + r * rowBytes;
+        for (int i = 0; i < count; ++i) {
+            out[i * outStride + r] = dot(row, x + qint64(i) * blocks, blocks);
+        }
+    }
+}
+
+QuantKernels::Isa QuantKernels::isa()
+{
+    return activeKernels().isa;
+}
+
+QString QuantKernels::isaName(Isa isa)
+{
+    switch (isa) {
+        case Isa::Avx512Vnni: return "avx512-vnni";
+        case Isa::Avx2: return "avx2";
+        default: return "scalar";
+    }
+}
+
+QList<QuantKernels::Isa> QuantKernels::supportedIsas()
+{
+    QList<Isa> isas;
+    for (const Kernels& kernels : availableKernels()) {
+        isas.append(kernels.isa);
+    }
+    return isas;
+}
+
+void QuantKernels::setMaxIsa(Isa isa)
+{
+    g_maxIsa.store(int(isa), std::memory_order_relaxed);
+}
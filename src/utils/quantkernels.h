@@ -0,0 +1,65 @@
+#ifndef QUANTKERNELS_H
+#define QUANTKERNELS_H
+
+#include <QList>
+#include <QString>
+#include <QtGlobal>
+
+/**
+ * @brief 量化权重的矩阵乘向量
+ *
+ * 权重为 GGUF 的 Q4_0 / Q8_0 块格式（每块 32 个值共用一个 fp16 缩放），激活先量化为
+ * 8 位块，点积全部用整数完成，每块只做一次浮点乘加。运行时根据 CPU 选择
+ * AVX-512 VNNI、AVX2 或标量实现，只在第一次使用时检测一次。
+ *
+ * Q4_0 的 4 位值按无符号数参与乘法，减去 8 的偏移用激活块的和一次性扣除，
+ * 这样可以直接用无符号乘有符号的指令（vpmaddubsw / vpdpbusd）。
+ */
+class QuantKernels
+{
+public:
+    // 与 ggml 的类型编号一致
+    enum WeightType : quint32 {
+        Q4_0 = 2,
+        Q8_0 = 8
+    };
+
+    enum class Isa {
+        Scalar,
+        Avx2,
+        Avx512Vnni
+    };
+
+    // 量化后的激活块：values * scale 近似原值，sum 为 values 之和
+    struct ActivationBlock {
+        float scale;
+        qint32 sum;
+        qint8 values[32];
+    };
+
+    static constexpr int kBlockSize = 32;
+
+    static bool supports(quint32 type) { return type == Q4_0 || type == Q8_0; }
+    static qint64 blockBytes(quint32 type) { return type == Q4_0 ? 18 : 34; }
+
+    // 把 x 量化为 cols / 32 个块，cols 必须是 32 的倍数
+    static void quantize(const float* x, int cols, ActivationBlock* out);
+
+    // out[r] = 第 r 行权重 · x，共 rows 行，每行 cols 个值
+    static void gemv(quint32 type, const uchar* weights, qint64 rowBytes, int rows,
+                     const ActivationBlock* x, int cols, float* out);
+    // 小批量：同一组权重乘以 count 个向量，x 按向量依次排列，
+    // 第 i 个向量的结果写入 out + i * outStride。每行权重只读一次
+    static void gemm(quint32 type, const uchar* weights, qint64 rowBytes, int rows,
+                     const ActivationBlock* x, int count, int cols, float* out, qint64 outStride);
+
+    // 当前使用的实现
+    static Isa isa();
+    static QString isaName(Isa isa);
+    // 本机支持的实现，从低到高
+    static QList<Isa> supportedIsas();
+    // 基准测试时限制使用的最高指令集
+    static void setMaxIsa(Isa isa);
+};
+
+#endif // QUANTKERNELS_H
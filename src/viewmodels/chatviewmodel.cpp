@@ -3,6 +3,7 @@
 #include "services/ollamaservice.h"
 #include "services/localmodelservice.h"
 #include "services/logger.h"
+#include "services/tracer.h"
 #include <QDebug>
 
 ChatViewModel::ChatViewModel(ChatModel* model, QObject *parent)
@@ -13,6 +14,8 @@ ChatViewModel::ChatViewModel(ChatModel* model, QObject *parent)
     , m_currentResponse("")
     , m_isGenerating(false)
     , m_isDeepThinking(false)
+    , m_responseIndex(-1)
+    , m_firstTokenMs(-1)
 {
 }
 
@@ -21,7 +24,7 @@ ChatViewModel::~ChatViewModel()
     delete m_llmService;
 }
 
-void ChatViewModel::sendMessage(const QString& message)
+void ChatViewModel::sendMessage(const QString& message, const QList<ImagePipeline::ImageHandle>& images)
 {
     if (message.isEmpty()) {
         LOG_WARNING("尝试发送空消息");
@@ -44,8 +47,27 @@ void ChatViewModel::sendMessage(const QString& message)
         return;
     }
 
+    // 本地模型按完整对话组织提示词，已完成的消息作为历史一起发送
+    if (m_llmService->supportsHistory()) {
+        QList<LLMService::Turn> history;
+        for (const ChatModel::Message& previous : m_model->messages()) {
+            if (previous.complete && (previous.role == "user" || previous.role == "assistant")
+                && !previous.content.isEmpty()) {
+                history.append({previous.role, previous.content});
+            }
+        }
+        m_llmService->setHistory(history);
+        m_llmService->setConversationPath(m_conversationPath);
+    }
+
     // 添加用户消息到聊天记录
-    m_model->addMessage("user", message);
+    QStringList attachments;
+    for (const ImagePipeline::ImageHandle& image : images) {
+        if (!image->hash.isEmpty()) {
+            attachments.append(image->hash);
+        }
+    }
+    m_model->addMessage("user", message, attachments);
     LOG_INFO(QString("发送用户消息: %1").arg(message));
 
     // 开始生成回复
@@ -54,6 +76,23 @@ void ChatViewModel::sendMessage(const QString& message)
     m_isCancelled = false;
     m_currentResponse.clear();
 
+    // 先创建空的助手消息，流式输出逐段追加
+    m_responseIndex = m_model->beginMessage("assistant", m_llmService->getModelName());
+    m_responseTimer.start();
+    m_firstTokenMs = -1;
+    m_imageMetrics = QJsonArray();
+    m_promptTokens = -1;
+    m_cachedTokens = -1;
+
+    if (!images.isEmpty()) {
+        if (m_llmService->supportsImages()) {
+            m_llmService->setImages(images, m_attachmentStore);
+            LOG_INFO(QString("随消息发送 %1 张图片").arg(images.size()));
+        } else {
+            LOG_WARNING(QString("当前模型不支持图片，%1 张图片未发送").arg(images.size()));
+        }
+    }
+
     // 发送消息到AI服务
     QFuture<QString> future = m_llmService->generateResponse(message);
     LOG_INFO("已发送消息到AI服务，等待响应...");
@@ -71,6 +110,7 @@ void ChatViewModel::sendMessage(const QString& message)
     }).onFailed([this](const std::exception& e) {
         QString errorMsg = QString("处理消息时发生错误: %1").arg(e.what());
         LOG_ERROR(errorMsg);
+        finishResponse();
         handleError(errorMsg);
         m_isGenerating = false;
         emit generationFinished();
@@ -84,10 +124,8 @@ void ChatViewModel::cancelGeneration()
         m_llmService->cancelGeneration();
         LOG_INFO("已取消生成");
 
-        // 如果有部分响应，添加到模型中
-        if (!m_currentResponse.isEmpty()) {
-            m_model->addMessage("assistant", m_currentResponse);
-        }
+        // 保留已经收到的部分响应
+        finishResponse();
 
         emit generationFinished();
     }
@@ -95,21 +133,72 @@ void ChatViewModel::cancelGeneration()
 
 void ChatViewModel::handleStreamResponse(const QString& partialResponse)
 {
+    TRACE_SCOPE_CAT("ChatViewModel::handleStreamResponse", "viewmodel");
+    quint64 sequence = ++m_streamSequence;
+    TRACE_FLOW_END("stream chunk", Tracer::flowId(m_llmService, sequence));
     if (!m_isCancelled) {
-        m_currentResponse = partialResponse;
+        if (m_firstTokenMs < 0) {
+            m_firstTokenMs = m_responseTimer.elapsed();
+        }
+        m_currentResponse += partialResponse;
+        m_model->appendToMessage(m_responseIndex, partialResponse);
         emit streamResponse(partialResponse);
         // LOG_INFO(QString("收到流式响应: %1").arg(partialResponse));
     }
 }
 
+void ChatViewModel::handleImageEncoded(const QString& id, qint64 uploadBytes, qint64 encodeMs)
+{
+    QJsonObject image;
+    image["id"] = id;
+    image["uploadBytes"] = uploadBytes;
+    image["encodeMs"] = encodeMs;
+    m_imageMetrics.append(image);
+}
+
+void ChatViewModel::handlePromptCache(int promptTokens, int cachedTokens)
+{
+    m_promptTokens = promptTokens;
+    m_cachedTokens = cachedTokens;
+}
+
 void ChatViewModel::handleResponse(const QString& response)
 {
     if (!m_isCancelled) {
-        m_model->addMessage("assistant", response);
+        // 非流式服务只在结束时给出完整响应
+        if (m_currentResponse.isEmpty() && !response.isEmpty()) {
+            m_currentResponse = response;
+            m_model->appendToMessage(m_responseIndex, response);
+        }
+        finishResponse();
         emit responseReceived(response);
     }
 }
 
+void ChatViewModel::finishResponse()
+{
+    if (m_responseIndex >= 0) {
+        QJsonObject metrics;
+        metrics["durationMs"] = m_responseTimer.elapsed();
+        if (m_firstTokenMs >= 0) {
+            metrics["firstTokenMs"] = m_firstTokenMs;
+        }
+        metrics["chars"] = m_currentResponse.size();
+        if (m_isCancelled) {
+            metrics["cancelled"] = true;
+        }
+        if (!m_imageMetrics.isEmpty()) {
+            metrics["images"] = m_imageMetrics;
+        }
+        if (m_promptTokens >= 0) {
+            metrics["promptTokens"] = m_promptTokens;
+            metrics["cachedTokens"] = m_cachedTokens;
+        }
+        m_model->finishMessage(m_responseIndex, metrics);
+        m_responseIndex = -1;
+    }
+}
+
 void ChatViewModel::handleError(const QString& error)
 {
     emit errorOccurred(error);
@@ -128,6 +217,7 @@ void ChatViewModel::setLLMService(LLMService* service)
 
     // 设置新服务
     m_llmService = service;
+    m_streamSequence = 0;
     if (m_llmService) {
         // 连接新服务的信号
         connect(m_llmService, &LLMService::streamResponseReceived,
@@ -142,6 +232,14 @@ void ChatViewModel::setLLMService(LLMService* service)
                 this, &ChatViewModel::handleError,
                 Qt::QueuedConnection);
 
+        connect(m_llmService, &LLMService::imageEncoded,
+                this, &ChatViewModel::handleImageEncoded);
+
+        connect(m_llmService, &LLMService::promptCacheReported,
+                this, &ChatViewModel::handlePromptCache);
+        connect(m_llmService, &LLMService::prefillProgress,
+                this, &ChatViewModel::prefillProgress);
+
         LOG_INFO(QString("已切换到模型: %1").arg(m_llmService->getModelName()));
     }
 }
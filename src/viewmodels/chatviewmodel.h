@@ -4,6 +4,8 @@
 #include <QObject>
 #include <QFuture>
 #include <QString>
+#include <QElapsedTimer>
+#include <QJsonArray>
 #include "models/chatmodel.h"
 #include "services/llmservice.h"
 #include "services/apiservice.h"
@@ -18,7 +20,8 @@ public:
     explicit ChatViewModel(ChatModel* model, QObject *parent = nullptr);
     ~ChatViewModel();
 
-    Q_INVOKABLE void sendMessage(const QString& message);
+    // images 为随消息发送的图片，模型不支持图片时只发送文字
+    void sendMessage(const QString& message, const QList<ImagePipeline::ImageHandle>& images = {});
     Q_INVOKABLE void clearChat();
     Q_INVOKABLE void cancelGeneration();
     Q_INVOKABLE void setDeepThinkingMode(bool enabled);
@@ -28,6 +31,9 @@ public:
     bool hasLLMService() const { return m_llmService != nullptr; }
     QString getServiceStatus() const;
     bool isDeepThinkingMode() const { return m_isDeepThinking; }
+    void setAttachmentStore(AttachmentStore* store) { m_attachmentStore = store; }
+    // 当前对话的目录，本地模型在其中保存键值缓存
+    void setConversationPath(const QString& path) { m_conversationPath = path; }
 
 signals:
     void responseReceived(const QString& response);
@@ -36,19 +42,34 @@ signals:
     void generationFinished();
     void streamResponse(const QString& partialResponse);
     void deepThinkingModeChanged(bool enabled);
+    // 转发服务计算提示词的进度
+    void prefillProgress(int done, int total, double tokensPerSecond);
 
 public slots:
     void handleResponse(const QString& response);
     void handleError(const QString& error);
     void handleStreamResponse(const QString& partialResponse);
+    void handleImageEncoded(const QString& id, qint64 uploadBytes, qint64 encodeMs);
+    void handlePromptCache(int promptTokens, int cachedTokens);
 
 private:
+    void finishResponse();
+
     ChatModel* m_model;
     LLMService* m_llmService;
     bool m_isCancelled;
     QString m_currentResponse;
     bool m_isGenerating;
     bool m_isDeepThinking;
+    int m_responseIndex;  // 正在生成的助手消息序号
+    QElapsedTimer m_responseTimer;
+    qint64 m_firstTokenMs;
+    QJsonArray m_imageMetrics;  // 本次请求中每张图片的上传大小和编码耗时
+    int m_promptTokens = -1;    // 本次请求的提示 token 数，服务未报告时为 -1
+    int m_cachedTokens = -1;    // 其中复用了键值缓存的数量
+    AttachmentStore* m_attachmentStore = nullptr;
+    QString m_conversationPath;
+    quint64 m_streamSequence = 0;  // 当前服务已收到的流式片段数，用于对应跟踪中的流事件
 };
 
 #endif // CHATVIEWMODEL_H
@@ -276,15 +276,7 @@ void SettingsViewModel::fetchApiModelsFromProvider(const QString& provider)
 
 QStringList SettingsViewModel::getApiModelsForProvider(const QString& provider)
 {
-    QStringList result;
-    QJsonObject providerConfig = m_model->getProviderConfig("api", provider);
-    if (providerConfig.contains("models")) {
-        QJsonObject models = providerConfig["models"].toObject();
-        for (auto it = models.begin(); it != models.end(); ++it) {
-            result.append(it.key());
-        }
-    }
-    return result;
+    return m_model->getProviderModels(provider);
 }
 
 QStringList SettingsViewModel::getApiModels(const QString& provider)
@@ -326,6 +318,36 @@ void SettingsViewModel::setLocalModelPath(const QString& path)
     m_model->setModelPath(path);
 }
 
+int SettingsViewModel::getInferenceThreads() const
+{
+    return m_model->inferenceThreads();
+}
+
+void SettingsViewModel::setInferenceThreads(int threads)
+{
+    m_model->setInferenceThreads(threads);
+}
+
+int SettingsViewModel::getKvCacheMB() const
+{
+    return m_model->kvCacheMB();
+}
+
+void SettingsViewModel::setKvCacheMB(int megabytes)
+{
+    m_model->setKvCacheMB(megabytes);
+}
+
+bool SettingsViewModel::getKvCache8Bit() const
+{
+    return m_model->kvCache8Bit();
+}
+
+void SettingsViewModel::setKvCache8Bit(bool enabled)
+{
+    m_model->setKvCache8Bit(enabled);
+}
+
 LLMService* SettingsViewModel::createLLMService()
 {
     if (!m_model) {
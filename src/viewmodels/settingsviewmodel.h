@@ -64,6 +64,12 @@ public:
     // 本地模型设置
     Q_INVOKABLE QString getLocalModelPath() const;
     Q_INVOKABLE void setLocalModelPath(const QString& path);
+    Q_INVOKABLE int getInferenceThreads() const;
+    Q_INVOKABLE void setInferenceThreads(int threads);
+    Q_INVOKABLE int getKvCacheMB() const;
+    Q_INVOKABLE void setKvCacheMB(int megabytes);
+    Q_INVOKABLE bool getKvCache8Bit() const;
+    Q_INVOKABLE void setKvCache8Bit(bool enabled);
     
 signals:
     void modelTypeChanged();
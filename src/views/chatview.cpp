@@ -0,0 +1,279 @@
+#include "chatview.h"
+#include <QPainter>
+#include <QPaintEvent>
+#include <QScrollBar>
+#include <QTextBlock>
+#include <QTextCursor>
+#include <QAbstractTextDocumentLayout>
+#include "services/tracer.h"
+
+namespace {
+// 段落格式中记录消息角色的属性
+const int kRoleProperty = QTextFormat::UserProperty + 1;
+// 消息第一段记录消息序号 + 1，其余段落为 0
+const int kMessageIndexProperty = QTextFormat::UserProperty + 2;
+// 气泡内正文与气泡左右边缘的距离
+const qreal kBubblePadding = 12.0;
+// 气泡超出正文上下边缘的距离
+const qreal kBubbleVerticalPadding = 6.0;
+const qreal kBubbleRadius = 12.0;
+}
+
+ChatView::ChatView(QWidget *parent)
+    : QTextEdit(parent)
+    , m_openBodyStart(-1)
+    , m_openRole(BubbleRole::None)
+{
+}
+
+ChatView::~ChatView()
+{
+}
+
+void ChatView::setChatPalette(const ThemeManager::ChatPalette& palette)
+{
+    m_palette = palette;
+    // 文档内容不变，只重绘当前可见的部分
+    viewport()->update();
+}
+
+void ChatView::appendMessage(const MessageBlock& message)
+{
+    TRACE_SCOPE_CAT("ChatView::appendMessage", "render");
+    QTextCursor cursor(document());
+    cursor.movePosition(QTextCursor::End);
+    if (!document()->isEmpty()) {
+        cursor.insertBlock();
+    }
+    m_openBodyStart = insertMessage(cursor, message);
+    m_openRole = message.role;
+}
+
+void ChatView::appendToMessage(const QString& html)
+{
+    TRACE_SCOPE_CAT("ChatView::appendToMessage", "render");
+    QTextCursor cursor(document());
+    cursor.movePosition(QTextCursor::End);
+    int start = cursor.position();
+    cursor.insertHtml(html);
+
+    // 流式内容可能带来新的段落，补上所属消息的角色
+    if (m_openBodyStart >= 0) {
+        markBlocks(start, cursor.position(), m_openRole);
+    }
+}
+
+void ChatView::closeMessage()
+{
+    m_openBodyStart = -1;
+    m_openRole = BubbleRole::None;
+}
+
+void ChatView::prependMessages(const QList<MessageBlock>& messages)
+{
+    TRACE_SCOPE_CAT("ChatView::prependMessages", "render");
+    if (messages.isEmpty()) {
+        return;
+    }
+
+    int sizeBefore = document()->characterCount();
+    QTextCursor cursor(document());
+    cursor.movePosition(QTextCursor::Start);
+    bool hadContent = !document()->isEmpty();
+    if (hadContent) {
+        // 在开头留出一个空段落，新消息写在其中，不会并入原来的第一段
+        cursor.insertBlock();
+        cursor.movePosition(QTextCursor::Start);
+    }
+
+    int inserted = 0;
+    for (const MessageBlock& message : messages) {
+        if (inserted++ > 0) {
+            cursor.insertBlock();
+        }
+        insertMessage(cursor, message);
+    }
+
+    // 正在输出的消息整体后移
+    if (m_openBodyStart >= 0) {
+        m_openBodyStart += document()->characterCount() - sizeBefore;
+    }
+}
+
+void ChatView::removeMessagesBefore(int index)
+{
+    TRACE_SCOPE_CAT("ChatView::removeMessagesBefore", "render");
+    QTextBlock block = findMessage(index);
+    if (!block.isValid() || block.position() == 0) {
+        return;
+    }
+
+    // 删除后剩下的第一段会沿用原来第一段的格式，先记下再恢复
+    int sizeBefore = document()->characterCount();
+    QTextBlockFormat format = block.blockFormat();
+    QTextCursor cursor(document());
+    cursor.setPosition(block.position(), QTextCursor::KeepAnchor);
+    cursor.removeSelectedText();
+    cursor.setBlockFormat(format);
+
+    if (m_openBodyStart >= 0) {
+        m_openBodyStart -= sizeBefore - document()->characterCount();
+    }
+}
+
+void ChatView::removeMessagesFrom(int index)
+{
+    // 正在输出的消息在文档末尾
+    if (m_openBodyStart >= 0) {
+        return;
+    }
+    TRACE_SCOPE_CAT("ChatView::removeMessagesFrom", "render");
+    QTextBlock block = findMessage(index);
+    if (!block.isValid() || block.position() == 0) {
+        return;
+    }
+
+    // 连同前一段末尾的段落分隔符一起删除
+    QTextCursor cursor(document());
+    cursor.setPosition(block.position() - 1);
+    cursor.movePosition(QTextCursor::End, QTextCursor::KeepAnchor);
+    cursor.removeSelectedText();
+}
+
+QTextBlock ChatView::findMessage(int index) const
+{
+    for (QTextBlock block = document()->firstBlock(); block.isValid(); block = block.next()) {
+        if (block.blockFormat().intProperty(kMessageIndexProperty) == index + 1) {
+            return block;
+        }
+    }
+    return QTextBlock();
+}
+
+void ChatView::clearMessages()
+{
+    clear();
+    closeMessage();
+}
+
+int ChatView::insertMessage(QTextCursor& cursor, const MessageBlock& message)
+{
+    int headerStart = cursor.position();
+    cursor.insertHtml(message.headerHtml);
+    markBlocks(headerStart, cursor.position(), BubbleRole::None);
+
+    cursor.insertBlock();
+    int bodyStart = cursor.position();
+    if (!message.bodyHtml.isEmpty()) {
+        cursor.insertHtml(message.bodyHtml);
+    }
+    markBlocks(bodyStart, cursor.position(), message.role);
+
+    // 新段落会继承前一段的格式，序号只留在第一段
+    int index = message.index + 1;
+    QTextBlock last = cursor.block();
+    for (QTextBlock block = document()->findBlock(headerStart); block.isValid(); block = block.next()) {
+        if (block.blockFormat().intProperty(kMessageIndexProperty) != index) {
+            QTextBlockFormat format = block.blockFormat();
+            format.setProperty(kMessageIndexProperty, index);
+            QTextCursor(block).setBlockFormat(format);
+        }
+        index = 0;
+        if (block == last) {
+            break;
+        }
+    }
+    return bodyStart;
+}
+
+void ChatView::markBlocks(int from, int to, BubbleRole role)
+{
+    QTextBlock block = document()->findBlock(from);
+    QTextBlock last = document()->findBlock(to);
+    while (block.isValid()) {
+        BubbleRole current = blockRole(block);
+        if (current != role) {
+            QTextBlockFormat format = block.blockFormat();
+            format.setProperty(kRoleProperty, static_cast<int>(role));
+
+            // 气泡内的段落向内缩进，离开气泡时恢复
+            qreal padding = 0.0;
+            if (current == BubbleRole::None) {
+                padding = kBubblePadding;
+            } else if (role == BubbleRole::None) {
+                padding = -kBubblePadding;
+            }
+            format.setLeftMargin(format.leftMargin() + padding);
+            format.setRightMargin(format.rightMargin() + padding);
+            QTextCursor(block).setBlockFormat(format);
+        }
+        if (block == last) {
+            break;
+        }
+        block = block.next();
+    }
+}
+
+ChatView::BubbleRole ChatView::blockRole(const QTextBlock& block)
+{
+    return static_cast<BubbleRole>(block.blockFormat().intProperty(kRoleProperty));
+}
+
+void ChatView::paintEvent(QPaintEvent *event)
+{
+    QTextBlock block = cursorForPosition(event->rect().topLeft()).block();
+    if (block.isValid()) {
+        // 从所在气泡的第一段开始，上边缘和圆角才能画在正确的位置
+        BubbleRole role = blockRole(block);
+        while (role != BubbleRole::None && block.previous().isValid()
+               && blockRole(block.previous()) == role) {
+            block = block.previous();
+        }
+
+        QPainter painter(viewport());
+        painter.setRenderHint(QPainter::Antialiasing);
+        painter.translate(-horizontalScrollBar()->value(), -verticalScrollBar()->value());
+
+        QAbstractTextDocumentLayout* layout = document()->documentLayout();
+        qreal bottom = verticalScrollBar()->value() + event->rect().bottom();
+        QRectF bubble;
+        BubbleRole bubbleRole = BubbleRole::None;
+
+        // 只遍历可见范围内的段落，相邻且角色相同的段落合成一个气泡
+        for (; block.isValid(); block = block.next()) {
+            QRectF rect = layout->blockBoundingRect(block);
+            if (rect.top() > bottom) {
+                break;
+            }
+            BubbleRole current = blockRole(block);
+            if (current != bubbleRole) {
+                drawBubble(painter, bubble, bubbleRole);
+                bubble = QRectF();
+                bubbleRole = current;
+            }
+            if (current != BubbleRole::None) {
+                bubble = bubble.isNull() ? rect : bubble.united(rect);
+            }
+        }
+        drawBubble(painter, bubble, bubbleRole);
+    }
+
+    QTextEdit::paintEvent(event);
+}
+
+void ChatView::drawBubble(QPainter& painter, const QRectF& rect, BubbleRole role) const
+{
+    if (role == BubbleRole::None || rect.isNull()) {
+        return;
+    }
+
+    qreal margin = document()->documentMargin();
+    QRectF bubble(margin,
+                  rect.top() - kBubbleVerticalPadding,
+                  document()->size().width() - 2 * margin,
+                  rect.height() + 2 * kBubbleVerticalPadding);
+
+    painter.setPen(m_palette.bubbleBorder);
+    painter.setBrush(role == BubbleRole::User ? m_palette.userBubble : m_palette.aiBubble);
+    painter.drawRoundedRect(bubble, kBubbleRadius, kBubbleRadius);
+}
@@ -0,0 +1,64 @@
+#ifndef CHATVIEW_H
+#define CHATVIEW_H
+
+#include <QTextEdit>
+#include <QList>
+#include "themes/theme.h"
+
+/**
+ * @brief 聊天记录显示区域
+ *
+ * 消息的 HTML 与主题无关，只在段落格式中记录所属角色。气泡背景在绘制时按
+ * 当前调色板画出，切换主题只需要替换调色板并重绘可见区域，不需要重新生成文档。
+ */
+class ChatView : public QTextEdit
+{
+    Q_OBJECT
+
+public:
+    enum class BubbleRole {
+        None = 0,
+        User,
+        Assistant
+    };
+
+    struct MessageBlock {
+        BubbleRole role = BubbleRole::None;
+        QString headerHtml;  // 头像、发送者和时间
+        QString bodyHtml;    // 消息正文，绘制在气泡中
+        int index = -1;      // 消息在对话中的序号，不属于对话的消息为 -1
+    };
+
+    explicit ChatView(QWidget *parent = nullptr);
+    ~ChatView();
+
+    void setChatPalette(const ThemeManager::ChatPalette& palette);
+
+    // 在末尾追加一条消息，之后的流式内容通过 appendToMessage 写入这条消息
+    void appendMessage(const MessageBlock& message);
+    void appendToMessage(const QString& html);
+    void closeMessage();
+    // 在开头插入一批较早的消息，顺序与显示顺序相同
+    void prependMessages(const QList<MessageBlock>& messages);
+    // 删除序号 index 之前的所有消息，向下翻阅时限制文档大小
+    void removeMessagesBefore(int index);
+    // 删除序号 index 及之后的所有消息，有正在输出的消息时不删除
+    void removeMessagesFrom(int index);
+    void clearMessages();
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+
+private:
+    int insertMessage(QTextCursor& cursor, const MessageBlock& message);
+    void markBlocks(int from, int to, BubbleRole role);
+    static BubbleRole blockRole(const QTextBlock& block);
+    QTextBlock findMessage(int index) const;
+    void drawBubble(QPainter& painter, const QRectF& rect, BubbleRole role) const;
+
+    ThemeManager::ChatPalette m_palette;
+    int m_openBodyStart;
+    BubbleRole m_openRole;
+};
+
+#endif // CHATVIEW_H
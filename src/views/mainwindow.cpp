@@ -4,23 +4,47 @@
 #include <QDateTime>
 #include <QScrollBar>
 #include <QActionGroup>
+#include <QUrl>
 #include "../utils/markdownparser.h"
 #include "models/chatmodel.h"
+#include "models/messagepagecache.h"
 #include "models/imagemodel.h"
 #include "models/settingsmodel.h"
 #include "viewmodels/chatviewmodel.h"
 #include "viewmodels/settingsviewmodel.h"
 #include "services/logger.h"
+#include "services/tracer.h"
 #include "views/settingsdialog.h"
+#include "views/stalldialog.h"
 #include <QDir>
 #include <QFileInfo>
 #include "themes/theme.h"
 
+namespace {
+// 打开对话时只加载最近的消息
+const int kInitialMessageWindow = 50;
+const int kHistoryMenuLimit = 20;
+// 滚动到距顶部不足该距离时加载更早的消息，距底部不足时重新显示被移除的较新消息
+const int kHistoryScrollThreshold = 40;
+// 聊天区域最多保留的消息数（4 页），超出后删除离可见区域最远的一端
+const int kMaxRenderedMessages = 256;
+// 聊天记录中图片的显示宽度（逻辑像素）
+const int kImageDisplayWidth = 300;
+}
+
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
     , m_chatModel(nullptr)
     , m_imageModel(nullptr)
     , m_settingsModel(nullptr)
+    , m_conversationStore(nullptr)
+    , m_autoSaveEngine(nullptr)
+    , m_searchIndex(nullptr)
+    , m_transfer(nullptr)
+    , m_transferProgress(nullptr)
+    , m_imagePipeline(nullptr)
+    , m_attachmentStore(nullptr)
+    , m_stallWatchdog(nullptr)
     , m_chatViewModel(nullptr)
     , m_settingsViewModel(nullptr)
     , m_centralWidget(nullptr)
@@ -32,18 +56,27 @@ MainWindow::MainWindow(QWidget *parent)
     , m_imageButton(nullptr)
     , m_modelSelector(nullptr)
     , m_statusLabel(nullptr)
+    , m_showingPrefill(false)
+    , m_loadingImages(0)
     , m_isGenerating(false)
     , m_isUpdating(false)
     , m_settingsAction(nullptr)
     , m_saveChatAction(nullptr)
     , m_loadChatAction(nullptr)
+    , m_newChatAction(nullptr)
+    , m_searchAction(nullptr)
     , m_aboutAction(nullptr)
+    , m_historyMenu(nullptr)
+    , m_searchDialog(nullptr)
     , m_deepThinkingButton(nullptr)
     , m_isDeepThinking(false)
+    , m_renderedFirst(0)
+    , m_renderedEnd(-1)
     , m_themeMenu(nullptr)
     , m_lightThemeAction(nullptr)
     , m_darkThemeAction(nullptr)
     , m_systemThemeAction(nullptr)
+    , m_firstFrameShown(false)
 {
     try {
         LOG_INFO("开始初始化主窗口...");
@@ -62,6 +95,14 @@ MainWindow::MainWindow(QWidget *parent)
             if (!m_settingsModel) {
                 throw std::runtime_error("无法获取 SettingsModel 实例");
             }
+            m_conversationStore = new ConversationStore(QString(), this);
+            m_autoSaveEngine = new AutoSaveEngine(m_chatModel, m_settingsModel, this);
+            m_searchIndex = new SearchIndex(QString(), this);
+            m_transfer = new ConversationTransfer(this);
+            m_imagePipeline = new ImagePipeline(this);
+            m_attachmentStore = new AttachmentStore(QString(), this);
+            m_imagePipeline->setAttachmentStore(m_attachmentStore);
+            m_stallWatchdog = new StallWatchdog(this);
             LOG_INFO("模型初始化完成");
         } catch (const std::exception& e) {
             LOG_ERROR("模型初始化失败: " + QString(e.what()));
@@ -74,6 +115,7 @@ MainWindow::MainWindow(QWidget *parent)
             if (!m_chatViewModel) {
                 throw std::runtime_error("无法创建 ChatViewModel");
             }
+            m_chatViewModel->setAttachmentStore(m_attachmentStore);
             m_settingsViewModel = new SettingsViewModel(m_settingsModel, this);
             if (!m_settingsViewModel) {
                 throw std::runtime_error("无法创建 SettingsViewModel");
@@ -129,14 +171,12 @@ MainWindow::MainWindow(QWidget *parent)
             throw;
         }
 
-        // 加载设置
-        try {
-            loadSettings();
-            LOG_INFO("设置和模型选择器初始化完成");
-        } catch (const std::exception& e) {
-            LOG_ERROR("设置加载失败: " + QString(e.what()));
-            throw;
-        }
+        // 恢复上次的对话
+        restoreLastConversation();
+
+        // 模型列表和服务不影响首帧，等窗口显示后再准备
+        connect(this, &MainWindow::firstFrameShown,
+                this, &MainWindow::startDeferredInit, Qt::QueuedConnection);
 
         // 连接日志信号
         connect(&Logger::instance(), &Logger::logMessage,
@@ -166,6 +206,45 @@ MainWindow::MainWindow(QWidget *parent)
     }
 }
 
+bool MainWindow::event(QEvent* event)
+{
+    // 顶层窗口在处理 UpdateRequest 时绘制并提交到屏幕
+    bool result = QMainWindow::event(event);
+    if (!m_firstFrameShown && event->type() == QEvent::UpdateRequest) {
+        m_firstFrameShown = true;
+        emit firstFrameShown();
+    }
+    return result;
+}
+
+void MainWindow::startDeferredInit()
+{
+    TRACE_SCOPE("MainWindow::startDeferredInit");
+
+    // Ollama 发现在子进程中进行，与下面的工作同时进行
+    m_settingsModel->refreshOllamaModels();
+
+    // 模型配置是快照中最大的分区，窗口显示后再取出，之后模型列表和服务都从中读取
+    m_settingsModel->ensureModelsLoaded();
+
+    // 加载设置
+    try {
+        loadSettings();
+        LOG_INFO("设置和模型选择器初始化完成");
+    } catch (const std::exception& e) {
+        LOG_ERROR("设置加载失败: " + QString(e.what()));
+    }
+
+    // 在后台补齐其他对话的搜索索引
+    QStringList otherConversations;
+    for (const ConversationStore::ConversationInfo& info : m_conversationStore->listConversations()) {
+        if (info.id != m_conversationStore->currentConversationId()) {
+            otherConversations.append(info.id);
+        }
+    }
+    m_searchIndex->syncConversations(m_conversationStore->rootPath(), otherConversations);
+}
+
 MainWindow::~MainWindow()
 {
     LOG_INFO("正在关闭主窗口...");
@@ -173,6 +252,21 @@ MainWindow::~MainWindow()
     // 保存设置
     LOG_INFO("正在保存设置...");
     saveSettings();
+
+    // 中止未完成的导出或导入
+    delete m_transfer;
+    m_transfer = nullptr;
+
+    // 写完尚未保存的变化，再关闭当前对话
+    if (m_autoSaveEngine) {
+        m_autoSaveEngine->flushAndWait();
+    }
+    if (m_searchIndex) {
+        m_searchIndex->flushAndWait();
+    }
+    if (m_conversationStore) {
+        m_conversationStore->closeConversation();
+    }
     
     // 清理服务
     if (m_chatViewModel) {
@@ -192,6 +286,7 @@ MainWindow::~MainWindow()
 
 void MainWindow::setupUI()
 {
+    TRACE_SCOPE("MainWindow::setupUI");
     // 创建中央部件
     m_centralWidget = new QWidget(this);
     setCentralWidget(m_centralWidget);
@@ -221,160 +316,14 @@ void MainWindow::setupUI()
     m_mainLayout->addLayout(topLayout);
 
     // 聊天显示区域 - 使用现代化样式
-    m_chatDisplay = new QTextEdit(this);
+    m_chatDisplay = new ChatView(this);
     m_chatDisplay->setObjectName("chatDisplay"); // 设置对象名称以匹配主题样式
     m_chatDisplay->setReadOnly(true);
     m_chatDisplay->setMinimumHeight(500);  // 增加聊天区域高度
     
-    // 从主题文件中加载聊天气泡样式
-    QString chatBubblesStyle;
-    QString appDir = QCoreApplication::applicationDirPath();
-    QString bubblePath = QDir(appDir).absoluteFilePath("themes/chat_bubbles.css");
-    
-    QFile bubbleFile(bubblePath);
-    if (bubbleFile.open(QFile::ReadOnly | QFile::Text)) {
-        chatBubblesStyle = QString::fromUtf8(bubbleFile.readAll());
-        bubbleFile.close();
-        LOG_INFO(QString("成功加载聊天气泡样式: %1").arg(bubblePath));
-    } else {
-        LOG_WARNING(QString("无法打开聊天气泡样式文件: %1, 错误: %2")
-            .arg(bubblePath)
-            .arg(bubbleFile.errorString()));
-        
-        // 使用默认样式
-        chatBubblesStyle = 
-            "@keyframes fadeIn {"
-            "  from { opacity: 0; transform: translateY(10px); }"
-            "  to { opacity: 1; transform: translateY(0); }"
-            "}"
-            ".message-container {"
-            "  display: flex;"
-            "  align-items: flex-start;"
-            "  margin-bottom: 12px;"
-            "  animation: fadeIn 0.3s ease-in-out;"
-            "  clear: both;"
-            "}"
-            ".avatar {"
-            "  width: 36px;"
-            "  height: 36px;"
-            "  margin-right: 10px;"
-            "  flex-shrink: 0;"
-            "  border-radius: 18px;"
-            "  text-align: center;"
-            "  line-height: 36px;"
-            "  font-weight: bold;"
-            "  color: white;"
-            "}"
-            ".user-avatar { background-color: #2979FF; }"
-            ".ai-avatar { background-color: #00BFA5; }"
-            ".message-content {"
-            "  flex-grow: 1;"
-            "  max-width: calc(100% - 46px);"
-            "}"
-            ".sender-info {"
-            "  font-weight: bold;"
-            "  margin-bottom: 2px;"
-            "}"
-            ".timestamp {"
-            "  color: #888;"
-            "  font-weight: normal;"
-            "  font-size: 0.8em;"
-            "}"
-            ".user-bubble-light {"
-            "  background-color: #e1f3fb;"
-            "  color: #000000;"
-            "  border-radius: 10px;"
-            "  padding: 10px;"
-            "  margin: 5px 0;"
-            "  display: inline-block;"
-            "  max-width: 100%;"
-            "  word-wrap: break-word;"
-            "  box-shadow: 0 1px 2px rgba(0,0,0,0.1);"
-            "}"
-            ".ai-bubble-light {"
-            "  background-color: #f0f0f0;"
-            "  color: #000000;"
-            "  border-radius: 10px;"
-            "  padding: 10px;"
-            "  margin: 5px 0;"
-            "  display: inline-block;"
-            "  max-width: 100%;"
-            "  word-wrap: break-word;"
-            "  box-shadow: 0 1px 2px rgba(0,0,0,0.1);"
-            "}"
-            ".user-bubble-dark {"
-            "  background-color: #2C4F70;"
-            "  color: #FFFFFF;"
-            "  border-radius: 10px;"
-            "  padding: 10px;"
-            "  margin: 5px 0;"
-            "  display: inline-block;"
-            "  max-width: 100%;"
-            "  word-wrap: break-word;"
-            "  box-shadow: 0 1px 2px rgba(0,0,0,0.3);"
-            "}"
-            ".ai-bubble-dark {"
-            "  background-color: #383838;"
-            "  color: #FFFFFF;"
-            "  border-radius: 10px;"
-            "  padding: 10px;"
-            "  margin: 5px 0;"
-            "  display: inline-block;"
-            "  max-width: 100%;"
-            "  word-wrap: break-word;"
-            "  box-shadow: 0 1px 2px rgba(0,0,0,0.3);"
-            "}"
-            ".markdown-content h1 {"
-            "  font-size: 1.5em;"
-            "  margin: 0.5em 0;"
-            "  border-bottom: 1px solid #ddd;"
-            "  padding-bottom: 0.3em;"
-            "}"
-            ".markdown-content h2 {"
-            "  font-size: 1.3em;"
-            "  margin: 0.5em 0;"
-            "}"
-            ".markdown-content h3 {"
-            "  font-size: 1.1em;"
-            "  margin: 0.5em 0;"
-            "}"
-            ".markdown-content ul, .markdown-content ol {"
-            "  padding-left: 1.5em;"
-            "  margin: 0.5em 0;"
-            "}"
-            ".markdown-content li {"
-            "  margin: 0.2em 0;"
-            "}"
-            ".markdown-content code {"
-            "  background-color: rgba(0, 0, 0, 0.1);"
-            "  padding: 0.2em 0.4em;"
-            "  border-radius: 3px;"
-            "  font-family: monospace;"
-            "}"
-            ".markdown-content pre {"
-            "  background-color: rgba(0, 0, 0, 0.1);"
-            "  padding: 0.5em;"
-            "  border-radius: 5px;"
-            "  overflow-x: auto;"
-            "  margin: 0.5em 0;"
-            "}"
-            ".markdown-content pre code {"
-            "  background-color: transparent;"
-            "  padding: 0;"
-            "}"
-            ".markdown-content blockquote {"
-            "  border-left: 4px solid #ccc;"
-            "  padding-left: 1em;"
-            "  margin: 0.5em 0;"
-            "  color: #777;"
-            "}"
-            ".markdown-content p {"
-            "  margin: 0.5em 0;"
-            "}";
-    }
-    
-    // 设置样式表
-    m_chatDisplay->document()->setDefaultStyleSheet(chatBubblesStyle);
+    // 文档样式与主题无关，气泡颜色在绘制时取自当前主题
+    m_chatDisplay->document()->setDefaultStyleSheet(ThemeManager::instance().chatStyleSheet());
+    m_chatDisplay->setChatPalette(ThemeManager::instance().chatPalette());
     
     // 设置文档背景和间距
     m_chatDisplay->document()->setDocumentMargin(10);
@@ -445,8 +394,14 @@ void MainWindow::setupMenu()
 
     // 文件菜单
     QMenu* fileMenu = menuBar->addMenu(this->tr("文件"));
-    m_saveChatAction = fileMenu->addAction(this->tr("保存对话"));
-    m_loadChatAction = fileMenu->addAction(this->tr("加载对话"));
+    m_newChatAction = fileMenu->addAction(this->tr("新建对话"));
+    m_historyMenu = fileMenu->addMenu(this->tr("历史对话"));
+    connect(m_historyMenu, &QMenu::aboutToShow, this, &MainWindow::populateHistoryMenu);
+    m_searchAction = fileMenu->addAction(this->tr("搜索对话"));
+    m_searchAction->setShortcut(QKeySequence::Find);
+    fileMenu->addSeparator();
+    m_saveChatAction = fileMenu->addAction(this->tr("导出对话..."));
+    m_loadChatAction = fileMenu->addAction(this->tr("导入对话..."));
     fileMenu->addSeparator();
     fileMenu->addAction(this->tr("退出"), this, &QWidget::close);
 
@@ -484,6 +439,13 @@ void MainWindow::setupMenu()
 
     // 帮助菜单
     QMenu* helpMenu = menuBar->addMenu(this->tr("帮助"));
+    // 性能跟踪可以随时开始，停止时保存为 Chrome trace 文件
+    QAction* traceAction = helpMenu->addAction(this->tr("记录性能跟踪"));
+    traceAction->setCheckable(true);
+    traceAction->setChecked(Tracer::instance().isEnabled());
+    connect(traceAction, &QAction::toggled, this, &MainWindow::onTraceToggled);
+    helpMenu->addAction(this->tr("界面卡顿统计..."), this, &MainWindow::onOpenStallStats);
+    helpMenu->addSeparator();
     m_aboutAction = helpMenu->addAction(this->tr("关于"));
 
     // 设置当前主题的选中状态
@@ -492,8 +454,25 @@ void MainWindow::setupMenu()
 
 void MainWindow::setupStatusBar()
 {
-    // 移除状态栏
+    // 状态栏平时隐藏，有消息时显示，消息清除或超时后再隐藏。
+    // 自动保存的错误在下一次保存成功前一直保留，被其他消息替换后重新显示
     statusBar()->hide();
+    connect(statusBar(), &QStatusBar::messageChanged, this, [this](const QString& message) {
+        if (!message.isEmpty()) {
+            return;
+        }
+        if (!m_saveError.isEmpty()) {
+            statusBar()->showMessage(m_saveError);
+        } else {
+            statusBar()->hide();
+        }
+    });
+}
+
+void MainWindow::showStatusMessage(const QString& message, int timeout)
+{
+    statusBar()->show();
+    statusBar()->showMessage(message, timeout);
 }
 
 void MainWindow::setupConnections()
@@ -521,6 +500,8 @@ void MainWindow::setupConnections()
             this, &MainWindow::onGenerationFinished);
     connect(m_chatViewModel, &ChatViewModel::streamResponse,
             this, &MainWindow::onStreamResponse);
+    connect(m_chatViewModel, &ChatViewModel::prefillProgress,
+            this, &MainWindow::onPrefillProgress);
 
     // 连接输入框回车信号
     connect(m_messageInput, &QLineEdit::returnPressed,
@@ -533,6 +514,10 @@ void MainWindow::setupConnections()
     // 连接菜单动作
     connect(m_settingsAction, &QAction::triggered,
             this, &MainWindow::onOpenSettings);
+    connect(m_newChatAction, &QAction::triggered,
+            this, &MainWindow::onNewConversation);
+    connect(m_searchAction, &QAction::triggered,
+            this, &MainWindow::onOpenSearch);
     connect(m_saveChatAction, &QAction::triggered,
             this, &MainWindow::onSaveChat);
     connect(m_loadChatAction, &QAction::triggered,
@@ -549,6 +534,55 @@ void MainWindow::setupConnections()
     connect(m_chatViewModel, &ChatViewModel::errorOccurred,
             this, &MainWindow::onError);
 
+    // 滚动到顶部时分页加载更早的消息
+    connect(m_chatDisplay->verticalScrollBar(), &QScrollBar::valueChanged,
+            this, &MainWindow::onChatScrolled);
+    connect(m_chatModel, &ChatModel::historyPageReady,
+            this, &MainWindow::onHistoryPageReady);
+
+    // 导出和导入在后台进行
+    connect(m_transfer, &ConversationTransfer::progress,
+            this, &MainWindow::onTransferProgress);
+    connect(m_transfer, &ConversationTransfer::finished,
+            this, &MainWindow::onTransferFinished);
+
+    // 图片在后台解码，完成后显示缩略图
+    connect(m_imagePipeline, &ImagePipeline::imageReady,
+            this, &MainWindow::onImageReady);
+    connect(m_imagePipeline, &ImagePipeline::imageFailed,
+            this, &MainWindow::onImageFailed);
+
+    // 删除对话后回收只被它引用的附件
+    connect(m_conversationStore, &ConversationStore::conversationRemoved,
+            m_attachmentStore, &AttachmentStore::releaseConversation);
+    // 删除对话后从搜索索引中去掉，查询结果的数量和上限不受影响
+    connect(m_conversationStore, &ConversationStore::conversationRemoved,
+            m_searchIndex, &SearchIndex::removeConversation);
+
+    // 已完成的消息加入搜索索引
+    auto indexMessage = [this](int index) {
+        ChatModel::Message message = m_chatModel->messageAt(index);
+        if (message.complete) {
+            m_searchIndex->addMessage(m_conversationStore->currentConversationId(), index, message.content);
+        }
+    };
+    connect(m_chatModel, &ChatModel::messageAdded, this, indexMessage);
+    connect(m_chatModel, &ChatModel::messageFinished, this, indexMessage);
+
+    // 自动保存失败时在状态栏持续提示，不打断对话，下一次保存成功后清除
+    connect(m_autoSaveEngine, &AutoSaveEngine::errorOccurred,
+            this, [this](const QString& error) {
+                m_saveError = error;
+                showStatusMessage(error);
+            });
+    connect(m_autoSaveEngine, &AutoSaveEngine::saved,
+            this, [this]() {
+                if (!m_saveError.isEmpty()) {
+                    m_saveError.clear();
+                    statusBar()->clearMessage();
+                }
+            });
+
     // 连接模型选择器信号
     connect(m_modelSelector, QOverload<int>::of(&QComboBox::currentIndexChanged),
             this, &MainWindow::onModelSelectionChanged);
@@ -562,9 +596,9 @@ void MainWindow::setupConnections()
 
 void MainWindow::loadSettings()
 {
-    // 加载设置
-    m_settingsModel->loadSettings();
-    LOG_INFO("设置加载完成");
+    TRACE_SCOPE("MainWindow::loadSettings");
+    // 设置在 SettingsModel 构造时已经加载，这里只刷新界面
+    updateModelList();
     
     // 立即创建服务
     QString currentModel = m_settingsModel->currentModelName();
@@ -682,34 +716,30 @@ void MainWindow::updateApiModelsForProvider(const QString& provider, const QStri
     
     LOG_INFO(QString("正在为提供商 %1 更新API模型列表").arg(provider));
     
-    // 获取提供商的配置
-    QJsonObject providerConfig = m_settingsModel->getProviderConfig("api", provider);
+    // 提供商和模型的配置都从索引中查找，不再逐个复制 JSON
+    const ModelRegistry& registry = m_settingsModel->modelRegistry();
+    const ModelRegistry::Provider* providerEntry = registry.provider(provider);
     
     // 检查提供商配置是否包含models字段
-    if (!providerConfig.contains("models")) {
+    if (!providerEntry || !providerEntry->config["models"].isObject()) {
         LOG_WARNING(QString("提供商 %1 配置中不包含models字段").arg(provider));
         return;
     }
     
     // 检查提供商是否配置了API Key
-    if (!providerConfig.contains("api_key") || providerConfig["api_key"].toString().isEmpty()) {
+    if (providerEntry->config["api_key"].toString().isEmpty()) {
         LOG_WARNING(QString("提供商 %1 未配置API Key").arg(provider));
         return;
     }
     
-    // 获取提供商的所有模型配置
-    QJsonObject modelsConfig = providerConfig["models"].toObject();
-    
     // 遍历传入的所有可用模型
     for (const QString& modelName : availableModels) {
         // 检查模型是否在配置中
-        if (modelsConfig.contains(modelName)) {
-            // 检查模型配置是否完整
-            bool isComplete = m_settingsModel->isModelConfigComplete("api", modelName);
-            QStringList missingItems;
-            if (!isComplete) {
-                missingItems = m_settingsModel->getMissingConfigItems("api", modelName);
-            }
+        if (registry.apiModel(provider, modelName)) {
+            // 同名模型按第一个提供商判断配置是否完整
+            const ModelRegistry::Model* model = registry.model("api", modelName);
+            bool isComplete = model->isComplete();
+            QStringList missingItems = model->currentMissingItems();
             
             // 获取模型显示名称并添加到选择器
             QString displayName = getModelDisplayName("api", modelName, provider);
@@ -923,9 +953,8 @@ void MainWindow::onModelSelectionChanged(int index)
 
 void MainWindow::saveSettings()
 {
-    // 保存设置
+    // 有变化的设置在后台写入，这里不等待
     m_settingsModel->saveSettings();
-    LOG_INFO("设置保存完成");
 }
 
 void MainWindow::applyMessageAnimation()
@@ -950,61 +979,387 @@ void MainWindow::onSendMessage()
         return;
     }
 
-    // 获取当前时间
-    QDateTime currentTime = QDateTime::currentDateTime();
-    QString timeStr = currentTime.toString("yyyy-MM-dd hh:mm:ss");
-    
-    // 将用户消息转换为HTML（支持Markdown语法）
-    QString htmlMessage = MarkdownParser::toHtml(message);
-    
-    // 获取气泡样式类名
-    QString userBubbleClass = ThemeManager::instance().getUserBubbleStyle();
-    
+    showLatestMessages();
+
+    // 之前选择的图片随这条消息一起发送，发送后流水线不再保留解码结果
+    const QList<ImagePipeline::ImageHandle> images = m_imageModel->takePendingImages();
+    updateInputPlaceholder();
+
     // 添加用户头像和气泡样式的消息，使用CSS类
-    m_chatDisplay->append(QString(
-        "<div class='message-container'>\n"
-        "  <div class='avatar user-avatar'>用</div>\n"
-        "  <div class='message-content'>\n"
-        "    <div class='sender-info'>用户 <span class='timestamp'>[%1]</span></div>\n"
-        "    <div class='%2 markdown-content'>%3</div>\n"
-        "  </div>\n"
-        "</div>")
-        .arg(timeStr)
-        .arg(userBubbleClass)
-        .arg(htmlMessage));
+    ChatModel::Message userMessage;
+    userMessage.role = "user";
+    userMessage.content = message;
+    userMessage.timestamp = QDateTime::currentDateTime();
+    for (const ImagePipeline::ImageHandle& image : images) {
+        if (!image->hash.isEmpty()) {
+            userMessage.attachments.append(image->hash);
+        }
+    }
+    int userIndex = m_chatModel->messageCount();
+    m_chatDisplay->appendMessage(messageBlock(userMessage, userIndex));
     
     // 应用消息动画
     applyMessageAnimation();
 
     m_messageInput->clear();
 
+    // 添加AI头像和气泡样式的初始响应，流式内容随后追加
+    ChatModel::Message aiMessage;
+    aiMessage.role = "assistant";
+    aiMessage.timestamp = QDateTime::currentDateTime();
+    m_chatDisplay->appendMessage(messageBlock(aiMessage, userIndex + 1));
+    
+    // 应用消息动画
+    applyMessageAnimation();
+
+    // 发送消息
+    QString conversationId = m_conversationStore->currentConversationId();
+    for (const ImagePipeline::ImageHandle& image : images) {
+        m_attachmentStore->addReference(image->hash, conversationId);
+    }
+    m_chatViewModel->sendMessage(message, images);
+    for (const ImagePipeline::ImageHandle& image : images) {
+        m_imagePipeline->release(image->id);
+    }
+}
+
+ChatView::MessageBlock MainWindow::messageBlock(const ChatModel::Message& message, int index) const
+{
+    bool isUser = message.role == "user";
+
     // 获取AI名称
     QString aiName = m_settingsModel->aiName();
     if (aiName.isEmpty()) {
         aiName = "皮蛋"; // 默认名称
     }
-    
-    // 获取AI气泡样式类名
-    QString aiBubbleClass = ThemeManager::instance().getAIBubbleStyle();
-    QDateTime aiResponseTime = QDateTime::currentDateTime();
-    QString aiTimeStr = aiResponseTime.toString("yyyy-MM-dd hh:mm:ss");
-    
-    // 添加AI头像和气泡样式的初始响应，使用CSS类
-    m_chatDisplay->append(QString(
-        "<div class='message-container'>\n"
-        "  <div class='avatar ai-avatar'>皮</div>\n"
-        "  <div class='message-content'>\n"
-        "    <div class='sender-info'>%1 <span class='timestamp'>[%2]</span></div>\n"
-        "    <div class='%3 markdown-content'>")
-        .arg(aiName)
-        .arg(aiTimeStr)
-        .arg(aiBubbleClass));
-    
-    // 应用消息动画
+
+    // 消息的 HTML 不包含主题相关的内容，气泡由聊天区域按角色绘制
+    ChatView::MessageBlock block;
+    block.role = isUser ? ChatView::BubbleRole::User : ChatView::BubbleRole::Assistant;
+    block.index = index;
+    block.headerHtml = QString(
+        "<div class='sender-info'>%1<span class='avatar %2'>&nbsp;%3&nbsp;</span> "
+        "%4 <span class='timestamp'>[%5]</span></div>")
+        .arg(index >= 0 ? QString("<a name='msg-%1'></a>").arg(index) : QString(),
+             isUser ? "user-avatar" : "ai-avatar",
+             isUser ? "用" : "皮",
+             isUser ? QString("用户") : aiName.toHtmlEscaped(),
+             message.timestamp.toString("yyyy-MM-dd hh:mm:ss"));
+
+    // 将消息转换为HTML（支持Markdown语法）
+    if (!message.content.isEmpty()) {
+        block.bodyHtml = QString("<div class='markdown-content'>%1</div>")
+            .arg(MarkdownParser::toHtml(message.content));
+    }
+
+    // 图片显示附件存储中的缩略图，文档被清空后再次显示时重新读取
+    const int thumbnailWidth = qRound(kImageDisplayWidth * devicePixelRatioF());
+    const QString variant = ImagePipeline::thumbnailVariant(thumbnailWidth);
+    for (const QString& hash : message.attachments) {
+        QUrl url(QString("attachment://%1/%2").arg(hash, variant));
+        QImage thumbnail = m_chatDisplay->document()->resource(QTextDocument::ImageResource, url).value<QImage>();
+        if (thumbnail.isNull() && m_attachmentStore) {
+            thumbnail.loadFromData(m_attachmentStore->derived(hash, variant), "PNG");
+            if (!thumbnail.isNull()) {
+                thumbnail.setDevicePixelRatio(devicePixelRatioF());
+                m_chatDisplay->document()->addResource(QTextDocument::ImageResource, url, thumbnail);
+            }
+        }
+        if (thumbnail.isNull()) {
+            block.bodyHtml += QString("<p>[图片]</p>");
+        } else {
+            block.bodyHtml += QString("<p><img src='%1' width='%2'/></p>")
+                .arg(url.toString())
+                .arg(qRound(thumbnail.width() / thumbnail.devicePixelRatio()));
+        }
+    }
+    return block;
+}
+
+void MainWindow::restoreLastConversation()
+{
+    TRACE_SCOPE("MainWindow::restoreLastConversation");
+    QString lastId = m_settingsModel->appStateValue("lastConversationId").toString();
+    if (m_conversationStore->hasConversation(lastId)) {
+        openConversation(lastId);
+    } else {
+        onNewConversation();
+    }
+}
+
+void MainWindow::openConversation(const QString& id)
+{
+    if (m_isGenerating) {
+        m_chatViewModel->cancelGeneration();
+    }
+
+    // 先写完上一个对话的变化
+    m_autoSaveEngine->flushAndWait();
+
+    if (!m_conversationStore->openConversation(id)) {
+        showError(tr("错误"), tr("无法打开对话: %1").arg(id));
+        return;
+    }
+
+    // 上次异常退出时正在输出的回答，保留已保存的部分并标记为完成
+    QSharedPointer<ConversationFile> file = m_conversationStore->current();
+    const QList<int> interrupted = file->recoverInterrupted();
+    m_autoSaveEngine->setConversation(file);
+    m_searchIndex->syncConversation(file);
+    m_chatViewModel->setConversationPath(file->path());
+
+    // 只读取最近一屏的消息，较早的消息留在磁盘上
+    int total = file->messageCount();
+    int first = qMax(0, total - kInitialMessageWindow);
+    QList<ChatModel::Message> recent = file->readMessages(first, total - first);
+    m_chatModel->loadHistory(recent, first, [file](int from, int count) {
+        return file->readMessages(from, count);
+    });
+    m_renderedFirst = first;
+    m_renderedEnd = -1;
+
+    m_chatDisplay->clearMessages();
+    m_chatDisplay->setExtraSelections(QList<QTextEdit::ExtraSelection>());
+    for (int i = 0; i < recent.size(); ++i) {
+        ChatModel::Message message = recent.at(i);
+        if (interrupted.contains(first + i)) {
+            message.content += tr("\n\n*（回答未完成，程序上次意外退出）*");
+        }
+        m_chatDisplay->appendMessage(messageBlock(message, first + i));
+    }
+    m_chatDisplay->closeMessage();
     applyMessageAnimation();
 
-    // 发送消息
-    m_chatViewModel->sendMessage(message);
+    m_settingsModel->setAppStateValue("lastConversationId", id);
+    LOG_INFO(QString("已打开对话 %1，共 %2 条消息，已加载 %3 条")
+        .arg(id)
+        .arg(total)
+        .arg(recent.size()));
+}
+
+void MainWindow::onChatScrolled(int value)
+{
+    QScrollBar* scrollBar = m_chatDisplay->verticalScrollBar();
+    if (m_renderedEnd >= 0 && scrollBar->maximum() - value <= kHistoryScrollThreshold) {
+        // 较新的消息已从文档中移除，向下翻阅时按页重新显示
+        int page = ChatModel::historyPageOf(m_renderedEnd);
+        if (m_chatModel->isLoaded(m_renderedEnd)) {
+            appendHistory(qMin(m_chatModel->messageCount(), m_chatModel->historyPageFirst(page + 1)));
+        } else {
+            m_chatModel->fetchHistoryPage(page);
+        }
+    }
+    if (m_renderedFirst <= 0 || value - scrollBar->minimum() > kHistoryScrollThreshold) {
+        return;
+    }
+    m_chatModel->fetchHistoryPage(ChatModel::historyPageOf(m_renderedFirst - 1));
+}
+
+void MainWindow::onHistoryPageReady(int page)
+{
+    QScrollBar* scrollBar = m_chatDisplay->verticalScrollBar();
+    if (m_renderedEnd >= 0 && page == ChatModel::historyPageOf(m_renderedEnd)) {
+        if (scrollBar->maximum() - scrollBar->value() <= kHistoryScrollThreshold) {
+            appendHistory(qMin(m_chatModel->messageCount(), m_chatModel->historyPageFirst(page + 1)));
+        }
+        return;
+    }
+
+    if (m_renderedFirst <= 0 || page != ChatModel::historyPageOf(m_renderedFirst - 1)) {
+        return;
+    }
+
+    // 用户已经离开顶部时只留在缓存中，下次滚动到顶部再显示
+    if (scrollBar->value() - scrollBar->minimum() > kHistoryScrollThreshold) {
+        return;
+    }
+
+    prependHistory(m_chatModel->historyPageFirst(page));
+
+    // 预取再上一页，滚动到顶部时可以直接显示
+    if (page > 0) {
+        m_chatModel->fetchHistoryPage(page - 1);
+    }
+}
+
+void MainWindow::prependHistory(int first)
+{
+    if (first >= m_renderedFirst) {
+        return;
+    }
+
+    QList<ChatView::MessageBlock> messages;
+    messages.reserve(m_renderedFirst - first);
+    for (int i = first; i < m_renderedFirst; ++i) {
+        messages.append(messageBlock(m_chatModel->messageAt(i), i));
+    }
+
+    // 插入到文档开头，并保持当前可见内容不跳动
+    QScrollBar* scrollBar = m_chatDisplay->verticalScrollBar();
+    int distanceFromBottom = scrollBar->maximum() - scrollBar->value();
+    m_chatDisplay->prependMessages(messages);
+    scrollBar->setValue(scrollBar->maximum() - distanceFromBottom);
+
+    LOG_DEBUG(QString("已显示历史消息 %1 - %2，缓存占用 %3 KB")
+        .arg(first)
+        .arg(m_renderedFirst - 1)
+        .arg(m_chatModel->historyCache()->memoryUsage() / 1024));
+    m_renderedFirst = first;
+    trimRenderedTail();
+}
+
+void MainWindow::appendHistory(int last)
+{
+    if (m_renderedEnd < 0 || last <= m_renderedEnd) {
+        return;
+    }
+
+    for (int i = m_renderedEnd; i < last; ++i) {
+        m_chatDisplay->appendMessage(messageBlock(m_chatModel->messageAt(i), i));
+    }
+    m_chatDisplay->closeMessage();
+    m_renderedEnd = last >= m_chatModel->messageCount() ? -1 : last;
+
+    // 超出窗口时删除开头的消息，并保持当前可见内容不跳动
+    int end = m_renderedEnd >= 0 ? m_renderedEnd : m_chatModel->messageCount();
+    if (end - m_renderedFirst > kMaxRenderedMessages) {
+        int first = end - kMaxRenderedMessages;
+        QScrollBar* scrollBar = m_chatDisplay->verticalScrollBar();
+        int distanceFromBottom = scrollBar->maximum() - scrollBar->value();
+        m_chatDisplay->removeMessagesBefore(first);
+        scrollBar->setValue(scrollBar->maximum() - distanceFromBottom);
+        m_renderedFirst = first;
+    }
+}
+
+void MainWindow::trimRenderedTail()
+{
+    // 正在输出的回答在末尾，这时不删除
+    if (m_isGenerating) {
+        return;
+    }
+    int end = m_renderedEnd >= 0 ? m_renderedEnd : m_chatModel->messageCount();
+    if (end - m_renderedFirst <= kMaxRenderedMessages) {
+        return;
+    }
+    // 删除的是可见区域下方的内容，滚动位置不变
+    m_renderedEnd = m_renderedFirst + kMaxRenderedMessages;
+    m_chatDisplay->removeMessagesFrom(m_renderedEnd);
+}
+
+void MainWindow::showLatestMessages()
+{
+    if (m_renderedEnd < 0) {
+        return;
+    }
+
+    // 较新的消息已被移除时，新消息之前重新显示最近的一段
+    int total = m_chatModel->messageCount();
+    renderMessages(qMax(0, total - kInitialMessageWindow), total);
+}
+
+void MainWindow::renderMessages(int first, int end)
+{
+    // 清空聊天区域，只显示 [first, end)，其余的消息由滚动按页补齐
+    m_chatDisplay->clearMessages();
+    m_chatDisplay->setExtraSelections(QList<QTextEdit::ExtraSelection>());
+    for (int i = first; i < end; ++i) {
+        m_chatDisplay->appendMessage(messageBlock(m_chatModel->messageAt(i), i));
+    }
+    m_chatDisplay->closeMessage();
+    m_renderedFirst = first;
+    m_renderedEnd = end >= m_chatModel->messageCount() ? -1 : end;
+}
+
+void MainWindow::onOpenSearch()
+{
+    if (!m_searchDialog) {
+        m_searchDialog = new SearchDialog(m_searchIndex, m_conversationStore, this);
+        connect(m_searchDialog, &SearchDialog::resultActivated,
+                this, &MainWindow::onSearchResultActivated);
+    }
+    m_searchDialog->show();
+    m_searchDialog->raise();
+    m_searchDialog->activateWindow();
+}
+
+void MainWindow::onSearchResultActivated(const QString& conversationId, int messageIndex, const QString& query)
+{
+    if (m_conversationStore->currentConversationId() != conversationId) {
+        openConversation(conversationId);
+        if (m_conversationStore->currentConversationId() != conversationId) {
+            return;
+        }
+    }
+
+    // 目标消息不在聊天区域中时，以它为中心重新显示一段，前后的消息随滚动按页载入
+    bool rendered = messageIndex >= m_renderedFirst && (m_renderedEnd < 0 || messageIndex < m_renderedEnd);
+    if (!rendered) {
+        if (m_isGenerating) {
+            // 正在输出的回答在文档末尾，这时不能清空重绘
+            showStatusMessage(tr("正在生成回答，完成后再打开该搜索结果"), 3000);
+            return;
+        }
+        int first = qMax(0, messageIndex - kInitialMessageWindow / 2);
+        renderMessages(first, qMin(m_chatModel->messageCount(), first + kInitialMessageWindow));
+    }
+
+    highlightSearchTerms(query);
+    m_chatDisplay->scrollToAnchor(QString("msg-%1").arg(messageIndex));
+}
+
+void MainWindow::highlightSearchTerms(const QString& query)
+{
+    const int maxHighlights = 1000;
+    QList<QTextEdit::ExtraSelection> selections;
+    const QStringList words = query.split(QRegularExpression("\\s+"), Qt::SkipEmptyParts);
+    QTextDocument* document = m_chatDisplay->document();
+
+    for (const QString& word : words) {
+        QTextCursor cursor = document->find(word);
+        while (!cursor.isNull() && selections.size() < maxHighlights) {
+            QTextEdit::ExtraSelection selection;
+            selection.cursor = cursor;
+            selection.format.setBackground(QColor(255, 213, 79, 160));
+            selections.append(selection);
+            cursor = document->find(word, cursor);
+        }
+    }
+    m_chatDisplay->setExtraSelections(selections);
+}
+
+void MainWindow::onNewConversation()
+{
+    QString id = m_conversationStore->createConversation();
+    if (!id.isEmpty()) {
+        openConversation(id);
+    }
+}
+
+void MainWindow::populateHistoryMenu()
+{
+    m_historyMenu->clear();
+
+    const QList<ConversationStore::ConversationInfo> conversations = m_conversationStore->listConversations();
+    QString currentId = m_conversationStore->currentConversationId();
+    int shown = 0;
+    for (const ConversationStore::ConversationInfo& info : conversations) {
+        if (shown++ >= kHistoryMenuLimit) {
+            break;
+        }
+        QString title = info.title.isEmpty() ? tr("未命名对话") : info.title;
+        QAction* action = m_historyMenu->addAction(QString("%1  (%2)")
+            .arg(title, info.updated.toString("MM-dd hh:mm")));
+        action->setCheckable(true);
+        action->setChecked(info.id == currentId);
+        connect(action, &QAction::triggered, this, [this, id = info.id]() {
+            openConversation(id);
+        });
+    }
+
+    if (conversations.isEmpty()) {
+        m_historyMenu->addAction(tr("暂无历史对话"))->setEnabled(false);
+    }
 }
 
 void MainWindow::onGenerationStarted()
@@ -1012,13 +1367,32 @@ void MainWindow::onGenerationStarted()
     updateSendButton(true);
 }
 
+void MainWindow::onPrefillProgress(int done, int total, double tokensPerSecond)
+{
+    // 只在计算较长的提示词时显示进度
+    if (!m_isGenerating || done >= total) {
+        if (m_showingPrefill) {
+            m_showingPrefill = false;
+            statusBar()->clearMessage();
+        }
+        return;
+    }
+    m_showingPrefill = true;
+    showStatusMessage(tr("正在处理提示词: %1 / %2 token，%3 token/s")
+        .arg(done).arg(total).arg(tokensPerSecond, 0, 'f', 1));
+}
+
 void MainWindow::onGenerationFinished()
 {
     updateSendButton(false);
+    // 取消时提示词可能还没算完
+    if (m_showingPrefill) {
+        m_showingPrefill = false;
+        statusBar()->clearMessage();
+    }
     
-    // 完成当前响应，关闭HTML标签
-    m_chatDisplay->moveCursor(QTextCursor::End);
-    m_chatDisplay->insertHtml("</div>\n  </div>\n</div>");
+    // 完成当前响应，之后的内容不再属于这条消息
+    m_chatDisplay->closeMessage();
     
     // 应用消息动画
     applyMessageAnimation();
@@ -1031,6 +1405,7 @@ void MainWindow::onGenerationFinished()
 
 void MainWindow::onStreamResponse(const QString& partialResponse)
 {
+    TRACE_SCOPE_CAT("MainWindow::onStreamResponse", "render");
     // 对于流式响应，我们使用简化的Markdown解析
     QString processedResponse = partialResponse.toHtmlEscaped().replace("\n", "<br>");
     
@@ -1064,7 +1439,7 @@ void MainWindow::onStreamResponse(const QString& partialResponse)
         processedResponse.replace(match.captured(0), htmlText);
     }
     
-    m_chatDisplay->insertHtml(processedResponse);
+    m_chatDisplay->appendToMessage(processedResponse);
     
     // 保持滚动到底部
     m_chatDisplay->verticalScrollBar()->setValue(
@@ -1087,8 +1462,11 @@ void MainWindow::updateSendButton(bool isGenerating)
 
 void MainWindow::onClearChat()
 {
-    // 清空聊天显示区域
-    m_chatDisplay->clear();
+    // 清空聊天显示区域，不再向上加载历史
+    m_chatDisplay->clearMessages();
+    m_chatDisplay->setExtraSelections(QList<QTextEdit::ExtraSelection>());
+    m_renderedFirst = 0;
+    m_renderedEnd = -1;
     LOG_INFO("聊天记录已清除");
 }
 
@@ -1140,52 +1518,154 @@ void MainWindow::onOpenSettings()
 
 void MainWindow::onSaveChat()
 {
-    // 获取保存文件的路径
+    QSharedPointer<ConversationFile> conversation = m_conversationStore->current();
+    if (!conversation) {
+        showError(tr("导出失败"), tr("当前没有打开的对话"));
+        return;
+    }
+    if (m_transfer->isRunning()) {
+        showTransferBusy();
+        return;
+    }
+
+    // 获取导出文件的路径，格式由扩展名决定
+    QString selectedFilter;
     QString filePath = QFileDialog::getSaveFileName(this,
-        tr("保存聊天记录"),
+        tr("导出对话"),
         QDir::homePath(),
-        tr("文本文件 (*.txt);;所有文件 (*.*)"));
+        tr("JSON Lines (*.jsonl);;Markdown (*.md);;HTML (*.html)"),
+        &selectedFilter);
 
     if (filePath.isEmpty()) {
         return;
     }
-
-    // 打开文件并保存聊天内容
-    QFile file(filePath);
-    if (file.open(QIODevice::WriteOnly | QIODevice::Text)) {
-        QTextStream out(&file);
-        out << m_chatDisplay->toPlainText();
-        file.close();
-        LOG_INFO(QString("聊天记录已保存到: %1").arg(filePath));
-    } else {
-        showError(tr("保存失败"), tr("无法保存聊天记录到文件"));
+    if (QFileInfo(filePath).suffix().isEmpty()) {
+        filePath += selectedFilter.contains("*.md") ? ".md"
+                  : selectedFilter.contains("*.html") ? ".html" : ".jsonl";
     }
+
+    // 导出读取的是磁盘上的对话，先写完尚未保存的变化
+    m_autoSaveEngine->flushAndWait();
+
+    QString aiName = m_settingsModel->aiName().isEmpty() ? QString("皮蛋") : m_settingsModel->aiName();
+    m_transfer->exportConversation(conversation, filePath,
+                                   ConversationTransfer::formatForPath(filePath), aiName);
+    showTransferProgress(tr("正在导出对话..."));
 }
 
 void MainWindow::onLoadChat()
 {
-    // 获取要加载的文件路径
+    if (m_transfer->isRunning()) {
+        showTransferBusy();
+        return;
+    }
+
+    // 获取要导入的文件路径
     QString filePath = QFileDialog::getOpenFileName(this,
-        tr("加载聊天记录"),
+        tr("导入对话"),
         QDir::homePath(),
-        tr("文本文件 (*.txt);;所有文件 (*.*)"));
+        tr("JSON Lines (*.jsonl);;所有文件 (*.*)"));
 
     if (filePath.isEmpty()) {
         return;
     }
 
-    // 打开文件并读取内容
-    QFile file(filePath);
-    if (file.open(QIODevice::ReadOnly | QIODevice::Text)) {
-        QTextStream in(&file);
-        m_chatDisplay->setPlainText(in.readAll());
-        file.close();
-        LOG_INFO(QString("已加载聊天记录: %1").arg(filePath));
-    } else {
-        showError(tr("加载失败"), tr("无法从文件加载聊天记录"));
+    // 导入到新的对话中，完成后再打开
+    m_importConversationId = m_conversationStore->createConversation();
+    if (m_importConversationId.isEmpty()) {
+        showError(tr("导入失败"), tr("无法创建对话"));
+        return;
+    }
+
+    m_transfer->importConversation(filePath, m_conversationStore->conversationPath(m_importConversationId));
+    showTransferProgress(tr("正在导入对话..."));
+}
+
+void MainWindow::showTransferProgress(const QString& label)
+{
+    if (!m_transferProgress) {
+        m_transferProgress = new QProgressDialog(this);
+        m_transferProgress->setWindowModality(Qt::NonModal);
+        m_transferProgress->setRange(0, 1000);
+        m_transferProgress->setMinimumDuration(500);
+        m_transferProgress->setAutoClose(false);
+        m_transferProgress->setAutoReset(false);
+        connect(m_transferProgress, &QProgressDialog::canceled,
+                m_transfer, &ConversationTransfer::cancel);
+    }
+    m_transferProgress->setLabelText(label);
+    m_transferProgress->setValue(0);
+}
+
+void MainWindow::showTransferBusy()
+{
+    // 进度对话框在最短显示时间之前可能还没出现，直接把它显示到前面
+    if (m_transferProgress) {
+        m_transferProgress->show();
+        m_transferProgress->raise();
+        m_transferProgress->activateWindow();
+    }
+    showStatusMessage(tr("正在导出或导入对话，请稍候"), 3000);
+}
+
+void MainWindow::onTransferProgress(qint64 done, qint64 total)
+{
+    if (m_transferProgress && total > 0) {
+        m_transferProgress->setValue(int(done * 1000 / total));
+    }
+}
+
+void MainWindow::onTransferFinished(bool ok, const QString& message)
+{
+    if (m_transferProgress) {
+        m_transferProgress->reset();
+        m_transferProgress->hide();
+    }
+
+    QString importedId = m_importConversationId;
+    m_importConversationId.clear();
+
+    if (!ok) {
+        // 导入失败或取消时不保留不完整的对话
+        if (!importedId.isEmpty()) {
+            m_conversationStore->removeConversation(importedId);
+        }
+        showError(tr("错误"), message);
+        return;
+    }
+
+    showStatusMessage(message, 5000);
+    if (!importedId.isEmpty()) {
+        openConversation(importedId);
     }
 }
 
+void MainWindow::onTraceToggled(bool checked)
+{
+    Tracer& tracer = Tracer::instance();
+    if (checked) {
+        tracer.start();
+        return;
+    }
+
+    tracer.stop();
+    QString path = QFileDialog::getSaveFileName(this, tr("保存性能跟踪"),
+        QDir::home().filePath("chatdot-trace.json"), tr("Chrome trace (*.json)"));
+    if (path.isEmpty()) {
+        return;
+    }
+    if (!tracer.writeTo(path)) {
+        showError(tr("错误"), tr("无法保存性能跟踪: %1").arg(path));
+    }
+}
+
+void MainWindow::onOpenStallStats()
+{
+    StallDialog* dialog = new StallDialog(m_stallWatchdog, this);
+    dialog->setAttribute(Qt::WA_DeleteOnClose);
+    dialog->show();
+}
+
 void MainWindow::onAbout()
 {
     // 显示关于对话框
@@ -1263,19 +1743,43 @@ void MainWindow::selectImage()
         return;
     }
 
-    // 加载图片
-    QImage image(filePath);
-    if (image.isNull()) {
-        showError(tr("错误"), tr("无法加载图片"));
-        return;
-    }
+    // 解码和生成缩略图在后台进行，界面线程不接触原图
+    m_imagePipeline->load(filePath, kImageDisplayWidth, devicePixelRatioF());
+    ++m_loadingImages;
+    updateInputPlaceholder();
+    LOG_INFO(QString("已选择图片: %1").arg(filePath));
+}
 
-    // 将图片添加到聊天显示区域
-    m_chatDisplay->append(tr("<p><b>用户:</b> [图片]</p>"));
-    m_chatDisplay->append(tr("<p><img src='%1' width='300'/></p>").arg(filePath));
+void MainWindow::onImageReady(const QString& id, const QImage& thumbnail)
+{
+    m_loadingImages = qMax(0, m_loadingImages - 1);
+    Q_UNUSED(thumbnail);
 
-    // 处理图片（这里可以添加图片处理逻辑）
-    LOG_INFO(QString("已选择图片: %1").arg(filePath));
+    // 上传使用同一份解码结果，图片保存在下一条用户消息中，随消息一起显示和发送
+    m_imageModel->uploadImage(m_imagePipeline->image(id));
+    updateInputPlaceholder();
+}
+
+void MainWindow::onImageFailed(const QString& id, const QString& error)
+{
+    Q_UNUSED(id);
+    m_loadingImages = qMax(0, m_loadingImages - 1);
+    updateInputPlaceholder();
+    showError(tr("错误"), error);
+}
+
+void MainWindow::updateInputPlaceholder()
+{
+    // 图片在后台解码，输入框的提示文字说明还有图片没有载入完，
+    // 或者已有图片等着随下一条消息发送
+    const int pending = m_imageModel->pendingImageCount();
+    if (m_loadingImages > 0) {
+        m_messageInput->setPlaceholderText(tr("正在载入图片..."));
+    } else if (pending > 0) {
+        m_messageInput->setPlaceholderText(tr("已添加 %1 张图片，将随下一条消息发送").arg(pending));
+    } else {
+        m_messageInput->setPlaceholderText(tr("输入消息..."));
+    }
 }
 
 void MainWindow::showError(const QString& title, const QString& message)
@@ -1311,6 +1815,8 @@ void MainWindow::createThemeMenu()
 void MainWindow::onThemeChanged(ThemeManager::Theme theme)
 {
     updateThemeActions();
+    // 只替换气泡颜色并重绘可见区域，不重新生成聊天记录
+    m_chatDisplay->setChatPalette(ThemeManager::instance().chatPalette());
 }
 
 void MainWindow::setLightTheme()
@@ -17,6 +17,7 @@
 #include <QGraphicsOpacityEffect>
 #include <QMenuBar>
 #include <QStatusBar>
+#include <QProgressDialog>
 #include "themes/theme.h"
 #include "models/chatmodel.h"
 #include "models/imagemodel.h"
@@ -24,7 +25,16 @@
 #include "viewmodels/chatviewmodel.h"
 #include "viewmodels/settingsviewmodel.h"
 #include "services/logger.h"
+#include "services/conversationstore.h"
+#include "services/autosaveengine.h"
+#include "services/searchindex.h"
+#include "services/conversationtransfer.h"
+#include "services/imagepipeline.h"
+#include "services/attachmentstore.h"
 #include "views/settingsdialog.h"
+#include "views/searchdialog.h"
+#include "services/stallwatchdog.h"
+#include "views/chatview.h"
 #include "themes/theme.h"
 
 class MainWindow : public QMainWindow
@@ -35,12 +45,33 @@ public:
     explicit MainWindow(QWidget *parent = nullptr);
     ~MainWindow();
 
+signals:
+    // 第一帧绘制完成后发出一次
+    void firstFrameShown();
+
+protected:
+    bool event(QEvent* event) override;
+
 private slots:
+    // 首帧之后再做的初始化：Ollama 发现、模型列表、服务创建和索引补齐
+    void startDeferredInit();
     void onSendMessage();
     void onClearChat();
     void onOpenSettings();
     void onSaveChat();
     void onLoadChat();
+    void onNewConversation();
+    void populateHistoryMenu();
+    void onChatScrolled(int value);
+    void onHistoryPageReady(int page);
+    void onOpenSearch();
+    void onSearchResultActivated(const QString& conversationId, int messageIndex, const QString& query);
+    void onTransferProgress(qint64 done, qint64 total);
+    void onTransferFinished(bool ok, const QString& message);
+    void onImageReady(const QString& id, const QImage& thumbnail);
+    void onImageFailed(const QString& id, const QString& error);
+    void onTraceToggled(bool checked);
+    void onOpenStallStats();
     void onAbout();
     void onError(const QString& error);
     void onLogMessage(Logger::Level level, const QString& message);
@@ -49,6 +80,7 @@ private slots:
     void onGenerationStarted();
     void onGenerationFinished();
     void onStreamResponse(const QString& partialResponse);
+    void onPrefillProgress(int done, int total, double tokensPerSecond);
     void onDeepThinkingToggled(bool checked);
     void createThemeMenu();
     void onThemeChanged(ThemeManager::Theme theme);
@@ -65,13 +97,30 @@ private:
     void saveSettings();
     void updateStatusBar();
     void selectImage();
+    void updateInputPlaceholder();
     void showError(const QString& title, const QString& message);
+    // 显示状态栏并提示 message，timeout 为 0 时一直显示到被清除或替换
+    void showStatusMessage(const QString& message, int timeout = 0);
     void refreshModelList();
     void updateSendButton(bool isGenerating);
     
     // 消息动画相关方法
     void applyMessageAnimation();
 
+    // 对话相关方法
+    void openConversation(const QString& id);
+    void restoreLastConversation();
+    ChatView::MessageBlock messageBlock(const ChatModel::Message& message, int index = -1) const;
+    void prependHistory(int first);
+    void appendHistory(int last);
+    void trimRenderedTail();
+    void showLatestMessages();
+    void renderMessages(int first, int end);
+    void showTransferProgress(const QString& label);
+    // 导出或导入进行中再次点击时的提示
+    void showTransferBusy();
+    void highlightSearchTerms(const QString& query);
+
     // 模型列表更新相关方法
     void updateApiModelsForProvider(const QString& provider, const QStringList& availableModels);
     void updateApiModels(const QStringList& availableModels); // 保留为兼容性考虑
@@ -86,6 +135,15 @@ private:
     ChatModel* m_chatModel;
     ImageModel* m_imageModel;
     SettingsModel* m_settingsModel;
+    ConversationStore* m_conversationStore;
+    AutoSaveEngine* m_autoSaveEngine;
+    SearchIndex* m_searchIndex;
+    ConversationTransfer* m_transfer;
+    QProgressDialog* m_transferProgress;
+    QString m_importConversationId;  // 正在导入的新对话
+    ImagePipeline* m_imagePipeline;
+    AttachmentStore* m_attachmentStore;
+    StallWatchdog* m_stallWatchdog;
 
     // ViewModels
     ChatViewModel* m_chatViewModel;
@@ -94,7 +152,7 @@ private:
     // UI Components
     QWidget* m_centralWidget;
     QVBoxLayout* m_mainLayout;
-    QTextEdit* m_chatDisplay;
+    ChatView* m_chatDisplay;
     QLineEdit* m_messageInput;
     QPushButton* m_sendButton;
     QPushButton* m_clearButton;
@@ -102,21 +160,32 @@ private:
     QPushButton* m_deepThinkingButton;
     QComboBox* m_modelSelector;
     QLabel* m_statusLabel;
+    QString m_saveError;      // 最近一次自动保存的错误，保存成功后清空
+    bool m_showingPrefill;    // 状态栏正在显示提示词的计算进度
+    int m_loadingImages;      // 已选择但还没解码完的图片数
     bool m_isGenerating;
     bool m_isUpdating;  // 用于防止模型选择器的递归更新
     bool m_isDeepThinking;
+    int m_renderedFirst;  // 聊天区域中最早一条消息的序号
+    int m_renderedEnd;    // 聊天区域中最后一条消息之后的序号，-1 表示一直显示到对话末尾
 
     // Menu Items
     QAction* m_settingsAction;
     QAction* m_saveChatAction;
     QAction* m_loadChatAction;
+    QAction* m_newChatAction;
+    QAction* m_searchAction;
     QAction* m_aboutAction;
+    QMenu* m_historyMenu;
+    SearchDialog* m_searchDialog;
 
     QMenu *m_themeMenu;
     QAction *m_lightThemeAction;
     QAction *m_darkThemeAction;
     QAction *m_systemThemeAction;
     void updateThemeActions();
+
+    bool m_firstFrameShown;
 };
 
 #endif // MAINWINDOW_H
@@ -0,0 +1,124 @@
+#include "searchdialog.h"
+#include <QVBoxLayout>
+#include <QElapsedTimer>
+#include "services/logger.h"
+
+namespace {
+// 输入停顿多久后开始查询
+const int kSearchDelayMs = 200;
+const int kResultLimit = 200;
+}
+
+SearchDialog::SearchDialog(SearchIndex* index, ConversationStore* store, QWidget *parent)
+    : QDialog(parent)
+    , m_index(index)
+    , m_store(store)
+{
+    setupUI();
+
+    m_searchTimer.setSingleShot(true);
+    m_searchTimer.setInterval(kSearchDelayMs);
+    connect(&m_searchTimer, &QTimer::timeout, this, &SearchDialog::runSearch);
+    connect(m_queryInput, &QLineEdit::textChanged, &m_searchTimer, qOverload<>(&QTimer::start));
+    connect(m_queryInput, &QLineEdit::returnPressed, this, &SearchDialog::runSearch);
+    connect(m_resultList, &QListWidget::itemActivated, this, &SearchDialog::onItemActivated);
+    connect(m_store, &ConversationStore::conversationRemoved, this, [this](const QString& id) {
+        m_conversations.remove(id);
+    });
+}
+
+SearchDialog::~SearchDialog()
+{
+}
+
+void SearchDialog::setupUI()
+{
+    setWindowTitle(tr("搜索对话"));
+    resize(480, 420);
+
+    QVBoxLayout* mainLayout = new QVBoxLayout(this);
+
+    m_queryInput = new QLineEdit();
+    m_queryInput->setPlaceholderText(tr("输入关键词，多个词之间用空格分隔"));
+    m_queryInput->setClearButtonEnabled(true);
+    mainLayout->addWidget(m_queryInput);
+
+    m_resultList = new QListWidget();
+    mainLayout->addWidget(m_resultList);
+
+    m_summaryLabel = new QLabel();
+    mainLayout->addWidget(m_summaryLabel);
+}
+
+void SearchDialog::showEvent(QShowEvent* event)
+{
+    // 标题可能在对话框关闭期间变化，每次打开时重新读取
+    reloadConversations();
+    QDialog::showEvent(event);
+}
+
+void SearchDialog::reloadConversations()
+{
+    m_conversations.clear();
+    for (const ConversationStore::ConversationInfo& info : m_store->listConversations()) {
+        m_conversations.insert(info.id, info);
+    }
+}
+
+void SearchDialog::runSearch()
+{
+    m_searchTimer.stop();
+    m_resultList->clear();
+
+    QString query = m_queryInput->text().trimmed();
+    if (query.isEmpty()) {
+        m_summaryLabel->clear();
+        return;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    const QList<SearchIndex::Hit> hits = m_index->search(query, kResultLimit);
+    qint64 elapsed = timer.elapsed();
+
+    // 对话框打开后新建的对话不在缓存中，重新读取一次
+    for (const SearchIndex::Hit& hit : hits) {
+        if (!m_conversations.contains(hit.conversationId)) {
+            reloadConversations();
+            break;
+        }
+    }
+
+    // 当前对话的标题可能刚刚生成，直接从打开的文件读取
+    const QSharedPointer<ConversationFile> current = m_store->current();
+
+    int shown = 0;
+    for (const SearchIndex::Hit& hit : hits) {
+        auto it = m_conversations.constFind(hit.conversationId);
+        if (it == m_conversations.constEnd()) {
+            // 对话目录在应用外被删除
+            continue;
+        }
+        QString title = current && current->id() == hit.conversationId ? current->title() : it->title;
+        if (title.isEmpty()) {
+            title = tr("未命名对话");
+        }
+        QListWidgetItem* item = new QListWidgetItem(tr("%1  ·  第 %2 条  (%3)")
+            .arg(title)
+            .arg(hit.messageIndex + 1)
+            .arg(it->updated.toString("yyyy-MM-dd hh:mm")), m_resultList);
+        item->setData(Qt::UserRole, hit.conversationId);
+        item->setData(Qt::UserRole + 1, hit.messageIndex);
+        ++shown;
+    }
+
+    m_summaryLabel->setText(tr("找到 %1 条结果，用时 %2 ms").arg(shown).arg(elapsed));
+    LOG_DEBUG(QString("搜索 \"%1\" 命中 %2 条，用时 %3 ms").arg(query).arg(hits.size()).arg(elapsed));
+}
+
+void SearchDialog::onItemActivated(QListWidgetItem* item)
+{
+    emit resultActivated(item->data(Qt::UserRole).toString(),
+                         item->data(Qt::UserRole + 1).toInt(),
+                         m_queryInput->text().trimmed());
+}
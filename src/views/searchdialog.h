@@ -0,0 +1,50 @@
+#ifndef SEARCHDIALOG_H
+#define SEARCHDIALOG_H
+
+#include <QDialog>
+#include <QLineEdit>
+#include <QListWidget>
+#include <QLabel>
+#include <QTimer>
+#include <QHash>
+#include "services/searchindex.h"
+#include "services/conversationstore.h"
+
+/**
+ * @brief 搜索历史对话
+ *
+ * 输入停顿后查询全文索引，双击结果跳转到对应的消息。
+ * 对话标题在打开对话框时读取一次，之后的查询不再扫描对话目录。
+ */
+class SearchDialog : public QDialog
+{
+    Q_OBJECT
+
+public:
+    SearchDialog(SearchIndex* index, ConversationStore* store, QWidget *parent = nullptr);
+    ~SearchDialog();
+
+signals:
+    void resultActivated(const QString& conversationId, int messageIndex, const QString& query);
+
+protected:
+    void showEvent(QShowEvent* event) override;
+
+private slots:
+    void runSearch();
+    void onItemActivated(QListWidgetItem* item);
+
+private:
+    void setupUI();
+    void reloadConversations();
+
+    SearchIndex* m_index;
+    ConversationStore* m_store;
+    QLineEdit* m_queryInput;
+    QListWidget* m_resultList;
+    QLabel* m_summaryLabel;
+    QTimer m_searchTimer;
+    QHash<QString, ConversationStore::ConversationInfo> m_conversations;  // 对话 ID -> 标题和时间
+};
+
+#endif // SEARCHDIALOG_H
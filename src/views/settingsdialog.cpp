@@ -5,6 +5,7 @@
 #include <QSettings>
 #include <QTimer>
 #include <QFormLayout>
+#include <QThread>
 
 SettingsDialog::SettingsDialog(SettingsViewModel* viewModel, QWidget *parent)
     : QDialog(parent)
@@ -122,6 +123,21 @@ void SettingsDialog::setupUI()
     m_browseLocalModelBtn = new QPushButton(tr("浏览..."));
     localPathLayout->addWidget(m_browseLocalModelBtn);
     localFormLayout->addRow(tr("模型路径:"), localPathLayout);
+
+    // 推理线程数，0 表示使用全部核心
+    m_inferenceThreadsInput = new QSpinBox();
+    m_inferenceThreadsInput->setRange(0, qMax(1, QThread::idealThreadCount()));
+    m_inferenceThreadsInput->setSpecialValueText(tr("自动"));
+    localFormLayout->addRow(tr("推理线程:"), m_inferenceThreadsInput);
+
+    // 键值缓存保留之前各轮对话的计算结果，下一轮只需处理新增的部分
+    m_kvCacheInput = new QSpinBox();
+    m_kvCacheInput->setRange(64, 65536);
+    m_kvCacheInput->setSingleStep(256);
+    m_kvCacheInput->setSuffix(" MB");
+    localFormLayout->addRow(tr("键值缓存上限:"), m_kvCacheInput);
+    m_kvCache8BitCheck = new QCheckBox(tr("以 8 位存储键值缓存（更省内存）"));
+    localFormLayout->addRow(QString(), m_kvCache8BitCheck);
     
     localLayout->addLayout(localFormLayout);
     m_modelSettingsStack->addWidget(m_localModelSettingsWidget);
@@ -205,6 +221,13 @@ void SettingsDialog::setupConnections()
     
     connect(m_browseLocalModelBtn, &QPushButton::clicked, 
             this, &SettingsDialog::onBrowseLocalModelClicked);
+
+    connect(m_inferenceThreadsInput, QOverload<int>::of(&QSpinBox::valueChanged),
+            m_viewModel, &SettingsViewModel::setInferenceThreads);
+    connect(m_kvCacheInput, QOverload<int>::of(&QSpinBox::valueChanged),
+            m_viewModel, &SettingsViewModel::setKvCacheMB);
+    connect(m_kvCache8BitCheck, &QCheckBox::toggled,
+            m_viewModel, &SettingsViewModel::setKvCache8Bit);
     
     // 错误处理连接
     connect(m_viewModel, &SettingsViewModel::errorOccurred, this, &SettingsDialog::onErrorOccurred);
@@ -251,6 +274,9 @@ void SettingsDialog::updateUIFromViewModel()
     
     // 更新本地模型设置
     m_localModelPathInput->setText(m_viewModel->getLocalModelPath());
+    m_inferenceThreadsInput->setValue(m_viewModel->getInferenceThreads());
+    m_kvCacheInput->setValue(m_viewModel->getKvCacheMB());
+    m_kvCache8BitCheck->setChecked(m_viewModel->getKvCache8Bit());
 }
 
 void SettingsDialog::onRefreshStateChanged(bool isRefreshing)
@@ -64,6 +64,9 @@ private:
     // 本地模型设置
     QWidget* m_localModelSettingsWidget;
     QLineEdit* m_localModelPathInput;
+    QSpinBox* m_inferenceThreadsInput;
+    QSpinBox* m_kvCacheInput;
+    QCheckBox* m_kvCache8BitCheck;
     QPushButton* m_browseLocalModelBtn;
 
     // 按钮
@@ -0,0 +1,124 @@
+#include "stalldialog.h"
+#include <QVBoxLayout>
+#include <QPainter>
+#include <climits>
+
+/**
+ * @brief 卡顿时长的柱状图
+ */
+class StallHistogram : public QWidget
+{
+public:
+    explicit StallHistogram(QWidget *parent = nullptr)
+        : QWidget(parent)
+    {
+        setMinimumHeight(140);
+    }
+
+    void setCounts(const QList<int>& counts, const QList<int>& limits)
+    {
+        m_counts = counts;
+        m_limits = limits;
+        update();
+    }
+
+protected:
+    void paintEvent(QPaintEvent *event) override
+    {
+        Q_UNUSED(event);
+        if (m_counts.isEmpty()) {
+            return;
+        }
+
+        QPainter painter(this);
+        painter.setRenderHint(QPainter::Antialiasing);
+
+        const int labelHeight = fontMetrics().height() + 4;
+        const int chartHeight = height() - labelHeight * 2;
+        const qreal slot = qreal(width()) / m_counts.size();
+        int maxCount = 1;
+        for (int count : m_counts) {
+            maxCount = qMax(maxCount, count);
+        }
+
+        for (int i = 0; i < m_counts.size(); ++i) {
+            QRectF column(i * slot, 0, slot, height());
+            qreal barHeight = chartHeight * m_counts.at(i) / qreal(maxCount);
+            QRectF bar(column.left() + slot * 0.15, labelHeight + chartHeight - barHeight,
+                       slot * 0.7, barHeight);
+            painter.fillRect(bar, palette().highlight());
+
+            painter.setPen(palette().text().color());
+            painter.drawText(QRectF(column.left(), bar.top() - labelHeight, slot, labelHeight),
+                             Qt::AlignCenter, QString::number(m_counts.at(i)));
+            painter.drawText(QRectF(column.left(), height() - labelHeight, slot, labelHeight),
+                             Qt::AlignCenter, bucketLabel(i));
+        }
+    }
+
+private:
+    QString bucketLabel(int index) const
+    {
+        if (m_limits.at(index) == INT_MAX) {
+            return QString("≥%1ms").arg(m_limits.value(index - 1));
+        }
+        return QString("<%1ms").arg(m_limits.at(index));
+    }
+
+    QList<int> m_counts;
+    QList<int> m_limits;
+};
+
+StallDialog::StallDialog(StallWatchdog* watchdog, QWidget *parent)
+    : QDialog(parent)
+    , m_watchdog(watchdog)
+{
+    setupUI();
+    connect(m_watchdog, &StallWatchdog::stallDetected, this, &StallDialog::refresh);
+    refresh();
+}
+
+StallDialog::~StallDialog()
+{
+}
+
+void StallDialog::setupUI()
+{
+    setWindowTitle(tr("界面卡顿统计"));
+    resize(520, 460);
+
+    QVBoxLayout* mainLayout = new QVBoxLayout(this);
+
+    m_summaryLabel = new QLabel();
+    m_summaryLabel->setWordWrap(true);
+    mainLayout->addWidget(m_summaryLabel);
+
+    m_histogram = new StallHistogram();
+    mainLayout->addWidget(m_histogram);
+
+    m_stallList = new QListWidget();
+    mainLayout->addWidget(m_stallList, 1);
+}
+
+void StallDialog::refresh()
+{
+    const QList<StallWatchdog::Stall> stalls = m_watchdog->recentStalls();
+    m_histogram->setCounts(m_watchdog->histogram(), StallWatchdog::bucketLimits());
+
+    qint64 longest = 0;
+    m_stallList->clear();
+    // 最近的卡顿排在前面
+    for (auto it = stalls.crbegin(); it != stalls.crend(); ++it) {
+        longest = qMax(longest, it->durationMs);
+        m_stallList->addItem(tr("%1  %2 ms  %3")
+            .arg(it->time.toString("hh:mm:ss"))
+            .arg(it->durationMs)
+            .arg(it->context));
+    }
+
+    m_summaryLabel->setText(tr("最近 %1 分钟界面线程卡顿 %2 次，最长 %3 ms（阈值 %4 ms）")
+        .arg(StallWatchdog::windowMinutes())
+        .arg(stalls.size())
+        .arg(longest)
+        .arg(m_watchdog->thresholdMs()));
+}
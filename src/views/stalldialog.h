@@ -0,0 +1,36 @@
+#ifndef STALLDIALOG_H
+#define STALLDIALOG_H
+
+#include <QDialog>
+#include <QListWidget>
+#include <QLabel>
+#include "services/stallwatchdog.h"
+
+class StallHistogram;
+
+/**
+ * @brief 界面卡顿统计
+ *
+ * 显示最近一段时间卡顿时长的分布和每次卡顿时界面线程在做什么，有新的卡顿时自动刷新。
+ */
+class StallDialog : public QDialog
+{
+    Q_OBJECT
+
+public:
+    StallDialog(StallWatchdog* watchdog, QWidget *parent = nullptr);
+    ~StallDialog();
+
+private slots:
+    void refresh();
+
+private:
+    void setupUI();
+
+    StallWatchdog* m_watchdog;
+    StallHistogram* m_histogram;
+    QListWidget* m_stallList;
+    QLabel* m_summaryLabel;
+};
+
+#endif // STALLDIALOG_H